@@ -0,0 +1,76 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// histogram.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A histogram of positive integers (ex: latencies in nanoseconds), in the
+ * style of HdrHistogram.
+ *
+ * The values are counted in buckets whose width grows with the value: every
+ * power of 2 is cut into 2^precision buckets, so a value is known within
+ * 1/2^precision of itself (ex: 1/16 with a precision of 4), whatever its size.
+ * Recording a value is O(1) and takes no memory, the percentiles are found by
+ * walking the buckets.
+ *
+ * The values are recorded either by a single thread (record), or by many at
+ * once (record_atomic); the histograms of the same layout can be merged (ex:
+ * those of many threads, when they are read) and serialized compactly, only
+ * the buckets that are used are written.
+ */
+
+#ifndef KC_HISTOGRAM_T_H
+#define KC_HISTOGRAM_T_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+
+// the precision is the number of bits kept after the highest one
+#define KC_HISTOGRAM_MAX_PRECISION                                           10
+#define KC_HISTOGRAM_MAX_BITS                                                64
+
+//---------------------------------------------------------------------------//
+
+struct kc_histogram_t
+{
+  int precision;  // 2^precision buckets for every power of 2
+  int max_bits;   // the values beyond 2^max_bits - 1 go in the last bucket
+
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;    // UINT64_MAX while empty
+  uint64_t max;
+
+  uint64_t* buckets;
+  size_t    buckets_len;
+
+  // a single thread at a time, or many at once
+  void     (*record)         (struct kc_histogram_t* self, uint64_t value);
+  void     (*record_atomic)  (struct kc_histogram_t* self, uint64_t value);
+
+  // add the values of another histogram of the same layout, it can be
+  // recorded into at the same time (with record_atomic)
+  int      (*merge)          (struct kc_histogram_t* self, struct kc_histogram_t* other);
+  void     (*reset)          (struct kc_histogram_t* self);
+
+  // the highest value of the bucket that holds the percentile (0 if empty),
+  // and the values up to a limit (those of the buckets that end below it)
+  uint64_t (*percentile)     (struct kc_histogram_t* self, double percentile);
+  uint64_t (*count_below)    (struct kc_histogram_t* self, uint64_t limit);
+
+  // the layout and the buckets in use, in a new buffer (to be freed)
+  int      (*serialize)      (struct kc_histogram_t* self, char** data, size_t* len);
+};
+
+struct kc_histogram_t* new_histogram          (int precision, int max_bits);
+struct kc_histogram_t* deserialize_histogram  (const char* data, size_t len);
+void                   destroy_histogram      (struct kc_histogram_t* histogram);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_HISTOGRAM_T_H */
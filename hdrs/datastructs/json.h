@@ -0,0 +1,90 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// json.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A JSON parser that builds a read-only document inside an arena.
+ *
+ * The parsing is done in two stages. The first stage classifies 64 bytes at
+ * a time (using SIMD when available) to find the quotes, the structural
+ * characters and the white spaces, and produces the index of every token
+ * outside of the strings. The second stage walks the index and writes the
+ * document on a "tape": a flat array of 64-bit words, where every container
+ * knows where it ends, so the values can be skipped in constant time.
+ *
+ * The document is queried with cursors, small values that point to a word on
+ * the tape. All the memory lives in the arena and is released with it.
+ */
+
+#ifndef KC_JSON_T_H
+#define KC_JSON_T_H
+
+#include "../system/arena.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_JSON_NULL     'n'
+#define KC_JSON_TRUE     't'
+#define KC_JSON_FALSE    'f'
+#define KC_JSON_INTEGER  'l'
+#define KC_JSON_DOUBLE   'd'
+#define KC_JSON_STRING   '"'
+#define KC_JSON_ARRAY    '['
+#define KC_JSON_OBJECT   '{'
+
+#define KC_JSON_MAX_DEPTH                                                  1024
+
+//---------------------------------------------------------------------------//
+
+struct kc_json_t
+{
+  struct kc_arena_t* _arena;  // the arena that holds the document
+
+  uint64_t* tape;             // the document, one or two words per value
+  size_t    tape_len;         // the number of words on the tape
+  char*     strings;          // the unescaped strings, length prefixed
+
+  int (*parse)  (struct kc_json_t* self, const char* buffer, size_t len);
+};
+
+struct kc_json_t* new_json  (struct kc_arena_t* arena);
+
+//---------------------------------------------------------------------------//
+
+struct kc_json_cursor_t
+{
+  const struct kc_json_t* json;  // the document
+  size_t index;                  // the position of the value on the tape
+  char parent;                   // the type of the parent container (if any)
+};
+
+int json_root        (const struct kc_json_t* json, struct kc_json_cursor_t* root);
+int json_type        (struct kc_json_cursor_t cursor);
+int json_size        (struct kc_json_cursor_t cursor, size_t* size);
+
+// navigation (the key of an object member is returned by json_key)
+int json_get         (struct kc_json_cursor_t cursor, const char* key, struct kc_json_cursor_t* value);
+int json_at          (struct kc_json_cursor_t cursor, size_t index, struct kc_json_cursor_t* value);
+int json_first       (struct kc_json_cursor_t cursor, struct kc_json_cursor_t* child);
+int json_next        (struct kc_json_cursor_t cursor, struct kc_json_cursor_t* sibling);
+int json_key         (struct kc_json_cursor_t cursor, const char** key, size_t* len);
+int json_query       (struct kc_json_cursor_t cursor, const char* pointer, struct kc_json_cursor_t* value);
+
+// values
+int json_get_string  (struct kc_json_cursor_t cursor, const char** str, size_t* len);
+int json_get_int     (struct kc_json_cursor_t cursor, int64_t* val);
+int json_get_double  (struct kc_json_cursor_t cursor, double* val);
+int json_get_bool    (struct kc_json_cursor_t cursor, bool* val);
+bool json_is_null    (struct kc_json_cursor_t cursor);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_JSON_T_H */
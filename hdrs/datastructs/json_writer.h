@@ -0,0 +1,58 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// json_writer.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A streaming JSON encoder that writes straight into a growable buffer.
+ *
+ * The values are appended one by one (the commas and colons are added by the
+ * writer), the integers are formatted two digits at a time, the doubles with
+ * the Grisu2 algorithm (shortest round-trip representation in most cases) and
+ * the strings are scanned 16 bytes at a time for the characters that must be
+ * escaped. When the document is done, the buffer can be handed over (ex: to a
+ * response body) without being copied.
+ */
+
+#ifndef KC_JSON_WRITER_T_H
+#define KC_JSON_WRITER_T_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_JSON_WRITER_CAPACITY                                             256
+
+//---------------------------------------------------------------------------//
+
+struct kc_json_writer_t
+{
+  char*  buffer;     // the JSON written so far (always NUL terminated)
+  size_t len;        // the length of the JSON written so far
+  size_t _capacity;  // the size of the buffer
+  bool   _comma;     // the next value must be preceded by a comma
+
+  int (*begin_object)  (struct kc_json_writer_t* self);
+  int (*end_object)    (struct kc_json_writer_t* self);
+  int (*begin_array)   (struct kc_json_writer_t* self);
+  int (*end_array)     (struct kc_json_writer_t* self);
+  int (*key)           (struct kc_json_writer_t* self, const char* key);
+  int (*string)        (struct kc_json_writer_t* self, const char* str);
+  int (*integer)       (struct kc_json_writer_t* self, int64_t val);
+  int (*number)        (struct kc_json_writer_t* self, double val);
+  int (*boolean)       (struct kc_json_writer_t* self, bool val);
+  int (*null)          (struct kc_json_writer_t* self);
+  int (*release)       (struct kc_json_writer_t* self, char** buffer, size_t* len);
+};
+
+struct kc_json_writer_t* new_json_writer      (size_t capacity);
+void                     destroy_json_writer  (struct kc_json_writer_t* writer);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_JSON_WRITER_T_H */
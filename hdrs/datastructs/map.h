@@ -13,6 +13,8 @@
 #ifndef KC_MAP_T_H
 #define KC_MAP_T_H
 
+#include "../system/arena.h"
+
 #include <stdio.h>
 
 //---------------------------------------------------------------------------//
@@ -40,12 +42,18 @@ struct kc_map_t
 {
   struct kc_entry_t** entries;
 
-  int (*set)  (struct kc_map_t* self, const char* key, void* val, size_t val_size);
-  int (*get)  (struct kc_map_t* self, const char* key, void** val);
+  // when set, the slots, the entries and the values are taken from the arena
+  // and they are released together with it
+  struct kc_arena_t* _arena;
+
+  int (*set)     (struct kc_map_t* self, const char* key, void* val, size_t val_size);
+  int (*get)     (struct kc_map_t* self, const char* key, void** val);
+  int (*remove)  (struct kc_map_t* self, const char* key);
 };
 
-struct kc_map_t* new_map      (void);
-void             destroy_map  (struct kc_map_t* map);
+struct kc_map_t* new_map        (void);
+struct kc_map_t* new_arena_map  (struct kc_arena_t* arena);
+void             destroy_map    (struct kc_map_t* map);
 
 //---------------------------------------------------------------------------//
 
@@ -0,0 +1,105 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// asset_cache.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * An in-memory cache for the static files of a directory.
+ *
+ * The files are loaded on their first request, together with everything
+ * the response needs: the status line and the headers are rendered once,
+ * with the length, the ETag (the SHA-1 of the content) and the date of the
+ * last modification. A cached file is sent with a single writev, straight
+ * from the immutable buffers, with no formatting on the request path.
+ *
+ * The precompressed variants are the files next to the original, with the
+ * ".br" or ".gz" extension, and they are picked by the Accept-Encoding of
+ * the request. The directory is watched with inotify and the entries are
+ * dropped as soon as their files change, so the cache is never stale.
+ */
+
+#ifndef KC_ASSET_CACHE_T_H
+#define KC_ASSET_CACHE_T_H
+
+#include "../datastructs/map.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+//---------------------------------------------------------------------------//
+
+// the files bigger than this are sent with sendfile, not cached
+#define KC_ASSET_MAX_FILE_SIZE                                     (1024 * 1024)
+
+// the most memory the files of a cache can take
+#define KC_ASSET_MAX_CACHE_SIZE                                (64 * 1024 * 1024)
+
+// the most subdirectories that are watched
+#define KC_ASSET_MAX_WATCHES                                               1024
+
+// the identity file and its precompressed variants (ex: app.css.br)
+#define KC_ASSET_VARIANTS_SIZE                                                3
+
+//---------------------------------------------------------------------------//
+
+// a cached file, with the response already rendered
+struct kc_asset_t
+{
+  // "HTTP/1.1 200 OK" and the headers, without the empty line
+  char*  head;
+  size_t head_len;
+
+  // "HTTP/1.1 304 Not Modified" and the validators
+  char*  not_modified;
+  size_t not_modified_len;
+
+  char*  body;
+  size_t body_len;
+
+  // checked against the conditional requests
+  char   etag[48];
+  char   last_modified[32];
+  time_t modified;
+
+  const char* encoding;  // NULL for the identity file (ex: "br", "gzip")
+
+  int _refs;  // the cache holds one, every request being served another
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_asset_cache_t
+{
+  char*  directory;  // the resolved path of the directory
+  size_t size;       // the bytes taken by the cached files
+
+  // the files by their path in the directory (ex: css/app.css)
+  struct kc_map_t* _assets;
+  pthread_rwlock_t _lock;
+  unsigned long    _generation;  // changes with every invalidation
+
+  // the watched directories, by their inotify descriptor
+  int       _inotify_fd;
+  int       _stop_fds[2];
+  char*     _watches[KC_ASSET_MAX_WATCHES];
+  pthread_t _watcher;
+
+  // the file of a path, in the best encoding the client accepts, returns
+  // KC_FILE_NOT_FOUND when there is no such file and KC_INVALID when the
+  // file can't be cached (ex: it's too big) and must be sent from the disk
+  int  (*get)         (struct kc_asset_cache_t* self, const char* path, const char* accept_encoding, struct kc_asset_t** asset);
+  void (*release)     (struct kc_asset_cache_t* self, struct kc_asset_t* asset);
+  void (*invalidate)  (struct kc_asset_cache_t* self, const char* path);
+};
+
+struct kc_asset_cache_t* new_asset_cache      (const char* directory);
+void                     destroy_asset_cache  (struct kc_asset_cache_t* cache);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_ASSET_CACHE_T_H */
@@ -0,0 +1,96 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// hpack.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * The header compression of HTTP/2 (HPACK, RFC 7541).
+ *
+ * Every direction of a connection has its own context: the decoder keeps
+ * the headers the client asked to be remembered, the encoder the ones it
+ * told the client to remember, so the blocks must be decoded (and encoded)
+ * in the order they are sent. A header is found by its index in the static
+ * table (the 61 common ones) or in the dynamic table that follows it (the
+ * newest first); the names and the values that are not indexed are sent as
+ * they are, or with the Huffman code of the RFC when it makes them shorter.
+ */
+
+#ifndef KC_HPACK_T_H
+#define KC_HPACK_T_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+// the entries of the static table
+#define KC_HPACK_STATIC_SIZE                                                 61
+
+// the default size of the dynamic table (SETTINGS_HEADER_TABLE_SIZE)
+#define KC_HPACK_TABLE_SIZE                                                4096
+
+// what an entry of the dynamic table costs, on top of its name and value
+#define KC_HPACK_ENTRY_OVERHEAD                                              32
+
+// the longest values that are added to the dynamic table by the encoder
+#define KC_HPACK_MAX_INDEXED_VALUE                                          256
+
+//---------------------------------------------------------------------------//
+
+struct kc_hpack_entry_t;
+
+//---------------------------------------------------------------------------//
+
+struct kc_hpack_t
+{
+  // the dynamic table, a ring of entries (the newest at the head)
+  struct kc_hpack_entry_t** _entries;
+  size_t _entries_cap;
+  size_t _entries_len;
+  size_t _head;
+
+  size_t _size;      // the size of the entries, as counted by the RFC
+  size_t _max_size;  // the size the table can't exceed
+
+  // the largest size the other side allows (the decoder takes the size
+  // updates up to it), and the update the encoder still has to send
+  size_t _limit;
+  bool   _update_pending;
+
+  // the Huffman decoded strings of the header being decoded
+  char*  _scratch;
+  size_t _scratch_cap;
+
+  // decode a header block, every header is given to the callback in
+  // order (the strings are valid only during the call)
+  int (*decode)  (struct kc_hpack_t* self, const uint8_t* block, size_t len,
+      int (*header)(void* data, const char* name, size_t name_len, const char* value, size_t value_len),
+      void* data);
+
+  // append a header to a block (at out + *len, up to size bytes)
+  int (*encode)  (struct kc_hpack_t* self, const char* name, size_t name_len,
+      const char* value, size_t value_len, uint8_t* out, size_t size, size_t* len);
+
+  // change the largest size of the dynamic table (the decoder is told the
+  // new limit, the encoder sends it with the next header)
+  int (*resize)  (struct kc_hpack_t* self, size_t max_size);
+};
+
+struct kc_hpack_t* new_hpack      (size_t max_size);
+void               destroy_hpack  (struct kc_hpack_t* hpack);
+
+//---------------------------------------------------------------------------//
+
+// the Huffman code of a string, its length is given first (to know when
+// the code is shorter than the string)
+size_t kc_hpack_huffman_len     (const uint8_t* src, size_t len);
+size_t kc_hpack_huffman_encode  (const uint8_t* src, size_t len, uint8_t* out);
+int    kc_hpack_huffman_decode  (const uint8_t* src, size_t len, uint8_t* out, size_t size, size_t* out_len);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_HPACK_T_H */
@@ -13,12 +13,17 @@
 #ifndef KC_HTTP_H
 #define KC_HTTP_H
 
+#include "../datastructs/json.h"
+#include "../datastructs/json_writer.h"
 #include "../datastructs/map.h"
+#include "../system/arena.h"
 
 #ifndef KC_HTTP_PARSER_H
 #include "http_parser.h"
 #endif
 
+#include "http_form.h"
+
 #include <stdio.h>
 #include <stdbool.h>
 
@@ -81,6 +86,90 @@
 #define KC_HTTP_STATUS_504  "504 Gateway Timeout"
 #define KC_HTTP_STATUS_505  "505 HTTP Version Not Supported"
 
+// --- the same codes, for set_status() ------------------------------------ //
+
+enum kc_http_status_t
+{
+  KC_HTTP_CONTINUE                         = 100,
+  KC_HTTP_SWITCHING_PROTOCOLS              = 101,
+
+  KC_HTTP_OK                               = 200,
+  KC_HTTP_CREATED                          = 201,
+  KC_HTTP_ACCEPTED                         = 202,
+  KC_HTTP_NON_AUTHORITATIVE_INFORMATION    = 203,
+  KC_HTTP_NO_CONTENT                       = 204,
+  KC_HTTP_RESET_CONTENT                    = 205,
+  KC_HTTP_PARTIAL_CONTENT                  = 206,
+
+  KC_HTTP_MULTIPLE_CHOICES                 = 300,
+  KC_HTTP_MOVED_PERMANENTLY                = 301,
+  KC_HTTP_FOUND                            = 302,
+  KC_HTTP_SEE_OTHER                        = 303,
+  KC_HTTP_NOT_MODIFIED                     = 304,
+  KC_HTTP_USE_PROXY                        = 305,
+  KC_HTTP_TEMPORARY_REDIRECT               = 307,
+  KC_HTTP_PERMANENT_REDIRECT               = 308,
+
+  KC_HTTP_BAD_REQUEST                      = 400,
+  KC_HTTP_UNAUTHORIZED                     = 401,
+  KC_HTTP_PAYMENT_REQUIRED                 = 402,
+  KC_HTTP_FORBIDDEN                        = 403,
+  KC_HTTP_NOT_FOUND                        = 404,
+  KC_HTTP_METHOD_NOT_ALLOWED               = 405,
+  KC_HTTP_NOT_ACCEPTABLE                   = 406,
+  KC_HTTP_PROXY_AUTHENTICATION_REQUIRED    = 407,
+  KC_HTTP_REQUEST_TIMEOUT                  = 408,
+  KC_HTTP_CONFLICT                         = 409,
+  KC_HTTP_GONE                             = 410,
+  KC_HTTP_LENGTH_REQUIRED                  = 411,
+  KC_HTTP_PRECONDITION_FAILED              = 412,
+  KC_HTTP_PAYLOAD_TOO_LARGE                = 413,
+  KC_HTTP_URI_TOO_LONG                     = 414,
+  KC_HTTP_UNSUPPORTED_MEDIA_TYPE           = 415,
+  KC_HTTP_RANGE_NOT_SATISFIABLE            = 416,
+  KC_HTTP_EXPECTATION_FAILED               = 417,
+  KC_HTTP_UPGRADE_REQUIRED                 = 426,
+  KC_HTTP_TOO_MANY_REQUESTS                = 429,
+
+  KC_HTTP_INTERNAL_SERVER_ERROR            = 500,
+  KC_HTTP_NOT_IMPLEMENTED                  = 501,
+  KC_HTTP_BAD_GATEWAY                      = 502,
+  KC_HTTP_SERVICE_UNAVAILABLE              = 503,
+  KC_HTTP_GATEWAY_TIMEOUT                  = 504,
+  KC_HTTP_VERSION_NOT_SUPPORTED            = 505
+};
+
+// the whole status line (ex: "HTTP/1.1 200 OK\r\n"), NULL for unknown codes
+const char* http_status_line  (int status, size_t* len);
+
+// the media type of a file, by its extension (ex: "image/png")
+const char* http_mime_type    (const char* path);
+
+#define KC_HTTP_DEFAULT_MIME_TYPE  "application/octet-stream"
+
+//---------------------------------------------------------------------------//
+// ------------------------------- HTTP HEADERS ---------------------------- //
+
+// the common headers are stored already rendered (ex: "Content-Type: ")
+#define KC_HTTP_HEADER_ACCEPT_RANGES     "Accept-Ranges"
+#define KC_HTTP_HEADER_CACHE_CONTROL     "Cache-Control"
+#define KC_HTTP_HEADER_CONNECTION        "Connection"
+#define KC_HTTP_HEADER_CONTENT_ENCODING  "Content-Encoding"
+#define KC_HTTP_HEADER_CONTENT_LENGTH    "Content-Length"
+#define KC_HTTP_HEADER_CONTENT_RANGE     "Content-Range"
+#define KC_HTTP_HEADER_CONTENT_TYPE      "Content-Type"
+#define KC_HTTP_HEADER_DATE              "Date"
+#define KC_HTTP_HEADER_ETAG              "ETag"
+#define KC_HTTP_HEADER_EXPIRES           "Expires"
+#define KC_HTTP_HEADER_KEEP_ALIVE        "Keep-Alive"
+#define KC_HTTP_HEADER_LAST_MODIFIED     "Last-Modified"
+#define KC_HTTP_HEADER_LOCATION          "Location"
+#define KC_HTTP_HEADER_SERVER            "Server"
+#define KC_HTTP_HEADER_SET_COOKIE        "Set-Cookie"
+#define KC_HTTP_HEADER_TRANSFER_ENCODING "Transfer-Encoding"
+#define KC_HTTP_HEADER_UPGRADE           "Upgrade"
+#define KC_HTTP_HEADER_VARY              "Vary"
+
 //---------------------------------------------------------------------------//
 // ------------------------------- HTTP METHODS ---------------------------- //
 
@@ -101,31 +190,49 @@
 
 //---------------------------------------------------------------------------//
 
-// TODO: use these values to parse the request body content-type
+// the values returned by http_parse_content_type()
 #define KC_BODY_CONTENT_TYPE_JSON                                    0xF0000010
 #define KC_BODY_CONTENT_TYPE_HTML                                    0xF0000020
 #define KC_BODY_CONTENT_TYPE_TEXT                                    0xF0000040
+#define KC_BODY_CONTENT_TYPE_FORM                                    0xF0000080
+#define KC_BODY_CONTENT_TYPE_MULTIPART                               0xF0000100
 
 #define KC_HTTP_REQUEST_MAX_SIZE                                           2048
 #define KC_HTTP_RESPONSE_MAX_SIZE                                          2048
 #define KC_HTTP_HEADER_MAX_SIZE                                            2048
+#define KC_HTTP_BODY_CHUNK_SIZE                                           16384
+
+// the largest JSON body read whole by get_json (the server answers the
+// larger ones with 413 Payload Too Large)
+#define KC_HTTP_JSON_MAX_SIZE                                           1048576
 
-#define KC_HTTP_MAX_HEADERS_LIST_SIZE                                        20
+// the response headers that fit inside the response, and the space for
+// their names and values (the common names are constants and take none)
+#define KC_HTTP_INLINE_HEADERS                                                8
+#define KC_HTTP_HEADER_DATA_SIZE                                            512
+
+// the states of a response body sent as it's produced (see begin_stream)
+#define KC_HTTP_STREAM_NONE                                                   0
+#define KC_HTTP_STREAM_OPEN                                                   1
+#define KC_HTTP_STREAM_ENDED                                                  2
+#define KC_HTTP_STREAM_BROKEN                                                 3
 
 //---------------------------------------------------------------------------//
 
-// TODO: remove header, use map instead
+struct kc_http2_stream_t;
+struct kc_http_response_t;
+struct kc_server_t;
+
+// a response header, ready to be sent
 struct kc_http_header_t
 {
-  char* key;    // the key of the header (ex: Content-Type)
-  char* val;    // the value of the header (ex: text/html)
+  const char* key;  // the rendered key of the header (ex: "Content-Type: ")
+  const char* val;  // the value of the header (ex: text/html)
 
-  size_t size;  // the size of the value
+  size_t key_len;
+  size_t val_len;
 };
 
-struct kc_http_header_t* new_header      (char* key, char* val);
-void                     destroy_header  (struct kc_http_header_t* header);
-
 //---------------------------------------------------------------------------//
 
 struct kc_http_request_t
@@ -140,13 +247,56 @@ struct kc_http_request_t
   struct kc_map_t* params;   // the hash-map of parameters
   struct kc_map_t* headers;  // the hash-map of headers
 
+  // the raw byte ranges of the query string and of the header section,
+  // they point into the receive buffer (which must outlive the request)
+  // and are parsed into the maps above only on the first lookup
+  char*  _raw_query;
+  size_t _raw_query_len;
+  bool   _params_parsed;
+
+  char*  _raw_headers;
+  size_t _raw_headers_len;
+  bool   _headers_parsed;
+
+  // the memory with the lifetime of the request (ex: the parsed body), for
+  // the requests created in an arena it also holds the request itself
+  struct kc_arena_t* arena;
+  struct kc_json_t*  _json;
+  bool               _in_arena;
+
+  // the part of the body received together with the headers, and
+  // how much of it (by Content-Length) is still waiting on the socket
+  char*  _body_buffered;
+  size_t _body_buffered_len;
+  size_t _body_left;
+
+  // where the rest of the body comes from, NULL for the socket (ex: the
+  // bytes the event loop received for a handler on a fiber)
+  int (*_receive)  (struct kc_http_request_t* self, char* buffer, size_t size, size_t* len);
+
+  // the middleware and the handler the request goes through, in order (the
+  // array is resolved by the server when it starts, see server->next)
+  int (**_chain)  (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+  size_t _chain_len;
+  size_t _chain_pos;
+
   // getters
-  char* (*get_header)     (struct kc_http_request_t* self, char* key);
-  char* (*get_param)      (struct kc_http_request_t* self, char* key);
+  char*             (*get_header)  (struct kc_http_request_t* self, char* key);
+  char*             (*get_param)   (struct kc_http_request_t* self, char* key);
+  struct kc_json_t* (*get_json)    (struct kc_http_request_t* self);
+
+  // the body readers, the body is streamed chunk by chunk and can be read
+  // only once (the forms and the uploads are never copied into body)
+  int (*read_body)       (struct kc_http_request_t* self, char* buffer, size_t size, size_t* len);
+  int (*read_form)       (struct kc_http_request_t* self);
+  int (*read_multipart)  (struct kc_http_request_t* self, struct kc_multipart_t* form);
 };
 
-struct kc_http_request_t* new_request      (void);
-void                      destroy_request  (struct kc_http_request_t* req);
+// the arena requests are released when the arena is reset (destroy is only
+// needed to close what was opened on the heap)
+struct kc_http_request_t* new_request        (void);
+struct kc_http_request_t* new_arena_request  (struct kc_arena_t* arena);
+void                      destroy_request    (struct kc_http_request_t* req);
 
 // TODO: decide if we want these public or private
 int _set_req_method     (struct kc_http_request_t* self, char* method);
@@ -158,22 +308,86 @@ int _set_req_body       (struct kc_http_request_t* self, char* body);
 
 struct kc_http_response_t
 {
-  char* http_ver;     // the HTTP version (ex: HTTP/1.1)
-  char* status_code;  // the status code (ex: 200 OK)
-  char* body;         // the content of the page
-
-  // the list of headers (ex: Content-Type: text/html)
-  struct kc_http_header_t* headers[KC_HTTP_MAX_HEADERS_LIST_SIZE];
+  const char* http_ver;  // the HTTP version (ex: HTTP/1.1)
+  int status;            // the status code (ex: KC_HTTP_OK)
+  char* body;            // the content of the page
+  size_t body_len;       // the length of the content
+  bool _heap_body;       // the body must be freed (ex: taken from a writer)
+
+  // instead of the body, a part of a file can be sent (see set_file)
+  struct kc_file_t* _file;
+  size_t _file_offset;
+  size_t _file_len;
+
+  // the list of headers (ex: Content-Type: text/html), the first ones are
+  // kept inline and only a long list moves to the heap (in one piece)
+  struct kc_http_header_t* headers;
   int headers_len;
 
+  struct kc_http_header_t _inline_headers[KC_HTTP_INLINE_HEADERS];
+  int _headers_cap;
+
+  // the names and values copied from the caller
+  char   _header_data[KC_HTTP_HEADER_DATA_SIZE];
+  size_t _header_data_len;
+  struct kc_arena_t* _arena;
+  bool _in_arena;        // the response and its data live in the arena
+  bool _sent;            // the response was already sent to the client
+
+  // a copy of the bytes sent, kept for a response cache (when the
+  // limit is set); the head ends before the empty line
+  size_t _record_max;
+  char*  _record;
+  size_t _record_len;
+  size_t _record_head_len;
+
+  // the body sent in pieces: in chunks (Transfer-Encoding: chunked), as
+  // they are (when the length was set, or the client can't take chunks),
+  // or until the connection is closed (when neither is known)
+  int  _stream;
+  int  _stream_fd;
+  bool _chunked;      // the client takes chunks
+  bool _until_close;  // the end of the body is told by closing
+
+  // the HTTP/2 stream the response goes on (NULL for HTTP/1)
+  struct kc_http2_stream_t* _h2;
+
+  // what the server keeps for a deferred response (NULL for the others)
+  void* _deferred;
+
   int (*set_header)       (struct kc_http_response_t* self, char* key, char* val);
   int (*set_http_ver)     (struct kc_http_response_t* self, char* http_ver);
+  int (*set_status)       (struct kc_http_response_t* self, int status);
   int (*set_status_code)  (struct kc_http_response_t* self, char* status_code);
   int (*set_body)         (struct kc_http_response_t* self, char* body);
+  int (*set_json)         (struct kc_http_response_t* self, struct kc_json_writer_t* writer);
+
+  // the response takes over the opened file and destroys it when done
+  int (*set_file)         (struct kc_http_response_t* self, struct kc_file_t* file, size_t offset, size_t len);
+
+  // send the head (and the body set so far, as the first piece), then the
+  // rest of the body as it's produced; every piece waits for the client to
+  // take the previous ones, so only one is kept in memory at a time. A
+  // stream the handler leaves open is ended by the server
+  int (*begin_stream)     (struct kc_http_response_t* self, int client_fd);
+  int (*write_chunk)      (struct kc_http_response_t* self, const char* data, size_t len);
+  int (*end)              (struct kc_http_response_t* self);
+
+  // answer later, without holding the thread: the handler defers the
+  // response (and returns KC_PENDING), the request and the response stay
+  // valid until complete is called from any thread; the response is then
+  // sent by the server, as it was set (the body of the request has to be
+  // read before, what's left of it is not received anymore); complete
+  // returns KC_LOST_CONNECTION when the client is gone meanwhile, and
+  // every response has to be completed before the server is destroyed
+  // (on an event loop, a deferred response is not kept by the cache)
+  int (*defer)            (struct kc_http_response_t* self);
+  int (*complete)         (struct kc_http_response_t* self);
 };
 
-struct kc_http_response_t* new_response      (void);
-void                       destroy_response  (struct kc_http_response_t* res);
+struct kc_http_response_t* new_response        (void);
+struct kc_http_response_t* new_arena_response  (struct kc_arena_t* arena);
+void                       destroy_response    (struct kc_http_response_t* res);
 
 //---------------------------------------------------------------------------//
 
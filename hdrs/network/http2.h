@@ -0,0 +1,255 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// http2.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * HTTP/2 over cleartext TCP (h2c, RFC 9113), on the connections of the server.
+ *
+ * A client either starts with the connection preface (it knows the server
+ * speaks HTTP/2), or asks for an upgrade in a HTTP/1.1 request that is then
+ * answered as the first stream. From then on the bytes received are frames,
+ * parsed as they come: the requests of many streams can be interleaved, the
+ * headers are decompressed (see hpack.h) and the bodies are put together.
+ *
+ * Every whole request is rebuilt as a HTTP/1 one ("GET / HTTP/2", the headers
+ * named as the HTTP/1 clients write them, ex: "Content-Type", and the body)
+ * and given to the server, that parses it as any other; the
+ * response goes back in HEADERS and DATA frames, as much as the windows of
+ * the client allow at a time. The settings, the pings and the windows are
+ * taken care of by the connection itself.
+ */
+
+#ifndef KC_HTTP2_T_H
+#define KC_HTTP2_T_H
+
+#include "hpack.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+//---------------------------------------------------------------------------//
+
+// what a client sends first, to tell it speaks HTTP/2
+#define KC_HTTP2_PREFACE                     "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define KC_HTTP2_PREFACE_SIZE                                                24
+
+// the length, the type, the flags and the stream of every frame
+#define KC_HTTP2_FRAME_HEADER_SIZE                                            9
+
+// the types of frames
+#define KC_HTTP2_DATA                                                       0x0
+#define KC_HTTP2_HEADERS                                                    0x1
+#define KC_HTTP2_PRIORITY                                                   0x2
+#define KC_HTTP2_RST_STREAM                                                 0x3
+#define KC_HTTP2_SETTINGS                                                   0x4
+#define KC_HTTP2_PUSH_PROMISE                                               0x5
+#define KC_HTTP2_PING                                                       0x6
+#define KC_HTTP2_GOAWAY                                                     0x7
+#define KC_HTTP2_WINDOW_UPDATE                                              0x8
+#define KC_HTTP2_CONTINUATION                                               0x9
+
+// the flags of the frames
+#define KC_HTTP2_FLAG_END_STREAM                                           0x01
+#define KC_HTTP2_FLAG_ACK                                                  0x01
+#define KC_HTTP2_FLAG_END_HEADERS                                          0x04
+#define KC_HTTP2_FLAG_PADDED                                               0x08
+#define KC_HTTP2_FLAG_PRIORITY                                             0x20
+
+// the reasons a stream is reset, or the connection closed
+#define KC_HTTP2_NO_ERROR                                                   0x0
+#define KC_HTTP2_PROTOCOL_ERROR                                             0x1
+#define KC_HTTP2_INTERNAL_ERROR                                             0x2
+#define KC_HTTP2_FLOW_CONTROL_ERROR                                         0x3
+#define KC_HTTP2_SETTINGS_TIMEOUT                                           0x4
+#define KC_HTTP2_STREAM_CLOSED                                              0x5
+#define KC_HTTP2_FRAME_SIZE_ERROR                                           0x6
+#define KC_HTTP2_REFUSED_STREAM                                             0x7
+#define KC_HTTP2_CANCEL                                                     0x8
+#define KC_HTTP2_COMPRESSION_ERROR                                          0x9
+#define KC_HTTP2_CONNECT_ERROR                                              0xA
+#define KC_HTTP2_ENHANCE_YOUR_CALM                                          0xB
+#define KC_HTTP2_INADEQUATE_SECURITY                                        0xC
+#define KC_HTTP2_HTTP_1_1_REQUIRED                                          0xD
+
+// the settings
+#define KC_HTTP2_SETTINGS_HEADER_TABLE_SIZE                                 0x1
+#define KC_HTTP2_SETTINGS_ENABLE_PUSH                                       0x2
+#define KC_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS                            0x3
+#define KC_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE                               0x4
+#define KC_HTTP2_SETTINGS_MAX_FRAME_SIZE                                    0x5
+#define KC_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE                              0x6
+
+// the window every stream (and the connection) starts with, by the RFC
+#define KC_HTTP2_DEFAULT_WINDOW_SIZE                                      65535
+
+// the largest window, and the largest frame the other side can allow
+#define KC_HTTP2_MAX_WINDOW_SIZE                                     2147483647
+#define KC_HTTP2_MAX_FRAME_SIZE_LIMIT                                  16777215
+
+// what the server allows: the streams open at the same time, the window of
+// the connection and of every stream, the largest frame, the size of the
+// headers of a request (as counted by HPACK) and of its body
+#define KC_HTTP2_MAX_STREAMS                                                100
+#define KC_HTTP2_WINDOW_SIZE                                            1048576
+#define KC_HTTP2_MAX_FRAME_SIZE                                           16384
+#define KC_HTTP2_MAX_HEADER_LIST                                          65536
+#define KC_HTTP2_MAX_BODY_SIZE                                         16777216
+
+// the states of a stream
+#define KC_HTTP2_STATE_OPEN                                                   0
+#define KC_HTTP2_STATE_HALF_CLOSED                                            1
+#define KC_HTTP2_STATE_CLOSED                                                 2
+
+//---------------------------------------------------------------------------//
+
+// a header of a response, the name in lowercase
+struct kc_http2_field_t
+{
+  const char* name;
+  size_t      name_len;
+  const char* value;
+  size_t      value_len;
+};
+
+// the bytes put together from many frames
+struct kc_http2_buffer_t
+{
+  char*  data;
+  size_t len;
+  size_t cap;
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_http2_stream_t
+{
+  uint32_t id;
+  int      state;  // see KC_HTTP2_STATE_OPEN and the others
+  void*    data;   // anything the server keeps with the stream
+
+  // the request is answered later (set by on_request), by the caller
+  // that then calls finish
+  bool deferred;
+
+  // the request rebuilt as a HTTP/1 one, NUL terminated (once it's whole)
+  char*  request;
+  size_t request_len;
+
+  // how much can be sent on the stream, and received
+  int64_t _send_window;
+  int64_t _recv_window;
+
+  // the request being received: the pseudo-headers, the other headers
+  // (already as "Name: value\r\n"), the cookies and the body
+  char* _method;
+  char* _path;
+  char* _authority;
+  bool  _has_scheme;
+  bool  _has_host;
+  bool  _regular_seen;  // the pseudo-headers must come first
+  size_t _header_list;  // the size of the headers, as counted by HPACK
+
+  int64_t _content_length;  // -1 when not known
+
+  struct kc_http2_buffer_t _head;
+  struct kc_http2_buffer_t _cookie;
+  struct kc_http2_buffer_t _body;
+
+  bool _busy;  // the request is being handled, it's freed after
+
+  struct kc_http2_stream_t* _next;        // the other streams
+  struct kc_http2_stream_t* _ready_next;  // the next whole request
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_http2_t
+{
+  int   client_fd;
+  void* data;  // anything the server keeps with the connection
+
+  // a whole request (see stream->request), called on the thread that
+  // receives; the stream is reset if it's not answered once this returns
+  // (unless it's deferred)
+  void (*on_request)  (struct kc_http2_t* h2, struct kc_http2_stream_t* stream);
+
+  // how the frames are written (the pieces can be changed), NULL for sendmsg
+  int  (*writer)      (int client_fd, struct iovec* iov, int iov_len, int flags);
+
+  size_t streams;  // open at the moment (can be read at any time)
+  bool   closing;  // a GOAWAY was sent, no new stream is taken
+
+  // the header compression of each direction
+  struct kc_hpack_t* _decoder;
+  struct kc_hpack_t* _encoder;
+
+  // the settings of the client, and how much can be sent and received
+  uint32_t _peer_max_frame_size;
+  int64_t  _peer_initial_window;
+  int64_t  _send_window;
+  int64_t  _recv_window;
+
+  uint32_t _last_stream_id;   // the last stream opened by the client
+  size_t   _preface_len;      // the bytes of the preface received so far
+  bool     _preface_sent;
+  bool     _settings_received;
+  bool     _failed;           // the connection can't be used anymore
+
+  // the frame being received (its payload is copied only when it comes
+  // in more than one piece)
+  uint8_t  _frame_header[KC_HTTP2_FRAME_HEADER_SIZE];
+  size_t   _frame_header_len;
+  uint8_t* _payload;
+  size_t   _payload_len;
+
+  // a header block that continues in the next frames
+  uint32_t _continuation;
+  uint8_t  _continuation_flags;
+  struct kc_http2_buffer_t _block;
+
+  struct kc_http2_stream_t* _streams;
+  struct kc_http2_stream_t* _ready;
+  struct kc_http2_stream_t* _ready_tail;
+  bool                      _dispatching;
+
+  // the frames are sent whole, one at a time
+  pthread_mutex_t _send_lock;
+
+  // parse the bytes received from the client, then hand over the requests
+  // that are whole; anything but KC_SUCCESS means the connection is over
+  int (*receive)       (struct kc_http2_t* self, char* data, size_t len);
+
+  // send the headers of a response, then its body (as the windows allow,
+  // waiting for the client to open them when they are full)
+  int (*send_headers)  (struct kc_http2_t* self, struct kc_http2_stream_t* stream,
+      const struct kc_http2_field_t* fields, size_t fields_len, bool end_stream);
+  int (*send_data)     (struct kc_http2_t* self, struct kc_http2_stream_t* stream,
+      const char* data, size_t len, bool end_stream);
+
+  // give up on a stream, or on the whole connection (the streams already
+  // open are still answered after a GOAWAY with KC_HTTP2_NO_ERROR)
+  int (*reset)         (struct kc_http2_t* self, struct kc_http2_stream_t* stream, uint32_t code);
+  int (*goaway)        (struct kc_http2_t* self, uint32_t code);
+
+  // take over a HTTP/1.1 connection that asked for h2c, with the settings
+  // it sent (decoded from HTTP2-Settings); the request becomes the first
+  // stream, handled by the caller until it calls finish (as for the
+  // deferred streams, on the thread that receives)
+  int  (*upgrade)      (struct kc_http2_t* self, const uint8_t* settings, size_t len,
+      struct kc_http2_stream_t** stream);
+  void (*finish)       (struct kc_http2_t* self, struct kc_http2_stream_t* stream);
+};
+
+struct kc_http2_t* new_http2      (int client_fd, void (*on_request)(struct kc_http2_t* h2, struct kc_http2_stream_t* stream));
+void               destroy_http2  (struct kc_http2_t* http2);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_HTTP2_T_H */
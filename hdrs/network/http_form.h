@@ -0,0 +1,108 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// http_form.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Streaming parsers for the form bodies.
+ *
+ * Both parsers are fed the body chunk by chunk, as it comes from the socket,
+ * and only keep a small fixed buffer between the chunks, so the memory used
+ * does not depend on the size of the upload.
+ *
+ * The urlencoded parser stores every decoded pair in a map (ex: the params
+ * of the request). The multipart parser calls back once when a part begins,
+ * once for every chunk of its data and once when it ends; the boundaries are
+ * searched 16 bytes at a time. The files can also be streamed to disk, with
+ * the parser handling the callbacks (see save_files).
+ */
+
+#ifndef KC_HTTP_FORM_H
+#define KC_HTTP_FORM_H
+
+#include "../datastructs/map.h"
+#include "../system/file.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_HTTP_FORM_FIELD_MAX_SIZE                                        2048
+#define KC_HTTP_MULTIPART_BOUNDARY_MAX_SIZE                                  70
+#define KC_HTTP_MULTIPART_HEADER_MAX_SIZE                                  2048
+#define KC_HTTP_MULTIPART_NAME_MAX_SIZE                                     256
+
+//---------------------------------------------------------------------------//
+
+struct kc_urlencoded_t
+{
+  struct kc_map_t* params;  // where the decoded pairs are stored
+
+  // the pair that continues in the next chunk
+  char   _pair[KC_HTTP_FORM_FIELD_MAX_SIZE];
+  size_t _pair_len;
+  bool   _skip;             // the current pair is too long and is ignored
+
+  int (*feed)    (struct kc_urlencoded_t* self, const char* chunk, size_t len);
+  int (*finish)  (struct kc_urlencoded_t* self);
+};
+
+struct kc_urlencoded_t* new_urlencoded      (struct kc_map_t* params);
+void                    destroy_urlencoded  (struct kc_urlencoded_t* form);
+
+//---------------------------------------------------------------------------//
+
+struct kc_multipart_part_t
+{
+  char name[KC_HTTP_MULTIPART_NAME_MAX_SIZE];          // the form field name
+  char filename[KC_HTTP_MULTIPART_NAME_MAX_SIZE];      // empty for the fields
+  char content_type[KC_HTTP_MULTIPART_NAME_MAX_SIZE];  // (ex: image/png)
+
+  bool is_file;
+};
+
+struct kc_multipart_t
+{
+  // the delimiter is "\r\n--" followed by the boundary
+  char   _delimiter[KC_HTTP_MULTIPART_BOUNDARY_MAX_SIZE + 5];
+  size_t _delimiter_len;
+
+  int _state;
+
+  // the partial part headers, or the bytes that may start a delimiter
+  char   _buffer[KC_HTTP_MULTIPART_HEADER_MAX_SIZE];
+  size_t _buffer_len;
+
+  struct kc_multipart_part_t part;  // the part being parsed
+
+  void* data;  // anything the callbacks need
+
+  // used only when the files are saved by the parser
+  char              _directory[KC_MAX_PATH];
+  struct kc_file_t* _file;
+  struct kc_map_t*  _fields;
+  char              _field[KC_HTTP_FORM_FIELD_MAX_SIZE];
+  size_t            _field_len;
+
+  // the callbacks, a non-zero return stops the parser
+  int (*on_part_begin)  (struct kc_multipart_t* self, struct kc_multipart_part_t* part);
+  int (*on_part_data)   (struct kc_multipart_t* self, const char* data, size_t len);
+  int (*on_part_end)    (struct kc_multipart_t* self);
+
+  int (*feed)        (struct kc_multipart_t* self, const char* chunk, size_t len);
+  int (*finish)      (struct kc_multipart_t* self);
+  int (*save_files)  (struct kc_multipart_t* self, const char* directory, struct kc_map_t* fields);
+};
+
+// the boundary is taken from the Content-Type
+// (ex: multipart/form-data; boundary=----1234)
+struct kc_multipart_t* new_multipart      (const char* content_type);
+void                   destroy_multipart  (struct kc_multipart_t* form);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_HTTP_FORM_H */
@@ -20,15 +20,53 @@
 #endif
 
 #include <stdio.h>
+#include <time.h>
+
+// the length of a date (ex: Sun, 06 Nov 1994 08:49:37 GMT) with the NUL
+#define KC_HTTP_DATE_SIZE                                                    30
+
+// the most byte ranges that are served for a single request
+#define KC_HTTP_MAX_RANGES                                                   16
 
 struct kc_http_request_t;
 
+// a satisfiable byte range of a representation (see http_parse_range)
+struct kc_http_range_t
+{
+  size_t start;  // the offset of the first byte
+  size_t len;    // the number of bytes, never zero
+};
+
 // ------------------------- PARSE FUNCTIONS --------------------------------//
 
 int http_parse_request_line     (char* request_line, struct kc_http_request_t* req);
 int http_parse_request_headers  (char* request_headers, struct kc_http_request_t* req);
 int http_parse_request_body     (char* request_body, struct kc_http_request_t* req);
 
+// the header section and the query string are only located by the functions
+// above, these ones do the actual work and are called on the first lookup
+int    http_parse_header_fields  (const char* raw, size_t raw_len, struct kc_map_t* headers);
+int    http_parse_query_string   (const char* raw, size_t raw_len, struct kc_map_t* params);
+size_t http_url_decode           (char* dest, const char* src, size_t src_len);
+int    http_parse_content_type   (const char* content_type);
+
+// the dates of the headers (ex: Last-Modified), always in GMT
+int    http_parse_date           (const char* date, time_t* time);
+size_t http_format_date          (time_t time, char* buffer);
+
+// the "bytes=" ranges of a Range header, for a representation of the given
+// size; KC_INVALID if none of them can be satisfied, and KC_FORMAT_ERROR
+// or KC_OVERFLOW if the header must be ignored (malformed or too many)
+int    http_parse_range          (const char* range, size_t size, struct kc_http_range_t* ranges, int* ranges_len);
+
+// if the entity tag is one of a list (ex: If-None-Match), the weak
+// tags (W/"...") are compared as the strong ones and "*" matches any
+int    http_match_etag           (const char* list, const char* etag);
+
+// if a content coding (ex: "gzip") is accepted, the codings with "q=0" are
+// refused and the ones not listed take the quality of "*" (if any)
+int    http_accept_encoding      (const char* accept_encoding, const char* encoding);
+
 // ------------------------- VALIDATE FUNCTIONS -----------------------------//
 
 int validate_http_method        (char* method);
@@ -0,0 +1,122 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// io_engine.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * An event loop for the connections of a listening socket.
+ *
+ * The engine accepts the connections and receives their bytes on the thread
+ * that runs it, handing them to its owner (ex: the server) through a few
+ * callbacks; the owner answers on the same thread and tells the engine when
+ * a connection must be closed. The other threads can only wake the loop up,
+ * to have something done on its thread (ex: send a response they completed).
+ *
+ * Two interfaces of the kernel can be used: epoll, and io_uring (Linux 5.19
+ * and newer), where one accept request keeps accepting the connections, the
+ * bytes are received into a ring of buffers shared with the kernel, and all
+ * the requests of a loop iteration are submitted with a single system call.
+ * When io_uring is asked for but the kernel lacks it, epoll is used instead.
+ */
+
+#ifndef KC_IO_ENGINE_T_H
+#define KC_IO_ENGINE_T_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+// the interfaces of the kernel
+#define KC_IO_ENGINE_EPOLL                                                    1
+#define KC_IO_ENGINE_IO_URING                                                 2
+
+// the most requests submitted (or events received) at once
+#define KC_IO_ENGINE_QUEUE_SIZE                                             256
+
+// the buffers the kernel receives into (a power of 2) and their size
+#define KC_IO_ENGINE_BUFFERS                                                256
+#define KC_IO_ENGINE_BUFFER_SIZE                                           4096
+
+//---------------------------------------------------------------------------//
+
+struct kc_io_connection_t;
+struct kc_io_uring_t;
+
+//---------------------------------------------------------------------------//
+
+struct kc_io_handler_t
+{
+  void* data;  // given back to accepted (ex: the server)
+
+  // a new connection, returns its context (or NULL to close it)
+  void* (*accepted)  (void* data, int fd);
+
+  // where the next bytes of a connection go, and how many fit
+  char* (*buffer)    (void* conn, size_t* size);
+
+  // the bytes were received in the buffer, false closes the connection
+  bool  (*received)  (void* conn, size_t len);
+
+  // the connection is being closed (its socket right after), its context
+  // can be released
+  void  (*closed)    (void* conn);
+
+  // the engine stopped accepting, the open connections should be wound
+  // down (optional)
+  void  (*draining)  (void* data);
+
+  // the loop was woken up by another thread (see wake), with something
+  // for the connections to do (optional)
+  void  (*woken)     (void* data);
+
+  // the descriptor given to watch is readable (optional)
+  void  (*ready)     (void* data, int fd);
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_io_engine_t
+{
+  int type;       // the interface actually used
+  int listen_fd;  // the listening socket
+
+  struct kc_io_handler_t handler;
+
+  int  _fd;           // the epoll instance or the ring
+  int  _stop_fds[2];  // a pipe, written to stop (or drain) the loop
+  bool _stopped;
+  bool _draining;
+  int  _watched;      // the descriptor given to watch (-1 for none)
+
+  struct kc_io_connection_t* _connections;  // the open ones
+  struct kc_io_uring_t*      _uring;        // NULL for epoll
+
+  // serve the connections until stopped, then close them
+  int  (*run)    (struct kc_io_engine_t* self);
+
+  // both can be called from any thread (or a signal handler); stop closes
+  // the connections right away, drain stops accepting and lets the loop run
+  // until the owner closes the last of them
+  void (*stop)   (struct kc_io_engine_t* self);
+  void (*drain)  (struct kc_io_engine_t* self);
+
+  // call woken on the thread of the loop, as soon as it can; it can be
+  // called from any thread, the calls made meanwhile are merged into one
+  void (*wake)   (struct kc_io_engine_t* self);
+
+  // call ready on the thread of the loop whenever the descriptor is
+  // readable (ex: the epoll instance of the fibers, see fiber.h); a single
+  // one is watched, given before the loop runs
+  int  (*watch)  (struct kc_io_engine_t* self, int fd);
+};
+
+struct kc_io_engine_t* new_io_engine      (int type, int listen_fd, struct kc_io_handler_t handler);
+void                   destroy_io_engine  (struct kc_io_engine_t* engine);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_IO_ENGINE_T_H */
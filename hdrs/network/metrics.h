@@ -0,0 +1,116 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// metrics.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * The counters and the latencies of a server.
+ *
+ * Every request is counted under its route and its status, with the bytes it
+ * received and sent, and the time it took is recorded in latency histograms,
+ * both as a whole (per route) and for every phase of it: parsing the request,
+ * running the handler, serializing the response and sending it.
+ *
+ * The latencies are kept in histograms (see histogram.h) of 16 buckets for
+ * every power of 2, so any percentile is known within 1/16 of its value.
+ *
+ * The pool of the blocking routes (if any) is shown along: its threads, the
+ * work queued and running, and how long the work waited for a thread.
+ *
+ * The numbers are kept in shards; every thread writes to its own (once there
+ * are more threads than shards, a few share one), so the threads serving the
+ * requests don't fight over the same cache lines. The shards are added up
+ * only when the numbers are read.
+ */
+
+#ifndef KC_METRICS_T_H
+#define KC_METRICS_T_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_METRICS_SHARDS                                                    16
+
+// the routes counted on their own, the first one is for all the requests
+// that have no route (ex: not found)
+#define KC_METRICS_ROUTES                                                    64
+#define KC_METRICS_OTHER_ROUTE                                                0
+
+// the status codes counted, the others are counted as 0
+#define KC_METRICS_STATUSES                                                 600
+
+// 16 buckets for every power of 2, up to 2^40 ns (about 18 minutes)
+#define KC_METRICS_SUB_BITS                                                   4
+#define KC_METRICS_MAX_BITS                                                  40
+
+// the phases of a request
+#define KC_METRICS_PARSE                                                      0
+#define KC_METRICS_HANDLER                                                    1
+#define KC_METRICS_SERIALIZE                                                  2
+#define KC_METRICS_SEND                                                       3
+#define KC_METRICS_PHASES                                                     4
+
+//---------------------------------------------------------------------------//
+
+struct kc_metrics_shard_t;
+struct kc_worker_pool_t;
+
+// what is known about a request once it's done
+struct kc_metrics_sample_t
+{
+  int    route;   // from add_route
+  int    status;  // 0 when no response was sent
+  size_t bytes_in;
+  size_t bytes_out;
+
+  uint64_t phases[KC_METRICS_PHASES];  // in nanoseconds, 0 if skipped
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_metrics_t
+{
+  // the labels of the routes (ex: "GET", "/home")
+  char* methods[KC_METRICS_ROUTES];
+  char* urls[KC_METRICS_ROUTES];
+  int   routes_len;
+
+  // the pool of the blocking routes, rendered along (NULL for none)
+  struct kc_worker_pool_t* pool;
+
+  struct kc_metrics_shard_t* _shards[KC_METRICS_SHARDS];  // made when first used
+  pthread_mutex_t            _lock;                       // for the routes
+
+  // a route to count the requests under, returns its number (or the
+  // other route, once there are too many)
+  int      (*add_route)  (struct kc_metrics_t* self, const char* method, const char* url);
+
+  // can be called by any thread, at the same time
+  void     (*opened)     (struct kc_metrics_t* self);
+  void     (*closed)     (struct kc_metrics_t* self);
+  void     (*record)     (struct kc_metrics_t* self, struct kc_metrics_sample_t* sample);
+
+  // the sums over all the shards (-1 for all the routes); the latency is in
+  // nanoseconds, of a whole request on the route when the phase is -1, else
+  // of the phase (kept for all the routes together)
+  uint64_t (*requests)   (struct kc_metrics_t* self, int route);
+  uint64_t (*responses)  (struct kc_metrics_t* self, int status);
+  uint64_t (*active)     (struct kc_metrics_t* self);
+  uint64_t (*latency)    (struct kc_metrics_t* self, int route, int phase, double percentile);
+
+  // everything in the Prometheus text format, in a new buffer (to be freed)
+  int      (*render)     (struct kc_metrics_t* self, char** text, size_t* len);
+};
+
+struct kc_metrics_t* new_metrics      (void);
+void                 destroy_metrics  (struct kc_metrics_t* metrics);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_METRICS_T_H */
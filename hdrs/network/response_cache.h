@@ -0,0 +1,79 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// response_cache.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A cache for the whole responses of a GET route.
+ *
+ * The responses are kept serialized, exactly as they were sent, under a key
+ * made of the URL and the values of a few chosen headers (ex: the language),
+ * and they expire after a number of seconds. When the same key is missed by
+ * many requests at once, only the first one runs the handler and the others
+ * wait for its response ("single-flight").
+ */
+
+#ifndef KC_RESPONSE_CACHE_T_H
+#define KC_RESPONSE_CACHE_T_H
+
+#include "../datastructs/map.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+//---------------------------------------------------------------------------//
+
+// the most headers that can be part of the key
+#define KC_RESPONSE_CACHE_MAX_HEADERS                                         8
+
+//---------------------------------------------------------------------------//
+
+struct kc_cached_response_t
+{
+  // the status line and the headers (without the empty line), then the body
+  char*  data;
+  size_t head_len;
+  size_t len;
+
+  time_t expires;  // on the monotonic clock
+
+  int _refs;  // the cache holds one, every request being served another
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_response_cache_t
+{
+  int    ttl;       // the seconds a response is kept
+  size_t max_size;  // the most bytes all the responses can take
+  size_t size;      // the bytes taken by the responses
+
+  // the headers whose values are part of the key (ex: Accept-Language)
+  char* headers[KC_RESPONSE_CACHE_MAX_HEADERS];
+  int   headers_len;
+
+  struct kc_map_t* _responses;
+  pthread_mutex_t  _lock;
+  pthread_cond_t   _filled;  // a missed key was filled (or abandoned)
+
+  // the response of a key, or KC_PENDING when it's missing and the caller
+  // must produce it, then either fill or abandon the key (the callers that
+  // miss the same key in the meantime wait for it)
+  int  (*acquire)  (struct kc_response_cache_t* self, const char* key, struct kc_cached_response_t** response);
+  int  (*fill)     (struct kc_response_cache_t* self, const char* key, char* data, size_t head_len, size_t len);
+  void (*abandon)  (struct kc_response_cache_t* self, const char* key);
+  void (*release)  (struct kc_response_cache_t* self, struct kc_cached_response_t* response);
+};
+
+// the headers are given as a list (ex: "Accept-Language, Accept"), or NULL
+struct kc_response_cache_t* new_response_cache      (int ttl, size_t max_size, const char* headers);
+void                        destroy_response_cache  (struct kc_response_cache_t* cache);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_RESPONSE_CACHE_T_H */
@@ -14,10 +14,19 @@
 #define KC_SERVER_T_H
 
 #include "http.h"
+#include "http2.h"
+#include "io_engine.h"
+#include "metrics.h"
 #include "socket.h"
+#include "sse.h"
+#include "websocket.h"
+#include "../system/fiber.h"
+#include "../system/timer_wheel.h"
+#include "../system/worker_pool.h"
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 //---------------------------------------------------------------------------//
 
@@ -25,6 +34,46 @@
 
 #define KC_SERVER_MAX_CONNECTIONS                                    0x00001024
 
+// the pieces of a response that are sent without a heap allocation
+#define KC_SERVER_IOVEC_SIZE                                                 64
+
+// the block size of the arena every connection allocates its requests in
+#define KC_SERVER_ARENA_BLOCK_SIZE                                        16384
+
+// the most bytes of an unread body that are received (and dropped) to keep
+// the connection open
+#define KC_SERVER_DRAIN_MAX_SIZE                                          65536
+
+// the default deadlines of a connection, in milliseconds (see kc_server_t),
+// and how often they are checked
+#define KC_SERVER_IDLE_TIMEOUT                                             5000
+#define KC_SERVER_HEADER_TIMEOUT                                          10000
+#define KC_SERVER_BODY_TIMEOUT                                            30000
+#define KC_SERVER_WRITE_TIMEOUT                                           30000
+#define KC_SERVER_DEADLINE_TICK                                             100
+
+// the default threads and queue of the blocking routes (see kc_server_t),
+// and the largest body of their requests (received whole before they run)
+#define KC_SERVER_BLOCKING_THREADS                                            4
+#define KC_SERVER_BLOCKING_QUEUE_SIZE                                       256
+#define KC_SERVER_BLOCKING_BODY_SIZE                                   16777216
+
+// the most directories that can be served as static files
+#define KC_SERVER_STATIC_ROUTES_SIZE                                         16
+
+// the most middleware of the server, and of every route
+#define KC_SERVER_MIDDLEWARE_SIZE                                            16
+
+// the length of the entity tag of a static file (a quoted SHA-1), with the NUL
+#define KC_SERVER_ETAG_SIZE                                                  43
+
+// how the connections are served: each on its own thread (the default), or
+// all of them by an event loop on the thread that starts the server, with
+// epoll or io_uring (which falls back to epoll on the older kernels)
+#define KC_SERVER_ENGINE_THREADS                                              0
+#define KC_SERVER_ENGINE_EPOLL                               KC_IO_ENGINE_EPOLL
+#define KC_SERVER_ENGINE_IO_URING                         KC_IO_ENGINE_IO_URING
+
 #define KC_SERVER_SEND_MSG                                           0xF0000010
 #define KC_SERVER_RENDER                                             0xF0000020
 #define KC_SERVER_REDIRECT                                           0xF0000040
@@ -33,6 +82,8 @@
 
 struct kc_server_t;
 struct kc_route_t;
+struct kc_connection_t;
+struct kc_deferred_t;
 
 //---------------------------------------------------------------------------//
 
@@ -41,18 +92,123 @@ struct kc_server_t
   struct kc_socket_t* socket;  // server' socket
   struct kc_route_t*  routes;  // server' endpoints
 
-  int (*start)  (struct kc_server_t* self);
-  int (*send)   (int client_fd, struct kc_http_response_t* res);
+  int engine;  // the one actually used (see KC_SERVER_ENGINE_*)
+
+  // the milliseconds a connection is given (0 for no limit) to start the
+  // next request, to send its headers, to send its body, and to take the
+  // response; a connection that misses a deadline is closed
+  unsigned idle_timeout;
+  unsigned header_timeout;
+  unsigned body_timeout;
+  unsigned write_timeout;
+
+  // the stack of the fiber every HTTP/1 handler runs on, with an event loop
+  // (0 for KC_FIBER_STACK_SIZE, the default): the socket reads and writes
+  // of a handler wait for the loop instead of blocking it, the handler goes
+  // on once the client is ready and the others are served meanwhile; set
+  // it before the start, as large as the deepest handler needs
+  size_t fiber_stack_size;
+
+  // the threads the blocking routes run on (see routes->blocking), and the
+  // most requests that wait for them; the requests that find the queue
+  // full are answered with 503 Service Unavailable. Set them before the
+  // start, the pool is made only when some route is blocking (0 threads
+  // run the blocking routes as the others)
+  size_t blocking_threads;
+  size_t blocking_queue_size;
+
+  // the counters and latencies of the requests (see routes->metrics)
+  struct kc_metrics_t* metrics;
+
+  struct kc_io_engine_t*       _io_engine;  // NULL for the threads
+  struct kc_fiber_scheduler_t* _fibers;     // NULL for the threads
+  struct kc_worker_pool_t*     _blocking;   // NULL unless a route is blocking
+
+  // the deferred responses completed (on any thread) and not sent yet, the
+  // event loop sends them; with the threads, the thread of the connection
+  // waits for its response instead
+  struct kc_deferred_t* _completed;
+
+  // the deadlines of the connections and the drain deadline, checked by
+  // their own thread; the wheel has a lock of its own, a phase change never
+  // waits for the connections being accepted or closed
+  struct kc_timer_wheel_t* _deadlines;
+  pthread_mutex_t          _deadlines_lock;
+  pthread_cond_t           _deadlines_added;
+  pthread_t                _watcher;
+  bool                     _watching;
+  bool                     _drain_due;  // the drain deadline fired
 
-  // TODO: add stop server function
+  // the connections being served (a thread that holds this lock may take
+  // the lock of the wheel, never the other way around)
+  struct kc_connection_t* _connections;
+  size_t                  _connections_len;
+  pthread_mutex_t         _lock;
+  pthread_cond_t          _drained;  // the last connection was closed
+
+  int               _stop_fds[2];  // a pipe, written once to stop
+  int               _stopping;
+  bool              _draining;
+  unsigned          _drain_timeout;
+  struct kc_timer_t _drain_deadline;
+
+  // the middleware of every request, and the chain of the requests that
+  // have no endpoint (the middleware, then the answer of the server)
+  int (*_middleware[KC_SERVER_MIDDLEWARE_SIZE])  (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+  size_t _middleware_len;
+  int (**_chain)  (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+  size_t _chain_len;
+
+  bool      _listening;  // the socket was taken over, already listening
+  int       _handoff_fd;
+  char*     _handoff_path;
+  unsigned  _handoff_drain_timeout;
+  pthread_t _handoff;
+
+  int  (*start)      (struct kc_server_t* self);
+  int  (*send)       (int client_fd, struct kc_http_response_t* res);
+
+  // add a middleware for every request (ex: auth, CORS, logging), before the
+  // start; the middleware are called in the order they were added, each one
+  // goes on with next or answers the request itself (ex: 401 Unauthorized)
+  int  (*use)        (struct kc_server_t* self, int (*middleware)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
+
+  // call the next middleware of the request, or its handler after the last
+  int  (*next)       (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+
+  // stop accepting the connections and close the idle ones, the others are
+  // closed after their current response, or when the drain deadline (in
+  // milliseconds, 0 closes them right away) passes; start returns once they
+  // are all closed. It can be called from any thread, or a signal handler
+  void (*stop)       (struct kc_server_t* self, unsigned drain_timeout);
+
+  // wait (on another thread) for the next process to take the listening
+  // socket over from the UNIX socket at the path, then stop; no connection
+  // is dropped in between, those waiting to be accepted are left to it
+  int  (*hand_off)   (struct kc_server_t* self, const char* path, unsigned drain_timeout);
+
+  // listen on the socket handed off by the server at the path (instead of
+  // binding a new one), to be called before start
+  int  (*take_over)  (struct kc_server_t* self, const char* path);
 };
 
-struct kc_server_t* new_server_IPv4  (const char* IP, const unsigned int PORT);
-struct kc_server_t* new_server_IPv6  (const char* IP, const unsigned int PORT);
-struct kc_server_t* new_server       (const int AF, const char* IP, const unsigned int PORT);
-void                destroy_server   (struct kc_server_t* server);
-int                 start_server     (struct kc_server_t* self);
-int                 send_msg_server  (int client_fd, struct kc_http_response_t* res);
+struct kc_server_t* new_server_IPv4      (const char* IP, const unsigned int PORT);
+struct kc_server_t* new_server_IPv6      (const char* IP, const unsigned int PORT);
+struct kc_server_t* new_server           (const int AF, const char* IP, const unsigned int PORT);
+struct kc_server_t* new_server_engine    (const int AF, const char* IP, const unsigned int PORT, const int ENGINE);
+void                destroy_server       (struct kc_server_t* server);
+int                 start_server         (struct kc_server_t* self);
+void                stop_server          (struct kc_server_t* self, unsigned drain_timeout);
+int                 hand_off_server      (struct kc_server_t* self, const char* path, unsigned drain_timeout);
+int                 take_over_server     (struct kc_server_t* self, const char* path);
+int                 use_server           (struct kc_server_t* self, int (*middleware)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
+int                 next_server          (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+int                 send_msg_server      (int client_fd, struct kc_http_response_t* res);
+int                 begin_stream_server  (struct kc_http_response_t* res, int client_fd);
+int                 write_chunk_server   (struct kc_http_response_t* res, const char* data, size_t len);
+int                 end_stream_server    (struct kc_http_response_t* res);
+int                 defer_server         (struct kc_http_response_t* res);
+int                 complete_server      (struct kc_http_response_t* res);
 
 //---------------------------------------------------------------------------//
 
@@ -66,6 +222,43 @@ struct kc_route_t
   void (*delete)   (char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
   void (*trace)    (char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
   void (*connect)  (char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
+
+  // serve the files of a directory under an URL prefix (ex: "/assets"),
+  // only for the GET and HEAD requests that match no other endpoint
+  void (*static_files)  (char* prefix, char* directory);
+
+  // keep the "200 OK" responses of a GET route for a number of seconds, by
+  // their URL and the values of some headers (ex: "Accept-Language"), up to
+  // a total size; a cached response is sent without running the handler
+  // (so a route with middleware, of its own or of the server, is not cached)
+  void (*cache)  (char* url, int ttl, size_t max_size, char* headers);
+
+  // answer the GET requests of the URL (ex: "/metrics") with the metrics
+  // of the server, in the Prometheus text format
+  void (*metrics)  (char* url);
+
+  // answer the GET requests of the URL with a stream of Server-Sent Events:
+  // the connection is handed over to the broadcaster, that sends it every
+  // event published from then on (the broadcaster is not owned by the server);
+  // the HTTP/2 clients are told to ask again over HTTP/1.1
+  void (*sse)  (char* url, struct kc_sse_broadcaster_t* broadcaster);
+
+  // add a middleware only for the requests of the URL (once it's added),
+  // called after the ones of the server and before the start
+  void (*use)  (char* url, int (*middleware)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
+
+  // run the requests of the URL (once it's added), their middleware and
+  // handler, on the threads of the blocking routes (ex: the ones that read
+  // files or hash large bodies), so they don't hold the threads that serve
+  // the sockets: those receive the whole body first (an event loop serves
+  // the others meanwhile), then send the response once the handler returned
+  // (it's deferred meanwhile, see res->defer); a stream is written by the
+  // blocking thread itself
+  void (*blocking)  (char* url);
+
+  // upgrade the GET requests of the URL to WebSocket connections, served by
+  // the handler on the connection loop of the server (see websocket.h)
+  void (*websocket)  (char* url, struct kc_websocket_handler_t handler);
 };
 
 //---------------------------------------------------------------------------//
@@ -0,0 +1,84 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// sse.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A broadcaster of Server-Sent Events.
+ *
+ * The clients of an SSE route (see routes->sse) are handed over to the
+ * broadcaster once the head of the response is sent: it owns their sockets
+ * from then on, so they hold no thread and no request of the server.
+ *
+ * An event is serialized once, in an immutable buffer shared by all the
+ * subscribers; every one of them keeps only a reference to it (and how much
+ * of it was sent) until its socket takes it. The events are written right
+ * away to the clients that keep up, a thread of the broadcaster sends the
+ * rest as their sockets become writable. A client that falls behind by a
+ * whole queue of events either misses the next ones, or is disconnected.
+ */
+
+#ifndef KC_SSE_BROADCASTER_T_H
+#define KC_SSE_BROADCASTER_T_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+//---------------------------------------------------------------------------//
+
+// what is done with a client whose queue is full
+#define KC_SSE_DROP                                                           1
+#define KC_SSE_DISCONNECT                                                     2
+
+// the events kept for a client that doesn't keep up
+#define KC_SSE_QUEUE_SIZE                                                    64
+
+// the milliseconds between two keep-alive comments, so the proxies keep the
+// idle connections open (and the dead ones are noticed)
+#define KC_SSE_HEARTBEAT                                                  15000
+
+//---------------------------------------------------------------------------//
+
+struct kc_sse_client_t;
+
+//---------------------------------------------------------------------------//
+
+struct kc_sse_broadcaster_t
+{
+  int      policy;      // KC_SSE_DROP or KC_SSE_DISCONNECT
+  size_t   queue_size;  // the events kept for every client
+  unsigned heartbeat;   // in milliseconds, 0 for none
+
+  // can be read at any time
+  size_t   subscribers;
+  uint64_t dropped;       // the events missed by the slow clients
+  uint64_t disconnected;  // the slow clients closed
+
+  struct kc_sse_client_t* _clients;
+  struct kc_sse_client_t* _closed;  // freed by the writer, between two waits
+  pthread_mutex_t         _lock;
+
+  int       _epoll_fd;
+  int       _stop_fds[2];
+  pthread_t _writer;
+
+  // take over the socket of a client (the head of the response was sent),
+  // it's closed by the broadcaster, even when it can't be subscribed
+  int (*subscribe)  (struct kc_sse_broadcaster_t* self, int client_fd);
+
+  // send an event to all the subscribers, the name and the id are optional
+  // and the data can have many lines (every one is sent as "data: ...")
+  int (*publish)    (struct kc_sse_broadcaster_t* self, const char* event, const char* data, const char* id);
+};
+
+struct kc_sse_broadcaster_t* new_sse_broadcaster      (int policy, size_t queue_size);
+void                         destroy_sse_broadcaster  (struct kc_sse_broadcaster_t* broadcaster);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_SSE_BROADCASTER_T_H */
@@ -0,0 +1,141 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// websocket.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * The WebSocket protocol (RFC 6455), on the connections of the server.
+ *
+ * A WebSocket route (see routes->websocket) answers the handshake of a
+ * client and hands the connection over to a kc_websocket_t: from then on the
+ * bytes received by the server are frames, parsed as they come (a frame can
+ * come in many pieces, a piece can hold many frames) and unmasked in place.
+ * The fragments of a message are put together and every whole message is
+ * given to the handler; the pings are answered and the closing handshake is
+ * done by the connection itself.
+ *
+ * The messages can be sent from any thread, as long as the connection is
+ * open (until the handler is told it was closed).
+ */
+
+#ifndef KC_WEBSOCKET_T_H
+#define KC_WEBSOCKET_T_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+//---------------------------------------------------------------------------//
+
+// the types of frames
+#define KC_WEBSOCKET_CONTINUATION                                           0x0
+#define KC_WEBSOCKET_TEXT                                                   0x1
+#define KC_WEBSOCKET_BINARY                                                 0x2
+#define KC_WEBSOCKET_CLOSE                                                  0x8
+#define KC_WEBSOCKET_PING                                                   0x9
+#define KC_WEBSOCKET_PONG                                                   0xA
+
+// the reasons a connection is closed for
+#define KC_WEBSOCKET_NORMAL_CLOSURE                                        1000
+#define KC_WEBSOCKET_GOING_AWAY                                            1001
+#define KC_WEBSOCKET_PROTOCOL_ERROR                                        1002
+#define KC_WEBSOCKET_NO_STATUS                                             1005
+#define KC_WEBSOCKET_ABNORMAL_CLOSURE                                      1006
+#define KC_WEBSOCKET_INVALID_DATA                                          1007
+#define KC_WEBSOCKET_MESSAGE_TOO_BIG                                       1009
+#define KC_WEBSOCKET_INTERNAL_ERROR                                        1011
+
+// the states of a connection
+#define KC_WEBSOCKET_OPEN                                                     0
+#define KC_WEBSOCKET_CLOSING                                                  1
+#define KC_WEBSOCKET_CLOSED                                                   2
+
+// the largest message that is put together, by default
+#define KC_WEBSOCKET_MAX_MESSAGE_SIZE                                  16777216
+
+// the largest payload of a control frame (ex: a ping)
+#define KC_WEBSOCKET_CONTROL_SIZE                                           125
+
+// the length of Sec-WebSocket-Accept (a Base64 SHA-1), with the NUL
+#define KC_WEBSOCKET_ACCEPT_SIZE                                             29
+
+// appended to the key of the client to prove the handshake was understood
+#define KC_WEBSOCKET_GUID                "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+//---------------------------------------------------------------------------//
+
+struct kc_websocket_t;
+
+// what is done with a connection (any of them can be NULL, but message)
+struct kc_websocket_handler_t
+{
+  // the handshake is done, the connection can be used
+  void (*opened)   (struct kc_websocket_t* ws);
+
+  // a whole message (ex: KC_WEBSOCKET_TEXT), valid only during the call
+  void (*message)  (struct kc_websocket_t* ws, int opcode, char* data, size_t len);
+
+  // the connection is closed, it can't be used once this returns
+  void (*closed)   (struct kc_websocket_t* ws, int code);
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_websocket_t
+{
+  int   client_fd;
+  int   state;  // see KC_WEBSOCKET_OPEN and the others
+  void* data;   // anything the handler keeps with the connection
+
+  size_t max_message_size;  // the bigger messages close the connection
+
+  struct kc_websocket_handler_t handler;
+
+  // the frame being received
+  uint8_t  _header[14];
+  size_t   _header_len;
+  uint64_t _payload_len;
+  uint64_t _payload_read;
+
+  // the message being put together, unless it came whole in a single piece
+  int    _opcode;  // 0 between messages
+  char*  _message;
+  size_t _message_len;
+  size_t _message_cap;
+  char*  _direct;
+
+  char _control[KC_WEBSOCKET_CONTROL_SIZE];
+
+  // the frames are sent whole, one at a time
+  pthread_mutex_t _send_lock;
+
+  // parse the bytes received from the client, anything but KC_SUCCESS
+  // means that the connection is over (ex: the closing handshake is done)
+  int (*receive)  (struct kc_websocket_t* self, char* data, size_t len);
+
+  // send a message (KC_WEBSOCKET_TEXT or KC_WEBSOCKET_BINARY), or a ping
+  int (*send)     (struct kc_websocket_t* self, int opcode, const char* data, size_t len);
+  int (*ping)     (struct kc_websocket_t* self, const char* data, size_t len);
+
+  // start the closing handshake, the reason is optional
+  int (*close)    (struct kc_websocket_t* self, int code, const char* reason);
+};
+
+struct kc_websocket_t* new_websocket      (int client_fd, struct kc_websocket_handler_t handler);
+void                   destroy_websocket  (struct kc_websocket_t* websocket);
+
+//---------------------------------------------------------------------------//
+
+// the answer to the Sec-WebSocket-Key of a client
+int  kc_websocket_accept  (const char* key, char accept[KC_WEBSOCKET_ACCEPT_SIZE]);
+
+// XOR a payload with its masking key, from an offset of the whole payload
+void kc_websocket_unmask  (char* data, size_t len, const uint8_t mask[4], uint64_t offset);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_WEBSOCKET_T_H */
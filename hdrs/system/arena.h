@@ -0,0 +1,61 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// arena.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A bump-pointer (arena) allocator for memory that shares the same lifetime.
+ *
+ * Instead of calling malloc and free for every small object, the arena
+ * reserves large blocks and hands out consecutive chunks of them. The
+ * allocations are never freed one by one, the whole arena is reset at once
+ * (in constant time) and the blocks are reused for the next cycle.
+ */
+
+#ifndef KC_ARENA_T_H
+#define KC_ARENA_T_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_ARENA_BLOCK_SIZE                                                4096
+#define KC_ARENA_ALIGNMENT                                                   16
+
+//---------------------------------------------------------------------------//
+
+struct kc_arena_block_t
+{
+  struct kc_arena_block_t* next;  // the next reserved block (if any)
+
+  size_t size;                    // the capacity of the data
+  size_t used;                    // the bytes already handed out
+
+  // the data starts aligned, like the allocations inside it
+  char data[] __attribute__((aligned(KC_ARENA_ALIGNMENT)));
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_arena_t
+{
+  struct kc_arena_block_t* _first;    // the first block of the chain
+  struct kc_arena_block_t* _current;  // the block used for allocations
+
+  size_t _block_size;                 // the size of a regular block
+
+  void* (*alloc)  (struct kc_arena_t* self, size_t size);
+  void* (*dup)    (struct kc_arena_t* self, const void* src, size_t size);
+  void  (*reset)  (struct kc_arena_t* self);
+};
+
+struct kc_arena_t* new_arena      (size_t block_size);
+void               destroy_arena  (struct kc_arena_t* arena);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_ARENA_T_H */
@@ -0,0 +1,53 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// clock.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A clock shared by the whole process, cheap enough to be read on every
+ * request.
+ *
+ * The monotonic time comes from the coarse clock of the kernel (read through
+ * the vDSO, without a system call, with a few milliseconds of resolution),
+ * which is plenty for the timeouts and the request timing. The wall time is
+ * kept already formatted, both as an HTTP date (ex: for the Date header) and
+ * as a local timestamp (ex: for the logs); the strings are formatted once per
+ * second, by the first reader of the second, and copied by all the others.
+ */
+
+#ifndef KC_CLOCK_H
+#define KC_CLOCK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+//---------------------------------------------------------------------------//
+
+// "Sun, 06 Nov 1994 08:49:37 GMT" and "1994-11-06 08:49:37", with the NUL
+#define KC_CLOCK_DATE_SIZE                                                   30
+#define KC_CLOCK_LOCAL_SIZE                                                  20
+
+//---------------------------------------------------------------------------//
+
+// the time since an unspecified point in the past, never going back
+time_t   kc_clock_monotonic     (void);
+uint64_t kc_clock_monotonic_ms  (void);
+
+// the same, from the precise clock (ex: to measure latencies)
+uint64_t kc_clock_monotonic_ns  (void);
+
+// the seconds since the Epoch
+time_t   kc_clock_realtime      (void);
+
+// the current time as an IMF-fixdate (RFC 7231) and as a local timestamp,
+// both return the length of the string
+size_t   kc_clock_http_date     (char buffer[KC_CLOCK_DATE_SIZE]);
+size_t   kc_clock_local_time    (char buffer[KC_CLOCK_LOCAL_SIZE]);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_CLOCK_H */
@@ -0,0 +1,143 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// fiber.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Fibers: functions that run on their own small stacks and can stop halfway
+ * (ex: to wait for a socket), letting the others run on the same thread, to
+ * go on later right where they stopped. The code on a fiber stays written
+ * as if it blocked, while a single thread keeps many of them going.
+ *
+ * Every fiber is one mapping of the memory: its stack, taken from the kernel
+ * only as it's touched, a guard page below it (a fiber that goes past its
+ * stack stops the process instead of overwriting another one) and the fiber
+ * itself on top. Switching between the fibers saves only the registers the
+ * calling convention keeps, in a few instructions on x86-64 and aarch64, and
+ * with ucontext on the others (or with KC_FIBER_UCONTEXT defined).
+ *
+ * A scheduler runs the fibers of a thread: the ready ones in turn, while the
+ * others wait to be resumed, or for a socket. Those are watched by an epoll
+ * instance of the scheduler, itself readable when one of them is ready, so
+ * the event loop of the thread can watch it along its own sockets (see fd).
+ * A scheduler, with its fibers, is used by a single thread.
+ */
+
+#ifndef KC_FIBER_T_H
+#define KC_FIBER_T_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+// the stack of a fiber, only the pages touched take memory (the guard
+// pages of 100k fibers are as many mappings again, see vm.max_map_count)
+#define KC_FIBER_STACK_SIZE                                               65536
+#define KC_FIBER_MIN_STACK_SIZE                                           16384
+
+// the mappings of the fibers that returned, kept for the next ones
+#define KC_FIBER_CACHE_SIZE                                                  64
+
+// the sockets found ready at once
+#define KC_FIBER_EVENTS                                                     256
+
+// the states of a fiber
+#define KC_FIBER_READY                                                        0
+#define KC_FIBER_RUNNING                                                      1
+#define KC_FIBER_WAITING                                                      2
+#define KC_FIBER_DONE                                                         3
+
+//---------------------------------------------------------------------------//
+
+struct kc_fiber_scheduler_t;
+
+//---------------------------------------------------------------------------//
+
+struct kc_fiber_t
+{
+  int state;  // see KC_FIBER_READY and the others
+
+  void (*entry)  (void* data);
+  void* data;  // given to the entry
+
+  struct kc_fiber_scheduler_t* scheduler;
+
+  void*  _context;  // where it stopped (the saved stack, or its ucontext)
+  char*  _mapping;  // the guard page, the stack, then the fiber
+  size_t _mapping_size;
+
+  int _fd;      // the socket it waits for (-1 for none)
+  int _result;  // what its wait returns, once resumed
+
+  struct kc_fiber_t* _prev;        // the other fibers that didn't return
+  struct kc_fiber_t* _next;
+  struct kc_fiber_t* _ready_next;  // the next ready one (or the next kept one)
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_fiber_scheduler_t
+{
+  int    fd;          // readable when a socket some fiber waits for is ready
+  size_t stack_size;  // of every fiber
+  size_t fibers;      // the ones that didn't return yet
+
+  struct kc_fiber_t* current;  // running now (NULL on the thread's own stack)
+
+  // called right before a fiber goes on, and with NULL once the thread is
+  // back on its own stack, to swap what's kept per thread (optional)
+  void (*switched)  (struct kc_fiber_t* fiber);
+
+  void* _context;  // where the thread stopped to run a fiber
+
+  struct kc_fiber_t* _fibers;  // the ones that didn't return
+  struct kc_fiber_t* _ready;
+  struct kc_fiber_t* _ready_tail;
+  struct kc_fiber_t* _kept;
+  size_t             _kept_len;
+
+  // start a fiber right away (or after the current one stops, when called
+  // on a fiber), it returns KC_SUCCESS once the entry returned and
+  // KC_PENDING while it waits, with the fiber (if asked for)
+  int (*spawn)   (struct kc_fiber_scheduler_t* self, void (*entry)(void* data), void* data,
+      struct kc_fiber_t** fiber);
+
+  // make a waiting fiber ready again, its wait returns the result
+  int (*resume)  (struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber, int result);
+
+  // run the ready fibers, in turn, until they all wait (or returned)
+  int (*run)     (struct kc_fiber_scheduler_t* self);
+
+  // the same, after waking up the fibers whose sockets are ready (waiting
+  // for them up to the timeout in milliseconds, -1 for no limit)
+  int (*poll)    (struct kc_fiber_scheduler_t* self, int timeout);
+};
+
+// the fibers that didn't return are given up with the scheduler (their
+// stacks are unmapped, whatever they held is not released)
+struct kc_fiber_scheduler_t* new_fiber_scheduler      (size_t stack_size);
+void                         destroy_fiber_scheduler  (struct kc_fiber_scheduler_t* scheduler);
+
+//---------------------------------------------------------------------------//
+
+// the fiber running on this thread (NULL on the thread's own stack)
+struct kc_fiber_t* kc_fiber_current  (void);
+
+// let the other ready fibers run first
+int kc_fiber_yield    (void);
+
+// stop until resumed, returns the result given to resume
+int kc_fiber_suspend  (void);
+
+// stop until the socket is ready (POLLIN, POLLOUT) or the fiber is resumed
+// (with the result given to resume); on the thread's own stack, it blocks
+// in poll instead, so the same code works on both
+int kc_fiber_wait     (int fd, short events);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_FIBER_T_H */
@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <time.h>
 
 //---------------------------------------------------------------------------//
 
@@ -41,6 +42,15 @@
 
 #define KC_MAX_PATH       257
 
+// the metadata of an opened file (see stat)
+struct kc_file_info_t
+{
+  size_t        size;      // the size of the file in bytes
+  time_t        modified;  // the time of the last modification
+  unsigned long inode;     // together with modified, tells if the file changed
+  bool          is_dir;    // the path is a directory
+};
+
 struct kc_file_t
 {
   struct kc_logger_t* _logger;
@@ -62,7 +72,10 @@ struct kc_file_t
   int (*move)         (struct kc_file_t* self, char* from, char* to);
   int (*open)         (struct kc_file_t* self, char* name, unsigned int mode);
   int (*read)         (struct kc_file_t* self, char** buffer);
+  int (*send)         (struct kc_file_t* self, int fd, size_t offset, size_t len);
+  int (*stat)         (struct kc_file_t* self, struct kc_file_info_t* info);
   int (*write)        (struct kc_file_t* self, char* buffer);
+  int (*write_bytes)  (struct kc_file_t* self, const char* buffer, size_t len);
 };
 
 struct kc_file_t* new_file      (void);
@@ -0,0 +1,84 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// timer_wheel.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A hierarchical timing wheel, for the timers that are set and cancelled far
+ * more often than they fire (ex: the deadlines of the connections).
+ *
+ * The time is cut into ticks. The first level has a slot for each of the
+ * next 64 ticks, and every level above a slot for 64 slots of the one below.
+ * A timer goes in the slot of its expiry, on the lowest level that reaches
+ * it, so adding and cancelling a timer are O(1); when the time gets to a slot
+ * of an upper level, its timers are spread over the levels below.
+ *
+ * The timers are kept by the caller (ex: inside a connection), the wheel
+ * allocates nothing for them. A wheel is not thread safe, it's meant to be
+ * used by a single thread (or under a lock).
+ */
+
+#ifndef KC_TIMER_WHEEL_T_H
+#define KC_TIMER_WHEEL_T_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+// 4 levels of 64 slots reach 64^4 ticks (about 19 days of 100 ms ticks),
+// a timer that expires later waits at the end of the last level, and is
+// placed again every time it comes down, until it is due
+#define KC_TIMER_WHEEL_LEVELS                                                 4
+#define KC_TIMER_WHEEL_SLOT_BITS                                              6
+#define KC_TIMER_WHEEL_SLOTS                     (1 << KC_TIMER_WHEEL_SLOT_BITS)
+
+//---------------------------------------------------------------------------//
+
+struct kc_timer_t
+{
+  uint64_t expires;  // the tick it fires at
+
+  void (*callback)  (struct kc_timer_t* timer);
+  void* data;        // for the callback
+
+  struct kc_timer_t*  _prev;
+  struct kc_timer_t*  _next;
+  struct kc_timer_t** _slot;  // NULL while the timer is not pending
+};
+
+// prepare a timer before it's added for the first time
+void kc_timer_init     (struct kc_timer_t* timer, void (*callback)(struct kc_timer_t* timer), void* data);
+bool kc_timer_pending  (struct kc_timer_t* timer);
+
+//---------------------------------------------------------------------------//
+
+struct kc_timer_wheel_t
+{
+  unsigned tick;   // the milliseconds of a tick
+  uint64_t start;  // when the tick 0 began, in milliseconds
+  uint64_t now;    // the last tick reached
+  size_t   size;   // the pending timers
+
+  struct kc_timer_t* _slots[KC_TIMER_WHEEL_LEVELS][KC_TIMER_WHEEL_SLOTS];
+
+  // the times are in milliseconds, on the same clock as the start (ex: the
+  // monotonic clock); a pending timer that is added again is moved
+  int  (*add)      (struct kc_timer_wheel_t* self, struct kc_timer_t* timer, uint64_t expires);
+  int  (*cancel)   (struct kc_timer_wheel_t* self, struct kc_timer_t* timer);
+
+  // move the time forward, firing the expired timers (their callbacks can
+  // add and cancel timers), returns how many were fired
+  int  (*advance)  (struct kc_timer_wheel_t* self, uint64_t now);
+};
+
+struct kc_timer_wheel_t* new_timer_wheel      (unsigned tick, uint64_t start);
+void                     destroy_timer_wheel  (struct kc_timer_wheel_t* wheel);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_TIMER_WHEEL_T_H */
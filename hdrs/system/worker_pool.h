@@ -0,0 +1,79 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// worker_pool.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A pool of threads for the work that blocks or takes long (ex: reading a
+ * file, hashing a large body), kept apart from the threads that serve the
+ * sockets, so the slow work can't hold them.
+ *
+ * The work is queued and taken in order by the first thread that is free.
+ * The queue has a size: once it's full the work is refused right away, so
+ * the caller can give up (ex: with 503 Service Unavailable) instead of
+ * piling up more than the threads will ever get to.
+ *
+ * The pool counts what it does, the counters can be read at any time: the
+ * work queued, the threads busy, the work done and refused, and the time
+ * the work waited in the queue (in a histogram, see histogram.h).
+ */
+
+#ifndef KC_WORKER_POOL_T_H
+#define KC_WORKER_POOL_T_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+//---------------------------------------------------------------------------//
+
+// the threads and the size of the queue, when they are not given
+#define KC_WORKER_POOL_THREADS                                                4
+#define KC_WORKER_POOL_QUEUE_SIZE                                          1024
+
+//---------------------------------------------------------------------------//
+
+struct kc_work_t;
+struct kc_histogram_t;
+
+//---------------------------------------------------------------------------//
+
+struct kc_worker_pool_t
+{
+  size_t threads;     // started by new_worker_pool
+  size_t queue_size;  // the most work waiting at once
+
+  // the counters, updated by the pool (can be read at any time)
+  size_t   queued;   // waiting for a thread
+  size_t   busy;     // the threads running some work
+  uint64_t done;
+  uint64_t refused;  // the queue was full
+
+  // the nanoseconds the work waited in the queue
+  struct kc_histogram_t* waits;
+
+  // the work waiting, in a ring
+  struct kc_work_t* _queue;
+  size_t            _head;
+
+  pthread_t*      _threads;
+  pthread_mutex_t _lock;
+  pthread_cond_t  _available;  // some work was queued (or the pool stops)
+  bool            _stopping;
+
+  // queue the work for the first thread free, KC_OVERFLOW when the queue
+  // is full (the work is then not run)
+  int (*submit)  (struct kc_worker_pool_t* self, void (*work)(void* data), void* data);
+};
+
+// the work still queued is done before the threads are joined
+struct kc_worker_pool_t* new_worker_pool      (size_t threads, size_t queue_size);
+void                     destroy_worker_pool  (struct kc_worker_pool_t* pool);
+
+//---------------------------------------------------------------------------//
+
+#endif /* KC_WORKER_POOL_T_H */
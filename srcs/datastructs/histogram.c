@@ -0,0 +1,460 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// histogram.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/datastructs/histogram.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the first byte of a serialized histogram
+#define KC_HISTOGRAM_VERSION                                                  1
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static void     record_histogram         (struct kc_histogram_t* self, uint64_t value);
+static void     record_atomic_histogram  (struct kc_histogram_t* self, uint64_t value);
+static int      merge_histogram          (struct kc_histogram_t* self, struct kc_histogram_t* other);
+static void     reset_histogram          (struct kc_histogram_t* self);
+static uint64_t percentile_histogram     (struct kc_histogram_t* self, double percentile);
+static uint64_t count_below_histogram    (struct kc_histogram_t* self, uint64_t limit);
+static int      serialize_histogram      (struct kc_histogram_t* self, char** data, size_t* len);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static size_t   _bucket      (struct kc_histogram_t* self, uint64_t value);
+static uint64_t _bucket_top  (struct kc_histogram_t* self, size_t bucket);
+static size_t   _put_varint  (char* data, uint64_t value);
+static bool     _get_varint  (const char* data, size_t len, size_t* offset, uint64_t* value);
+
+//---------------------------------------------------------------------------//
+
+struct kc_histogram_t* new_histogram(int precision, int max_bits)
+{
+  if (precision < 1 || precision > KC_HISTOGRAM_MAX_PRECISION ||
+      max_bits <= precision || max_bits > KC_HISTOGRAM_MAX_BITS)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
+  // create a histogram instance to be returned
+  struct kc_histogram_t* new_histogram = malloc(sizeof(struct kc_histogram_t));
+
+  // confirm that there is memory to allocate
+  if (new_histogram == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  // a bucket for each of the smallest values, then 2^precision for every
+  // power of 2 above them
+  new_histogram->precision   = precision;
+  new_histogram->max_bits    = max_bits;
+  new_histogram->buckets_len = (size_t)(max_bits - precision + 1) << precision;
+
+  new_histogram->buckets = calloc(new_histogram->buckets_len, sizeof(uint64_t));
+  if (new_histogram->buckets == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    free(new_histogram);
+
+    return NULL;
+  }
+
+  new_histogram->count = 0;
+  new_histogram->sum   = 0;
+  new_histogram->min   = UINT64_MAX;
+  new_histogram->max   = 0;
+
+  // assigns the public member methods
+  new_histogram->record        = record_histogram;
+  new_histogram->record_atomic = record_atomic_histogram;
+  new_histogram->merge         = merge_histogram;
+  new_histogram->reset         = reset_histogram;
+  new_histogram->percentile    = percentile_histogram;
+  new_histogram->count_below   = count_below_histogram;
+  new_histogram->serialize     = serialize_histogram;
+
+  return new_histogram;
+}
+
+//---------------------------------------------------------------------------//
+
+struct kc_histogram_t* deserialize_histogram(const char* data, size_t len)
+{
+  if (data == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  size_t offset = 0;
+  uint64_t header[7];
+
+  // the version, the layout and the totals
+  for (int i = 0; i < 7; ++i)
+  {
+    if (_get_varint(data, len, &offset, &header[i]) == false)
+    {
+      log_error(KC_FORMAT_ERROR_LOG);
+      return NULL;
+    }
+  }
+
+  if (header[0] != KC_HISTOGRAM_VERSION || header[1] > KC_HISTOGRAM_MAX_PRECISION || header[2] > KC_HISTOGRAM_MAX_BITS)
+  {
+    log_error(KC_FORMAT_ERROR_LOG);
+    return NULL;
+  }
+
+  struct kc_histogram_t* histogram = new_histogram((int)header[1], (int)header[2]);
+  if (histogram == NULL)
+  {
+    return NULL;
+  }
+
+  histogram->count = header[3];
+  histogram->sum   = header[4];
+  histogram->min   = header[5];
+  histogram->max   = header[6];
+
+  // the buckets in use, each after the number of empty ones before it
+  size_t bucket = 0;
+  uint64_t count = 0;
+
+  while (offset < len)
+  {
+    uint64_t skip  = 0;
+    uint64_t value = 0;
+
+    if (_get_varint(data, len, &offset, &skip) == false ||
+        _get_varint(data, len, &offset, &value) == false ||
+        skip >= histogram->buckets_len - bucket || value == 0)
+    {
+      log_error(KC_FORMAT_ERROR_LOG);
+      destroy_histogram(histogram);
+
+      return NULL;
+    }
+
+    bucket += skip;
+    histogram->buckets[bucket++] = value;
+    count += value;
+  }
+
+  if (count != histogram->count)
+  {
+    log_error(KC_DATA_CORRUPTION_LOG);
+    destroy_histogram(histogram);
+
+    return NULL;
+  }
+
+  return histogram;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_histogram(struct kc_histogram_t* histogram)
+{
+  if (histogram == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  free(histogram->buckets);
+  free(histogram);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static void record_histogram(struct kc_histogram_t* self, uint64_t value)
+{
+  self->buckets[_bucket(self, value)] += 1;
+  self->count += 1;
+  self->sum   += value;
+
+  if (value < self->min)
+  {
+    self->min = value;
+  }
+
+  if (value > self->max)
+  {
+    self->max = value;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void record_atomic_histogram(struct kc_histogram_t* self, uint64_t value)
+{
+  __atomic_fetch_add(&self->buckets[_bucket(self, value)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&self->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&self->sum, value, __ATOMIC_RELAXED);
+
+  // the extremes change rarely, once the first values are in
+  uint64_t min = __atomic_load_n(&self->min, __ATOMIC_RELAXED);
+  while (value < min && __atomic_compare_exchange_n(&self->min, &min, value,
+      true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false);
+
+  uint64_t max = __atomic_load_n(&self->max, __ATOMIC_RELAXED);
+  while (value > max && __atomic_compare_exchange_n(&self->max, &max, value,
+      true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false);
+}
+
+//---------------------------------------------------------------------------//
+
+static int merge_histogram(struct kc_histogram_t* self, struct kc_histogram_t* other)
+{
+  if (self == NULL || other == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (self->precision != other->precision || self->max_bits != other->max_bits)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // the other one can be recorded into meanwhile, so its values are read
+  // one by one (and its total can be off by the values in flight)
+  for (size_t i = 0; i < self->buckets_len; ++i)
+  {
+    self->buckets[i] += __atomic_load_n(&other->buckets[i], __ATOMIC_RELAXED);
+  }
+
+  self->count += __atomic_load_n(&other->count, __ATOMIC_RELAXED);
+  self->sum   += __atomic_load_n(&other->sum, __ATOMIC_RELAXED);
+
+  uint64_t min = __atomic_load_n(&other->min, __ATOMIC_RELAXED);
+  uint64_t max = __atomic_load_n(&other->max, __ATOMIC_RELAXED);
+
+  self->min = (min < self->min) ? min : self->min;
+  self->max = (max > self->max) ? max : self->max;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void reset_histogram(struct kc_histogram_t* self)
+{
+  memset(self->buckets, 0, self->buckets_len * sizeof(uint64_t));
+
+  self->count = 0;
+  self->sum   = 0;
+  self->min   = UINT64_MAX;
+  self->max   = 0;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t percentile_histogram(struct kc_histogram_t* self, double percentile)
+{
+  uint64_t count = 0;
+
+  // the count can be read apart from the buckets, they are summed up again
+  for (size_t i = 0; i < self->buckets_len; ++i)
+  {
+    count += self->buckets[i];
+  }
+
+  if (count == 0)
+  {
+    return 0;
+  }
+
+  percentile = (percentile < 0) ? 0 : (percentile > 100) ? 100 : percentile;
+
+  // the rank of the value, the first one for the 0th percentile
+  uint64_t rank = (uint64_t)(percentile / 100 * count + 0.5);
+  rank = (rank == 0) ? 1 : rank;
+
+  uint64_t seen = 0;
+  size_t bucket = self->buckets_len - 1;
+
+  for (size_t i = 0; i < self->buckets_len; ++i)
+  {
+    seen += self->buckets[i];
+
+    if (seen >= rank)
+    {
+      bucket = i;
+      break;
+    }
+  }
+
+  // no value is above the highest one recorded
+  uint64_t top = _bucket_top(self, bucket);
+  return (self->max > 0 && top > self->max) ? self->max : top;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t count_below_histogram(struct kc_histogram_t* self, uint64_t limit)
+{
+  uint64_t count = 0;
+
+  for (size_t i = 0; i < self->buckets_len && _bucket_top(self, i) <= limit; ++i)
+  {
+    count += self->buckets[i];
+  }
+
+  return count;
+}
+
+//---------------------------------------------------------------------------//
+
+static int serialize_histogram(struct kc_histogram_t* self, char** data, size_t* len)
+{
+  if (self == NULL || data == NULL || len == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  size_t used = 0;
+
+  for (size_t i = 0; i < self->buckets_len; ++i)
+  {
+    used += (self->buckets[i] != 0);
+  }
+
+  // a varint takes at most 10 bytes, the header has 7 and every bucket 2
+  char* buffer = malloc((7 + used * 2) * 10);
+  if (buffer == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return KC_OUT_OF_MEMORY;
+  }
+
+  size_t offset = 0;
+
+  offset += _put_varint(buffer + offset, KC_HISTOGRAM_VERSION);
+  offset += _put_varint(buffer + offset, (uint64_t)self->precision);
+  offset += _put_varint(buffer + offset, (uint64_t)self->max_bits);
+  offset += _put_varint(buffer + offset, self->count);
+  offset += _put_varint(buffer + offset, self->sum);
+  offset += _put_varint(buffer + offset, self->min);
+  offset += _put_varint(buffer + offset, self->max);
+
+  size_t skip = 0;
+
+  for (size_t i = 0; i < self->buckets_len; ++i)
+  {
+    if (self->buckets[i] == 0)
+    {
+      ++skip;
+      continue;
+    }
+
+    offset += _put_varint(buffer + offset, skip);
+    offset += _put_varint(buffer + offset, self->buckets[i]);
+
+    skip = 0;
+  }
+
+  (*data) = buffer;
+  (*len)  = offset;
+
+  return KC_SUCCESS;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static size_t _bucket(struct kc_histogram_t* self, uint64_t value)
+{
+  int precision = self->precision;
+
+  // the small values have a bucket each
+  if (value < ((uint64_t)2 << precision))
+  {
+    return (size_t)value;
+  }
+
+  int bits = 63 - __builtin_clzll(value);
+
+  // the values beyond the range share the last bucket
+  if (bits >= self->max_bits)
+  {
+    return self->buckets_len - 1;
+  }
+
+  // the power of 2 picks the group, the next bits the bucket in it
+  return ((size_t)(bits - precision) << precision) + (size_t)(value >> (bits - precision));
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t _bucket_top(struct kc_histogram_t* self, size_t bucket)
+{
+  int precision = self->precision;
+
+  if (bucket < ((size_t)2 << precision))
+  {
+    return bucket;
+  }
+
+  int bits  = (int)(bucket >> precision) + precision - 1;
+  int shift = bits - precision;
+
+  uint64_t sub = (uint64_t)(bucket & (((size_t)1 << precision) - 1)) + ((uint64_t)1 << precision);
+
+  // the highest value that falls in the bucket (it wraps to the highest
+  // value of all for the last bucket of 64 bits)
+  return ((sub + 1) << shift) - 1;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t _put_varint(char* data, uint64_t value)
+{
+  size_t len = 0;
+
+  // 7 bits at a time, the lowest first, the high bit set on all but the last
+  while (value >= 0x80)
+  {
+    data[len++] = (char)((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+
+  data[len++] = (char)value;
+
+  return len;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _get_varint(const char* data, size_t len, size_t* offset, uint64_t* value)
+{
+  uint64_t result = 0;
+
+  for (int shift = 0; shift < 64 && *offset < len; shift += 7)
+  {
+    unsigned char byte = (unsigned char)data[(*offset)++];
+    result |= (uint64_t)(byte & 0x7F) << shift;
+
+    if ((byte & 0x80) == 0)
+    {
+      (*value) = result;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//---------------------------------------------------------------------------//
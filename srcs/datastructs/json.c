@@ -0,0 +1,1268 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// json.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/datastructs/json.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//--- MARK: TAPE FORMAT -----------------------------------------------------//
+
+/*
+ * Every word on the tape holds the type of the value in the highest 8 bits
+ * and a payload in the lowest 56 bits:
+ *
+ *  - '{' and '[' : the index after the matching closing word (32 bits) and
+ *                  the number of children (24 bits, saturated)
+ *  - '}' and ']' : the index of the matching opening word
+ *  - '"'         : the offset of the string in the strings buffer
+ *  - 'l' and 'd' : nothing, the value is stored raw in the next word
+ *  - 't', 'f', 'n' : nothing
+ */
+
+#define _TAPE_WORD(type, payload)  (((uint64_t)(type) << 56) | (payload))
+#define _TAPE_TYPE(word)           ((char)((word) >> 56))
+#define _TAPE_PAYLOAD(word)        ((word) & 0x00FFFFFFFFFFFFFFULL)
+#define _TAPE_END(word)            ((size_t)((word) & 0xFFFFFFFFULL))
+#define _TAPE_COUNT(word)          ((size_t)(((word) >> 32) & 0xFFFFFFULL))
+
+#define _TAPE_MAX_COUNT            0xFFFFFFULL
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int parse_json  (struct kc_json_t* self, const char* buffer, size_t len);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+struct _json_masks_t
+{
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t op;
+  uint64_t ws;
+};
+
+static void     _classify_block   (const unsigned char* block, struct _json_masks_t* masks);
+static uint64_t _odd_backslashes  (uint64_t backslash, uint64_t* prev_ends_odd);
+static uint64_t _prefix_xor       (uint64_t bits);
+static int      _find_structurals (const char* buffer, size_t len, uint32_t* indexes, size_t* count);
+static int      _build_tape       (struct kc_json_t* self, const char* buffer, size_t len, const uint32_t* indexes, size_t count);
+static int      _parse_string     (struct kc_json_t* self, const char* src, const char* end, size_t* strings_len);
+static int      _parse_number     (struct kc_json_t* self, const char* src, const char* end);
+static int      _parse_literal    (struct kc_json_t* self, const char* src, const char* end);
+static size_t   _skip_value       (const uint64_t* tape, size_t index);
+static bool     _is_delimiter     (char c);
+
+//---------------------------------------------------------------------------//
+
+struct kc_json_t* new_json(struct kc_arena_t* arena)
+{
+  if (arena == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  // the document lives in the arena, there is no destroy function
+  struct kc_json_t* new_json = arena->alloc(arena, sizeof(struct kc_json_t));
+
+  // confirm that there is memory to allocate
+  if (new_json == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_json->_arena   = arena;
+  new_json->tape     = NULL;
+  new_json->tape_len = 0;
+  new_json->strings  = NULL;
+
+  // assigns the public member methods
+  new_json->parse = parse_json;
+
+  return new_json;
+}
+
+//---------------------------------------------------------------------------//
+
+static int parse_json(struct kc_json_t* self, const char* buffer, size_t len)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (buffer == NULL || len == 0 || len >= UINT32_MAX)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  struct kc_arena_t* arena = self->_arena;
+
+  // there can't be more tokens than bytes
+  uint32_t* indexes = arena->alloc(arena, sizeof(uint32_t) * (len + 1));
+  if (indexes == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // stage 1: find the position of every token
+  size_t count = 0;
+  int ret = _find_structurals(buffer, len, indexes, &count);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  if (count == 0)
+  {
+    return KC_PARSE_ERROR;
+  }
+
+  // a token is never written on more than two words, and a string never
+  // grows after unescaping (+ the length prefix, the NUL and a SIMD lane)
+  self->tape    = arena->alloc(arena, sizeof(uint64_t) * (count * 2));
+  self->strings = arena->alloc(arena, len + (count * 5) + 16);
+
+  if (self->tape == NULL || self->strings == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  self->tape_len = 0;
+
+  // stage 2: walk the tokens and write the document on the tape
+  return _build_tape(self, buffer, len, indexes, count);
+}
+
+//---------------------------------------------------------------------------//
+
+int json_root(const struct kc_json_t* json, struct kc_json_cursor_t* root)
+{
+  if (json == NULL || root == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // nothing was parsed yet
+  if (json->tape_len == 0)
+  {
+    return KC_EMPTY_STRUCTURE;
+  }
+
+  root->json   = json;
+  root->index  = 0;
+  root->parent = 0;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_type(struct kc_json_cursor_t cursor)
+{
+  if (cursor.json == NULL || cursor.index >= cursor.json->tape_len)
+  {
+    return KC_INVALID;
+  }
+
+  return _TAPE_TYPE(cursor.json->tape[cursor.index]);
+}
+
+//---------------------------------------------------------------------------//
+
+int json_size(struct kc_json_cursor_t cursor, size_t* size)
+{
+  if (size == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int type = json_type(cursor);
+
+  if (type == KC_JSON_STRING)
+  {
+    return json_get_string(cursor, NULL, size);
+  }
+
+  if (type != KC_JSON_ARRAY && type != KC_JSON_OBJECT)
+  {
+    return KC_INVALID;
+  }
+
+  uint64_t word = cursor.json->tape[cursor.index];
+
+  // the count is stored on the opening word, unless it was too big
+  if (_TAPE_COUNT(word) < _TAPE_MAX_COUNT)
+  {
+    (*size) = _TAPE_COUNT(word);
+    return KC_SUCCESS;
+  }
+
+  struct kc_json_cursor_t child;
+  size_t len = 0;
+
+  int ret = json_first(cursor, &child);
+  while (ret == KC_SUCCESS)
+  {
+    ++len;
+    ret = json_next(child, &child);
+  }
+
+  (*size) = len;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_get(struct kc_json_cursor_t cursor, const char* key, struct kc_json_cursor_t* value)
+{
+  if (key == NULL || value == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  if (json_type(cursor) != KC_JSON_OBJECT)
+  {
+    return KC_INVALID;
+  }
+
+  size_t key_len = strlen(key);
+
+  struct kc_json_cursor_t child;
+  int ret = json_first(cursor, &child);
+
+  // compare the length first, then the bytes
+  while (ret == KC_SUCCESS)
+  {
+    const char* member_key = NULL;
+    size_t member_len = 0;
+
+    json_key(child, &member_key, &member_len);
+
+    if (member_len == key_len && memcmp(member_key, key, key_len) == 0)
+    {
+      (*value) = child;
+      return KC_SUCCESS;
+    }
+
+    ret = json_next(child, &child);
+  }
+
+  // the key was not found
+  return KC_INVALID;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_at(struct kc_json_cursor_t cursor, size_t index, struct kc_json_cursor_t* value)
+{
+  if (value == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  if (json_type(cursor) != KC_JSON_ARRAY)
+  {
+    return KC_INVALID;
+  }
+
+  struct kc_json_cursor_t child;
+  int ret = json_first(cursor, &child);
+
+  // the values are skipped in constant time
+  for (size_t i = 0; i < index && ret == KC_SUCCESS; ++i)
+  {
+    ret = json_next(child, &child);
+  }
+
+  if (ret != KC_SUCCESS)
+  {
+    return KC_INDEX_OUT_OF_BOUNDS;
+  }
+
+  (*value) = child;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_first(struct kc_json_cursor_t cursor, struct kc_json_cursor_t* child)
+{
+  if (child == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int type = json_type(cursor);
+  if (type != KC_JSON_ARRAY && type != KC_JSON_OBJECT)
+  {
+    return KC_INVALID;
+  }
+
+  size_t first = cursor.index + 1;
+
+  // the container is empty
+  char first_type = _TAPE_TYPE(cursor.json->tape[first]);
+  if (first_type == '}' || first_type == ']')
+  {
+    return KC_INDEX_OUT_OF_BOUNDS;
+  }
+
+  child->json   = cursor.json;
+  child->parent = (char)type;
+
+  // the cursor of a member points to the value, the key is right before it
+  child->index = (type == KC_JSON_OBJECT) ? first + 1 : first;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_next(struct kc_json_cursor_t cursor, struct kc_json_cursor_t* sibling)
+{
+  if (sibling == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // the root has no siblings
+  if (json_type(cursor) == KC_INVALID || cursor.parent == 0)
+  {
+    return KC_INVALID;
+  }
+
+  size_t next = _skip_value(cursor.json->tape, cursor.index);
+
+  // the end of the parent was reached
+  char next_type = _TAPE_TYPE(cursor.json->tape[next]);
+  if (next_type == '}' || next_type == ']')
+  {
+    return KC_INDEX_OUT_OF_BOUNDS;
+  }
+
+  sibling->json   = cursor.json;
+  sibling->parent = cursor.parent;
+  sibling->index  = (cursor.parent == KC_JSON_OBJECT) ? next + 1 : next;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_key(struct kc_json_cursor_t cursor, const char** key, size_t* len)
+{
+  if (json_type(cursor) == KC_INVALID || cursor.parent != KC_JSON_OBJECT)
+  {
+    return KC_INVALID;
+  }
+
+  struct kc_json_cursor_t key_cursor = cursor;
+  key_cursor.index = cursor.index - 1;
+
+  return json_get_string(key_cursor, key, len);
+}
+
+//---------------------------------------------------------------------------//
+
+int json_query(struct kc_json_cursor_t cursor, const char* pointer, struct kc_json_cursor_t* value)
+{
+  if (pointer == NULL || value == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // the pointer is a JSON Pointer (RFC 6901), ex: /users/0/name
+  if (pointer[0] != '\0' && pointer[0] != '/')
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  struct kc_json_cursor_t current = cursor;
+  const char* token = pointer;
+
+  while (*token == '/')
+  {
+    ++token;
+
+    // decode the token, "~1" is '/' and "~0" is '~'
+    char name[256];
+    size_t name_len = 0;
+
+    while (*token != '\0' && *token != '/')
+    {
+      if (name_len == sizeof(name) - 1)
+      {
+        return KC_OVERFLOW;
+      }
+
+      if (token[0] == '~' && (token[1] == '0' || token[1] == '1'))
+      {
+        name[name_len++] = (token[1] == '0') ? '~' : '/';
+        token += 2;
+        continue;
+      }
+
+      name[name_len++] = *token++;
+    }
+
+    name[name_len] = '\0';
+
+    int ret = KC_INVALID;
+    int type = json_type(current);
+
+    if (type == KC_JSON_OBJECT)
+    {
+      ret = json_get(current, name, &current);
+    }
+    else if (type == KC_JSON_ARRAY)
+    {
+      // the array indexes are plain decimal numbers
+      char* name_end = NULL;
+      size_t index = strtoul(name, &name_end, 10);
+
+      if (name_len == 0 || *name_end != '\0' || name[0] == '-' || name[0] == '+')
+      {
+        return KC_INVALID_ARGUMENT;
+      }
+
+      ret = json_at(current, index, &current);
+    }
+
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
+  }
+
+  (*value) = current;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_get_string(struct kc_json_cursor_t cursor, const char** str, size_t* len)
+{
+  if (json_type(cursor) != KC_JSON_STRING)
+  {
+    return KC_INVALID;
+  }
+
+  // the string is prefixed by its length
+  const char* data = cursor.json->strings +
+      _TAPE_PAYLOAD(cursor.json->tape[cursor.index]);
+
+  uint32_t data_len = 0;
+  memcpy(&data_len, data, sizeof(uint32_t));
+
+  if (str != NULL)
+  {
+    (*str) = data + sizeof(uint32_t);
+  }
+
+  if (len != NULL)
+  {
+    (*len) = data_len;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_get_int(struct kc_json_cursor_t cursor, int64_t* val)
+{
+  if (val == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  if (json_type(cursor) != KC_JSON_INTEGER)
+  {
+    return KC_INVALID;
+  }
+
+  memcpy(val, &cursor.json->tape[cursor.index + 1], sizeof(int64_t));
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_get_double(struct kc_json_cursor_t cursor, double* val)
+{
+  if (val == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int type = json_type(cursor);
+
+  // the integers are converted too
+  if (type == KC_JSON_INTEGER)
+  {
+    int64_t int_val = 0;
+    json_get_int(cursor, &int_val);
+    (*val) = (double)int_val;
+
+    return KC_SUCCESS;
+  }
+
+  if (type != KC_JSON_DOUBLE)
+  {
+    return KC_INVALID;
+  }
+
+  memcpy(val, &cursor.json->tape[cursor.index + 1], sizeof(double));
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int json_get_bool(struct kc_json_cursor_t cursor, bool* val)
+{
+  if (val == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int type = json_type(cursor);
+  if (type != KC_JSON_TRUE && type != KC_JSON_FALSE)
+  {
+    return KC_INVALID;
+  }
+
+  (*val) = (type == KC_JSON_TRUE);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+bool json_is_null(struct kc_json_cursor_t cursor)
+{
+  return json_type(cursor) == KC_JSON_NULL;
+}
+
+//--- MARK: STAGE 1 ---------------------------------------------------------//
+
+static void _classify_block(const unsigned char* block, struct _json_masks_t* masks)
+{
+  masks->quote     = 0;
+  masks->backslash = 0;
+  masks->op        = 0;
+  masks->ws        = 0;
+
+#if defined(__SSE2__)
+  const __m128i quote     = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i lower     = _mm_set1_epi8(0x20);
+  const __m128i open      = _mm_set1_epi8('{');
+  const __m128i close     = _mm_set1_epi8('}');
+  const __m128i colon     = _mm_set1_epi8(':');
+  const __m128i comma     = _mm_set1_epi8(',');
+  const __m128i space     = _mm_set1_epi8(' ');
+  const __m128i tab       = _mm_set1_epi8('\t');
+  const __m128i new_line  = _mm_set1_epi8('\n');
+  const __m128i ret       = _mm_set1_epi8('\r');
+
+  // 4 lanes of 16 bytes make a 64-bit mask
+  for (int i = 0; i < 4; ++i)
+  {
+    __m128i chunk = _mm_loadu_si128((const __m128i*)(block + (i * 16)));
+
+    // '[' and ']' are '{' and '}' without the 0x20 bit
+    __m128i folded = _mm_or_si128(chunk, lower);
+
+    __m128i op = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma)));
+
+    __m128i ws = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, new_line), _mm_cmpeq_epi8(chunk, ret)));
+
+    int shift = i * 16;
+
+    masks->quote     |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)) << shift;
+    masks->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash)) << shift;
+    masks->op        |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << shift;
+    masks->ws        |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << shift;
+  }
+#else
+  for (int i = 0; i < 64; ++i)
+  {
+    uint64_t bit = 1ULL << i;
+
+    switch (block[i])
+    {
+      case '"':
+        masks->quote |= bit;
+        break;
+      case '\\':
+        masks->backslash |= bit;
+        break;
+      case '{': case '}': case '[': case ']': case ':': case ',':
+        masks->op |= bit;
+        break;
+      case ' ': case '\t': case '\n': case '\r':
+        masks->ws |= bit;
+        break;
+    }
+  }
+#endif
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t _odd_backslashes(uint64_t backslash, uint64_t* prev_ends_odd)
+{
+  // returns the characters that follow an odd-length
+  // sequence of backslashes (the escaped characters)
+  const uint64_t even_bits = 0x5555555555555555ULL;
+  const uint64_t odd_bits  = ~even_bits;
+
+  uint64_t start_edges = backslash & ~(backslash << 1);
+
+  // flip the parity if the previous block ended in an odd sequence
+  uint64_t even_start_mask = even_bits ^ (*prev_ends_odd);
+  uint64_t even_starts = start_edges & even_start_mask;
+  uint64_t odd_starts  = start_edges & ~even_start_mask;
+
+  uint64_t even_carries = backslash + even_starts;
+  uint64_t odd_carries  = backslash + odd_starts;
+
+  // the sequence continues in the next block
+  bool ends_odd = odd_carries < backslash;
+
+  odd_carries |= (*prev_ends_odd);
+  (*prev_ends_odd) = ends_odd ? 1ULL : 0ULL;
+
+  uint64_t even_carry_ends = even_carries & ~backslash;
+  uint64_t odd_carry_ends  = odd_carries & ~backslash;
+
+  return (even_carry_ends & odd_bits) | (odd_carry_ends & even_bits);
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t _prefix_xor(uint64_t bits)
+{
+  // every bit becomes the xor of itself and all the lower bits,
+  // so the bits between an opening and a closing quote are set
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+
+  return bits;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _find_structurals(const char* buffer, size_t len, uint32_t* indexes, size_t* count)
+{
+  uint64_t prev_ends_odd  = 0;
+  uint64_t prev_in_string = 0;
+  uint64_t prev_pred      = 1;  // the start of the input separates a token
+
+  size_t n = 0;
+
+  for (size_t base = 0; base < len; base += 64)
+  {
+    const unsigned char* block = (const unsigned char*)buffer + base;
+    unsigned char tail[64];
+
+    // pad the last block with white spaces
+    if (len - base < 64)
+    {
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, block, len - base);
+      block = tail;
+    }
+
+    struct _json_masks_t masks;
+    _classify_block(block, &masks);
+
+    // the escaped quotes don't open or close strings
+    uint64_t quote = masks.quote & ~_odd_backslashes(masks.backslash, &prev_ends_odd);
+
+    // the opening quote and the content of the strings
+    uint64_t in_string = _prefix_xor(quote) ^ prev_in_string;
+    prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+    // a scalar (number, true, false, null) starts after a separator
+    uint64_t pred   = masks.op | masks.ws | quote;
+    uint64_t scalar = ~pred & ~in_string;
+    uint64_t scalar_start = scalar & ((pred << 1) | prev_pred);
+    prev_pred = pred >> 63;
+
+    uint64_t structurals = (masks.op & ~in_string) | (quote & in_string) | scalar_start;
+
+    // flatten the bits into indexes
+    while (structurals != 0)
+    {
+      indexes[n++] = (uint32_t)(base + __builtin_ctzll(structurals));
+      structurals &= structurals - 1;
+    }
+  }
+
+  // the last string was never closed
+  if (prev_in_string != 0)
+  {
+    return KC_PARSE_ERROR;
+  }
+
+  (*count) = n;
+
+  return KC_SUCCESS;
+}
+
+//--- MARK: STAGE 2 ---------------------------------------------------------//
+
+enum
+{
+  _JSON_EXPECT_VALUE,
+  _JSON_EXPECT_KEY,
+  _JSON_AFTER_VALUE
+};
+
+static int _build_tape(struct kc_json_t* self, const char* buffer, size_t len, const uint32_t* indexes, size_t count)
+{
+  size_t stack[KC_JSON_MAX_DEPTH];
+  size_t children[KC_JSON_MAX_DEPTH];
+  size_t depth = 0;
+
+  size_t strings_len = 0;
+  const char* end = buffer + len;
+
+  int state = _JSON_EXPECT_VALUE;
+  size_t i = 0;
+
+  while (i < count)
+  {
+    const char* token = buffer + indexes[i];
+    int ret = KC_SUCCESS;
+
+    switch (state)
+    {
+      case _JSON_EXPECT_VALUE:
+        // count the value in its container
+        if (depth > 0)
+        {
+          ++children[depth - 1];
+        }
+        // the whole document is a single value
+        else if (self->tape_len > 0)
+        {
+          return KC_PARSE_ERROR;
+        }
+
+        if (*token == '{' || *token == '[')
+        {
+          if (depth == KC_JSON_MAX_DEPTH)
+          {
+            return KC_OVERFLOW;
+          }
+
+          // the opening word is completed when the container is closed
+          stack[depth] = self->tape_len;
+          children[depth] = 0;
+          ++depth;
+
+          self->tape[self->tape_len++] = _TAPE_WORD(*token, 0);
+          ++i;
+
+          // check for an empty container
+          char close = (*token == '{') ? '}' : ']';
+          if (i < count && buffer[indexes[i]] == close)
+          {
+            state = _JSON_AFTER_VALUE;
+            continue;
+          }
+
+          state = (*token == '{') ? _JSON_EXPECT_KEY : _JSON_EXPECT_VALUE;
+          continue;
+        }
+
+        if (*token == '"')
+        {
+          ret = _parse_string(self, token, end, &strings_len);
+        }
+        else if (*token == 't' || *token == 'f' || *token == 'n')
+        {
+          ret = _parse_literal(self, token, end);
+        }
+        else
+        {
+          ret = _parse_number(self, token, end);
+        }
+
+        if (ret != KC_SUCCESS)
+        {
+          return ret;
+        }
+
+        ++i;
+        state = _JSON_AFTER_VALUE;
+        break;
+
+      case _JSON_EXPECT_KEY:
+        if (*token != '"')
+        {
+          return KC_PARSE_ERROR;
+        }
+
+        ret = _parse_string(self, token, end, &strings_len);
+        if (ret != KC_SUCCESS)
+        {
+          return ret;
+        }
+
+        // the key must be followed by a colon
+        if (++i >= count || buffer[indexes[i]] != ':')
+        {
+          return KC_PARSE_ERROR;
+        }
+
+        ++i;
+        state = _JSON_EXPECT_VALUE;
+        break;
+
+      case _JSON_AFTER_VALUE:
+      {
+        // there is nothing after the document
+        if (depth == 0)
+        {
+          return KC_PARSE_ERROR;
+        }
+
+        char type = _TAPE_TYPE(self->tape[stack[depth - 1]]);
+
+        if (*token == ',')
+        {
+          ++i;
+          state = (type == '{') ? _JSON_EXPECT_KEY : _JSON_EXPECT_VALUE;
+          break;
+        }
+
+        if ((*token == '}' && type == '{') || (*token == ']' && type == '['))
+        {
+          --depth;
+
+          size_t start = stack[depth];
+          size_t size  = children[depth];
+
+          if (size > _TAPE_MAX_COUNT)
+          {
+            size = _TAPE_MAX_COUNT;
+          }
+
+          // write the closing word and complete the opening one
+          self->tape[self->tape_len++] = _TAPE_WORD(*token, start);
+          self->tape[start] = _TAPE_WORD(type, ((uint64_t)size << 32) | self->tape_len);
+
+          ++i;
+          break;
+        }
+
+        return KC_PARSE_ERROR;
+      }
+    }
+  }
+
+  // the document must be complete
+  if (depth != 0 || state != _JSON_AFTER_VALUE)
+  {
+    return KC_PARSE_ERROR;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _parse_string(struct kc_json_t* self, const char* src, const char* end, size_t* strings_len)
+{
+  // skip the opening quote
+  ++src;
+
+  size_t offset = (*strings_len);
+  char* dest = self->strings + offset + sizeof(uint32_t);
+  char* dest_start = dest;
+
+  for (;;)
+  {
+#if defined(__SSE2__)
+    // copy the runs without quotes, backslashes and control characters
+    while (end - src >= 16)
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i*)src);
+      _mm_storeu_si128((__m128i*)dest, chunk);
+
+      __m128i special = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))),
+          _mm_cmpeq_epi8(_mm_max_epu8(chunk, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F)));
+
+      int mask = _mm_movemask_epi8(special);
+      if (mask != 0)
+      {
+        int skip = __builtin_ctz(mask);
+        src  += skip;
+        dest += skip;
+        break;
+      }
+
+      src  += 16;
+      dest += 16;
+    }
+#endif
+
+    if (src >= end)
+    {
+      return KC_PARSE_ERROR;
+    }
+
+    unsigned char c = (unsigned char)*src;
+
+    if (c == '"')
+    {
+      break;
+    }
+
+    // the control characters must be escaped
+    if (c < 0x20)
+    {
+      return KC_PARSE_ERROR;
+    }
+
+    if (c != '\\')
+    {
+      *dest++ = *src++;
+      continue;
+    }
+
+    if (end - src < 2)
+    {
+      return KC_PARSE_ERROR;
+    }
+
+    char escaped = src[1];
+    src += 2;
+
+    switch (escaped)
+    {
+      case '"':  *dest++ = '"';  break;
+      case '\\': *dest++ = '\\'; break;
+      case '/':  *dest++ = '/';  break;
+      case 'b':  *dest++ = '\b'; break;
+      case 'f':  *dest++ = '\f'; break;
+      case 'n':  *dest++ = '\n'; break;
+      case 'r':  *dest++ = '\r'; break;
+      case 't':  *dest++ = '\t'; break;
+
+      case 'u':
+      {
+        unsigned int code_point = 0;
+
+        // read the four hex digits (and the low surrogate, if needed)
+        for (int pass = 0; pass < 2; ++pass)
+        {
+          if (end - src < 4)
+          {
+            return KC_PARSE_ERROR;
+          }
+
+          unsigned int unit = 0;
+          for (int j = 0; j < 4; ++j)
+          {
+            char h = src[j];
+            unit <<= 4;
+
+            if (h >= '0' && h <= '9')      unit |= h - '0';
+            else if (h >= 'a' && h <= 'f') unit |= h - 'a' + 10;
+            else if (h >= 'A' && h <= 'F') unit |= h - 'A' + 10;
+            else return KC_PARSE_ERROR;
+          }
+
+          src += 4;
+
+          if (pass == 0)
+          {
+            code_point = unit;
+
+            // a high surrogate must be followed by a low one
+            if (unit < 0xD800 || unit > 0xDBFF)
+            {
+              break;
+            }
+
+            if (end - src < 2 || src[0] != '\\' || src[1] != 'u')
+            {
+              return KC_PARSE_ERROR;
+            }
+
+            src += 2;
+          }
+          else
+          {
+            if (unit < 0xDC00 || unit > 0xDFFF)
+            {
+              return KC_PARSE_ERROR;
+            }
+
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (unit - 0xDC00);
+          }
+        }
+
+        // a lone low surrogate is invalid
+        if (code_point >= 0xDC00 && code_point <= 0xDFFF)
+        {
+          return KC_PARSE_ERROR;
+        }
+
+        // encode the code point as UTF-8
+        if (code_point < 0x80)
+        {
+          *dest++ = (char)code_point;
+        }
+        else if (code_point < 0x800)
+        {
+          *dest++ = (char)(0xC0 | (code_point >> 6));
+          *dest++ = (char)(0x80 | (code_point & 0x3F));
+        }
+        else if (code_point < 0x10000)
+        {
+          *dest++ = (char)(0xE0 | (code_point >> 12));
+          *dest++ = (char)(0x80 | ((code_point >> 6) & 0x3F));
+          *dest++ = (char)(0x80 | (code_point & 0x3F));
+        }
+        else
+        {
+          *dest++ = (char)(0xF0 | (code_point >> 18));
+          *dest++ = (char)(0x80 | ((code_point >> 12) & 0x3F));
+          *dest++ = (char)(0x80 | ((code_point >> 6) & 0x3F));
+          *dest++ = (char)(0x80 | (code_point & 0x3F));
+        }
+
+        break;
+      }
+
+      default:
+        return KC_PARSE_ERROR;
+    }
+  }
+
+  // write the length prefix and the NUL terminator
+  uint32_t len = (uint32_t)(dest - dest_start);
+  memcpy(self->strings + offset, &len, sizeof(uint32_t));
+  (*dest) = '\0';
+
+  (*strings_len) = offset + sizeof(uint32_t) + len + 1;
+
+  self->tape[self->tape_len++] = _TAPE_WORD(KC_JSON_STRING, offset);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _parse_number(struct kc_json_t* self, const char* src, const char* end)
+{
+  const char* start = src;
+
+  bool negative  = false;
+  bool is_double = false;
+
+  uint64_t value  = 0;
+  int      digits = 0;
+
+  if (src < end && *src == '-')
+  {
+    negative = true;
+    ++src;
+  }
+
+  if (src >= end || *src < '0' || *src > '9')
+  {
+    return KC_PARSE_ERROR;
+  }
+
+  // no leading zeros, except the zero itself
+  if (*src == '0')
+  {
+    ++src;
+  }
+  else
+  {
+    while (src < end && *src >= '0' && *src <= '9')
+    {
+      value = (value * 10) + (*src - '0');
+      ++digits;
+      ++src;
+    }
+  }
+
+  // the fraction
+  if (src < end && *src == '.')
+  {
+    ++src;
+    is_double = true;
+
+    if (src >= end || *src < '0' || *src > '9')
+    {
+      return KC_PARSE_ERROR;
+    }
+
+    while (src < end && *src >= '0' && *src <= '9')
+    {
+      ++src;
+    }
+  }
+
+  // the exponent
+  if (src < end && (*src == 'e' || *src == 'E'))
+  {
+    ++src;
+    is_double = true;
+
+    if (src < end && (*src == '+' || *src == '-'))
+    {
+      ++src;
+    }
+
+    if (src >= end || *src < '0' || *src > '9')
+    {
+      return KC_PARSE_ERROR;
+    }
+
+    while (src < end && *src >= '0' && *src <= '9')
+    {
+      ++src;
+    }
+  }
+
+  if (src < end && _is_delimiter(*src) == false)
+  {
+    return KC_PARSE_ERROR;
+  }
+
+  // the integers that fit in 64 bits are stored as they are
+  if (is_double == false && digits <= 19 &&
+      value <= (uint64_t)INT64_MAX + (negative ? 1 : 0))
+  {
+    int64_t int_val = negative ? (int64_t)(0 - value) : (int64_t)value;
+
+    self->tape[self->tape_len++] = _TAPE_WORD(KC_JSON_INTEGER, 0);
+    memcpy(&self->tape[self->tape_len++], &int_val, sizeof(int64_t));
+
+    return KC_SUCCESS;
+  }
+
+  // strtod needs a NUL terminated copy of the number
+  size_t len = src - start;
+  char local[64];
+  char* copy = local;
+
+  if (len >= sizeof(local))
+  {
+    copy = self->_arena->alloc(self->_arena, len + 1);
+    if (copy == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+  }
+
+  memcpy(copy, start, len);
+  copy[len] = '\0';
+
+  double double_val = strtod(copy, NULL);
+
+  self->tape[self->tape_len++] = _TAPE_WORD(KC_JSON_DOUBLE, 0);
+  memcpy(&self->tape[self->tape_len++], &double_val, sizeof(double));
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _parse_literal(struct kc_json_t* self, const char* src, const char* end)
+{
+  const char* literal = NULL;
+  char type = *src;
+
+  switch (type)
+  {
+    case 't': literal = "true";  break;
+    case 'f': literal = "false"; break;
+    default:  literal = "null";  break;
+  }
+
+  size_t len = strlen(literal);
+
+  if ((size_t)(end - src) < len || memcmp(src, literal, len) != 0)
+  {
+    return KC_PARSE_ERROR;
+  }
+
+  // the literal must end where the token ends
+  if (src + len < end && _is_delimiter(src[len]) == false)
+  {
+    return KC_PARSE_ERROR;
+  }
+
+  self->tape[self->tape_len++] = _TAPE_WORD(type, 0);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t _skip_value(const uint64_t* tape, size_t index)
+{
+  switch (_TAPE_TYPE(tape[index]))
+  {
+    case KC_JSON_OBJECT:
+    case KC_JSON_ARRAY:
+      return _TAPE_END(tape[index]);
+
+    case KC_JSON_INTEGER:
+    case KC_JSON_DOUBLE:
+      return index + 2;
+
+    default:
+      return index + 1;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _is_delimiter(char c)
+{
+  return c == ' '  || c == '\t' || c == '\n' || c == '\r' ||
+         c == ','  || c == ':'  || c == ']'  || c == '}'  ||
+         c == '['  || c == '{'  || c == '"';
+}
+
+//---------------------------------------------------------------------------//
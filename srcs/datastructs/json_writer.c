@@ -0,0 +1,882 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// json_writer.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/datastructs/json_writer.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int begin_object_writer  (struct kc_json_writer_t* self);
+static int end_object_writer    (struct kc_json_writer_t* self);
+static int begin_array_writer   (struct kc_json_writer_t* self);
+static int end_array_writer     (struct kc_json_writer_t* self);
+static int key_writer           (struct kc_json_writer_t* self, const char* key);
+static int string_writer        (struct kc_json_writer_t* self, const char* str);
+static int integer_writer       (struct kc_json_writer_t* self, int64_t val);
+static int number_writer        (struct kc_json_writer_t* self, double val);
+static int boolean_writer       (struct kc_json_writer_t* self, bool val);
+static int null_writer          (struct kc_json_writer_t* self);
+static int release_writer       (struct kc_json_writer_t* self, char** buffer, size_t* len);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int    _reserve        (struct kc_json_writer_t* self, size_t size);
+static int    _write_raw      (struct kc_json_writer_t* self, const char* raw, size_t len);
+static int    _write_escaped  (struct kc_json_writer_t* self, const char* str, size_t len);
+static size_t _format_uint    (char* dest, uint64_t val);
+static size_t _format_double  (char* dest, double val);
+
+//---------------------------------------------------------------------------//
+
+// every two-digit number, so the integers are formatted two digits at a time
+static const char _digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+//---------------------------------------------------------------------------//
+
+struct kc_json_writer_t* new_json_writer(size_t capacity)
+{
+  // create a writer instance to be returned
+  struct kc_json_writer_t* new_writer = malloc(sizeof(struct kc_json_writer_t));
+
+  // confirm that there is memory to allocate
+  if (new_writer == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_writer->buffer    = NULL;
+  new_writer->len       = 0;
+  new_writer->_capacity = 0;
+  new_writer->_comma    = false;
+
+  // reserve the buffer right away
+  if (_reserve(new_writer, (capacity > 0) ? capacity : KC_JSON_WRITER_CAPACITY) != KC_SUCCESS)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+
+    // free the writer instance
+    free(new_writer);
+
+    return NULL;
+  }
+
+  // assigns the public member methods
+  new_writer->begin_object = begin_object_writer;
+  new_writer->end_object   = end_object_writer;
+  new_writer->begin_array  = begin_array_writer;
+  new_writer->end_array    = end_array_writer;
+  new_writer->key          = key_writer;
+  new_writer->string       = string_writer;
+  new_writer->integer      = integer_writer;
+  new_writer->number       = number_writer;
+  new_writer->boolean      = boolean_writer;
+  new_writer->null         = null_writer;
+  new_writer->release      = release_writer;
+
+  return new_writer;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_json_writer(struct kc_json_writer_t* writer)
+{
+  if (writer == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // the buffer is NULL if it was released
+  free(writer->buffer);
+  free(writer);
+}
+
+//---------------------------------------------------------------------------//
+
+static int begin_object_writer(struct kc_json_writer_t* self)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int ret = _write_raw(self, self->_comma ? ",{" : "{", self->_comma ? 2 : 1);
+  self->_comma = false;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int end_object_writer(struct kc_json_writer_t* self)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  self->_comma = true;
+
+  return _write_raw(self, "}", 1);
+}
+
+//---------------------------------------------------------------------------//
+
+static int begin_array_writer(struct kc_json_writer_t* self)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int ret = _write_raw(self, self->_comma ? ",[" : "[", self->_comma ? 2 : 1);
+  self->_comma = false;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int end_array_writer(struct kc_json_writer_t* self)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  self->_comma = true;
+
+  return _write_raw(self, "]", 1);
+}
+
+//---------------------------------------------------------------------------//
+
+static int key_writer(struct kc_json_writer_t* self, const char* key)
+{
+  if (self == NULL || key == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // the key is written like a string, followed by a colon
+  int ret = string_writer(self, key);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  self->_comma = false;
+
+  return _write_raw(self, ":", 1);
+}
+
+//---------------------------------------------------------------------------//
+
+static int string_writer(struct kc_json_writer_t* self, const char* str)
+{
+  if (self == NULL || str == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  size_t len = strlen(str);
+
+  // the worst case is a "\u00XX" for every byte
+  int ret = _reserve(self, self->len + (len * 6) + 3);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  if (self->_comma)
+  {
+    self->buffer[self->len++] = ',';
+  }
+
+  self->buffer[self->len++] = '"';
+  _write_escaped(self, str, len);
+  self->buffer[self->len++] = '"';
+  self->buffer[self->len] = '\0';
+
+  self->_comma = true;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int integer_writer(struct kc_json_writer_t* self, int64_t val)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // a comma, a sign and 20 digits at most
+  int ret = _reserve(self, self->len + 23);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  char* dest = self->buffer + self->len;
+
+  if (self->_comma)
+  {
+    *dest++ = ',';
+  }
+
+  uint64_t abs_val = (uint64_t)val;
+  if (val < 0)
+  {
+    *dest++ = '-';
+    abs_val = 0 - abs_val;
+  }
+
+  dest += _format_uint(dest, abs_val);
+  (*dest) = '\0';
+
+  self->len = dest - self->buffer;
+  self->_comma = true;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int number_writer(struct kc_json_writer_t* self, double val)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // JSON has no representation for NaN and infinity
+  if (isnan(val) || isinf(val))
+  {
+    return null_writer(self);
+  }
+
+  // a comma and the longest double (ex: -2.2250738585072014e-308)
+  int ret = _reserve(self, self->len + 32);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  char* dest = self->buffer + self->len;
+
+  if (self->_comma)
+  {
+    *dest++ = ',';
+  }
+
+  dest += _format_double(dest, val);
+  (*dest) = '\0';
+
+  self->len = dest - self->buffer;
+  self->_comma = true;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int boolean_writer(struct kc_json_writer_t* self, bool val)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int ret = KC_SUCCESS;
+
+  if (self->_comma)
+  {
+    ret = _write_raw(self, val ? ",true" : ",false", val ? 5 : 6);
+  }
+  else
+  {
+    ret = _write_raw(self, val ? "true" : "false", val ? 4 : 5);
+  }
+
+  self->_comma = true;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int null_writer(struct kc_json_writer_t* self)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int ret = _write_raw(self, self->_comma ? ",null" : "null", self->_comma ? 5 : 4);
+  self->_comma = true;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int release_writer(struct kc_json_writer_t* self, char** buffer, size_t* len)
+{
+  if (self == NULL || buffer == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // the caller owns the buffer from now on
+  (*buffer) = self->buffer;
+
+  if (len != NULL)
+  {
+    (*len) = self->len;
+  }
+
+  // the next document starts with a new buffer
+  self->buffer    = NULL;
+  self->len       = 0;
+  self->_capacity = 0;
+  self->_comma    = false;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _reserve(struct kc_json_writer_t* self, size_t size)
+{
+  // keep room for the NUL terminator
+  if (size < self->_capacity)
+  {
+    return KC_SUCCESS;
+  }
+
+  // grow geometrically, so the appends are amortized O(1)
+  size_t capacity = (self->_capacity > 0) ? self->_capacity : KC_JSON_WRITER_CAPACITY;
+  while (capacity <= size)
+  {
+    capacity *= 2;
+  }
+
+  char* buffer = realloc(self->buffer, capacity);
+  if (buffer == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // a new (or released) buffer is an empty string
+  if (self->buffer == NULL)
+  {
+    buffer[0] = '\0';
+  }
+
+  self->buffer    = buffer;
+  self->_capacity = capacity;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _write_raw(struct kc_json_writer_t* self, const char* raw, size_t len)
+{
+  int ret = _reserve(self, self->len + len);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  memcpy(self->buffer + self->len, raw, len);
+  self->len += len;
+  self->buffer[self->len] = '\0';
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _write_escaped(struct kc_json_writer_t* self, const char* str, size_t len)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  char* dest = self->buffer + self->len;
+  const char* end = str + len;
+
+  while (str < end)
+  {
+#if defined(__SSE2__)
+    // copy 16 bytes at a time while there is nothing to escape
+    while (end - str >= 16)
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i*)str);
+
+      __m128i special = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))),
+          _mm_cmpeq_epi8(_mm_max_epu8(chunk, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F)));
+
+      _mm_storeu_si128((__m128i*)dest, chunk);
+
+      int mask = _mm_movemask_epi8(special);
+      if (mask != 0)
+      {
+        int skip = __builtin_ctz(mask);
+        str  += skip;
+        dest += skip;
+        break;
+      }
+
+      str  += 16;
+      dest += 16;
+    }
+
+    if (str >= end)
+    {
+      break;
+    }
+#endif
+
+    unsigned char c = (unsigned char)*str++;
+
+    if (c >= 0x20 && c != '"' && c != '\\')
+    {
+      *dest++ = (char)c;
+      continue;
+    }
+
+    *dest++ = '\\';
+
+    switch (c)
+    {
+      case '"':  *dest++ = '"';  break;
+      case '\\': *dest++ = '\\'; break;
+      case '\b': *dest++ = 'b';  break;
+      case '\f': *dest++ = 'f';  break;
+      case '\n': *dest++ = 'n';  break;
+      case '\r': *dest++ = 'r';  break;
+      case '\t': *dest++ = 't';  break;
+
+      default:
+        *dest++ = 'u';
+        *dest++ = '0';
+        *dest++ = '0';
+        *dest++ = hex[c >> 4];
+        *dest++ = hex[c & 0xF];
+        break;
+    }
+  }
+
+  self->len = dest - self->buffer;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t _format_uint(char* dest, uint64_t val)
+{
+  // write the digits backwards, two at a time
+  char tmp[20];
+  char* ptr = tmp + sizeof(tmp);
+
+  while (val >= 100)
+  {
+    unsigned int pair = (unsigned int)(val % 100) * 2;
+    val /= 100;
+
+    *--ptr = _digit_pairs[pair + 1];
+    *--ptr = _digit_pairs[pair];
+  }
+
+  if (val >= 10)
+  {
+    unsigned int pair = (unsigned int)val * 2;
+
+    *--ptr = _digit_pairs[pair + 1];
+    *--ptr = _digit_pairs[pair];
+  }
+  else
+  {
+    *--ptr = (char)('0' + val);
+  }
+
+  size_t len = tmp + sizeof(tmp) - ptr;
+  memcpy(dest, ptr, len);
+
+  return len;
+}
+
+//--- MARK: GRISU2 ----------------------------------------------------------//
+
+/*
+ * Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers") works on "do-it-yourself" floating points: a
+ * 64-bit significand and a binary exponent. The double and its boundaries
+ * are scaled by a cached power of ten, so the digits can be generated with
+ * integer arithmetic only. The result always converts back to the same
+ * double and is the shortest representation in the vast majority of cases.
+ */
+
+struct _diy_fp_t
+{
+  uint64_t f;  // the significand
+  int e;       // the binary exponent
+};
+
+#define _DP_SIGNIFICAND_SIZE  52
+#define _DP_EXPONENT_BIAS     (0x3FF + _DP_SIGNIFICAND_SIZE)
+#define _DP_MIN_EXPONENT      (-_DP_EXPONENT_BIAS)
+#define _DP_HIDDEN_BIT        0x0010000000000000ULL
+#define _DP_SIGNIFICAND_MASK  0x000FFFFFFFFFFFFFULL
+#define _DP_EXPONENT_MASK     0x7FF0000000000000ULL
+
+// the normalized powers of ten from 10^-348 to 10^340, in steps of 8
+static const uint64_t _cached_powers_f[] =
+{
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t _cached_powers_e[] =
+{
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007,  -980,
+   -954,  -927,  -901,  -874,  -847,  -821,  -794,  -768,  -741,  -715,
+   -688,  -661,  -635,  -608,  -582,  -555,  -529,  -502,  -475,  -449,
+   -422,  -396,  -369,  -343,  -316,  -289,  -263,  -236,  -210,  -183,
+   -157,  -130,  -103,   -77,   -50,   -24,     3,    30,    56,    83,
+    109,   136,   162,   189,   216,   242,   269,   295,   322,   348,
+    375,   402,   428,   455,   481,   508,   534,   561,   588,   614,
+    641,   667,   694,   720,   747,   774,   800,   827,   853,   880,
+    907,   933,   960,   986,  1013,  1039,  1066
+};
+
+static const uint32_t _pow10[] =
+{
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+//---------------------------------------------------------------------------//
+
+static struct _diy_fp_t _diy_fp_multiply(struct _diy_fp_t x, struct _diy_fp_t y)
+{
+  // the upper 64 bits of the 128-bit product, rounded
+  const uint64_t mask = 0xFFFFFFFFULL;
+
+  uint64_t a = x.f >> 32;
+  uint64_t b = x.f & mask;
+  uint64_t c = y.f >> 32;
+  uint64_t d = y.f & mask;
+
+  uint64_t ac = a * c;
+  uint64_t bc = b * c;
+  uint64_t ad = a * d;
+  uint64_t bd = b * d;
+
+  uint64_t tmp = (bd >> 32) + (ad & mask) + (bc & mask);
+  tmp += 1ULL << 31;
+
+  struct _diy_fp_t result = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+
+  return result;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct _diy_fp_t _diy_fp_normalize(struct _diy_fp_t x)
+{
+  int shift = __builtin_clzll(x.f);
+
+  x.f <<= shift;
+  x.e -= shift;
+
+  return x;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _grisu_round(char* buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+  // move the last digit closer to the exact value while staying in range
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+      (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+  {
+    buffer[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _digit_gen(struct _diy_fp_t w, struct _diy_fp_t mp, uint64_t delta, char* buffer, int* len, int* k)
+{
+  struct _diy_fp_t one = { 1ULL << -mp.e, mp.e };
+  uint64_t wp_w = mp.f - w.f;
+
+  uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+
+  // the number of digits of the integral part
+  int kappa = 1;
+  while (kappa < 10 && p1 >= _pow10[kappa])
+  {
+    ++kappa;
+  }
+
+  (*len) = 0;
+
+  // the integral part
+  while (kappa > 0)
+  {
+    uint32_t d = p1 / _pow10[kappa - 1];
+    p1 %= _pow10[kappa - 1];
+
+    if (d != 0 || (*len) != 0)
+    {
+      buffer[(*len)++] = (char)('0' + d);
+    }
+
+    --kappa;
+
+    uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+    if (rest <= delta)
+    {
+      (*k) += kappa;
+      _grisu_round(buffer, *len, delta, rest, (uint64_t)_pow10[kappa] << -one.e, wp_w);
+      return;
+    }
+  }
+
+  // the fractional part
+  for (;;)
+  {
+    p2 *= 10;
+    delta *= 10;
+
+    char d = (char)(p2 >> -one.e);
+    if (d != 0 || (*len) != 0)
+    {
+      buffer[(*len)++] = (char)('0' + d);
+    }
+
+    p2 &= one.f - 1;
+    --kappa;
+
+    if (p2 < delta)
+    {
+      (*k) += kappa;
+      _grisu_round(buffer, *len, delta, p2, one.f, wp_w * ((-kappa < 10) ? _pow10[-kappa] : 0));
+      return;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _grisu2(double val, char* buffer, int* len, int* k)
+{
+  uint64_t bits = 0;
+  memcpy(&bits, &val, sizeof(double));
+
+  int biased_e = (int)((bits & _DP_EXPONENT_MASK) >> _DP_SIGNIFICAND_SIZE);
+  uint64_t significand = bits & _DP_SIGNIFICAND_MASK;
+
+  struct _diy_fp_t v;
+
+  if (biased_e != 0)
+  {
+    v.f = significand + _DP_HIDDEN_BIT;
+    v.e = biased_e - _DP_EXPONENT_BIAS;
+  }
+  else
+  {
+    v.f = significand;
+    v.e = _DP_MIN_EXPONENT + 1;
+  }
+
+  // the boundaries m- and m+, halfway to the neighbouring doubles
+  struct _diy_fp_t plus = { (v.f << 1) + 1, v.e - 1 };
+  plus = _diy_fp_normalize(plus);
+
+  struct _diy_fp_t minus;
+  if (v.f == _DP_HIDDEN_BIT)
+  {
+    minus.f = (v.f << 2) - 1;
+    minus.e = v.e - 2;
+  }
+  else
+  {
+    minus.f = (v.f << 1) - 1;
+    minus.e = v.e - 1;
+  }
+
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  // find the cached power that brings the exponent in [-60, -32]
+  double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+  int cached_k = (int)dk;
+  if (dk - cached_k > 0.0)
+  {
+    ++cached_k;
+  }
+
+  unsigned int index = (unsigned int)((cached_k >> 3) + 1);
+  (*k) = -(-348 + (int)(index << 3));
+
+  struct _diy_fp_t c_mk = { _cached_powers_f[index], _cached_powers_e[index] };
+
+  struct _diy_fp_t w  = _diy_fp_multiply(_diy_fp_normalize(v), c_mk);
+  struct _diy_fp_t wp = _diy_fp_multiply(plus, c_mk);
+  struct _diy_fp_t wm = _diy_fp_multiply(minus, c_mk);
+
+  // stay on the safe side of the boundaries
+  wm.f++;
+  wp.f--;
+
+  _digit_gen(w, wp, wp.f - wm.f, buffer, len, k);
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t _format_double(char* dest, double val)
+{
+  char* start = dest;
+
+  if (val == 0.0)
+  {
+    (*dest) = '0';
+    return 1;
+  }
+
+  if (val < 0)
+  {
+    *dest++ = '-';
+    val = -val;
+  }
+
+  // the digits and the decimal exponent: val = digits * 10^k
+  int len = 0;
+  int k = 0;
+  _grisu2(val, dest, &len, &k);
+
+  // the position of the decimal point: 10^(kk - 1) <= val < 10^kk
+  int kk = len + k;
+
+  if (k >= 0 && kk <= 21)
+  {
+    // 1234e7 -> 12340000000
+    for (int i = len; i < kk; ++i)
+    {
+      dest[i] = '0';
+    }
+
+    return (dest - start) + kk;
+  }
+
+  if (kk > 0 && kk <= 21)
+  {
+    // 1234e-2 -> 12.34
+    memmove(dest + kk + 1, dest + kk, len - kk);
+    dest[kk] = '.';
+
+    return (dest - start) + len + 1;
+  }
+
+  if (kk > -6 && kk <= 0)
+  {
+    // 1234e-6 -> 0.001234
+    int offset = 2 - kk;
+    memmove(dest + offset, dest, len);
+    dest[0] = '0';
+    dest[1] = '.';
+
+    for (int i = 2; i < offset; ++i)
+    {
+      dest[i] = '0';
+    }
+
+    return (dest - start) + len + offset;
+  }
+
+  // the scientific notation: 1e30 or 1.234e33
+  char* ptr = dest + 1;
+
+  if (len > 1)
+  {
+    memmove(dest + 2, dest + 1, len - 1);
+    dest[1] = '.';
+    ptr = dest + len + 1;
+  }
+
+  *ptr++ = 'e';
+
+  int exponent = kk - 1;
+  if (exponent < 0)
+  {
+    *ptr++ = '-';
+    exponent = -exponent;
+  }
+
+  ptr += _format_uint(ptr, (uint64_t)exponent);
+
+  return ptr - start;
+}
+
+//---------------------------------------------------------------------------//
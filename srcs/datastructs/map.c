@@ -52,6 +52,9 @@ struct kc_entry_t* new_entry(const char* key, void* val, size_t val_size)
   strcpy(new_entry->key, key);
   memcpy(new_entry->val, val, val_size);
 
+  // the entry is the last one of its slot
+  new_entry->next = NULL;
+
   return new_entry;
 }
 
@@ -79,10 +82,12 @@ void destroy_entry(struct kc_entry_t* entry)
 
 //---------------------------------------------------------------------------//
 
-int set_map_key  (struct kc_map_t* self, const char* key, void* val, size_t val_size);
-int get_map_val  (struct kc_map_t* self, const char* key, void** val);
+int set_map_key     (struct kc_map_t* self, const char* key, void* val, size_t val_size);
+int get_map_val     (struct kc_map_t* self, const char* key, void** val);
+int remove_map_key  (struct kc_map_t* self, const char* key);
 
-static unsigned int _hash  (const char* key);
+static struct kc_entry_t* _new_arena_entry  (struct kc_arena_t* arena, const char* key, void* val, size_t val_size);
+static unsigned int       _hash             (const char* key);
 
 //---------------------------------------------------------------------------//
 
@@ -115,9 +120,51 @@ struct kc_map_t* new_map(void)
     new_map->entries[i] = NULL;
   }
 
+  // the memory is owned by the map
+  new_map->_arena = NULL;
+
+  // asign public function members
+  new_map->set    = set_map_key;
+  new_map->get    = get_map_val;
+  new_map->remove = remove_map_key;
+
+  return new_map;
+}
+
+//---------------------------------------------------------------------------//
+
+struct kc_map_t* new_arena_map(struct kc_arena_t* arena)
+{
+  if (arena == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  // create a new instance to be returned
+  struct kc_map_t* new_map = arena->alloc(arena, sizeof(struct kc_map_t));
+  if (new_map == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_map->entries = arena->alloc(arena, sizeof(struct kc_entry_t*) * KC_MAP_MAX_SIZE);
+  if (new_map->entries == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  // set each entry to NULL
+  memset(new_map->entries, 0, sizeof(struct kc_entry_t*) * KC_MAP_MAX_SIZE);
+
+  new_map->_arena = arena;
+
   // asign public function members
-  new_map->set = set_map_key;
-  new_map->get = get_map_val;
+  new_map->set    = set_map_key;
+  new_map->get    = get_map_val;
+  new_map->remove = remove_map_key;
 
   return new_map;
 }
@@ -131,8 +178,25 @@ void destroy_map(struct kc_map_t* map)
     return;
   }
 
-  // TODO: erase all elements
+  // the memory is released with the arena
+  if (map->_arena != NULL)
+  {
+    return;
+  }
 
+  // erase all elements
+  for (int i = 0; i < KC_MAP_MAX_SIZE; ++i)
+  {
+    struct kc_entry_t* entry = map->entries[i];
+    while (entry != NULL)
+    {
+      struct kc_entry_t* next = entry->next;
+      destroy_entry(entry);
+      entry = next;
+    }
+  }
+
+  free(map->entries);
   free(map);
 }
 
@@ -158,8 +222,11 @@ int set_map_key(struct kc_map_t* self, const char* key, void* val, size_t val_si
   // no entry means slot empty, insert immediately
   if (entry == NULL)
   {
-    self->entries[slot] = new_entry(key, val, val_size);
-    return KC_SUCCESS;
+    self->entries[slot] = (self->_arena == NULL)
+      ? new_entry(key, val, val_size)
+      : _new_arena_entry(self->_arena, key, val, val_size);
+
+    return self->entries[slot] != NULL ? KC_SUCCESS : KC_OUT_OF_MEMORY;
   }
 
   struct kc_entry_t* prev; 
@@ -171,6 +238,13 @@ int set_map_key(struct kc_map_t* self, const char* key, void* val, size_t val_si
     // check the key for maches
     if (strcmp(entry->key, key) == 0)
     {
+      // the old value stays in the arena until it is reset
+      if (self->_arena != NULL)
+      {
+        entry->val = self->_arena->dup(self->_arena, val, val_size);
+        return entry->val != NULL ? KC_SUCCESS : KC_OUT_OF_MEMORY;
+      }
+
       // first, free the value
       free(entry->val);
 
@@ -187,9 +261,11 @@ int set_map_key(struct kc_map_t* self, const char* key, void* val, size_t val_si
   }
 
   // if no entries were found, create a new one
-  prev->next = new_entry(key, val, val_size);
-  
-  return KC_SUCCESS;
+  prev->next = (self->_arena == NULL)
+    ? new_entry(key, val, val_size)
+    : _new_arena_entry(self->_arena, key, val, val_size);
+
+  return prev->next != NULL ? KC_SUCCESS : KC_OUT_OF_MEMORY;
 }
 
 //---------------------------------------------------------------------------//
@@ -236,6 +312,76 @@ int get_map_val(struct kc_map_t* self, const char* key, void** val)
 
 //---------------------------------------------------------------------------//
 
+int remove_map_key(struct kc_map_t* self, const char* key)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  if (key == NULL)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  unsigned int slot = _hash(key);
+
+  // the link that points to the current entry
+  struct kc_entry_t** link = &self->entries[slot];
+
+  while (*link != NULL)
+  {
+    struct kc_entry_t* entry = *link;
+
+    if (strcmp(entry->key, key) == 0)
+    {
+      // skip the entry, the arena entries are released with the arena
+      (*link) = entry->next;
+
+      if (self->_arena == NULL)
+      {
+        destroy_entry(entry);
+      }
+
+      return KC_SUCCESS;
+    }
+
+    link = &entry->next;
+  }
+
+  // the entry was not found
+  return KC_INVALID;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_entry_t* _new_arena_entry(struct kc_arena_t* arena,
+    const char* key, void* val, size_t val_size)
+{
+  struct kc_entry_t* entry = arena->alloc(arena, sizeof(struct kc_entry_t));
+  if (entry == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  entry->key = arena->dup(arena, key, strlen(key) + 1);
+  entry->val = arena->dup(arena, val, val_size);
+
+  if (entry->key == NULL || entry->val == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  // the entry is the last one of its slot
+  entry->next = NULL;
+
+  return entry;
+}
+
+//---------------------------------------------------------------------------//
+
 static unsigned int _hash(const char* key)
 {
   unsigned long int value = 0;
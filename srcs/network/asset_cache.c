@@ -0,0 +1,788 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// asset_cache.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/asset_cache.h"
+#include "../../hdrs/network/http.h"
+#include "../../hdrs/network/http_parser.h"
+#include "../../hdrs/security/sha1.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//---------------------------------------------------------------------------//
+
+#define _IDENTITY  0
+#define _GZIP      1
+#define _BR        2
+
+// the events that change the content of a watched directory
+#define _WATCH_EVENTS  (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | \
+                        IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+// the extension and the coding of every variant, by its index
+static const char* _extensions[KC_ASSET_VARIANTS_SIZE] = { "", ".gz", ".br" };
+static const char* _encodings[KC_ASSET_VARIANTS_SIZE]  = { NULL, "gzip", "br" };
+
+// a file with all its variants, as kept in the map
+struct kc_asset_entry_t
+{
+  int    status;  // KC_SUCCESS, or KC_INVALID for the files sent from the disk
+  size_t size;    // the memory taken by the variants
+
+  struct kc_asset_t* variants[KC_ASSET_VARIANTS_SIZE];
+};
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int  get_asset_cache         (struct kc_asset_cache_t* self, const char* path, const char* accept_encoding, struct kc_asset_t** asset);
+static void release_asset_cache     (struct kc_asset_cache_t* self, struct kc_asset_t* asset);
+static void invalidate_asset_cache  (struct kc_asset_cache_t* self, const char* path);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int   _pick_variant   (struct kc_asset_entry_t* entry, const char* accept_encoding, struct kc_asset_t** asset);
+static void  _load_entry     (struct kc_asset_cache_t* self, const char* path, struct kc_asset_entry_t* entry);
+static int   _load_variant   (struct kc_asset_cache_t* self, const char* path, int variant, struct kc_asset_t** asset);
+static int   _render_heads   (struct kc_asset_t* asset, const char* mime_type, bool vary);
+static void  _free_asset     (struct kc_asset_t* asset);
+static void  _release_entry  (struct kc_asset_entry_t* entry);
+static void  _clear          (struct kc_asset_cache_t* self);
+static void  _add_watches    (struct kc_asset_cache_t* self, const char* directory);
+static void  _handle_event   (struct kc_asset_cache_t* self, struct inotify_event* event);
+static void* _watch          (void* cache);
+
+//---------------------------------------------------------------------------//
+
+struct kc_asset_cache_t* new_asset_cache(const char* directory)
+{
+  if (directory == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  // create a cache instance to be returned
+  struct kc_asset_cache_t* new_cache = malloc(sizeof(struct kc_asset_cache_t));
+
+  // confirm that there is memory to allocate
+  if (new_cache == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  memset(new_cache, 0, sizeof(struct kc_asset_cache_t));
+  new_cache->_inotify_fd  = -1;
+  new_cache->_stop_fds[0] = -1;
+  new_cache->_stop_fds[1] = -1;
+
+  // the files are checked against the resolved directory
+  new_cache->directory = realpath(directory, NULL);
+  if (new_cache->directory == NULL)
+  {
+    log_error(KC_FILE_NOT_FOUND_LOG);
+    free(new_cache);
+    return NULL;
+  }
+
+  new_cache->_assets = new_map();
+  if (new_cache->_assets == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    free(new_cache->directory);
+    free(new_cache);
+    return NULL;
+  }
+
+  pthread_rwlock_init(&new_cache->_lock, NULL);
+
+  // without the notifications, the cache could serve old files
+  new_cache->_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (new_cache->_inotify_fd < 0 || pipe(new_cache->_stop_fds) != 0)
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+    destroy_asset_cache(new_cache);
+    return NULL;
+  }
+
+  _add_watches(new_cache, "");
+
+  if (pthread_create(&new_cache->_watcher, NULL, _watch, new_cache) != 0)
+  {
+    log_error(KC_THREAD_ERROR_LOG);
+    destroy_asset_cache(new_cache);
+    return NULL;
+  }
+
+  // assigns the public member methods
+  new_cache->get        = get_asset_cache;
+  new_cache->release    = release_asset_cache;
+  new_cache->invalidate = invalidate_asset_cache;
+
+  return new_cache;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_asset_cache(struct kc_asset_cache_t* cache)
+{
+  if (cache == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // wake up the watcher and wait for it to stop
+  if (cache->_watcher != 0)
+  {
+    char stop = 1;
+    while (write(cache->_stop_fds[1], &stop, 1) < 0 && errno == EINTR);
+
+    pthread_join(cache->_watcher, NULL);
+  }
+
+  // the files still being sent are freed by their last release
+  _clear(cache);
+  destroy_map(cache->_assets);
+
+  for (int i = 0; i < KC_ASSET_MAX_WATCHES; ++i)
+  {
+    free(cache->_watches[i]);
+  }
+
+  if (cache->_inotify_fd >= 0)
+  {
+    close(cache->_inotify_fd);
+  }
+
+  for (int i = 0; i < 2; ++i)
+  {
+    if (cache->_stop_fds[i] >= 0)
+    {
+      close(cache->_stop_fds[i]);
+    }
+  }
+
+  pthread_rwlock_destroy(&cache->_lock);
+
+  free(cache->directory);
+  free(cache);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int get_asset_cache(struct kc_asset_cache_t* self, const char* path,
+    const char* accept_encoding, struct kc_asset_t** asset)
+{
+  if (self == NULL || path == NULL || asset == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct kc_asset_entry_t* cached = NULL;
+
+  // most requests end here, with the file already in memory
+  pthread_rwlock_rdlock(&self->_lock);
+
+  if (self->_assets->get(self->_assets, path, (void**)&cached) == KC_SUCCESS)
+  {
+    int ret = _pick_variant(cached, accept_encoding, asset);
+    pthread_rwlock_unlock(&self->_lock);
+
+    return ret;
+  }
+
+  unsigned long generation = self->_generation;
+  pthread_rwlock_unlock(&self->_lock);
+
+  // the disk is read without holding the lock
+  struct kc_asset_entry_t entry;
+  _load_entry(self, path, &entry);
+
+  // there is nothing to remember about the missing files (or the
+  // ones that failed to load, they are tried again next time)
+  if (entry.status != KC_SUCCESS && entry.status != KC_INVALID)
+  {
+    return entry.status;
+  }
+
+  pthread_rwlock_wrlock(&self->_lock);
+
+  // another request loaded the same file in the meantime
+  if (self->_assets->get(self->_assets, path, (void**)&cached) == KC_SUCCESS)
+  {
+    int ret = _pick_variant(cached, accept_encoding, asset);
+    pthread_rwlock_unlock(&self->_lock);
+
+    _release_entry(&entry);
+    return ret;
+  }
+
+  // the cache is full, the file is remembered only to be sent from the disk
+  if (entry.status == KC_SUCCESS && self->size + entry.size > KC_ASSET_MAX_CACHE_SIZE)
+  {
+    _release_entry(&entry);
+    entry.status = KC_INVALID;
+  }
+
+  int ret = _pick_variant(&entry, accept_encoding, asset);
+
+  // a file that changed while it was read is sent only this once
+  if (generation == self->_generation &&
+      self->_assets->set(self->_assets, path, &entry, sizeof(struct kc_asset_entry_t)) == KC_SUCCESS)
+  {
+    self->size += entry.size;
+  }
+  else
+  {
+    _release_entry(&entry);
+  }
+
+  pthread_rwlock_unlock(&self->_lock);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static void release_asset_cache(struct kc_asset_cache_t* self, struct kc_asset_t* asset)
+{
+  if (self == NULL || asset == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  if (__atomic_sub_fetch(&asset->_refs, 1, __ATOMIC_ACQ_REL) == 0)
+  {
+    _free_asset(asset);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void invalidate_asset_cache(struct kc_asset_cache_t* self, const char* path)
+{
+  if (self == NULL || path == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  struct kc_asset_entry_t* cached = NULL;
+
+  pthread_rwlock_wrlock(&self->_lock);
+
+  // the files being loaded right now are not kept either
+  ++self->_generation;
+
+  if (self->_assets->get(self->_assets, path, (void**)&cached) == KC_SUCCESS)
+  {
+    self->size -= cached->size;
+
+    _release_entry(cached);
+    self->_assets->remove(self->_assets, path);
+  }
+
+  pthread_rwlock_unlock(&self->_lock);
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static int _pick_variant(struct kc_asset_entry_t* entry, const char* accept_encoding,
+    struct kc_asset_t** asset)
+{
+  if (entry->status != KC_SUCCESS)
+  {
+    return entry->status;
+  }
+
+  // the smallest first (brotli, then gzip), the identity file is the default
+  struct kc_asset_t* found = entry->variants[_IDENTITY];
+
+  for (int i = _BR; i > _IDENTITY; --i)
+  {
+    if (entry->variants[i] != NULL && http_accept_encoding(accept_encoding, _encodings[i]) == KC_SUCCESS)
+    {
+      found = entry->variants[i];
+      break;
+    }
+  }
+
+  __atomic_add_fetch(&found->_refs, 1, __ATOMIC_RELAXED);
+  *asset = found;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _load_entry(struct kc_asset_cache_t* self, const char* path,
+    struct kc_asset_entry_t* entry)
+{
+  memset(entry, 0, sizeof(struct kc_asset_entry_t));
+
+  entry->status = _load_variant(self, path, _IDENTITY, &entry->variants[_IDENTITY]);
+  if (entry->status != KC_SUCCESS)
+  {
+    return;
+  }
+
+  // the variants are optional, any problem just leaves them out
+  bool vary = false;
+  for (int i = _GZIP; i < KC_ASSET_VARIANTS_SIZE; ++i)
+  {
+    if (_load_variant(self, path, i, &entry->variants[i]) == KC_SUCCESS)
+    {
+      vary = true;
+    }
+  }
+
+  // every variant is described as the identity file, but with its coding
+  const char* mime_type = http_mime_type(path);
+
+  for (int i = 0; i < KC_ASSET_VARIANTS_SIZE; ++i)
+  {
+    struct kc_asset_t* asset = entry->variants[i];
+    if (asset == NULL)
+    {
+      continue;
+    }
+
+    if (_render_heads(asset, mime_type, vary) != KC_SUCCESS)
+    {
+      _release_entry(entry);
+      entry->status = KC_INVALID;
+      return;
+    }
+
+    entry->size += asset->body_len + asset->head_len + asset->not_modified_len;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int _load_variant(struct kc_asset_cache_t* self, const char* path, int variant,
+    struct kc_asset_t** asset)
+{
+  char full[PATH_MAX];
+  int full_len = snprintf(full, sizeof(full), "%s/%s%s", self->directory, path,
+      _extensions[variant]);
+
+  if (full_len < 0 || (size_t)full_len >= sizeof(full))
+  {
+    return KC_FILE_NOT_FOUND;
+  }
+
+  // a path that is not already resolved (ex: a symbolic link) goes through
+  // the checks of the server, on every request
+  char resolved[PATH_MAX];
+  if (realpath(full, resolved) == NULL)
+  {
+    return KC_FILE_NOT_FOUND;
+  }
+
+  if (strcmp(full, resolved) != 0)
+  {
+    return KC_INVALID;
+  }
+
+  int fd = open(full, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return KC_FILE_NOT_FOUND;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || S_ISREG(info.st_mode) == 0)
+  {
+    close(fd);
+    return KC_FILE_NOT_FOUND;
+  }
+
+  if ((size_t)info.st_size > KC_ASSET_MAX_FILE_SIZE)
+  {
+    close(fd);
+    return KC_INVALID;
+  }
+
+  struct kc_asset_t* new_asset = calloc(1, sizeof(struct kc_asset_t));
+  char* body = malloc(info.st_size + 1);
+
+  if (new_asset == NULL || body == NULL)
+  {
+    free(new_asset);
+    free(body);
+    close(fd);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  new_asset->body = body;
+
+  // the size is the one seen by fstat, a file that is still being written
+  // is read again after its notification
+  while (new_asset->body_len < (size_t)info.st_size)
+  {
+    ssize_t len = read(fd, body + new_asset->body_len, info.st_size - new_asset->body_len);
+    if (len < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (len <= 0)
+    {
+      break;
+    }
+
+    new_asset->body_len += len;
+  }
+
+  close(fd);
+
+  struct kc_sha1_t* sha1 = new_sha1();
+  if (new_asset->body_len != (size_t)info.st_size || sha1 == NULL)
+  {
+    if (sha1 != NULL)
+    {
+      destroy_sha1(sha1);
+    }
+
+    _free_asset(new_asset);
+    return KC_IO_ERROR;
+  }
+
+  // the same tag the server gives to the files it sends from the disk
+  uint8_t digest[KC_SHA1_LENGTH];
+  unsigned char hex[KC_SHA1_LENGTH * 2 + 1];
+
+  sha1->digest(sha1, (uint8_t*)body, new_asset->body_len);
+  sha1->get_hash(sha1, digest);
+  sha1_to_string(digest, hex);
+  destroy_sha1(sha1);
+
+  sprintf(new_asset->etag, "\"%s\"", hex);
+
+  new_asset->modified = info.st_mtime;
+  http_format_date(info.st_mtime, new_asset->last_modified);
+
+  new_asset->encoding = _encodings[variant];
+  new_asset->_refs    = 1;
+
+  *asset = new_asset;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _render_heads(struct kc_asset_t* asset, const char* mime_type, bool vary)
+{
+  char encoding[64] = "";
+  if (asset->encoding != NULL)
+  {
+    sprintf(encoding, KC_HTTP_HEADER_CONTENT_ENCODING ": %s\r\n", asset->encoding);
+  }
+
+  const char* vary_header = vary ? KC_HTTP_HEADER_VARY ": Accept-Encoding\r\n" : "";
+
+  size_t ok_len = 0;
+  size_t not_modified_len = 0;
+
+  const char* ok = http_status_line(KC_HTTP_OK, &ok_len);
+  const char* not_modified = http_status_line(KC_HTTP_NOT_MODIFIED, &not_modified_len);
+
+  const char* format =
+      "%s"
+      KC_HTTP_HEADER_CONTENT_TYPE ": %s\r\n"
+      KC_HTTP_HEADER_CONTENT_LENGTH ": %zu\r\n"
+      KC_HTTP_HEADER_LAST_MODIFIED ": %s\r\n"
+      KC_HTTP_HEADER_ETAG ": %s\r\n"
+      KC_HTTP_HEADER_ACCEPT_RANGES ": bytes\r\n"
+      "%s%s";
+
+  int len = snprintf(NULL, 0, format, ok, mime_type, asset->body_len,
+      asset->last_modified, asset->etag, encoding, vary_header);
+
+  asset->head = malloc(len + 1);
+  if (asset->head == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  asset->head_len = sprintf(asset->head, format, ok, mime_type, asset->body_len,
+      asset->last_modified, asset->etag, encoding, vary_header);
+
+  // the "304 Not Modified" repeats only the validators
+  format =
+      "%s"
+      KC_HTTP_HEADER_LAST_MODIFIED ": %s\r\n"
+      KC_HTTP_HEADER_ETAG ": %s\r\n"
+      "%s";
+
+  len = snprintf(NULL, 0, format, not_modified, asset->last_modified, asset->etag, vary_header);
+
+  asset->not_modified = malloc(len + 1);
+  if (asset->not_modified == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  asset->not_modified_len = sprintf(asset->not_modified, format, not_modified,
+      asset->last_modified, asset->etag, vary_header);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _free_asset(struct kc_asset_t* asset)
+{
+  free(asset->head);
+  free(asset->not_modified);
+  free(asset->body);
+  free(asset);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _release_entry(struct kc_asset_entry_t* entry)
+{
+  // the cache gives up its reference, the requests keep theirs
+  for (int i = 0; i < KC_ASSET_VARIANTS_SIZE; ++i)
+  {
+    struct kc_asset_t* asset = entry->variants[i];
+
+    if (asset != NULL && __atomic_sub_fetch(&asset->_refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+      _free_asset(asset);
+    }
+
+    entry->variants[i] = NULL;
+  }
+
+  entry->size = 0;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _clear(struct kc_asset_cache_t* self)
+{
+  pthread_rwlock_wrlock(&self->_lock);
+
+  ++self->_generation;
+
+  for (int i = 0; i < KC_MAP_MAX_SIZE; ++i)
+  {
+    struct kc_entry_t* entry = self->_assets->entries[i];
+
+    while (entry != NULL)
+    {
+      struct kc_entry_t* next = entry->next;
+
+      _release_entry(entry->val);
+      self->_assets->remove(self->_assets, entry->key);
+
+      entry = next;
+    }
+  }
+
+  self->size = 0;
+
+  pthread_rwlock_unlock(&self->_lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _add_watches(struct kc_asset_cache_t* self, const char* directory)
+{
+  char path[PATH_MAX];
+  int path_len = snprintf(path, sizeof(path), "%s/%s", self->directory, directory);
+
+  if (path_len < 0 || (size_t)path_len >= sizeof(path))
+  {
+    return;
+  }
+
+  // the symbolic links are not followed, their files are never cached
+  int wd = inotify_add_watch(self->_inotify_fd, path, _WATCH_EVENTS | IN_DONT_FOLLOW | IN_ONLYDIR);
+  if (wd < 0)
+  {
+    return;
+  }
+
+  // too many directories, the files of this one can't be cached safely
+  if (wd >= KC_ASSET_MAX_WATCHES)
+  {
+    log_warning(KC_OVERFLOW_LOG);
+    inotify_rm_watch(self->_inotify_fd, wd);
+    return;
+  }
+
+  free(self->_watches[wd]);
+  self->_watches[wd] = strdup(directory);
+
+  DIR* dir = opendir(path);
+  if (dir == NULL)
+  {
+    return;
+  }
+
+  struct dirent* item;
+  while ((item = readdir(dir)) != NULL)
+  {
+    if (item->d_type != DT_DIR || strcmp(item->d_name, ".") == 0 ||
+        strcmp(item->d_name, "..") == 0)
+    {
+      continue;
+    }
+
+    char child[PATH_MAX];
+    int child_len = snprintf(child, sizeof(child), "%s%s/", directory, item->d_name);
+
+    if (child_len > 0 && (size_t)child_len < sizeof(child))
+    {
+      _add_watches(self, child);
+    }
+  }
+
+  closedir(dir);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _handle_event(struct kc_asset_cache_t* self, struct inotify_event* event)
+{
+  // some notifications were lost, nothing can be trusted anymore
+  if (event->mask & IN_Q_OVERFLOW)
+  {
+    _clear(self);
+    return;
+  }
+
+  if (event->wd < 0 || event->wd >= KC_ASSET_MAX_WATCHES || self->_watches[event->wd] == NULL)
+  {
+    return;
+  }
+
+  // the directory is gone (or not watched anymore)
+  if (event->mask & IN_IGNORED)
+  {
+    free(self->_watches[event->wd]);
+    self->_watches[event->wd] = NULL;
+    return;
+  }
+
+  if (event->len == 0)
+  {
+    return;
+  }
+
+  char path[PATH_MAX];
+  int path_len = snprintf(path, sizeof(path), "%s%s", self->_watches[event->wd], event->name);
+
+  if (path_len < 0 || (size_t)path_len >= sizeof(path))
+  {
+    _clear(self);
+    return;
+  }
+
+  if (event->mask & IN_ISDIR)
+  {
+    // the new directories are watched as well
+    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+    {
+      strcat(path, "/");
+      _add_watches(self, path);
+    }
+
+    // a directory that moves takes all its files with it
+    if (event->mask & (IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE))
+    {
+      _clear(self);
+    }
+
+    return;
+  }
+
+  // a variant belongs to the entry of its identity file
+  for (int i = _GZIP; i < KC_ASSET_VARIANTS_SIZE; ++i)
+  {
+    size_t extension_len = strlen(_extensions[i]);
+
+    if ((size_t)path_len > extension_len &&
+        strcmp(path + path_len - extension_len, _extensions[i]) == 0)
+    {
+      path[path_len - extension_len] = '\0';
+      break;
+    }
+  }
+
+  invalidate_asset_cache(self, path);
+}
+
+//---------------------------------------------------------------------------//
+
+static void* _watch(void* cache)
+{
+  struct kc_asset_cache_t* self = cache;
+
+  struct pollfd fds[2] =
+  {
+    { self->_inotify_fd,  POLLIN, 0 },
+    { self->_stop_fds[0], POLLIN, 0 }
+  };
+
+  // the events are aligned as the kernel writes them
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  for (;;)
+  {
+    if (poll(fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      break;
+    }
+
+    if (fds[1].revents != 0)
+    {
+      break;
+    }
+
+    ssize_t len;
+    while ((len = read(self->_inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+      for (char* item = buffer; item < buffer + len; )
+      {
+        struct inotify_event* event = (struct inotify_event*)item;
+        _handle_event(self, event);
+
+        item += sizeof(struct inotify_event) + event->len;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,903 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// hpack.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/hpack.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------//
+
+// an entry of the dynamic table, the name followed by the value
+struct kc_hpack_entry_t
+{
+  size_t name_len;
+  size_t value_len;
+  char   data[];
+};
+
+// an entry of the static table
+struct kc_hpack_static_t
+{
+  const char* name;
+  const char* value;
+};
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int decode_hpack  (struct kc_hpack_t* self, const uint8_t* block, size_t len,
+    int (*header)(void* data, const char* name, size_t name_len, const char* value, size_t value_len),
+    void* data);
+static int encode_hpack  (struct kc_hpack_t* self, const char* name, size_t name_len,
+    const char* value, size_t value_len, uint8_t* out, size_t size, size_t* len);
+static int resize_hpack  (struct kc_hpack_t* self, size_t max_size);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static struct kc_hpack_entry_t* _new_entry  (const char* name, size_t name_len, const char* value, size_t value_len);
+static struct kc_hpack_entry_t* _get_entry  (struct kc_hpack_t* self, size_t index);
+static bool _insert_entry    (struct kc_hpack_t* self, struct kc_hpack_entry_t* entry);
+static void _evict_entries   (struct kc_hpack_t* self, size_t max_size);
+static int  _lookup          (struct kc_hpack_t* self, size_t index, const char** name, size_t* name_len, const char** value, size_t* value_len);
+static int  _decode_int      (const uint8_t** pos, const uint8_t* end, int prefix, size_t* value);
+static int  _decode_string   (struct kc_hpack_t* self, const uint8_t** pos, const uint8_t* end, size_t* used, const char** str, size_t* len);
+static void _encode_int      (uint8_t* out, size_t* len, uint8_t flags, int prefix, size_t value);
+static void _encode_string   (uint8_t* out, size_t* len, const char* str, size_t str_len);
+
+//---------------------------------------------------------------------------//
+
+static const struct kc_hpack_static_t _static_table[KC_HPACK_STATIC_SIZE] =
+{
+  { ":authority", "" },
+  { ":method", "GET" },
+  { ":method", "POST" },
+  { ":path", "/" },
+  { ":path", "/index.html" },
+  { ":scheme", "http" },
+  { ":scheme", "https" },
+  { ":status", "200" },
+  { ":status", "204" },
+  { ":status", "206" },
+  { ":status", "304" },
+  { ":status", "400" },
+  { ":status", "404" },
+  { ":status", "500" },
+  { "accept-charset", "" },
+  { "accept-encoding", "gzip, deflate" },
+  { "accept-language", "" },
+  { "accept-ranges", "" },
+  { "accept", "" },
+  { "access-control-allow-origin", "" },
+  { "age", "" },
+  { "allow", "" },
+  { "authorization", "" },
+  { "cache-control", "" },
+  { "content-disposition", "" },
+  { "content-encoding", "" },
+  { "content-language", "" },
+  { "content-length", "" },
+  { "content-location", "" },
+  { "content-range", "" },
+  { "content-type", "" },
+  { "cookie", "" },
+  { "date", "" },
+  { "etag", "" },
+  { "expect", "" },
+  { "expires", "" },
+  { "from", "" },
+  { "host", "" },
+  { "if-match", "" },
+  { "if-modified-since", "" },
+  { "if-none-match", "" },
+  { "if-range", "" },
+  { "if-unmodified-since", "" },
+  { "last-modified", "" },
+  { "link", "" },
+  { "location", "" },
+  { "max-forwards", "" },
+  { "proxy-authenticate", "" },
+  { "proxy-authorization", "" },
+  { "range", "" },
+  { "referer", "" },
+  { "refresh", "" },
+  { "retry-after", "" },
+  { "server", "" },
+  { "set-cookie", "" },
+  { "strict-transport-security", "" },
+  { "transfer-encoding", "" },
+  { "user-agent", "" },
+  { "vary", "" },
+  { "via", "" },
+  { "www-authenticate", "" }
+};
+
+// the Huffman code of every byte (and of the end of string, the last one),
+// aligned to the right, and its length in bits
+static const uint32_t _huffman_codes[257] =
+{
+  0x00001ff8, 0x007fffd8, 0x0fffffe2, 0x0fffffe3, 0x0fffffe4, 0x0fffffe5,
+  0x0fffffe6, 0x0fffffe7, 0x0fffffe8, 0x00ffffea, 0x3ffffffc, 0x0fffffe9,
+  0x0fffffea, 0x3ffffffd, 0x0fffffeb, 0x0fffffec, 0x0fffffed, 0x0fffffee,
+  0x0fffffef, 0x0ffffff0, 0x0ffffff1, 0x0ffffff2, 0x3ffffffe, 0x0ffffff3,
+  0x0ffffff4, 0x0ffffff5, 0x0ffffff6, 0x0ffffff7, 0x0ffffff8, 0x0ffffff9,
+  0x0ffffffa, 0x0ffffffb, 0x00000014, 0x000003f8, 0x000003f9, 0x00000ffa,
+  0x00001ff9, 0x00000015, 0x000000f8, 0x000007fa, 0x000003fa, 0x000003fb,
+  0x000000f9, 0x000007fb, 0x000000fa, 0x00000016, 0x00000017, 0x00000018,
+  0x00000000, 0x00000001, 0x00000002, 0x00000019, 0x0000001a, 0x0000001b,
+  0x0000001c, 0x0000001d, 0x0000001e, 0x0000001f, 0x0000005c, 0x000000fb,
+  0x00007ffc, 0x00000020, 0x00000ffb, 0x000003fc, 0x00001ffa, 0x00000021,
+  0x0000005d, 0x0000005e, 0x0000005f, 0x00000060, 0x00000061, 0x00000062,
+  0x00000063, 0x00000064, 0x00000065, 0x00000066, 0x00000067, 0x00000068,
+  0x00000069, 0x0000006a, 0x0000006b, 0x0000006c, 0x0000006d, 0x0000006e,
+  0x0000006f, 0x00000070, 0x00000071, 0x00000072, 0x000000fc, 0x00000073,
+  0x000000fd, 0x00001ffb, 0x0007fff0, 0x00001ffc, 0x00003ffc, 0x00000022,
+  0x00007ffd, 0x00000003, 0x00000023, 0x00000004, 0x00000024, 0x00000005,
+  0x00000025, 0x00000026, 0x00000027, 0x00000006, 0x00000074, 0x00000075,
+  0x00000028, 0x00000029, 0x0000002a, 0x00000007, 0x0000002b, 0x00000076,
+  0x0000002c, 0x00000008, 0x00000009, 0x0000002d, 0x00000077, 0x00000078,
+  0x00000079, 0x0000007a, 0x0000007b, 0x00007ffe, 0x000007fc, 0x00003ffd,
+  0x00001ffd, 0x0ffffffc, 0x000fffe6, 0x003fffd2, 0x000fffe7, 0x000fffe8,
+  0x003fffd3, 0x003fffd4, 0x003fffd5, 0x007fffd9, 0x003fffd6, 0x007fffda,
+  0x007fffdb, 0x007fffdc, 0x007fffdd, 0x007fffde, 0x00ffffeb, 0x007fffdf,
+  0x00ffffec, 0x00ffffed, 0x003fffd7, 0x007fffe0, 0x00ffffee, 0x007fffe1,
+  0x007fffe2, 0x007fffe3, 0x007fffe4, 0x001fffdc, 0x003fffd8, 0x007fffe5,
+  0x003fffd9, 0x007fffe6, 0x007fffe7, 0x00ffffef, 0x003fffda, 0x001fffdd,
+  0x000fffe9, 0x003fffdb, 0x003fffdc, 0x007fffe8, 0x007fffe9, 0x001fffde,
+  0x007fffea, 0x003fffdd, 0x003fffde, 0x00fffff0, 0x001fffdf, 0x003fffdf,
+  0x007fffeb, 0x007fffec, 0x001fffe0, 0x001fffe1, 0x003fffe0, 0x001fffe2,
+  0x007fffed, 0x003fffe1, 0x007fffee, 0x007fffef, 0x000fffea, 0x003fffe2,
+  0x003fffe3, 0x003fffe4, 0x007ffff0, 0x003fffe5, 0x003fffe6, 0x007ffff1,
+  0x03ffffe0, 0x03ffffe1, 0x000fffeb, 0x0007fff1, 0x003fffe7, 0x007ffff2,
+  0x003fffe8, 0x01ffffec, 0x03ffffe2, 0x03ffffe3, 0x03ffffe4, 0x07ffffde,
+  0x07ffffdf, 0x03ffffe5, 0x00fffff1, 0x01ffffed, 0x0007fff2, 0x001fffe3,
+  0x03ffffe6, 0x07ffffe0, 0x07ffffe1, 0x03ffffe7, 0x07ffffe2, 0x00fffff2,
+  0x001fffe4, 0x001fffe5, 0x03ffffe8, 0x03ffffe9, 0x0ffffffd, 0x07ffffe3,
+  0x07ffffe4, 0x07ffffe5, 0x000fffec, 0x00fffff3, 0x000fffed, 0x001fffe6,
+  0x003fffe9, 0x001fffe7, 0x001fffe8, 0x007ffff3, 0x003fffea, 0x003fffeb,
+  0x01ffffee, 0x01ffffef, 0x00fffff4, 0x00fffff5, 0x03ffffea, 0x007ffff4,
+  0x03ffffeb, 0x07ffffe6, 0x03ffffec, 0x03ffffed, 0x07ffffe7, 0x07ffffe8,
+  0x07ffffe9, 0x07ffffea, 0x07ffffeb, 0x0ffffffe, 0x07ffffec, 0x07ffffed,
+  0x07ffffee, 0x07ffffef, 0x07fffff0, 0x03ffffee, 0x3fffffff
+};
+
+static const uint8_t _huffman_lengths[257] =
+{
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+   6, 10, 10, 12, 13,  6,  8, 11, 10, 10,  8, 11,  8,  6,  6,  6,
+   5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8, 15,  6, 12, 10,
+  13,  6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+   7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8, 13, 19, 13, 14,  6,
+  15,  5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,
+   6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+  30
+};
+
+// the code is canonical: the codes of the same length are consecutive, in
+// the order of the symbols, so a code is decoded from the first code of its
+// length (and the number of codes of that length)
+static const uint16_t _huffman_symbols[257] =
+{
+   48,  49,  50,  97,  99, 101, 105, 111, 115, 116,  32,  37,
+   45,  46,  47,  51,  52,  53,  54,  55,  56,  57,  61,  65,
+   95,  98, 100, 102, 103, 104, 108, 109, 110, 112, 114, 117,
+   58,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,
+   77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  89,
+  106, 107, 113, 118, 119, 120, 121, 122,  38,  42,  44,  59,
+   88,  90,  33,  34,  40,  41,  63,  39,  43, 124,  35,  62,
+    0,  36,  64,  91,  93, 126,  94, 125,  60,  96, 123,  92,
+  195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161,
+  167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+  132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170,
+  173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+  233,   1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+  151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182,
+  183, 188, 191, 197, 231, 239,   9, 142, 144, 145, 148, 159,
+  171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+  200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243,
+  255, 203, 204, 211, 212, 214, 221, 222, 223, 241, 244, 245,
+  246, 247, 248, 250, 251, 252, 253, 254,   2,   3,   4,   5,
+    6,   7,   8,  11,  12,  14,  15,  16,  17,  18,  19,  20,
+   21,  23,  24,  25,  26,  27,  28,  29,  30,  31, 127, 220,
+  249,  10,  13,  22, 256
+};
+
+static const uint32_t _huffman_first[31] =
+{
+  0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+  0x00000014, 0x0000005c, 0x000000f8, 0x00000000, 0x000003f8, 0x000007fa,
+  0x00000ffa, 0x00001ff8, 0x00003ffc, 0x00007ffc, 0x00000000, 0x00000000,
+  0x00000000, 0x0007fff0, 0x000fffe6, 0x001fffdc, 0x003fffd2, 0x007fffd8,
+  0x00ffffea, 0x01ffffec, 0x03ffffe0, 0x07ffffde, 0x0fffffe2, 0x00000000,
+  0x3ffffffc
+};
+
+static const uint16_t _huffman_count[31] =
+{
+   0,  0,  0,  0,  0, 10, 26, 32,  6,  0,  5,  3,  2,  6,  2,  3,
+   0,  0,  0,  3,  8, 13, 26, 29, 12,  4, 15, 19, 29,  0,  4
+};
+
+static const uint16_t _huffman_offset[31] =
+{
+    0,   0,   0,   0,   0,   0,  10,  36,  68,   0,  74,  79,  82,  84,  90,  92,
+    0,   0,   0,  95,  98, 106, 119, 145, 174, 186, 190, 205, 224,   0, 253
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_hpack_t* new_hpack(size_t max_size)
+{
+  // create a hpack instance to be returned
+  struct kc_hpack_t* new_hpack = malloc(sizeof(struct kc_hpack_t));
+
+  // confirm that there is memory to allocate
+  if (new_hpack == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  memset(new_hpack, 0, sizeof(struct kc_hpack_t));
+
+  new_hpack->_max_size = max_size;
+  new_hpack->_limit    = max_size;
+
+  // assigns the public member methods
+  new_hpack->decode = decode_hpack;
+  new_hpack->encode = encode_hpack;
+  new_hpack->resize = resize_hpack;
+
+  return new_hpack;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_hpack(struct kc_hpack_t* hpack)
+{
+  if (hpack == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  _evict_entries(hpack, 0);
+
+  free(hpack->_entries);
+  free(hpack->_scratch);
+  free(hpack);
+}
+
+//---------------------------------------------------------------------------//
+
+size_t kc_hpack_huffman_len(const uint8_t* src, size_t len)
+{
+  size_t bits = 0;
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    bits += _huffman_lengths[src[i]];
+  }
+
+  return (bits + 7) / 8;
+}
+
+//---------------------------------------------------------------------------//
+
+size_t kc_hpack_huffman_encode(const uint8_t* src, size_t len, uint8_t* out)
+{
+  // the codes are at most 30 bits, added to less than a byte left
+  uint64_t bits = 0;
+  int bits_len = 0;
+  size_t out_len = 0;
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    bits = (bits << _huffman_lengths[src[i]]) | _huffman_codes[src[i]];
+    bits_len += _huffman_lengths[src[i]];
+
+    while (bits_len >= 8)
+    {
+      bits_len -= 8;
+      out[out_len++] = (uint8_t)(bits >> bits_len);
+    }
+  }
+
+  // the last byte is padded with the start of the end of string (all 1s)
+  if (bits_len > 0)
+  {
+    out[out_len++] = (uint8_t)((bits << (8 - bits_len)) | (0xFF >> bits_len));
+  }
+
+  return out_len;
+}
+
+//---------------------------------------------------------------------------//
+
+int kc_hpack_huffman_decode(const uint8_t* src, size_t len, uint8_t* out, size_t size, size_t* out_len)
+{
+  uint32_t code = 0;
+  int code_len = 0;
+
+  (*out_len) = 0;
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    for (int bit = 7; bit >= 0; --bit)
+    {
+      code = (code << 1) | ((src[i] >> bit) & 1);
+      ++code_len;
+
+      // a code longer than the longest one is not in the table
+      if (code_len > 30)
+      {
+        return KC_FORMAT_ERROR;
+      }
+
+      if (code < _huffman_first[code_len] ||
+          code - _huffman_first[code_len] >= _huffman_count[code_len])
+      {
+        continue;
+      }
+
+      uint16_t symbol = _huffman_symbols[_huffman_offset[code_len] + (code - _huffman_first[code_len])];
+
+      // the end of string is never encoded (only its start pads)
+      if (symbol == 256 || (*out_len) == size)
+      {
+        return KC_FORMAT_ERROR;
+      }
+
+      out[(*out_len)++] = (uint8_t)symbol;
+
+      code = 0;
+      code_len = 0;
+    }
+  }
+
+  // the padding is shorter than a byte, and made of 1s
+  if (code_len > 7 || code != (uint32_t)((1 << code_len) - 1))
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  return KC_SUCCESS;
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int decode_hpack(struct kc_hpack_t* self, const uint8_t* block, size_t len,
+    int (*header)(void* data, const char* name, size_t name_len, const char* value, size_t value_len),
+    void* data)
+{
+  if (self == NULL || header == NULL || (block == NULL && len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // a Huffman code takes at least 5 bits, so no string of the block
+  // decodes to more than 8/5 of its size
+  size_t scratch_size = (len * 8) / 5 + 1;
+  if (self->_scratch_cap < scratch_size)
+  {
+    char* scratch = realloc(self->_scratch, scratch_size);
+    if (scratch == NULL)
+    {
+      log_error(KC_OUT_OF_MEMORY_LOG);
+      return KC_OUT_OF_MEMORY;
+    }
+
+    self->_scratch     = scratch;
+    self->_scratch_cap = scratch_size;
+  }
+
+  const uint8_t* pos = block;
+  const uint8_t* end = block + len;
+
+  bool headers_seen = false;
+
+  // a header the callback refuses does not stop the decoding, the table
+  // must stay the same as the one of the encoder
+  int result = KC_SUCCESS;
+
+  while (pos < end)
+  {
+    const char* name  = NULL;
+    const char* value = NULL;
+    size_t name_len   = 0;
+    size_t value_len  = 0;
+    size_t index      = 0;
+    size_t used       = 0;
+    int ret           = KC_SUCCESS;
+
+    // an indexed header (1xxxxxxx)
+    if (*pos & 0x80)
+    {
+      if (_decode_int(&pos, end, 7, &index) != KC_SUCCESS ||
+          _lookup(self, index, &name, &name_len, &value, &value_len) != KC_SUCCESS)
+      {
+        return KC_FORMAT_ERROR;
+      }
+
+      ret = header(data, name, name_len, value, value_len);
+    }
+    // a change of the table size (001xxxxx), only before the headers
+    else if ((*pos & 0xE0) == 0x20)
+    {
+      if (headers_seen || _decode_int(&pos, end, 5, &index) != KC_SUCCESS || index > self->_limit)
+      {
+        return KC_FORMAT_ERROR;
+      }
+
+      _evict_entries(self, index);
+      self->_max_size = index;
+
+      continue;
+    }
+    else
+    {
+      // a literal that is added to the table (01xxxxxx), or not (0000xxxx
+      // and the never indexed 0001xxxx), the name can be an index
+      bool indexing = (*pos & 0x40) != 0;
+
+      if (_decode_int(&pos, end, indexing ? 6 : 4, &index) != KC_SUCCESS)
+      {
+        return KC_FORMAT_ERROR;
+      }
+
+      if (index > 0)
+      {
+        const char* unused = NULL;
+        size_t unused_len  = 0;
+
+        if (_lookup(self, index, &name, &name_len, &unused, &unused_len) != KC_SUCCESS)
+        {
+          return KC_FORMAT_ERROR;
+        }
+      }
+      else if (_decode_string(self, &pos, end, &used, &name, &name_len) != KC_SUCCESS)
+      {
+        return KC_FORMAT_ERROR;
+      }
+
+      if (_decode_string(self, &pos, end, &used, &value, &value_len) != KC_SUCCESS)
+      {
+        return KC_FORMAT_ERROR;
+      }
+
+      if (indexing)
+      {
+        // the name can be an entry that is evicted by this one
+        struct kc_hpack_entry_t* entry = _new_entry(name, name_len, value, value_len);
+        if (entry == NULL)
+        {
+          return KC_OUT_OF_MEMORY;
+        }
+
+        bool inserted = _insert_entry(self, entry);
+
+        ret = header(data, entry->data, name_len, entry->data + name_len, value_len);
+
+        // an entry bigger than the whole table only empties it
+        if (inserted == false)
+        {
+          free(entry);
+        }
+      }
+      else
+      {
+        ret = header(data, name, name_len, value, value_len);
+      }
+    }
+
+    headers_seen = true;
+
+    if (ret != KC_SUCCESS && result == KC_SUCCESS)
+    {
+      result = ret;
+    }
+  }
+
+  return result;
+}
+
+//---------------------------------------------------------------------------//
+
+static int encode_hpack(struct kc_hpack_t* self, const char* name, size_t name_len,
+    const char* value, size_t value_len, uint8_t* out, size_t size, size_t* len)
+{
+  if (self == NULL || name == NULL || value == NULL || out == NULL || len == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (name_len == 0)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // the integers take at most a few bytes, the strings never grow
+  if ((*len) + name_len + value_len + 24 > size)
+  {
+    return KC_OVERFLOW;
+  }
+
+  // the decoder is told the new size first
+  if (self->_update_pending)
+  {
+    _encode_int(out, len, 0x20, 5, self->_max_size);
+    self->_update_pending = false;
+  }
+
+  size_t name_index = 0;
+
+  // the whole header, or only its name, can be in a table
+  for (size_t i = 0; i < KC_HPACK_STATIC_SIZE; ++i)
+  {
+    if (_static_table[i].name[0] != name[0] || strlen(_static_table[i].name) != name_len ||
+        memcmp(_static_table[i].name, name, name_len) != 0)
+    {
+      continue;
+    }
+
+    if (strlen(_static_table[i].value) == value_len &&
+        memcmp(_static_table[i].value, value, value_len) == 0)
+    {
+      _encode_int(out, len, 0x80, 7, i + 1);
+      return KC_SUCCESS;
+    }
+
+    if (name_index == 0)
+    {
+      name_index = i + 1;
+    }
+  }
+
+  for (size_t i = 0; i < self->_entries_len; ++i)
+  {
+    struct kc_hpack_entry_t* entry = _get_entry(self, i);
+
+    if (entry->name_len != name_len || memcmp(entry->data, name, name_len) != 0)
+    {
+      continue;
+    }
+
+    if (entry->value_len == value_len && memcmp(entry->data + name_len, value, value_len) == 0)
+    {
+      _encode_int(out, len, 0x80, 7, KC_HPACK_STATIC_SIZE + 1 + i);
+      return KC_SUCCESS;
+    }
+
+    if (name_index == 0)
+    {
+      name_index = KC_HPACK_STATIC_SIZE + 1 + i;
+    }
+  }
+
+  // the cookies are never kept by the intermediaries, the values that
+  // change with every response (or are long) are not worth a table entry
+  bool sensitive = (name_len == 10 && memcmp(name, "set-cookie", 10) == 0);
+  bool indexing  = sensitive == false && value_len <= KC_HPACK_MAX_INDEXED_VALUE &&
+      (name_len != 14 || memcmp(name, "content-length", 14) != 0) &&
+      (name_len != 13 || memcmp(name, "content-range", 13) != 0) &&
+      name_len + value_len + KC_HPACK_ENTRY_OVERHEAD <= self->_max_size;
+
+  if (indexing)
+  {
+    _encode_int(out, len, 0x40, 6, name_index);
+  }
+  else
+  {
+    _encode_int(out, len, sensitive ? 0x10 : 0x00, 4, name_index);
+  }
+
+  if (name_index == 0)
+  {
+    _encode_string(out, len, name, name_len);
+  }
+
+  _encode_string(out, len, value, value_len);
+
+  // the decoder adds the same entry
+  if (indexing)
+  {
+    struct kc_hpack_entry_t* entry = _new_entry(name, name_len, value, value_len);
+    if (entry == NULL || _insert_entry(self, entry) == false)
+    {
+      free(entry);
+      return KC_OUT_OF_MEMORY;
+    }
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int resize_hpack(struct kc_hpack_t* self, size_t max_size)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  self->_limit = max_size;
+
+  if (self->_max_size != max_size)
+  {
+    _evict_entries(self, max_size);
+
+    self->_max_size       = max_size;
+    self->_update_pending = true;
+  }
+
+  return KC_SUCCESS;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static struct kc_hpack_entry_t* _new_entry(const char* name, size_t name_len,
+    const char* value, size_t value_len)
+{
+  struct kc_hpack_entry_t* entry = malloc(sizeof(struct kc_hpack_entry_t) + name_len + value_len);
+  if (entry == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  entry->name_len  = name_len;
+  entry->value_len = value_len;
+
+  memcpy(entry->data, name, name_len);
+  memcpy(entry->data + name_len, value, value_len);
+
+  return entry;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_hpack_entry_t* _get_entry(struct kc_hpack_t* self, size_t index)
+{
+  // the newest entry has the first index
+  return self->_entries[(self->_head + index) % self->_entries_cap];
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _insert_entry(struct kc_hpack_t* self, struct kc_hpack_entry_t* entry)
+{
+  size_t entry_size = entry->name_len + entry->value_len + KC_HPACK_ENTRY_OVERHEAD;
+
+  // the oldest entries make room for the new one
+  _evict_entries(self, (entry_size < self->_max_size) ? self->_max_size - entry_size : 0);
+
+  if (entry_size > self->_max_size)
+  {
+    return false;
+  }
+
+  // the ring is unrolled into a bigger one
+  if (self->_entries_len == self->_entries_cap)
+  {
+    size_t cap = (self->_entries_cap == 0) ? 16 : self->_entries_cap * 2;
+
+    struct kc_hpack_entry_t** entries = malloc(sizeof(struct kc_hpack_entry_t*) * cap);
+    if (entries == NULL)
+    {
+      log_error(KC_OUT_OF_MEMORY_LOG);
+      return false;
+    }
+
+    for (size_t i = 0; i < self->_entries_len; ++i)
+    {
+      entries[i] = _get_entry(self, i);
+    }
+
+    free(self->_entries);
+
+    self->_entries     = entries;
+    self->_entries_cap = cap;
+    self->_head        = 0;
+  }
+
+  self->_head = (self->_head + self->_entries_cap - 1) % self->_entries_cap;
+  self->_entries[self->_head] = entry;
+
+  self->_entries_len++;
+  self->_size += entry_size;
+
+  return true;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _evict_entries(struct kc_hpack_t* self, size_t max_size)
+{
+  while (self->_entries_len > 0 && self->_size > max_size)
+  {
+    struct kc_hpack_entry_t* oldest = _get_entry(self, self->_entries_len - 1);
+
+    self->_size -= oldest->name_len + oldest->value_len + KC_HPACK_ENTRY_OVERHEAD;
+    self->_entries_len--;
+
+    free(oldest);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int _lookup(struct kc_hpack_t* self, size_t index, const char** name,
+    size_t* name_len, const char** value, size_t* value_len)
+{
+  // the static table comes first, from 1
+  if (index >= 1 && index <= KC_HPACK_STATIC_SIZE)
+  {
+    (*name)      = _static_table[index - 1].name;
+    (*name_len)  = strlen(*name);
+    (*value)     = _static_table[index - 1].value;
+    (*value_len) = strlen(*value);
+
+    return KC_SUCCESS;
+  }
+
+  if (index <= KC_HPACK_STATIC_SIZE || index - KC_HPACK_STATIC_SIZE > self->_entries_len)
+  {
+    return KC_INDEX_OUT_OF_BOUNDS;
+  }
+
+  struct kc_hpack_entry_t* entry = _get_entry(self, index - KC_HPACK_STATIC_SIZE - 1);
+
+  (*name)      = entry->data;
+  (*name_len)  = entry->name_len;
+  (*value)     = entry->data + entry->name_len;
+  (*value_len) = entry->value_len;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _decode_int(const uint8_t** pos, const uint8_t* end, int prefix, size_t* value)
+{
+  if ((*pos) >= end)
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  // the value fits in the prefix, unless all its bits are set
+  size_t max_prefix = (1 << prefix) - 1;
+  (*value) = *(*pos)++ & max_prefix;
+
+  if ((*value) < max_prefix)
+  {
+    return KC_SUCCESS;
+  }
+
+  // then 7 bits at a time, the lowest first
+  for (int shift = 0; shift <= 28; shift += 7)
+  {
+    if ((*pos) >= end)
+    {
+      return KC_FORMAT_ERROR;
+    }
+
+    uint8_t byte = *(*pos)++;
+    (*value) += (size_t)(byte & 0x7F) << shift;
+
+    if ((byte & 0x80) == 0)
+    {
+      return KC_SUCCESS;
+    }
+  }
+
+  return KC_OVERFLOW;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _decode_string(struct kc_hpack_t* self, const uint8_t** pos, const uint8_t* end,
+    size_t* used, const char** str, size_t* len)
+{
+  if ((*pos) >= end)
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  bool huffman = (**pos & 0x80) != 0;
+  size_t str_len = 0;
+
+  if (_decode_int(pos, end, 7, &str_len) != KC_SUCCESS || str_len > (size_t)(end - (*pos)))
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  // the plain strings are used from the block
+  if (huffman == false)
+  {
+    (*str) = (const char*)(*pos);
+    (*len) = str_len;
+  }
+  else
+  {
+    char* out = self->_scratch + (*used);
+
+    if (kc_hpack_huffman_decode(*pos, str_len, (uint8_t*)out,
+        self->_scratch_cap - (*used), len) != KC_SUCCESS)
+    {
+      return KC_FORMAT_ERROR;
+    }
+
+    (*str)  = out;
+    (*used) += (*len);
+  }
+
+  (*pos) += str_len;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _encode_int(uint8_t* out, size_t* len, uint8_t flags, int prefix, size_t value)
+{
+  size_t max_prefix = (1 << prefix) - 1;
+
+  if (value < max_prefix)
+  {
+    out[(*len)++] = flags | (uint8_t)value;
+    return;
+  }
+
+  out[(*len)++] = flags | (uint8_t)max_prefix;
+  value -= max_prefix;
+
+  while (value >= 0x80)
+  {
+    out[(*len)++] = (uint8_t)(value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+
+  out[(*len)++] = (uint8_t)value;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _encode_string(uint8_t* out, size_t* len, const char* str, size_t str_len)
+{
+  size_t huffman_len = kc_hpack_huffman_len((const uint8_t*)str, str_len);
+
+  // the Huffman code only when it's shorter
+  if (huffman_len < str_len)
+  {
+    _encode_int(out, len, 0x80, 7, huffman_len);
+    (*len) += kc_hpack_huffman_encode((const uint8_t*)str, str_len, out + (*len));
+  }
+  else
+  {
+    _encode_int(out, len, 0x00, 7, str_len);
+    memcpy(out + (*len), str, str_len);
+    (*len) += str_len;
+  }
+}
+
+//---------------------------------------------------------------------------//
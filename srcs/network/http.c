@@ -8,89 +8,28 @@
 
 #include "../../hdrs/system/logger.h"
 #include "../../hdrs/network/http.h"
+#include "../../hdrs/network/server.h"
 #include "../../hdrs/common.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
-
-//--- MARK: PUBLIC HEADER FUNCTION PROTOTYPES -------------------------------//
-
-//---------------------------------------------------------------------------//
-
-struct kc_http_header_t* new_header(char* key, char* val)
-{
-  // create a new instance to be returned
-  struct kc_http_header_t* new_header = malloc(sizeof(struct kc_http_header_t));
-
-  // check the allocation of the memory
-  if (new_header == NULL)
-  {
-    log_error(KC_OUT_OF_MEMORY_LOG);
-    return NULL;
-  }
-
-  // allocate memory for the key
-  new_header->key = (char*)malloc(sizeof(char) * strlen(key) + 1);
-  if (new_header->key == NULL)
-  {
-    log_error(KC_OUT_OF_MEMORY_LOG);
-
-    // first free the memory
-    free(new_header);
-
-    return NULL;
-  }
-
-  // allocate memory for the value
-  new_header->val = (char*)malloc(sizeof(char) * strlen(val) + 1);
-  if (new_header->val == NULL)
-  {
-    log_error(KC_OUT_OF_MEMORY_LOG);
-
-    // first free the memory
-    free(new_header->key);
-    free(new_header);
-
-    return NULL;
-  }
-
-  // asign the values
-  strcpy(new_header->key, key);
-  strcpy(new_header->val, val);
-  new_header->size = strlen(val);
-
-  return new_header;
-}
-
-//---------------------------------------------------------------------------//
-
-void destroy_header(struct kc_http_header_t* header)
-{
-  if (header == NULL)
-  {
-    return;
-  }
-
-  if (header->key != NULL)
-  {
-    free(header->key);
-  }
-
-  if (header->val != NULL)
-  {
-    free(header->val);
-  }
-
-  free(header);
-}
+#include <strings.h>
+#include <sys/socket.h>
 
 //--- MARK: PUBLIC REQUEST FUNCTION PROTOTYPES ------------------------------//
 
-struct kc_http_request_t* new_request      (void);
-void                      destroy_request  (struct kc_http_request_t* req);
+struct kc_http_request_t* new_request        (void);
+struct kc_http_request_t* new_arena_request  (struct kc_arena_t* arena);
+void                      destroy_request    (struct kc_http_request_t* req);
 
-char* get_req_header     (struct kc_http_request_t* self, char* key);
-char* get_req_param      (struct kc_http_request_t* self, char* key);
+char*             get_req_header  (struct kc_http_request_t* self, char* key);
+char*             get_req_param   (struct kc_http_request_t* self, char* key);
+struct kc_json_t* get_req_json    (struct kc_http_request_t* self);
+
+int read_req_body       (struct kc_http_request_t* self, char* buffer, size_t size, size_t* len);
+int read_req_form       (struct kc_http_request_t* self);
+int read_req_multipart  (struct kc_http_request_t* self, struct kc_multipart_t* form);
 
 //--- MARK: PRIVATE REQUEST FUNCTION PROTOTYPES -----------------------------//
 
@@ -99,6 +38,9 @@ int _set_req_url        (struct kc_http_request_t* self, char* url);
 int _set_req_http_ver   (struct kc_http_request_t* self, char* http_ver);
 int _set_req_body       (struct kc_http_request_t* self, char* body);
 
+static void _init_request  (struct kc_http_request_t* req);
+static int  _req_copy      (struct kc_http_request_t* self, char** field, const char* str);
+
 //---------------------------------------------------------------------------//
 
 struct kc_http_request_t* new_request(void)
@@ -137,16 +79,48 @@ struct kc_http_request_t* new_request(void)
     return NULL;
   }
 
-  // asign the values
-  new_req->method    = NULL;
-  new_req->url       = NULL;
-  new_req->http_ver  = NULL;
-  new_req->body      = NULL;
-  new_req->client_fd = 0;
+  // the request owns its memory
+  new_req->arena     = NULL;
+  new_req->_in_arena = false;
 
-  // asign the methods
-  new_req->get_header = get_req_header;
-  new_req->get_param  = get_req_param;
+  _init_request(new_req);
+
+  return new_req;
+}
+
+//---------------------------------------------------------------------------//
+
+struct kc_http_request_t* new_arena_request(struct kc_arena_t* arena)
+{
+  if (arena == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  struct kc_http_request_t* new_req = arena->alloc(arena, sizeof(struct kc_http_request_t));
+
+  // check the allocation of the memory
+  if (new_req == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  // the maps, the strings and the parsed body go in the same arena
+  new_req->params  = new_arena_map(arena);
+  new_req->headers = new_arena_map(arena);
+
+  if (new_req->params == NULL || new_req->headers == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_req->arena     = arena;
+  new_req->_in_arena = true;
+
+  _init_request(new_req);
 
   return new_req;
 }
@@ -160,6 +134,12 @@ void destroy_request(struct kc_http_request_t* req)
     return;
   }
 
+  // everything is released when the arena is reset
+  if (req->_in_arena)
+  {
+    return;
+  }
+
   if (req->method != NULL)
   {
     free(req->method);
@@ -180,6 +160,12 @@ void destroy_request(struct kc_http_request_t* req)
     free(req->body);
   }
 
+  if (req->arena != NULL)
+  {
+    destroy_arena(req->arena);
+  }
+
+  destroy_map(req->params);
   destroy_map(req->headers);
 
   free(req);
@@ -194,6 +180,18 @@ char* get_req_header(struct kc_http_request_t* self, char* key)
     return NULL;
   }
 
+  // the headers are parsed into the map on the first lookup only
+  if (self->_headers_parsed == false)
+  {
+    self->_headers_parsed = true;
+
+    if (http_parse_header_fields(self->_raw_headers,
+        self->_raw_headers_len, self->headers) != KC_SUCCESS)
+    {
+      return NULL;
+    }
+  }
+
   // temp variable to store the value
   char* header_val = NULL;
 
@@ -212,6 +210,18 @@ char* get_req_param(struct kc_http_request_t* self, char* key)
     return NULL;
   }
 
+  // the query string is decoded into the map on the first lookup only
+  if (self->_params_parsed == false)
+  {
+    self->_params_parsed = true;
+
+    if (http_parse_query_string(self->_raw_query,
+        self->_raw_query_len, self->params) != KC_SUCCESS)
+    {
+      return NULL;
+    }
+  }
+
   // temp variable to store the value
   char* param_val = NULL;
 
@@ -223,104 +233,303 @@ char* get_req_param(struct kc_http_request_t* self, char* key)
 
 //---------------------------------------------------------------------------//
 
-int _set_req_method(struct kc_http_request_t* self, char* method)
+struct kc_json_t* get_req_json(struct kc_http_request_t* self)
 {
   if (self == NULL)
+  {
+    return NULL;
+  }
+
+  // the body was already parsed
+  if (self->_json != NULL)
+  {
+    return self->_json;
+  }
+
+  // only the JSON bodies are parsed
+  char* content_type = get_req_header(self, "Content-Type");
+  if ((self->body == NULL && self->_body_left == 0) || content_type == NULL ||
+      http_parse_content_type(content_type) != KC_BODY_CONTENT_TYPE_JSON)
+  {
+    return NULL;
+  }
+
+  // the document lives in the arena of the request
+  if (self->arena == NULL)
+  {
+    self->arena = new_arena(KC_ARENA_BLOCK_SIZE);
+    if (self->arena == NULL)
+    {
+      return NULL;
+    }
+  }
+
+  char*  body     = self->body;
+  size_t body_len = (body != NULL) ? strlen(body) : 0;
+
+  // the body that did not come with the headers is read whole first (on
+  // a fiber, the event loop goes on meanwhile), then parsed by its length
+  if (self->_body_left > 0)
+  {
+    size_t size = self->_body_buffered_len + self->_body_left;
+    if (size > KC_HTTP_JSON_MAX_SIZE)
+    {
+      return NULL;
+    }
+
+    body = self->arena->alloc(self->arena, size + 1);
+    if (body == NULL)
+    {
+      return NULL;
+    }
+
+    body_len = 0;
+    while (body_len < size)
+    {
+      size_t len = 0;
+      if (read_req_body(self, body + body_len, size - body_len, &len) != KC_SUCCESS || len == 0)
+      {
+        return NULL;
+      }
+
+      body_len += len;
+    }
+
+    body[body_len] = '\0';
+  }
+
+  struct kc_json_t* json = new_json(self->arena);
+  if (json == NULL)
+  {
+    return NULL;
+  }
+
+  if (json->parse(json, body, body_len) != KC_SUCCESS)
+  {
+    return NULL;
+  }
+
+  self->_json = json;
+
+  return json;
+}
+
+//---------------------------------------------------------------------------//
+
+int read_req_body(struct kc_http_request_t* self, char* buffer, size_t size, size_t* len)
+{
+  if (self == NULL || buffer == NULL || len == NULL)
   {
     return KC_NULL_REFERENCE;
   }
 
-  // validate the method before creating the request object
-  if (validate_http_method(method) != KC_SUCCESS)
+  (*len) = 0;
+
+  // first the bytes that came together with the headers
+  if (self->_body_buffered_len > 0)
   {
-    return KC_INVALID;
+    size_t n = (size < self->_body_buffered_len) ? size : self->_body_buffered_len;
+
+    memcpy(buffer, self->_body_buffered, n);
+    self->_body_buffered     += n;
+    self->_body_buffered_len -= n;
+
+    (*len) = n;
+    return KC_SUCCESS;
   }
 
-  // if the field is being reset, free the memory first
-  if (self->method != NULL)
+  // the whole body was read
+  if (self->_body_left == 0 || self->client_fd <= 0)
   {
-    free(self->method);
+    return KC_SUCCESS;
   }
 
-  // allocate memory
-  self->method = (char*)malloc(sizeof(char) * strlen(method) + 1);
-  if (self->method == NULL)
+  // then the rest of it, straight from the socket
+  size_t n = (size < self->_body_left) ? size : self->_body_left;
+
+  // (or from where the server received it)
+  if (self->_receive != NULL)
   {
-    return KC_OUT_OF_MEMORY;
+    int ret = self->_receive(self, buffer, n, len);
+
+    if (ret == KC_LOST_CONNECTION)
+    {
+      self->_body_left = 0;
+    }
+    else if (ret == KC_SUCCESS)
+    {
+      self->_body_left -= (*len);
+    }
+
+    return ret;
   }
 
-  // copy the string
-  strcpy(self->method, method);
+  ssize_t ret = 0;
+  do
+  {
+    ret = recv(self->client_fd, buffer, n, 0);
+  }
+  while (ret < 0 && errno == EINTR);
+
+  if (ret < 0)
+  {
+    return KC_NETWORK_ERROR;
+  }
+
+  // the client closed the connection before sending the whole body
+  if (ret == 0)
+  {
+    self->_body_left = 0;
+    return KC_LOST_CONNECTION;
+  }
+
+  self->_body_left -= ret;
+  (*len) = ret;
 
   return KC_SUCCESS;
 }
 
 //---------------------------------------------------------------------------//
 
-int _set_req_url(struct kc_http_request_t* self, char* url)
+int read_req_form(struct kc_http_request_t* self)
 {
   if (self == NULL)
   {
     return KC_NULL_REFERENCE;
   }
 
-  // validate the URL before creating the request object
-  if (validate_http_url(url) != KC_SUCCESS)
+  char* content_type = get_req_header(self, "Content-Type");
+  if (content_type == NULL ||
+      http_parse_content_type(content_type) != KC_BODY_CONTENT_TYPE_FORM)
   {
     return KC_INVALID;
   }
 
-  // if the field is being reset, free the memory first
-  if (self->url != NULL)
+  // decode the query string first, the form fields are added next to it
+  if (self->_params_parsed == false)
   {
-    free(self->url);
+    self->_params_parsed = true;
+
+    int ret = http_parse_query_string(self->_raw_query,
+        self->_raw_query_len, self->params);
+
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
   }
 
-  // allocate memory
-  self->url = (char*)malloc(sizeof(char) * strlen(url) + 1);
-  if (self->url == NULL)
+  struct kc_urlencoded_t* form = new_urlencoded(self->params);
+  if (form == NULL)
   {
     return KC_OUT_OF_MEMORY;
   }
 
-  // copy the string
-  strcpy(self->url, url);
+  char chunk[KC_HTTP_BODY_CHUNK_SIZE];
+  size_t chunk_len = 0;
+  int ret = KC_SUCCESS;
 
-  return KC_SUCCESS;
+  do
+  {
+    ret = read_req_body(self, chunk, sizeof(chunk), &chunk_len);
+    if (ret == KC_SUCCESS && chunk_len > 0)
+    {
+      ret = form->feed(form, chunk, chunk_len);
+    }
+  }
+  while (ret == KC_SUCCESS && chunk_len > 0);
+
+  if (ret == KC_SUCCESS)
+  {
+    ret = form->finish(form);
+  }
+
+  destroy_urlencoded(form);
+
+  return ret;
 }
 
 //---------------------------------------------------------------------------//
 
-int _set_req_http_ver(struct kc_http_request_t* self, char* http_ver)
+int read_req_multipart(struct kc_http_request_t* self, struct kc_multipart_t* form)
+{
+  if (self == NULL || form == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  char chunk[KC_HTTP_BODY_CHUNK_SIZE];
+  size_t chunk_len = 0;
+  int ret = KC_SUCCESS;
+
+  do
+  {
+    ret = read_req_body(self, chunk, sizeof(chunk), &chunk_len);
+    if (ret == KC_SUCCESS && chunk_len > 0)
+    {
+      ret = form->feed(form, chunk, chunk_len);
+    }
+  }
+  while (ret == KC_SUCCESS && chunk_len > 0);
+
+  // close the files even if the body was cut short
+  int finish_ret = form->finish(form);
+
+  return (ret != KC_SUCCESS) ? ret : finish_ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int _set_req_method(struct kc_http_request_t* self, char* method)
 {
   if (self == NULL)
   {
     return KC_NULL_REFERENCE;
   }
 
-  // validate the HTTP version before creating the request
-  if (validate_http_ver(http_ver) != KC_SUCCESS)
+  // validate the method before creating the request object
+  if (validate_http_method(method) != KC_SUCCESS)
   {
     return KC_INVALID;
   }
 
-  // if the field is being reset, free the memory first
-  if (self->http_ver != NULL)
+  return _req_copy(self, &self->method, method);
+}
+
+//---------------------------------------------------------------------------//
+
+int _set_req_url(struct kc_http_request_t* self, char* url)
+{
+  if (self == NULL)
   {
-    free(self->http_ver);
+    return KC_NULL_REFERENCE;
   }
 
-  // allocate memory
-  self->http_ver = (char*)malloc(sizeof(char) * strlen(http_ver) + 1);
-  if (self->http_ver == NULL)
+  // validate the URL before creating the request object
+  if (validate_http_url(url) != KC_SUCCESS)
   {
-    return KC_OUT_OF_MEMORY;
+    return KC_INVALID;
   }
 
-  // copy the string
-  strcpy(self->http_ver, http_ver);
+  return _req_copy(self, &self->url, url);
+}
 
-  return KC_SUCCESS;
+//---------------------------------------------------------------------------//
+
+int _set_req_http_ver(struct kc_http_request_t* self, char* http_ver)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // validate the HTTP version before creating the request
+  if (validate_http_ver(http_ver) != KC_SUCCESS)
+  {
+    return KC_INVALID;
+  }
+
+  return _req_copy(self, &self->http_ver, http_ver);
 }
 
 //---------------------------------------------------------------------------//
@@ -338,31 +547,269 @@ int _set_req_body(struct kc_http_request_t* self, char* body)
     return KC_INVALID;
   }
 
+  return _req_copy(self, &self->body, body);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _init_request(struct kc_http_request_t* req)
+{
+  // asign the values
+  req->method    = NULL;
+  req->url       = NULL;
+  req->http_ver  = NULL;
+  req->body      = NULL;
+  req->client_fd = 0;
+
+  // nothing to parse until the request line and headers are set
+  req->_raw_query       = NULL;
+  req->_raw_query_len   = 0;
+  req->_params_parsed   = false;
+  req->_raw_headers     = NULL;
+  req->_raw_headers_len = 0;
+  req->_headers_parsed  = false;
+
+  req->_json = NULL;
+
+  // nothing to read until the server finds the body
+  req->_body_buffered     = NULL;
+  req->_body_buffered_len = 0;
+  req->_body_left         = 0;
+  req->_receive           = NULL;
+
+  // the server sets the chain once the route is known
+  req->_chain     = NULL;
+  req->_chain_len = 0;
+  req->_chain_pos = 0;
+
+  // asign the methods
+  req->get_header = get_req_header;
+  req->get_param  = get_req_param;
+  req->get_json   = get_req_json;
+
+  req->read_body      = read_req_body;
+  req->read_form      = read_req_form;
+  req->read_multipart = read_req_multipart;
+
+}
+
+//---------------------------------------------------------------------------//
+
+static int _req_copy(struct kc_http_request_t* self, char** field, const char* str)
+{
+  size_t len = strlen(str) + 1;
+
+  // the old value stays in the arena until it is reset
+  if (self->_in_arena)
+  {
+    *field = self->arena->dup(self->arena, str, len);
+    return (*field != NULL) ? KC_SUCCESS : KC_OUT_OF_MEMORY;
+  }
+
   // if the field is being reset, free the memory first
-  if (self->body != NULL)
+  if (*field != NULL)
   {
-    free(self->body);
+    free(*field);
   }
 
-  // allocate memory
-  self->body = (char*)malloc(sizeof(char) * strlen(body) + 1);
-  if (self->body == NULL)
+  // allocate memory and copy the string
+  *field = (char*)malloc(sizeof(char) * len);
+  if (*field == NULL)
   {
     return KC_OUT_OF_MEMORY;
   }
 
-  // copy the string
-  strcpy(self->body, body);
+  memcpy(*field, str, len);
 
   return KC_SUCCESS;
 }
 
 //--- MARK: PUBLIC RESPONSE FUNCTION PROTOTYPES -----------------------------//
 
+struct kc_http_response_t* new_response        (void);
+struct kc_http_response_t* new_arena_response  (struct kc_arena_t* arena);
+void                       destroy_response    (struct kc_http_response_t* res);
+
 int add_res_header       (struct kc_http_response_t* self, char* key, char* val);
 int set_res_http_ver     (struct kc_http_response_t* self, char* http_ver);
+int set_res_status       (struct kc_http_response_t* self, int status);
 int set_res_status_code  (struct kc_http_response_t* self, char* status_code);
 int set_res_body         (struct kc_http_response_t* self, char* body);
+int set_res_json         (struct kc_http_response_t* self, struct kc_json_writer_t* writer);
+int set_res_file         (struct kc_http_response_t* self, struct kc_file_t* file, size_t offset, size_t len);
+
+//--- MARK: PRIVATE RESPONSE FUNCTION PROTOTYPES ----------------------------//
+
+static void  _init_response  (struct kc_http_response_t* res);
+static char* _res_alloc      (struct kc_http_response_t* self, size_t size);
+
+//---------------------------------------------------------------------------//
+
+#define _STATUS_LINE(code, reason)  [code] = "HTTP/1.1 " #code " " reason "\r\n"
+
+// every status line rendered once, indexed by the status code
+static const char* const _status_lines[600] =
+{
+  _STATUS_LINE(100, "Continue"),
+  _STATUS_LINE(101, "Switching Protocols"),
+
+  _STATUS_LINE(200, "OK"),
+  _STATUS_LINE(201, "Created"),
+  _STATUS_LINE(202, "Accepted"),
+  _STATUS_LINE(203, "Non-Authoritative Information"),
+  _STATUS_LINE(204, "No Content"),
+  _STATUS_LINE(205, "Reset Content"),
+  _STATUS_LINE(206, "Partial Content"),
+
+  _STATUS_LINE(300, "Multiple Choices"),
+  _STATUS_LINE(301, "Moved Permanently"),
+  _STATUS_LINE(302, "Found"),
+  _STATUS_LINE(303, "See Other"),
+  _STATUS_LINE(304, "Not Modified"),
+  _STATUS_LINE(305, "Use Proxy"),
+  _STATUS_LINE(307, "Temporary Redirect"),
+  _STATUS_LINE(308, "Permanent Redirect"),
+
+  _STATUS_LINE(400, "Bad Request"),
+  _STATUS_LINE(401, "Unauthorized"),
+  _STATUS_LINE(402, "Payment Required"),
+  _STATUS_LINE(403, "Forbidden"),
+  _STATUS_LINE(404, "Not Found"),
+  _STATUS_LINE(405, "Method Not Allowed"),
+  _STATUS_LINE(406, "Not Acceptable"),
+  _STATUS_LINE(407, "Proxy Authentication Required"),
+  _STATUS_LINE(408, "Request Timeout"),
+  _STATUS_LINE(409, "Conflict"),
+  _STATUS_LINE(410, "Gone"),
+  _STATUS_LINE(411, "Length Required"),
+  _STATUS_LINE(412, "Precondition Failed"),
+  _STATUS_LINE(413, "Payload Too Large"),
+  _STATUS_LINE(414, "URI Too Long"),
+  _STATUS_LINE(415, "Unsupported Media Type"),
+  _STATUS_LINE(416, "Range Not Satisfiable"),
+  _STATUS_LINE(417, "Expectation Failed"),
+  _STATUS_LINE(426, "Upgrade Required"),
+  _STATUS_LINE(429, "Too Many Requests"),
+
+  _STATUS_LINE(500, "Internal Server Error"),
+  _STATUS_LINE(501, "Not Implemented"),
+  _STATUS_LINE(502, "Bad Gateway"),
+  _STATUS_LINE(503, "Service Unavailable"),
+  _STATUS_LINE(504, "Gateway Timeout"),
+  _STATUS_LINE(505, "HTTP Version Not Supported"),
+};
+
+#define _HEADER_NAME(name)  { name ": ", sizeof(name ": ") - 1 }
+
+// the common header names, rendered with the separator
+static const struct
+{
+  const char* name;
+  size_t len;
+}
+_header_names[] =
+{
+  _HEADER_NAME(KC_HTTP_HEADER_ACCEPT_RANGES),
+  _HEADER_NAME(KC_HTTP_HEADER_CACHE_CONTROL),
+  _HEADER_NAME(KC_HTTP_HEADER_CONNECTION),
+  _HEADER_NAME(KC_HTTP_HEADER_CONTENT_ENCODING),
+  _HEADER_NAME(KC_HTTP_HEADER_CONTENT_LENGTH),
+  _HEADER_NAME(KC_HTTP_HEADER_CONTENT_RANGE),
+  _HEADER_NAME(KC_HTTP_HEADER_CONTENT_TYPE),
+  _HEADER_NAME(KC_HTTP_HEADER_DATE),
+  _HEADER_NAME(KC_HTTP_HEADER_ETAG),
+  _HEADER_NAME(KC_HTTP_HEADER_EXPIRES),
+  _HEADER_NAME(KC_HTTP_HEADER_KEEP_ALIVE),
+  _HEADER_NAME(KC_HTTP_HEADER_LAST_MODIFIED),
+  _HEADER_NAME(KC_HTTP_HEADER_LOCATION),
+  _HEADER_NAME(KC_HTTP_HEADER_SERVER),
+  _HEADER_NAME(KC_HTTP_HEADER_SET_COOKIE),
+  _HEADER_NAME(KC_HTTP_HEADER_TRANSFER_ENCODING),
+  _HEADER_NAME(KC_HTTP_HEADER_UPGRADE),
+  _HEADER_NAME(KC_HTTP_HEADER_VARY),
+};
+
+// the media types of the common file extensions
+static const struct
+{
+  const char* extension;
+  const char* type;
+}
+_mime_types[] =
+{
+  { "css",   "text/css; charset=utf-8"        },
+  { "csv",   "text/csv; charset=utf-8"        },
+  { "gif",   "image/gif"                      },
+  { "gz",    "application/gzip"               },
+  { "htm",   "text/html; charset=utf-8"       },
+  { "html",  "text/html; charset=utf-8"       },
+  { "ico",   "image/x-icon"                   },
+  { "jpeg",  "image/jpeg"                     },
+  { "jpg",   "image/jpeg"                     },
+  { "js",    "text/javascript; charset=utf-8" },
+  { "json",  "application/json"               },
+  { "map",   "application/json"               },
+  { "md",    "text/markdown; charset=utf-8"   },
+  { "mjs",   "text/javascript; charset=utf-8" },
+  { "mp3",   "audio/mpeg"                     },
+  { "mp4",   "video/mp4"                      },
+  { "ogg",   "audio/ogg"                      },
+  { "otf",   "font/otf"                       },
+  { "pdf",   "application/pdf"                },
+  { "png",   "image/png"                      },
+  { "svg",   "image/svg+xml"                  },
+  { "tar",   "application/x-tar"              },
+  { "ttf",   "font/ttf"                       },
+  { "txt",   "text/plain; charset=utf-8"      },
+  { "wasm",  "application/wasm"               },
+  { "wav",   "audio/wav"                      },
+  { "webm",  "video/webm"                     },
+  { "webp",  "image/webp"                     },
+  { "woff",  "font/woff"                      },
+  { "woff2", "font/woff2"                     },
+  { "xml",   "application/xml"                },
+  { "zip",   "application/zip"                },
+};
+
+//---------------------------------------------------------------------------//
+
+const char* http_status_line(int status, size_t* len)
+{
+  if (status < 0 || status >= 600 || _status_lines[status] == NULL)
+  {
+    return NULL;
+  }
+
+  if (len != NULL)
+  {
+    (*len) = strlen(_status_lines[status]);
+  }
+
+  return _status_lines[status];
+}
+
+//---------------------------------------------------------------------------//
+
+const char* http_mime_type(const char* path)
+{
+  const char* extension = (path != NULL) ? strrchr(path, '.') : NULL;
+
+  // the extension must be part of the file name, not of a directory
+  if (extension == NULL || strchr(extension, '/') != NULL)
+  {
+    return KC_HTTP_DEFAULT_MIME_TYPE;
+  }
+
+  for (size_t i = 0; i < sizeof(_mime_types) / sizeof(_mime_types[0]); ++i)
+  {
+    if (strcasecmp(extension + 1, _mime_types[i].extension) == 0)
+    {
+      return _mime_types[i].type;
+    }
+  }
+
+  return KC_HTTP_DEFAULT_MIME_TYPE;
+}
 
 //---------------------------------------------------------------------------//
 
@@ -377,18 +824,39 @@ struct kc_http_response_t* new_response(void)
     return NULL;
   }
 
-  // asign the values
-  new_res->http_ver    = NULL;
-  new_res->status_code = NULL;
-  new_res->body        = NULL;
-  new_res->headers[0]  = NULL;
-  new_res->headers_len = 0;
+  // the response owns its memory
+  new_res->_arena    = NULL;
+  new_res->_in_arena = false;
 
-  // asign the methods
-  new_res->set_header      = add_res_header;
-  new_res->set_http_ver    = set_res_http_ver;
-  new_res->set_status_code = set_res_status_code;
-  new_res->set_body        = set_res_body;
+  _init_response(new_res);
+
+  return new_res;
+}
+
+//---------------------------------------------------------------------------//
+
+struct kc_http_response_t* new_arena_response(struct kc_arena_t* arena)
+{
+  if (arena == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  struct kc_http_response_t* new_res = arena->alloc(arena, sizeof(struct kc_http_response_t));
+
+  // check the allocation of the memory
+  if (new_res == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  // the long header lists and the body go in the same arena
+  new_res->_arena    = arena;
+  new_res->_in_arena = true;
+
+  _init_response(new_res);
 
   return new_res;
 }
@@ -402,24 +870,36 @@ void destroy_response(struct kc_http_response_t* res)
     return;
   }
 
-  if (res->http_ver != NULL)
+  // the body handed over by a JSON writer is always on the heap
+  if (res->body != NULL && res->_heap_body)
+  {
+    free(res->body);
+  }
+
+  // the response owns the file it sends
+  if (res->_file != NULL)
   {
-    free(res->http_ver);
+    destroy_file(res->_file);
   }
 
-  if (res->http_ver != NULL)
+  // the copy that was not taken by a cache
+  free(res->_record);
+
+  // everything else is released when the arena is reset
+  if (res->_in_arena)
   {
-    free(res->status_code);
+    return;
   }
 
-  if (res->http_ver != NULL)
+  // the list moved to the heap
+  if (res->headers != res->_inline_headers)
   {
-    free(res->body);
+    free(res->headers);
   }
 
-  for (int i = 0; i < res->headers_len; ++i)
+  if (res->_arena != NULL)
   {
-    destroy_header(res->headers[i]);
+    destroy_arena(res->_arena);
   }
 
   free(res);
@@ -434,35 +914,108 @@ int add_res_header(struct kc_http_response_t* self, char* key, char* val)
     return KC_NULL_REFERENCE;
   }
 
-  // search for the header
+  if (key == NULL || val == NULL)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  size_t key_len = strlen(key);
+  size_t val_len = strlen(val);
+
+  // search for the header (the rendered key ends with ": ")
+  struct kc_http_header_t* header = NULL;
+
   for (int i = 0; i < self->headers_len; ++i)
   {
-    if (strcmp(self->headers[i]->key, key) == 0)
+    if (self->headers[i].key_len == key_len + 2 &&
+        strncasecmp(self->headers[i].key, key, key_len) == 0)
+    {
+      header = &self->headers[i];
+      break;
+    }
+  }
+
+  if (header == NULL)
+  {
+    // double the list when it's full, it moves to the heap only once
+    if (self->headers_len == self->_headers_cap)
     {
-      // free the header first
-      destroy_header(self->headers[i]);
+      int cap = self->_headers_cap * 2;
+
+      struct kc_http_header_t* headers = NULL;
+
+      if (self->_in_arena)
+      {
+        headers = self->_arena->alloc(self->_arena, sizeof(struct kc_http_header_t) * cap);
+      }
+      else
+      {
+        headers = (self->headers == self->_inline_headers) ?
+            malloc(sizeof(struct kc_http_header_t) * cap) :
+            realloc(self->headers, sizeof(struct kc_http_header_t) * cap);
+      }
 
-      // create a new header
-      self->headers[i] = new_header(key, val);
-      if (self->headers[i] == NULL)
+      if (headers == NULL)
       {
         return KC_OUT_OF_MEMORY;
       }
 
-      return KC_SUCCESS;
+      // the arena lists are never resized in place, the current list (the
+      // inline one at first) is copied to the new one
+      if (self->headers == self->_inline_headers || self->_in_arena)
+      {
+        memcpy(headers, self->headers,
+            sizeof(struct kc_http_header_t) * self->headers_len);
+      }
+
+      self->headers      = headers;
+      self->_headers_cap = cap;
     }
+
+    header = &self->headers[self->headers_len];
+
+    // the common names are constants, the others are copied
+    header->key = NULL;
+    for (size_t i = 0; i < sizeof(_header_names) / sizeof(_header_names[0]); ++i)
+    {
+      if (_header_names[i].len == key_len + 2 &&
+          strncasecmp(_header_names[i].name, key, key_len) == 0)
+      {
+        header->key     = _header_names[i].name;
+        header->key_len = _header_names[i].len;
+        break;
+      }
+    }
+
+    if (header->key == NULL)
+    {
+      char* rendered = _res_alloc(self, key_len + 3);
+      if (rendered == NULL)
+      {
+        return KC_OUT_OF_MEMORY;
+      }
+
+      memcpy(rendered, key, key_len);
+      memcpy(rendered + key_len, ": ", 3);
+
+      header->key     = rendered;
+      header->key_len = key_len + 2;
+    }
+
+    self->headers_len++;
   }
 
-  // create a new header to be asign
-  struct kc_http_header_t* header = new_header(key, val);
-  if (header == NULL)
+  // the value is always copied, the caller may reuse its buffer
+  char* copy = _res_alloc(self, val_len + 1);
+  if (copy == NULL)
   {
     return KC_OUT_OF_MEMORY;
   }
 
-  // asign the header
-  self->headers[self->headers_len] = header;
-  self->headers_len++;
+  memcpy(copy, val, val_len + 1);
+
+  header->val     = copy;
+  header->val_len = val_len;
 
   return KC_SUCCESS;
 }
@@ -476,21 +1029,47 @@ int set_res_http_ver(struct kc_http_response_t* self, char* http_ver)
     return KC_NULL_REFERENCE;
   }
 
-  // if the field is being reset, free the memory first
-  if (self->http_ver != NULL)
+  if (http_ver == NULL)
   {
-    free(self->http_ver);
+    return KC_INVALID_ARGUMENT;
   }
 
-  // allocate memory
-  self->http_ver = (char*)malloc(sizeof(char) * strlen(http_ver) + 1);
-  if (self->http_ver == NULL)
+  // only the known versions, so the version is never copied
+  if (strcmp(http_ver, KC_HTTP_1) == 0)
   {
-    return KC_OUT_OF_MEMORY;
+    self->http_ver = KC_HTTP_1;
+  }
+  else if (strcmp(http_ver, KC_HTTP_2) == 0)
+  {
+    self->http_ver = KC_HTTP_2;
+  }
+  else if (strcmp(http_ver, "HTTP/1.0") == 0)
+  {
+    self->http_ver = "HTTP/1.0";
+  }
+  else
+  {
+    return KC_INVALID_ARGUMENT;
   }
 
-  // copy the string
-  strcpy(self->http_ver, http_ver);
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int set_res_status(struct kc_http_response_t* self, int status)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  if (status < 100 || status > 599)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  self->status = status;
 
   return KC_SUCCESS;
 }
@@ -504,51 +1083,184 @@ int set_res_status_code(struct kc_http_response_t* self, char* status_code)
     return KC_NULL_REFERENCE;
   }
 
+  if (status_code == NULL)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // only the code matters (ex: "404 Not Found"), the reason is a constant
+  return set_res_status(self, atoi(status_code));
+}
+
+//---------------------------------------------------------------------------//
+
+int set_res_body(struct kc_http_response_t* self, char* body)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
   // if the field is being reset, free the memory first
-  if (self->status_code != NULL)
+  if (self->body != NULL && self->_heap_body)
   {
-    free(self->status_code);
+    free(self->body);
   }
 
+  self->body_len = strlen(body);
+
   // allocate memory
-  self->status_code = (char*)malloc(sizeof(char) * strlen(status_code) + 1);
-  if (self->status_code == NULL)
+  self->body = self->_in_arena ?
+      self->_arena->alloc(self->_arena, self->body_len + 1) :
+      (char*)malloc(sizeof(char) * self->body_len + 1);
+
+  self->_heap_body = !self->_in_arena;
+
+  if (self->body == NULL)
   {
+    self->body_len = 0;
     return KC_OUT_OF_MEMORY;
   }
 
   // copy the string
-  strcpy(self->status_code, status_code);
+  memcpy(self->body, body, self->body_len + 1);
 
   return KC_SUCCESS;
 }
 
 //---------------------------------------------------------------------------//
 
-int set_res_body(struct kc_http_response_t* self, char* body)
+int set_res_json(struct kc_http_response_t* self, struct kc_json_writer_t* writer)
 {
-  if (self == NULL)
+  if (self == NULL || writer == NULL)
   {
     return KC_NULL_REFERENCE;
   }
 
+  // nothing was written, or the buffer was already released
+  if (writer->buffer == NULL)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
   // if the field is being reset, free the memory first
-  if (self->body != NULL)
+  if (self->body != NULL && self->_heap_body)
   {
     free(self->body);
   }
 
-  // allocate memory
-  self->body = (char*)malloc(sizeof(char) * strlen(body) + 3);
-  if (self->body == NULL)
+  // the response takes over the buffer, no copy is made
+  writer->release(writer, &self->body, &self->body_len);
+  self->_heap_body = true;
+
+  return add_res_header(self, KC_HTTP_HEADER_CONTENT_TYPE, "application/json");
+}
+
+//---------------------------------------------------------------------------//
+
+int set_res_file(struct kc_http_response_t* self, struct kc_file_t* file, size_t offset, size_t len)
+{
+  if (self == NULL || file == NULL)
   {
-    return KC_OUT_OF_MEMORY;
+    return KC_NULL_REFERENCE;
   }
 
-  // copy the string
-  strcpy(self->body, body);
+  if (file->opened == false)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // a file set before is not needed anymore
+  if (self->_file != NULL && self->_file != file)
+  {
+    destroy_file(self->_file);
+  }
+
+  // the bytes are sent by the kernel, straight from the file
+  self->_file        = file;
+  self->_file_offset = offset;
+  self->_file_len    = len;
 
   return KC_SUCCESS;
 }
 
 //---------------------------------------------------------------------------//
+
+static void _init_response(struct kc_http_response_t* res)
+{
+  // asign the values, every response starts as "HTTP/1.1 200 OK"
+  res->http_ver    = KC_HTTP_1;
+  res->status      = KC_HTTP_OK;
+  res->body        = NULL;
+  res->body_len    = 0;
+  res->_heap_body  = false;
+
+  res->_file        = NULL;
+  res->_file_offset = 0;
+  res->_file_len    = 0;
+
+  res->headers      = res->_inline_headers;
+  res->headers_len  = 0;
+  res->_headers_cap = KC_HTTP_INLINE_HEADERS;
+
+  res->_header_data_len = 0;
+  res->_sent            = false;
+
+  res->_record_max      = 0;
+  res->_record          = NULL;
+  res->_record_len      = 0;
+  res->_record_head_len = 0;
+
+  res->_stream      = KC_HTTP_STREAM_NONE;
+  res->_stream_fd   = -1;
+  res->_chunked     = true;
+  res->_until_close = false;
+  res->_h2          = NULL;
+  res->_deferred    = NULL;
+
+  // asign the methods
+  res->set_header      = add_res_header;
+  res->set_http_ver    = set_res_http_ver;
+  res->set_status      = set_res_status;
+  res->set_status_code = set_res_status_code;
+  res->set_body        = set_res_body;
+  res->set_json        = set_res_json;
+  res->set_file        = set_res_file;
+
+  // the pieces of a stream are sent by the server
+  res->begin_stream    = begin_stream_server;
+  res->write_chunk     = write_chunk_server;
+  res->end             = end_stream_server;
+
+  // and so is a deferred response
+  res->defer           = defer_server;
+  res->complete        = complete_server;
+}
+
+//---------------------------------------------------------------------------//
+
+static char* _res_alloc(struct kc_http_response_t* self, size_t size)
+{
+  // the small strings go in the response itself
+  if (self->_header_data_len + size <= sizeof(self->_header_data))
+  {
+    char* ptr = self->_header_data + self->_header_data_len;
+    self->_header_data_len += size;
+
+    return ptr;
+  }
+
+  // the rest in an arena, created only if needed
+  if (self->_arena == NULL)
+  {
+    self->_arena = new_arena(0);
+    if (self->_arena == NULL)
+    {
+      return NULL;
+    }
+  }
+
+  return self->_arena->alloc(self->_arena, size);
+}
+
+//---------------------------------------------------------------------------//
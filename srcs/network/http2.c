@@ -0,0 +1,1788 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// http2.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/http2.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+// the most frames a header block of a response is split in, sent at once
+#define KC_HTTP2_MAX_HEADER_FRAMES                                           16
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int  receive_http2       (struct kc_http2_t* self, char* data, size_t len);
+static int  send_headers_http2  (struct kc_http2_t* self, struct kc_http2_stream_t* stream,
+    const struct kc_http2_field_t* fields, size_t fields_len, bool end_stream);
+static int  send_data_http2     (struct kc_http2_t* self, struct kc_http2_stream_t* stream,
+    const char* data, size_t len, bool end_stream);
+static int  reset_http2         (struct kc_http2_t* self, struct kc_http2_stream_t* stream, uint32_t code);
+static int  goaway_http2        (struct kc_http2_t* self, uint32_t code);
+static int  upgrade_http2       (struct kc_http2_t* self, const uint8_t* settings, size_t len,
+    struct kc_http2_stream_t** stream);
+static void finish_http2        (struct kc_http2_t* self, struct kc_http2_stream_t* stream);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int  _send_preface      (struct kc_http2_t* self);
+static int  _process_frame     (struct kc_http2_t* self, uint8_t type, uint8_t flags, uint32_t id, uint8_t* payload, size_t len);
+static int  _on_data           (struct kc_http2_t* self, uint8_t flags, uint32_t id, uint8_t* payload, size_t len);
+static int  _on_headers        (struct kc_http2_t* self, uint8_t flags, uint32_t id, uint8_t* payload, size_t len);
+static int  _on_continuation   (struct kc_http2_t* self, uint8_t flags, uint32_t id, uint8_t* payload, size_t len);
+static int  _on_header_block   (struct kc_http2_t* self, uint8_t flags, uint32_t id, const uint8_t* block, size_t len, bool self_dependent);
+static int  _on_rst_stream     (struct kc_http2_t* self, uint32_t id, uint8_t* payload, size_t len);
+static int  _on_settings       (struct kc_http2_t* self, uint8_t flags, uint32_t id, uint8_t* payload, size_t len);
+static int  _apply_settings    (struct kc_http2_t* self, const uint8_t* payload, size_t len);
+static int  _on_window_update  (struct kc_http2_t* self, uint32_t id, uint8_t* payload, size_t len);
+static int  _stream_header     (void* data, const char* name, size_t name_len, const char* value, size_t value_len);
+static int  _ignore_header     (void* data, const char* name, size_t name_len, const char* value, size_t value_len);
+static struct kc_http2_stream_t* _new_stream   (struct kc_http2_t* self, uint32_t id);
+static struct kc_http2_stream_t* _find_stream  (struct kc_http2_t* self, uint32_t id);
+static void _remove_stream     (struct kc_http2_t* self, struct kc_http2_stream_t* stream);
+static int  _stream_ready      (struct kc_http2_t* self, struct kc_http2_stream_t* stream);
+static int  _dispatch          (struct kc_http2_t* self);
+static int  _fail              (struct kc_http2_t* self, uint32_t code);
+static int  _refuse            (struct kc_http2_t* self, uint32_t id, uint32_t code);
+static int  _write             (struct kc_http2_t* self, struct iovec* iov, int iov_len);
+static int  _write_frame       (struct kc_http2_t* self, uint8_t type, uint8_t flags, uint32_t id, const void* payload, size_t len);
+static int  _wait_window       (struct kc_http2_t* self);
+static int  _append            (struct kc_http2_buffer_t* buffer, const char* data, size_t len, size_t limit);
+static int  _append_name       (struct kc_http2_buffer_t* buffer, const char* name, size_t len);
+static bool _is_token          (const char* str, size_t len, bool lowercase);
+static void _frame_header      (uint8_t header[KC_HTTP2_FRAME_HEADER_SIZE], size_t len, uint8_t type, uint8_t flags, uint32_t id);
+static uint32_t _read_u32      (const uint8_t* data);
+static void     _write_u32     (uint8_t* data, uint32_t value);
+
+//---------------------------------------------------------------------------//
+
+struct kc_http2_t* new_http2(int client_fd, void (*on_request)(struct kc_http2_t* h2, struct kc_http2_stream_t* stream))
+{
+  if (client_fd < 0 || on_request == NULL)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
+  // create a http2 instance to be returned
+  struct kc_http2_t* new_http2 = malloc(sizeof(struct kc_http2_t));
+
+  // confirm that there is memory to allocate
+  if (new_http2 == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  memset(new_http2, 0, sizeof(struct kc_http2_t));
+
+  new_http2->client_fd  = client_fd;
+  new_http2->on_request = on_request;
+
+  // until the client says otherwise, the defaults of the RFC
+  new_http2->_peer_max_frame_size = KC_HTTP2_MAX_FRAME_SIZE;
+  new_http2->_peer_initial_window = KC_HTTP2_DEFAULT_WINDOW_SIZE;
+  new_http2->_send_window         = KC_HTTP2_DEFAULT_WINDOW_SIZE;
+  new_http2->_recv_window         = KC_HTTP2_DEFAULT_WINDOW_SIZE;
+
+  new_http2->_decoder = new_hpack(KC_HPACK_TABLE_SIZE);
+  new_http2->_encoder = new_hpack(KC_HPACK_TABLE_SIZE);
+  new_http2->_payload = malloc(KC_HTTP2_MAX_FRAME_SIZE);
+
+  if (new_http2->_decoder == NULL || new_http2->_encoder == NULL || new_http2->_payload == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    destroy_http2(new_http2);
+    return NULL;
+  }
+
+  pthread_mutex_init(&new_http2->_send_lock, NULL);
+
+  // assigns the public member methods
+  new_http2->receive      = receive_http2;
+  new_http2->send_headers = send_headers_http2;
+  new_http2->send_data    = send_data_http2;
+  new_http2->reset        = reset_http2;
+  new_http2->goaway       = goaway_http2;
+  new_http2->upgrade      = upgrade_http2;
+  new_http2->finish       = finish_http2;
+
+  return new_http2;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_http2(struct kc_http2_t* http2)
+{
+  if (http2 == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  while (http2->_streams != NULL)
+  {
+    _remove_stream(http2, http2->_streams);
+  }
+
+  if (http2->_decoder != NULL)
+  {
+    destroy_hpack(http2->_decoder);
+  }
+
+  if (http2->_encoder != NULL)
+  {
+    destroy_hpack(http2->_encoder);
+  }
+
+  // the lock exists only once the methods are assigned
+  if (http2->receive != NULL)
+  {
+    pthread_mutex_destroy(&http2->_send_lock);
+  }
+
+  free(http2->_block.data);
+  free(http2->_payload);
+  free(http2);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int receive_http2(struct kc_http2_t* self, char* data, size_t len)
+{
+  if (self == NULL || (data == NULL && len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  int ret = _send_preface(self);
+  size_t used = 0;
+
+  while (ret == KC_SUCCESS && self->_failed == false)
+  {
+    // the client starts with the preface, then its settings
+    if (self->_preface_len < KC_HTTP2_PREFACE_SIZE)
+    {
+      if (used == len)
+      {
+        break;
+      }
+
+      size_t take = KC_HTTP2_PREFACE_SIZE - self->_preface_len;
+      take = (take < len - used) ? take : len - used;
+
+      if (memcmp(data + used, KC_HTTP2_PREFACE + self->_preface_len, take) != 0)
+      {
+        return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+      }
+
+      self->_preface_len += take;
+      used += take;
+
+      continue;
+    }
+
+    // the header of the frame first, it tells the size of the payload
+    if (self->_frame_header_len < KC_HTTP2_FRAME_HEADER_SIZE)
+    {
+      if (used == len)
+      {
+        break;
+      }
+
+      size_t take = KC_HTTP2_FRAME_HEADER_SIZE - self->_frame_header_len;
+      take = (take < len - used) ? take : len - used;
+
+      memcpy(self->_frame_header + self->_frame_header_len, data + used, take);
+      self->_frame_header_len += take;
+      used += take;
+
+      if (self->_frame_header_len < KC_HTTP2_FRAME_HEADER_SIZE)
+      {
+        break;
+      }
+
+      self->_payload_len = 0;
+    }
+
+    size_t length = ((size_t)self->_frame_header[0] << 16) |
+        ((size_t)self->_frame_header[1] << 8) | self->_frame_header[2];
+
+    uint8_t  type  = self->_frame_header[3];
+    uint8_t  flags = self->_frame_header[4];
+    uint32_t id    = _read_u32(self->_frame_header + 5) & 0x7FFFFFFF;
+
+    // the server allows no frame bigger than its setting
+    if (length > KC_HTTP2_MAX_FRAME_SIZE)
+    {
+      return _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+    }
+
+    // a payload that came whole is used from where it is
+    if (self->_payload_len == 0 && len - used >= length)
+    {
+      ret = _process_frame(self, type, flags, id, (uint8_t*)data + used, length);
+
+      used += length;
+      self->_frame_header_len = 0;
+
+      continue;
+    }
+
+    if (used == len)
+    {
+      break;
+    }
+
+    size_t take = length - self->_payload_len;
+    take = (take < len - used) ? take : len - used;
+
+    memcpy(self->_payload + self->_payload_len, data + used, take);
+    self->_payload_len += take;
+    used += take;
+
+    if (self->_payload_len == length)
+    {
+      ret = _process_frame(self, type, flags, id, self->_payload, length);
+
+      self->_frame_header_len = 0;
+      self->_payload_len = 0;
+    }
+  }
+
+  if (ret != KC_SUCCESS || self->_failed)
+  {
+    return (ret != KC_SUCCESS) ? ret : KC_PROTOCOL_ERROR;
+  }
+
+  // the requests are handled once the whole piece is parsed
+  return _dispatch(self);
+}
+
+//---------------------------------------------------------------------------//
+
+static int send_headers_http2(struct kc_http2_t* self, struct kc_http2_stream_t* stream,
+    const struct kc_http2_field_t* fields, size_t fields_len, bool end_stream)
+{
+  if (self == NULL || stream == NULL || (fields == NULL && fields_len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // the names and values never grow, the integers take a few bytes
+  size_t size = 32;
+  for (size_t i = 0; i < fields_len; ++i)
+  {
+    size += fields[i].name_len + fields[i].value_len + 24;
+  }
+
+  uint8_t* block = malloc(size);
+  if (block == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // the blocks are encoded in the order they are sent
+  pthread_mutex_lock(&self->_send_lock);
+
+  if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) == KC_HTTP2_STATE_CLOSED || self->_failed)
+  {
+    pthread_mutex_unlock(&self->_send_lock);
+    free(block);
+
+    return KC_LOST_CONNECTION;
+  }
+
+  size_t block_len = 0;
+  int ret = KC_SUCCESS;
+
+  for (size_t i = 0; i < fields_len && ret == KC_SUCCESS; ++i)
+  {
+    ret = self->_encoder->encode(self->_encoder, fields[i].name, fields[i].name_len,
+        fields[i].value, fields[i].value_len, block, size, &block_len);
+  }
+
+  // the block goes in a HEADERS frame, and as many CONTINUATION as needed
+  size_t frames = (block_len + self->_peer_max_frame_size - 1) / self->_peer_max_frame_size;
+  frames = (frames == 0) ? 1 : frames;
+
+  if (ret == KC_SUCCESS && frames > KC_HTTP2_MAX_HEADER_FRAMES)
+  {
+    ret = KC_OVERFLOW;
+  }
+
+  if (ret == KC_SUCCESS)
+  {
+    uint8_t headers[KC_HTTP2_MAX_HEADER_FRAMES][KC_HTTP2_FRAME_HEADER_SIZE];
+    struct iovec iov[KC_HTTP2_MAX_HEADER_FRAMES * 2];
+    size_t offset = 0;
+
+    for (size_t i = 0; i < frames; ++i)
+    {
+      size_t frame_len = block_len - offset;
+      frame_len = (frame_len < self->_peer_max_frame_size) ? frame_len : self->_peer_max_frame_size;
+
+      uint8_t flags = (i + 1 == frames) ? KC_HTTP2_FLAG_END_HEADERS : 0;
+      if (i == 0 && end_stream)
+      {
+        flags |= KC_HTTP2_FLAG_END_STREAM;
+      }
+
+      _frame_header(headers[i], frame_len, (i == 0) ? KC_HTTP2_HEADERS : KC_HTTP2_CONTINUATION, flags, stream->id);
+
+      iov[2 * i]     = (struct iovec){ headers[i], KC_HTTP2_FRAME_HEADER_SIZE };
+      iov[2 * i + 1] = (struct iovec){ block + offset, frame_len };
+
+      offset += frame_len;
+    }
+
+    ret = _write(self, iov, (int)frames * 2);
+  }
+
+  // the client did not get the block, its table is not the one of the encoder
+  if (ret != KC_SUCCESS)
+  {
+    self->_failed = true;
+  }
+
+  // the response ends with its headers (ex: "304 Not Modified")
+  if (ret == KC_SUCCESS && end_stream)
+  {
+    __atomic_store_n(&stream->state, KC_HTTP2_STATE_CLOSED, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&self->_send_lock);
+  free(block);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int send_data_http2(struct kc_http2_t* self, struct kc_http2_stream_t* stream,
+    const char* data, size_t len, bool end_stream)
+{
+  if (self == NULL || stream == NULL || (data == NULL && len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  pthread_mutex_lock(&self->_send_lock);
+
+  int ret = KC_SUCCESS;
+
+  do
+  {
+    // the client reset the stream, or left
+    if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) == KC_HTTP2_STATE_CLOSED || self->_failed)
+    {
+      ret = KC_LOST_CONNECTION;
+      break;
+    }
+
+    // as much as both windows allow, in frames the client takes
+    int64_t available = (self->_send_window < stream->_send_window) ?
+        self->_send_window : stream->_send_window;
+
+    if (available > (int64_t)self->_peer_max_frame_size)
+    {
+      available = self->_peer_max_frame_size;
+    }
+
+    // the client opens the windows as it takes the data, the frames that
+    // come meanwhile are received (the lock is not held, they are answered)
+    if (len > 0 && available <= 0)
+    {
+      pthread_mutex_unlock(&self->_send_lock);
+      ret = _wait_window(self);
+      pthread_mutex_lock(&self->_send_lock);
+
+      if (ret != KC_SUCCESS)
+      {
+        break;
+      }
+
+      continue;
+    }
+
+    size_t frame_len = (len < (size_t)available) ? len : (size_t)available;
+    bool last = end_stream && frame_len == len;
+
+    // there's nothing to send (an empty piece of a stream)
+    if (frame_len == 0 && last == false)
+    {
+      break;
+    }
+
+    uint8_t header[KC_HTTP2_FRAME_HEADER_SIZE];
+    _frame_header(header, frame_len, KC_HTTP2_DATA, last ? KC_HTTP2_FLAG_END_STREAM : 0, stream->id);
+
+    struct iovec iov[2] =
+    {
+      { header, KC_HTTP2_FRAME_HEADER_SIZE },
+      { (char*)data, frame_len }
+    };
+
+    ret = _write(self, iov, (frame_len > 0) ? 2 : 1);
+    if (ret != KC_SUCCESS)
+    {
+      break;
+    }
+
+    self->_send_window     -= frame_len;
+    stream->_send_window   -= frame_len;
+
+    data += frame_len;
+    len  -= frame_len;
+
+    if (last)
+    {
+      __atomic_store_n(&stream->state, KC_HTTP2_STATE_CLOSED, __ATOMIC_RELEASE);
+    }
+  }
+  while (len > 0);
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int reset_http2(struct kc_http2_t* self, struct kc_http2_stream_t* stream, uint32_t code)
+{
+  if (self == NULL || stream == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (__atomic_exchange_n(&stream->state, KC_HTTP2_STATE_CLOSED, __ATOMIC_ACQ_REL) == KC_HTTP2_STATE_CLOSED)
+  {
+    return KC_SUCCESS;
+  }
+
+  uint8_t payload[4];
+  _write_u32(payload, code);
+
+  return _write_frame(self, KC_HTTP2_RST_STREAM, 0, stream->id, payload, sizeof(payload));
+}
+
+//---------------------------------------------------------------------------//
+
+static int goaway_http2(struct kc_http2_t* self, uint32_t code)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // only the first one is sent
+  if (__atomic_exchange_n(&self->closing, true, __ATOMIC_ACQ_REL))
+  {
+    return KC_SUCCESS;
+  }
+
+  // the last stream that is still answered, and why the others aren't
+  uint8_t payload[8];
+  _write_u32(payload, __atomic_load_n(&self->_last_stream_id, __ATOMIC_ACQUIRE));
+  _write_u32(payload + 4, code);
+
+  return _write_frame(self, KC_HTTP2_GOAWAY, 0, 0, payload, sizeof(payload));
+}
+
+//---------------------------------------------------------------------------//
+
+static int upgrade_http2(struct kc_http2_t* self, const uint8_t* settings, size_t len,
+    struct kc_http2_stream_t** stream)
+{
+  if (self == NULL || stream == NULL || (settings == NULL && len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // the settings of the client came in the request
+  if (len % 6 != 0 || _apply_settings(self, settings, len) != KC_HTTP2_NO_ERROR)
+  {
+    return KC_PROTOCOL_ERROR;
+  }
+
+  int ret = _send_preface(self);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  // the request is the first stream, already received
+  (*stream) = _new_stream(self, 1);
+  if ((*stream) == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  (*stream)->state = KC_HTTP2_STATE_HALF_CLOSED;
+  (*stream)->_busy = true;
+
+  self->_last_stream_id = 1;
+
+  // the requests that come meanwhile wait for it to be answered
+  self->_dispatching = true;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void finish_http2(struct kc_http2_t* self, struct kc_http2_stream_t* stream)
+{
+  if (self == NULL || stream == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // a response that was not ended is useless to the client
+  if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) != KC_HTTP2_STATE_CLOSED)
+  {
+    reset_http2(self, stream, KC_HTTP2_INTERNAL_ERROR);
+  }
+
+  // the requests that waited for the upgraded one can be handled (a
+  // deferred one is finished once the others were already handled)
+  if (stream->deferred == false)
+  {
+    self->_dispatching = false;
+  }
+
+  stream->_busy = false;
+  _remove_stream(self, stream);
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static int _send_preface(struct kc_http2_t* self)
+{
+  if (self->_preface_sent)
+  {
+    return KC_SUCCESS;
+  }
+
+  self->_preface_sent = true;
+
+  // the settings of the server, then the rest of the window of the connection
+  uint8_t settings[24];
+  uint16_t ids[4] =
+  {
+    KC_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, KC_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE,
+    KC_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE,   KC_HTTP2_SETTINGS_ENABLE_PUSH
+  };
+  uint32_t values[4] =
+  {
+    KC_HTTP2_MAX_STREAMS, KC_HTTP2_WINDOW_SIZE, KC_HTTP2_MAX_HEADER_LIST, 0
+  };
+
+  for (int i = 0; i < 4; ++i)
+  {
+    settings[6 * i]     = (uint8_t)(ids[i] >> 8);
+    settings[6 * i + 1] = (uint8_t)(ids[i] & 0xFF);
+    _write_u32(settings + 6 * i + 2, values[i]);
+  }
+
+  uint8_t increment[4];
+  _write_u32(increment, KC_HTTP2_WINDOW_SIZE - KC_HTTP2_DEFAULT_WINDOW_SIZE);
+
+  int ret = _write_frame(self, KC_HTTP2_SETTINGS, 0, 0, settings, sizeof(settings));
+  if (ret == KC_SUCCESS)
+  {
+    ret = _write_frame(self, KC_HTTP2_WINDOW_UPDATE, 0, 0, increment, sizeof(increment));
+  }
+
+  if (ret != KC_SUCCESS)
+  {
+    self->_failed = true;
+    return ret;
+  }
+
+  self->_recv_window = KC_HTTP2_WINDOW_SIZE;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _process_frame(struct kc_http2_t* self, uint8_t type, uint8_t flags,
+    uint32_t id, uint8_t* payload, size_t len)
+{
+  // a header block is never interrupted by another frame
+  if (self->_continuation != 0 && type != KC_HTTP2_CONTINUATION)
+  {
+    return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  // the preface of the client ends with its settings
+  if (self->_settings_received == false &&
+      (type != KC_HTTP2_SETTINGS || (flags & KC_HTTP2_FLAG_ACK)))
+  {
+    return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  switch (type)
+  {
+    case KC_HTTP2_DATA:
+      return _on_data(self, flags, id, payload, len);
+
+    case KC_HTTP2_HEADERS:
+      return _on_headers(self, flags, id, payload, len);
+
+    case KC_HTTP2_CONTINUATION:
+      return _on_continuation(self, flags, id, payload, len);
+
+    case KC_HTTP2_PRIORITY:
+      // the priorities are not used, but the frame must be right
+      if (id == 0)
+      {
+        return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+      }
+
+      if (len != 5)
+      {
+        return _refuse(self, id, KC_HTTP2_FRAME_SIZE_ERROR);
+      }
+
+      if ((_read_u32(payload) & 0x7FFFFFFF) == id)
+      {
+        return _refuse(self, id, KC_HTTP2_PROTOCOL_ERROR);
+      }
+
+      return KC_SUCCESS;
+
+    case KC_HTTP2_RST_STREAM:
+      return _on_rst_stream(self, id, payload, len);
+
+    case KC_HTTP2_SETTINGS:
+      return _on_settings(self, flags, id, payload, len);
+
+    case KC_HTTP2_PING:
+      if (id != 0)
+      {
+        return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+      }
+
+      if (len != 8)
+      {
+        return _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+      }
+
+      // the same bytes go back
+      if ((flags & KC_HTTP2_FLAG_ACK) == 0)
+      {
+        return _write_frame(self, KC_HTTP2_PING, KC_HTTP2_FLAG_ACK, 0, payload, len);
+      }
+
+      return KC_SUCCESS;
+
+    case KC_HTTP2_GOAWAY:
+      if (id != 0)
+      {
+        return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+      }
+
+      if (len < 8)
+      {
+        return _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+      }
+
+      // the client opens no more streams, the open ones are still answered
+      return KC_SUCCESS;
+
+    case KC_HTTP2_WINDOW_UPDATE:
+      return _on_window_update(self, id, payload, len);
+
+    case KC_HTTP2_PUSH_PROMISE:
+      // only a server can push
+      return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+
+    default:
+      // the unknown frames are ignored
+      return KC_SUCCESS;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int _on_data(struct kc_http2_t* self, uint8_t flags, uint32_t id, uint8_t* payload, size_t len)
+{
+  if (id == 0)
+  {
+    return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  // the whole frame counts against the windows, the padding too
+  if ((int64_t)len > self->_recv_window)
+  {
+    return _fail(self, KC_HTTP2_FLOW_CONTROL_ERROR);
+  }
+
+  self->_recv_window -= len;
+
+  // the window of the connection is opened again once half of it is used
+  if (self->_recv_window < KC_HTTP2_WINDOW_SIZE / 2)
+  {
+    uint8_t increment[4];
+    _write_u32(increment, (uint32_t)(KC_HTTP2_WINDOW_SIZE - self->_recv_window));
+
+    self->_recv_window = KC_HTTP2_WINDOW_SIZE;
+
+    if (_write_frame(self, KC_HTTP2_WINDOW_UPDATE, 0, 0, increment, sizeof(increment)) != KC_SUCCESS)
+    {
+      return KC_NETWORK_ERROR;
+    }
+  }
+
+  size_t frame_len = len;
+
+  if (flags & KC_HTTP2_FLAG_PADDED)
+  {
+    if (len < 1 || payload[0] >= len)
+    {
+      return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+    }
+
+    len -= 1 + payload[0];
+    payload += 1;
+  }
+
+  struct kc_http2_stream_t* stream = _find_stream(self, id);
+
+  // a stream that was never opened, or one that is closed
+  if (stream == NULL)
+  {
+    return (id > self->_last_stream_id) ?
+        _fail(self, KC_HTTP2_PROTOCOL_ERROR) : _refuse(self, id, KC_HTTP2_STREAM_CLOSED);
+  }
+
+  if (stream->state != KC_HTTP2_STATE_OPEN)
+  {
+    return _refuse(self, id, KC_HTTP2_STREAM_CLOSED);
+  }
+
+  stream->_recv_window -= frame_len;
+
+  if (stream->_recv_window < 0)
+  {
+    return _refuse(self, id, KC_HTTP2_FLOW_CONTROL_ERROR);
+  }
+
+  if (_append(&stream->_body, (char*)payload, len, KC_HTTP2_MAX_BODY_SIZE) != KC_SUCCESS)
+  {
+    return _refuse(self, id, KC_HTTP2_CANCEL);
+  }
+
+  if (flags & KC_HTTP2_FLAG_END_STREAM)
+  {
+    return _stream_ready(self, stream);
+  }
+
+  // the same for the window of the stream, while it's still sending
+  if (stream->_recv_window < KC_HTTP2_WINDOW_SIZE / 2)
+  {
+    uint8_t increment[4];
+    _write_u32(increment, (uint32_t)(KC_HTTP2_WINDOW_SIZE - stream->_recv_window));
+
+    stream->_recv_window = KC_HTTP2_WINDOW_SIZE;
+
+    return _write_frame(self, KC_HTTP2_WINDOW_UPDATE, 0, id, increment, sizeof(increment));
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _on_headers(struct kc_http2_t* self, uint8_t flags, uint32_t id, uint8_t* payload, size_t len)
+{
+  if (id == 0)
+  {
+    return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  size_t padding = 0;
+  bool self_dependent = false;
+
+  if (flags & KC_HTTP2_FLAG_PADDED)
+  {
+    if (len < 1)
+    {
+      return _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+    }
+
+    padding = payload[0];
+    payload += 1;
+    len -= 1;
+  }
+
+  // the priority is not used, a stream can't depend on itself though
+  if (flags & KC_HTTP2_FLAG_PRIORITY)
+  {
+    if (len < 5)
+    {
+      return _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+    }
+
+    self_dependent = (_read_u32(payload) & 0x7FFFFFFF) == id;
+
+    payload += 5;
+    len -= 5;
+  }
+
+  if (padding > len)
+  {
+    return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  len -= padding;
+
+  if (flags & KC_HTTP2_FLAG_END_HEADERS)
+  {
+    return _on_header_block(self, flags, id, payload, len, self_dependent);
+  }
+
+  // the rest of the block follows in CONTINUATION frames
+  self->_block.len = 0;
+
+  if (_append(&self->_block, (char*)payload, len, KC_HTTP2_MAX_HEADER_LIST) != KC_SUCCESS)
+  {
+    return _fail(self, KC_HTTP2_ENHANCE_YOUR_CALM);
+  }
+
+  self->_continuation       = id;
+  self->_continuation_flags = flags & ~KC_HTTP2_FLAG_PRIORITY;
+
+  // a self dependency is remembered as a priority flag
+  if (self_dependent)
+  {
+    self->_continuation_flags |= KC_HTTP2_FLAG_PRIORITY;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _on_continuation(struct kc_http2_t* self, uint8_t flags, uint32_t id, uint8_t* payload, size_t len)
+{
+  if (self->_continuation == 0 || id != self->_continuation)
+  {
+    return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  if (_append(&self->_block, (char*)payload, len, KC_HTTP2_MAX_HEADER_LIST) != KC_SUCCESS)
+  {
+    return _fail(self, KC_HTTP2_ENHANCE_YOUR_CALM);
+  }
+
+  if ((flags & KC_HTTP2_FLAG_END_HEADERS) == 0)
+  {
+    return KC_SUCCESS;
+  }
+
+  self->_continuation = 0;
+
+  return _on_header_block(self, self->_continuation_flags, id, (uint8_t*)self->_block.data,
+      self->_block.len, (self->_continuation_flags & KC_HTTP2_FLAG_PRIORITY) != 0);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _on_header_block(struct kc_http2_t* self, uint8_t flags, uint32_t id,
+    const uint8_t* block, size_t len, bool self_dependent)
+{
+  struct kc_http2_stream_t* stream = _find_stream(self, id);
+  int ret = KC_SUCCESS;
+
+  // the trailers of a request are decoded (to keep the table right), but
+  // not used; the other blocks of a known stream are not allowed
+  if (stream != NULL || id <= self->_last_stream_id || (id % 2) == 0 || self->closing ||
+      self->streams >= KC_HTTP2_MAX_STREAMS || self_dependent)
+  {
+    ret = self->_decoder->decode(self->_decoder, block, len, _ignore_header, NULL);
+    if (ret != KC_SUCCESS)
+    {
+      return _fail(self, (ret == KC_OUT_OF_MEMORY) ? KC_HTTP2_INTERNAL_ERROR : KC_HTTP2_COMPRESSION_ERROR);
+    }
+
+    // only the client opens streams, with growing odd numbers
+    if (stream == NULL && ((id % 2) == 0 || id <= self->_last_stream_id))
+    {
+      return ((id % 2) == 0) ? _fail(self, KC_HTTP2_PROTOCOL_ERROR) : _refuse(self, id, KC_HTTP2_STREAM_CLOSED);
+    }
+
+    if (stream != NULL)
+    {
+      if (stream->state != KC_HTTP2_STATE_OPEN)
+      {
+        return _refuse(self, id, KC_HTTP2_STREAM_CLOSED);
+      }
+
+      return (flags & KC_HTTP2_FLAG_END_STREAM) ?
+          _stream_ready(self, stream) : _refuse(self, id, KC_HTTP2_PROTOCOL_ERROR);
+    }
+
+    self->_last_stream_id = (id > self->_last_stream_id) ? id : self->_last_stream_id;
+
+    // the server is closing, the client can try the request again elsewhere
+    if (self->closing)
+    {
+      return KC_SUCCESS;
+    }
+
+    return _refuse(self, id, self_dependent ? KC_HTTP2_PROTOCOL_ERROR : KC_HTTP2_REFUSED_STREAM);
+  }
+
+  __atomic_store_n(&self->_last_stream_id, id, __ATOMIC_RELEASE);
+
+  stream = _new_stream(self, id);
+  if (stream == NULL)
+  {
+    return _fail(self, KC_HTTP2_INTERNAL_ERROR);
+  }
+
+  ret = self->_decoder->decode(self->_decoder, block, len, _stream_header, stream);
+
+  if (ret == KC_FORMAT_ERROR || ret == KC_OUT_OF_MEMORY)
+  {
+    return _fail(self, (ret == KC_OUT_OF_MEMORY) ? KC_HTTP2_INTERNAL_ERROR : KC_HTTP2_COMPRESSION_ERROR);
+  }
+
+  // a malformed request, or one without the pseudo-headers it needs
+  if (ret != KC_SUCCESS || stream->_method == NULL || stream->_path == NULL ||
+      stream->_has_scheme == false)
+  {
+    return _refuse(self, id, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  if (flags & KC_HTTP2_FLAG_END_STREAM)
+  {
+    return _stream_ready(self, stream);
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _on_rst_stream(struct kc_http2_t* self, uint32_t id, uint8_t* payload, size_t len)
+{
+  if (id == 0 || id > self->_last_stream_id)
+  {
+    return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  if (len != 4)
+  {
+    return _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+  }
+
+  struct kc_http2_stream_t* stream = _find_stream(self, id);
+  if (stream == NULL)
+  {
+    return KC_SUCCESS;
+  }
+
+  // the response being sent stops, the stream is freed once it's handled
+  __atomic_store_n(&stream->state, KC_HTTP2_STATE_CLOSED, __ATOMIC_RELEASE);
+
+  if (stream->_busy == false && stream->request == NULL)
+  {
+    _remove_stream(self, stream);
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _on_settings(struct kc_http2_t* self, uint8_t flags, uint32_t id, uint8_t* payload, size_t len)
+{
+  if (id != 0)
+  {
+    return _fail(self, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  if (flags & KC_HTTP2_FLAG_ACK)
+  {
+    return (len == 0) ? KC_SUCCESS : _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+  }
+
+  if (len % 6 != 0)
+  {
+    return _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+  }
+
+  int code = _apply_settings(self, payload, len);
+  if (code != KC_HTTP2_NO_ERROR)
+  {
+    return _fail(self, code);
+  }
+
+  self->_settings_received = true;
+
+  return _write_frame(self, KC_HTTP2_SETTINGS, KC_HTTP2_FLAG_ACK, 0, NULL, 0);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _apply_settings(struct kc_http2_t* self, const uint8_t* payload, size_t len)
+{
+  // the windows and the frame size are read by the senders
+  pthread_mutex_lock(&self->_send_lock);
+
+  int code = KC_HTTP2_NO_ERROR;
+
+  for (size_t i = 0; i + 6 <= len && code == KC_HTTP2_NO_ERROR; i += 6)
+  {
+    uint16_t setting = (uint16_t)((payload[i] << 8) | payload[i + 1]);
+    uint32_t value   = _read_u32(payload + i + 2);
+
+    switch (setting)
+    {
+      case KC_HTTP2_SETTINGS_HEADER_TABLE_SIZE:
+        // the table of the encoder stays as small as the server wants
+        self->_encoder->resize(self->_encoder,
+            (value < KC_HPACK_TABLE_SIZE) ? value : KC_HPACK_TABLE_SIZE);
+        break;
+
+      case KC_HTTP2_SETTINGS_ENABLE_PUSH:
+        code = (value > 1) ? KC_HTTP2_PROTOCOL_ERROR : code;
+        break;
+
+      case KC_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+        if (value > KC_HTTP2_MAX_WINDOW_SIZE)
+        {
+          code = KC_HTTP2_FLOW_CONTROL_ERROR;
+          break;
+        }
+
+        // the windows of the open streams move by the same amount
+        for (struct kc_http2_stream_t* stream = self->_streams; stream != NULL; stream = stream->_next)
+        {
+          stream->_send_window += (int64_t)value - self->_peer_initial_window;
+
+          if (stream->_send_window > KC_HTTP2_MAX_WINDOW_SIZE)
+          {
+            code = KC_HTTP2_FLOW_CONTROL_ERROR;
+          }
+        }
+
+        self->_peer_initial_window = value;
+        break;
+
+      case KC_HTTP2_SETTINGS_MAX_FRAME_SIZE:
+        if (value < KC_HTTP2_MAX_FRAME_SIZE || value > KC_HTTP2_MAX_FRAME_SIZE_LIMIT)
+        {
+          code = KC_HTTP2_PROTOCOL_ERROR;
+          break;
+        }
+
+        self->_peer_max_frame_size = value;
+        break;
+
+      default:
+        // the server pushes nothing and keeps no limit of the client on the
+        // headers it sends, the unknown settings are ignored
+        break;
+    }
+  }
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  return code;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _on_window_update(struct kc_http2_t* self, uint32_t id, uint8_t* payload, size_t len)
+{
+  if (len != 4)
+  {
+    return _fail(self, KC_HTTP2_FRAME_SIZE_ERROR);
+  }
+
+  uint32_t increment = _read_u32(payload) & 0x7FFFFFFF;
+
+  if (id == 0)
+  {
+    pthread_mutex_lock(&self->_send_lock);
+
+    self->_send_window += increment;
+    bool overflow = self->_send_window > KC_HTTP2_MAX_WINDOW_SIZE;
+
+    pthread_mutex_unlock(&self->_send_lock);
+
+    return (increment == 0) ? _fail(self, KC_HTTP2_PROTOCOL_ERROR) :
+        overflow ? _fail(self, KC_HTTP2_FLOW_CONTROL_ERROR) : KC_SUCCESS;
+  }
+
+  struct kc_http2_stream_t* stream = _find_stream(self, id);
+  if (stream == NULL)
+  {
+    return (id > self->_last_stream_id) ? _fail(self, KC_HTTP2_PROTOCOL_ERROR) : KC_SUCCESS;
+  }
+
+  if (increment == 0)
+  {
+    return _refuse(self, id, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  pthread_mutex_lock(&self->_send_lock);
+
+  stream->_send_window += increment;
+  bool overflow = stream->_send_window > KC_HTTP2_MAX_WINDOW_SIZE;
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  return overflow ? _refuse(self, id, KC_HTTP2_FLOW_CONTROL_ERROR) : KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _stream_header(void* data, const char* name, size_t name_len, const char* value, size_t value_len)
+{
+  struct kc_http2_stream_t* stream = (struct kc_http2_stream_t*)data;
+
+  stream->_header_list += name_len + value_len + KC_HPACK_ENTRY_OVERHEAD;
+  if (stream->_header_list > KC_HTTP2_MAX_HEADER_LIST)
+  {
+    return KC_OVERFLOW;
+  }
+
+  // the request is rebuilt from the values, they can't end a line
+  if (memchr(value, '\r', value_len) != NULL || memchr(value, '\n', value_len) != NULL ||
+      memchr(value, '\0', value_len) != NULL)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  if (name_len > 0 && name[0] == ':')
+  {
+    char** field = NULL;
+
+    if (stream->_regular_seen)
+    {
+      return KC_INVALID_ARGUMENT;
+    }
+
+    if (name_len == 7 && memcmp(name, ":method", 7) == 0 && _is_token(value, value_len, false))
+    {
+      field = &stream->_method;
+    }
+    else if (name_len == 5 && memcmp(name, ":path", 5) == 0 && value_len > 0 &&
+        memchr(value, ' ', value_len) == NULL)
+    {
+      field = &stream->_path;
+    }
+    else if (name_len == 10 && memcmp(name, ":authority", 10) == 0 &&
+        memchr(value, ' ', value_len) == NULL)
+    {
+      field = &stream->_authority;
+    }
+    else if (name_len == 7 && memcmp(name, ":scheme", 7) == 0 && stream->_has_scheme == false)
+    {
+      stream->_has_scheme = true;
+      return KC_SUCCESS;
+    }
+
+    // an unknown pseudo-header, or one that came twice
+    if (field == NULL || (*field) != NULL)
+    {
+      return KC_INVALID_ARGUMENT;
+    }
+
+    (*field) = malloc(value_len + 1);
+    if ((*field) == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+
+    memcpy(*field, value, value_len);
+    (*field)[value_len] = '\0';
+
+    return KC_SUCCESS;
+  }
+
+  stream->_regular_seen = true;
+
+  // the names are sent in lowercase
+  if (_is_token(name, name_len, true) == false)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // the headers of a HTTP/1 connection mean nothing here
+  if ((name_len == 10 && memcmp(name, "connection", 10) == 0) ||
+      (name_len == 10 && memcmp(name, "keep-alive", 10) == 0) ||
+      (name_len == 16 && memcmp(name, "proxy-connection", 16) == 0) ||
+      (name_len == 17 && memcmp(name, "transfer-encoding", 17) == 0) ||
+      (name_len == 7 && memcmp(name, "upgrade", 7) == 0) ||
+      (name_len == 2 && memcmp(name, "te", 2) == 0 && (value_len != 8 || memcmp(value, "trailers", 8) != 0)))
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // the cookies can be split, they are put together again
+  if (name_len == 6 && memcmp(name, "cookie", 6) == 0)
+  {
+    if (stream->_cookie.len > 0 && _append(&stream->_cookie, "; ", 2, KC_HTTP2_MAX_HEADER_LIST) != KC_SUCCESS)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+
+    return _append(&stream->_cookie, value, value_len, KC_HTTP2_MAX_HEADER_LIST);
+  }
+
+  if (name_len == 14 && memcmp(name, "content-length", 14) == 0)
+  {
+    int64_t length = 0;
+
+    for (size_t i = 0; i < value_len; ++i)
+    {
+      if (value[i] < '0' || value[i] > '9' || length > KC_HTTP2_MAX_BODY_SIZE)
+      {
+        return KC_INVALID_ARGUMENT;
+      }
+
+      length = (length * 10) + (value[i] - '0');
+    }
+
+    if (value_len == 0 || (stream->_content_length >= 0 && stream->_content_length != length))
+    {
+      return KC_INVALID_ARGUMENT;
+    }
+
+    stream->_content_length = length;
+  }
+
+  if (name_len == 4 && memcmp(name, "host", 4) == 0)
+  {
+    stream->_has_host = true;
+  }
+
+  // "Name: value\r\n", as the parser of the server reads them (the names
+  // are looked up as the HTTP/1 clients write them, ex: "Content-Type")
+  if (_append_name(&stream->_head, name, name_len) != KC_SUCCESS ||
+      _append(&stream->_head, ": ", 2, KC_HTTP2_MAX_HEADER_LIST) != KC_SUCCESS ||
+      _append(&stream->_head, value, value_len, KC_HTTP2_MAX_HEADER_LIST) != KC_SUCCESS ||
+      _append(&stream->_head, "\r\n", 2, KC_HTTP2_MAX_HEADER_LIST) != KC_SUCCESS)
+  {
+    return KC_OVERFLOW;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _ignore_header(void* data, const char* name, size_t name_len, const char* value, size_t value_len)
+{
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_http2_stream_t* _new_stream(struct kc_http2_t* self, uint32_t id)
+{
+  struct kc_http2_stream_t* stream = malloc(sizeof(struct kc_http2_stream_t));
+  if (stream == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  memset(stream, 0, sizeof(struct kc_http2_stream_t));
+
+  stream->id              = id;
+  stream->state           = KC_HTTP2_STATE_OPEN;
+  stream->_content_length = -1;
+  stream->_recv_window    = KC_HTTP2_WINDOW_SIZE;
+
+  // the window of the stream is read by the senders
+  pthread_mutex_lock(&self->_send_lock);
+
+  stream->_send_window = self->_peer_initial_window;
+
+  stream->_next  = self->_streams;
+  self->_streams = stream;
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  __atomic_add_fetch(&self->streams, 1, __ATOMIC_RELAXED);
+
+  return stream;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_http2_stream_t* _find_stream(struct kc_http2_t* self, uint32_t id)
+{
+  for (struct kc_http2_stream_t* stream = self->_streams; stream != NULL; stream = stream->_next)
+  {
+    if (stream->id == id)
+    {
+      return stream;
+    }
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _remove_stream(struct kc_http2_t* self, struct kc_http2_stream_t* stream)
+{
+  pthread_mutex_lock(&self->_send_lock);
+
+  struct kc_http2_stream_t** link = &self->_streams;
+  while ((*link) != NULL && (*link) != stream)
+  {
+    link = &(*link)->_next;
+  }
+
+  if ((*link) != NULL)
+  {
+    (*link) = stream->_next;
+  }
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  __atomic_sub_fetch(&self->streams, 1, __ATOMIC_RELAXED);
+
+  free(stream->request);
+  free(stream->_method);
+  free(stream->_path);
+  free(stream->_authority);
+  free(stream->_head.data);
+  free(stream->_cookie.data);
+  free(stream->_body.data);
+  free(stream);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _stream_ready(struct kc_http2_t* self, struct kc_http2_stream_t* stream)
+{
+  size_t body_len = stream->_body.len;
+
+  // the length the client announced must be the one it sent
+  if (stream->_content_length >= 0 && (size_t)stream->_content_length != body_len)
+  {
+    return _refuse(self, stream->id, KC_HTTP2_PROTOCOL_ERROR);
+  }
+
+  // "METHOD path HTTP/2", the host, the headers, the cookies, the length
+  // (when there is a body and it was not announced), then the body
+  size_t size = strlen(stream->_method) + strlen(stream->_path) + 16 +
+      ((stream->_authority != NULL) ? strlen(stream->_authority) + 8 : 0) +
+      stream->_head.len + stream->_cookie.len + 12 + 48 + body_len + 1;
+
+  stream->request = malloc(size);
+  if (stream->request == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return _refuse(self, stream->id, KC_HTTP2_INTERNAL_ERROR);
+  }
+
+  char* pos = stream->request;
+
+  pos += sprintf(pos, "%s %s HTTP/2\r\n", stream->_method, stream->_path);
+
+  if (stream->_authority != NULL && stream->_has_host == false)
+  {
+    pos += sprintf(pos, "Host: %s\r\n", stream->_authority);
+  }
+
+  memcpy(pos, stream->_head.data, stream->_head.len);
+  pos += stream->_head.len;
+
+  if (stream->_cookie.len > 0)
+  {
+    pos += sprintf(pos, "Cookie: %.*s\r\n", (int)stream->_cookie.len, stream->_cookie.data);
+  }
+
+  if (body_len > 0 && stream->_content_length < 0)
+  {
+    pos += sprintf(pos, "Content-Length: %zu\r\n", body_len);
+  }
+
+  memcpy(pos, "\r\n", 2);
+  pos += 2;
+
+  memcpy(pos, stream->_body.data, body_len);
+  pos += body_len;
+  (*pos) = '\0';
+
+  stream->request_len = pos - stream->request;
+  stream->state = KC_HTTP2_STATE_HALF_CLOSED;
+
+  // the parts are not needed anymore
+  free(stream->_head.data);
+  free(stream->_cookie.data);
+  free(stream->_body.data);
+
+  memset(&stream->_head, 0, sizeof(struct kc_http2_buffer_t));
+  memset(&stream->_cookie, 0, sizeof(struct kc_http2_buffer_t));
+  memset(&stream->_body, 0, sizeof(struct kc_http2_buffer_t));
+
+  // the requests are handled in the order they are whole
+  stream->_ready_next = NULL;
+
+  if (self->_ready_tail != NULL)
+  {
+    self->_ready_tail->_ready_next = stream;
+  }
+  else
+  {
+    self->_ready = stream;
+  }
+
+  self->_ready_tail = stream;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _dispatch(struct kc_http2_t* self)
+{
+  // a request handled now can wait for a window, the frames received
+  // meanwhile only queue the new requests
+  if (self->_dispatching)
+  {
+    return KC_SUCCESS;
+  }
+
+  self->_dispatching = true;
+
+  while (self->_ready != NULL && self->_failed == false)
+  {
+    struct kc_http2_stream_t* stream = self->_ready;
+
+    self->_ready = stream->_ready_next;
+    if (self->_ready == NULL)
+    {
+      self->_ready_tail = NULL;
+    }
+
+    // the client reset it before it was handled
+    if (__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) != KC_HTTP2_STATE_CLOSED)
+    {
+      stream->_busy = true;
+      self->on_request(self, stream);
+    }
+
+    // a deferred stream stays open (and busy) until the caller finishes it,
+    // the next requests are handled meanwhile
+    if (stream->deferred == false)
+    {
+      finish_http2(self, stream);
+    }
+
+    self->_dispatching = true;
+  }
+
+  self->_dispatching = false;
+
+  return self->_failed ? KC_PROTOCOL_ERROR : KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _fail(struct kc_http2_t* self, uint32_t code)
+{
+  // the client is told why, and the last stream that was handled
+  goaway_http2(self, code);
+
+  self->_failed = true;
+
+  return KC_PROTOCOL_ERROR;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _refuse(struct kc_http2_t* self, uint32_t id, uint32_t code)
+{
+  struct kc_http2_stream_t* stream = _find_stream(self, id);
+
+  // only the stream is closed, the connection goes on
+  uint8_t payload[4];
+  _write_u32(payload, code);
+
+  int ret = _write_frame(self, KC_HTTP2_RST_STREAM, 0, id, payload, sizeof(payload));
+
+  if (stream != NULL)
+  {
+    __atomic_store_n(&stream->state, KC_HTTP2_STATE_CLOSED, __ATOMIC_RELEASE);
+
+    // the ones handled (or waiting to be) are freed after
+    if (stream->_busy == false && stream->request == NULL)
+    {
+      _remove_stream(self, stream);
+    }
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _write(struct kc_http2_t* self, struct iovec* iov, int iov_len)
+{
+  if (self->writer != NULL)
+  {
+    return self->writer(self->client_fd, iov, iov_len, 0);
+  }
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+
+  msg.msg_iov = iov;
+
+  while (iov_len > 0)
+  {
+    msg.msg_iovlen = iov_len;
+
+    // a closed connection must not kill the process with SIGPIPE
+    ssize_t sent = sendmsg(self->client_fd, &msg, MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      // a non-blocking socket waits until it takes more
+      struct pollfd writable = { .fd = self->client_fd, .events = POLLOUT };
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && poll(&writable, 1, -1) >= 0)
+      {
+        continue;
+      }
+
+      return KC_NETWORK_ERROR;
+    }
+
+    // skip what was sent, the rest goes with the next call
+    while (iov_len > 0 && (size_t)sent >= msg.msg_iov->iov_len)
+    {
+      sent -= msg.msg_iov->iov_len;
+      msg.msg_iov++;
+      iov_len--;
+    }
+
+    if (iov_len > 0)
+    {
+      msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + sent;
+      msg.msg_iov->iov_len -= sent;
+    }
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _write_frame(struct kc_http2_t* self, uint8_t type, uint8_t flags, uint32_t id,
+    const void* payload, size_t len)
+{
+  uint8_t header[KC_HTTP2_FRAME_HEADER_SIZE];
+  _frame_header(header, len, type, flags, id);
+
+  struct iovec iov[2] =
+  {
+    { header, KC_HTTP2_FRAME_HEADER_SIZE },
+    { (void*)payload, len }
+  };
+
+  pthread_mutex_lock(&self->_send_lock);
+  int ret = _write(self, iov, (len > 0) ? 2 : 1);
+  pthread_mutex_unlock(&self->_send_lock);
+
+  if (ret != KC_SUCCESS)
+  {
+    self->_failed = true;
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _wait_window(struct kc_http2_t* self)
+{
+  // the frames that open the windows come from the client, with the others
+  char buffer[KC_HTTP2_MAX_FRAME_SIZE];
+  ssize_t len = 0;
+
+  while (1)
+  {
+    len = recv(self->client_fd, buffer, sizeof(buffer), 0);
+
+    if (len < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    // a non-blocking socket waits until the client sends more
+    struct pollfd readable = { .fd = self->client_fd, .events = POLLIN };
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && poll(&readable, 1, -1) >= 0)
+    {
+      continue;
+    }
+
+    break;
+  }
+
+  if (len <= 0)
+  {
+    self->_failed = true;
+    return KC_LOST_CONNECTION;
+  }
+
+  return receive_http2(self, buffer, len);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _append(struct kc_http2_buffer_t* buffer, const char* data, size_t len, size_t limit)
+{
+  if (buffer->len + len > limit)
+  {
+    return KC_OVERFLOW;
+  }
+
+  if (buffer->len + len > buffer->cap)
+  {
+    size_t cap = (buffer->cap == 0) ? 256 : buffer->cap;
+    while (cap < buffer->len + len)
+    {
+      cap *= 2;
+    }
+
+    char* data_grown = realloc(buffer->data, cap);
+    if (data_grown == NULL)
+    {
+      log_error(KC_OUT_OF_MEMORY_LOG);
+      return KC_OUT_OF_MEMORY;
+    }
+
+    buffer->data = data_grown;
+    buffer->cap  = cap;
+  }
+
+  memcpy(buffer->data + buffer->len, data, len);
+  buffer->len += len;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _append_name(struct kc_http2_buffer_t* buffer, const char* name, size_t len)
+{
+  size_t start = buffer->len;
+
+  int ret = _append(buffer, name, len, KC_HTTP2_MAX_HEADER_LIST);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  // every word starts with a capital letter
+  for (size_t i = start; i < buffer->len; ++i)
+  {
+    if ((i == start || buffer->data[i - 1] == '-') && buffer->data[i] >= 'a' && buffer->data[i] <= 'z')
+    {
+      buffer->data[i] -= 'a' - 'A';
+    }
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _is_token(const char* str, size_t len, bool lowercase)
+{
+  if (len == 0)
+  {
+    return false;
+  }
+
+  // the characters of a token (RFC 9110), without the uppercase letters
+  // for the names of the headers
+  for (size_t i = 0; i < len; ++i)
+  {
+    char c = str[i];
+
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || strchr("!#$%&'*+-.^_`|~", c) != NULL)
+    {
+      continue;
+    }
+
+    if (c >= 'A' && c <= 'Z' && lowercase == false)
+    {
+      continue;
+    }
+
+    return false;
+  }
+
+  return true;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _frame_header(uint8_t header[KC_HTTP2_FRAME_HEADER_SIZE], size_t len,
+    uint8_t type, uint8_t flags, uint32_t id)
+{
+  header[0] = (uint8_t)(len >> 16);
+  header[1] = (uint8_t)(len >> 8);
+  header[2] = (uint8_t)(len & 0xFF);
+  header[3] = type;
+  header[4] = flags;
+
+  _write_u32(header + 5, id & 0x7FFFFFFF);
+}
+
+//---------------------------------------------------------------------------//
+
+static uint32_t _read_u32(const uint8_t* data)
+{
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+      ((uint32_t)data[2] << 8) | data[3];
+}
+
+//---------------------------------------------------------------------------//
+
+static void _write_u32(uint8_t* data, uint32_t value)
+{
+  data[0] = (uint8_t)(value >> 24);
+  data[1] = (uint8_t)(value >> 16);
+  data[2] = (uint8_t)(value >> 8);
+  data[3] = (uint8_t)(value & 0xFF);
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,889 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// http_form.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/http_form.h"
+#include "../../hdrs/network/http_parser.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//---------------------------------------------------------------------------//
+
+#define _MULTIPART_PREAMBLE       0  // before the first delimiter
+#define _MULTIPART_AFTER_DELIM    1  // a delimiter was found, "\r\n" or "--"
+#define _MULTIPART_AFTER_CR       2  // expecting the '\n' of the "\r\n"
+#define _MULTIPART_AFTER_DASH     3  // expecting the second '-' of the "--"
+#define _MULTIPART_HEADERS        4  // reading the headers of a part
+#define _MULTIPART_DATA           5  // reading the data of a part
+#define _MULTIPART_END            6  // the close delimiter was found
+#define _MULTIPART_ERROR          7  // a callback stopped the parser
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int feed_urlencoded     (struct kc_urlencoded_t* self, const char* chunk, size_t len);
+static int finish_urlencoded   (struct kc_urlencoded_t* self);
+
+static int feed_multipart      (struct kc_multipart_t* self, const char* chunk, size_t len);
+static int finish_multipart    (struct kc_multipart_t* self);
+static int save_files_multipart(struct kc_multipart_t* self, const char* directory, struct kc_map_t* fields);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static const char* _memmem            (const char* haystack, size_t len, const char* needle, size_t needle_len);
+static bool        _header_param      (const char* value, size_t len, const char* key, char* dest, size_t dest_size);
+static int         _emit              (struct kc_multipart_t* self, const char* data, size_t len);
+static int         _delimiter_found   (struct kc_multipart_t* self);
+static int         _consume_data      (struct kc_multipart_t* self, const char** chunk, size_t* len);
+static int         _consume_headers   (struct kc_multipart_t* self, const char** chunk, size_t* len);
+static int         _begin_part        (struct kc_multipart_t* self);
+
+static int _save_part_begin  (struct kc_multipart_t* self, struct kc_multipart_part_t* part);
+static int _save_part_data   (struct kc_multipart_t* self, const char* data, size_t len);
+static int _save_part_end    (struct kc_multipart_t* self);
+
+//---------------------------------------------------------------------------//
+
+struct kc_urlencoded_t* new_urlencoded(struct kc_map_t* params)
+{
+  if (params == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  // create a parser instance to be returned
+  struct kc_urlencoded_t* new_form = malloc(sizeof(struct kc_urlencoded_t));
+
+  // confirm that there is memory to allocate
+  if (new_form == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_form->params    = params;
+  new_form->_pair_len = 0;
+  new_form->_skip     = false;
+
+  // assigns the public member methods
+  new_form->feed   = feed_urlencoded;
+  new_form->finish = finish_urlencoded;
+
+  return new_form;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_urlencoded(struct kc_urlencoded_t* form)
+{
+  if (form == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  free(form);
+}
+
+//---------------------------------------------------------------------------//
+
+static int feed_urlencoded(struct kc_urlencoded_t* self, const char* chunk, size_t len)
+{
+  if (self == NULL || chunk == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // first complete the pair that started in the previous chunk
+  if (self->_pair_len > 0 || self->_skip)
+  {
+    const char* amp = memchr(chunk, '&', len);
+    size_t n = (amp != NULL) ? (size_t)(amp - chunk) : len;
+
+    if (self->_skip == false && self->_pair_len + n > sizeof(self->_pair))
+    {
+      self->_skip = true;
+    }
+
+    if (self->_skip == false)
+    {
+      memcpy(self->_pair + self->_pair_len, chunk, n);
+      self->_pair_len += n;
+    }
+
+    // the pair continues in the next chunk too
+    if (amp == NULL)
+    {
+      return KC_SUCCESS;
+    }
+
+    int ret = finish_urlencoded(self);
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
+
+    chunk += n + 1;
+    len   -= n + 1;
+  }
+
+  // the complete pairs are parsed straight from the chunk
+  const char* last = chunk + len;
+  while (last > chunk && last[-1] != '&')
+  {
+    --last;
+  }
+
+  if (last > chunk)
+  {
+    int ret = http_parse_query_string(chunk, last - chunk - 1, self->params);
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
+
+    len  -= last - chunk;
+    chunk = last;
+  }
+
+  // keep the last pair until the next chunk (or the end of the body)
+  if (len > sizeof(self->_pair))
+  {
+    self->_skip = true;
+    return KC_SUCCESS;
+  }
+
+  memcpy(self->_pair, chunk, len);
+  self->_pair_len = len;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int finish_urlencoded(struct kc_urlencoded_t* self)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int ret = KC_SUCCESS;
+
+  if (self->_skip == false && self->_pair_len > 0)
+  {
+    ret = http_parse_query_string(self->_pair, self->_pair_len, self->params);
+  }
+
+  self->_pair_len = 0;
+  self->_skip     = false;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+struct kc_multipart_t* new_multipart(const char* content_type)
+{
+  if (content_type == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  // one more byte, to notice the boundaries that are too long
+  char boundary[KC_HTTP_MULTIPART_BOUNDARY_MAX_SIZE + 2];
+
+  // the boundary is mandatory and has at most 70 characters
+  if (_header_param(content_type, strlen(content_type), "boundary",
+      boundary, sizeof(boundary)) == false || boundary[0] == '\0' ||
+      strlen(boundary) > KC_HTTP_MULTIPART_BOUNDARY_MAX_SIZE)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
+  // create a parser instance to be returned
+  struct kc_multipart_t* new_form = malloc(sizeof(struct kc_multipart_t));
+
+  // confirm that there is memory to allocate
+  if (new_form == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  size_t boundary_len = strlen(boundary);
+
+  memcpy(new_form->_delimiter, "\r\n--", 4);
+  memcpy(new_form->_delimiter + 4, boundary, boundary_len + 1);
+  new_form->_delimiter_len = boundary_len + 4;
+  new_form->_state = _MULTIPART_PREAMBLE;
+
+  // the body can start with the delimiter right away, so act
+  // like it was preceded by a new line (like any other one)
+  memcpy(new_form->_buffer, "\r\n", 2);
+  new_form->_buffer_len = 2;
+
+  memset(&new_form->part, 0, sizeof(struct kc_multipart_part_t));
+
+  new_form->data          = NULL;
+  new_form->_directory[0] = '\0';
+  new_form->_file         = NULL;
+  new_form->_fields       = NULL;
+  new_form->_field_len    = 0;
+
+  // the callbacks are set by the user
+  new_form->on_part_begin = NULL;
+  new_form->on_part_data  = NULL;
+  new_form->on_part_end   = NULL;
+
+  // assigns the public member methods
+  new_form->feed       = feed_multipart;
+  new_form->finish     = finish_multipart;
+  new_form->save_files = save_files_multipart;
+
+  return new_form;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_multipart(struct kc_multipart_t* form)
+{
+  if (form == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  if (form->_file != NULL)
+  {
+    destroy_file(form->_file);
+  }
+
+  free(form);
+}
+
+//---------------------------------------------------------------------------//
+
+static int feed_multipart(struct kc_multipart_t* self, const char* chunk, size_t len)
+{
+  if (self == NULL || chunk == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  int ret = KC_SUCCESS;
+
+  while (len > 0 && ret == KC_SUCCESS)
+  {
+    switch (self->_state)
+    {
+      case _MULTIPART_PREAMBLE:
+      case _MULTIPART_DATA:
+        ret = _consume_data(self, &chunk, &len);
+        break;
+
+      case _MULTIPART_AFTER_DELIM:
+        // skip the transport padding (if any)
+        if (*chunk == '\r')
+        {
+          self->_state = _MULTIPART_AFTER_CR;
+        }
+        else if (*chunk == '-')
+        {
+          self->_state = _MULTIPART_AFTER_DASH;
+        }
+        else if (*chunk != ' ' && *chunk != '\t')
+        {
+          ret = KC_FORMAT_ERROR;
+        }
+
+        ++chunk;
+        --len;
+        break;
+
+      case _MULTIPART_AFTER_CR:
+        if (*chunk != '\n')
+        {
+          ret = KC_FORMAT_ERROR;
+          break;
+        }
+
+        self->_state = _MULTIPART_HEADERS;
+        self->_buffer_len = 0;
+
+        ++chunk;
+        --len;
+        break;
+
+      case _MULTIPART_AFTER_DASH:
+        if (*chunk != '-')
+        {
+          ret = KC_FORMAT_ERROR;
+          break;
+        }
+
+        self->_state = _MULTIPART_END;
+
+        ++chunk;
+        --len;
+        break;
+
+      case _MULTIPART_HEADERS:
+        ret = _consume_headers(self, &chunk, &len);
+        break;
+
+      case _MULTIPART_END:
+        // the epilogue is ignored
+        return KC_SUCCESS;
+
+      default:
+        return KC_INVALID;
+    }
+  }
+
+  if (ret != KC_SUCCESS)
+  {
+    self->_state = _MULTIPART_ERROR;
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int finish_multipart(struct kc_multipart_t* self)
+{
+  if (self == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // don't leave a truncated file open
+  if (self->_file != NULL)
+  {
+    self->_file->close(self->_file);
+  }
+
+  // the body must end with the close delimiter
+  if (self->_state != _MULTIPART_END)
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int save_files_multipart(struct kc_multipart_t* self, const char* directory, struct kc_map_t* fields)
+{
+  if (self == NULL || directory == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  if (strlen(directory) >= sizeof(self->_directory))
+  {
+    return KC_OVERFLOW;
+  }
+
+  // the same file object is reused for all the parts
+  if (self->_file == NULL)
+  {
+    self->_file = new_file();
+    if (self->_file == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+  }
+
+  strcpy(self->_directory, directory);
+  self->_fields = fields;
+
+  self->on_part_begin = _save_part_begin;
+  self->on_part_data  = _save_part_data;
+  self->on_part_end   = _save_part_end;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static const char* _memmem(const char* haystack, size_t len, const char* needle, size_t needle_len)
+{
+  if (needle_len == 0 || len < needle_len)
+  {
+    return NULL;
+  }
+
+  const char* end = haystack + len - needle_len + 1;
+  const char* ptr = haystack;
+
+#if defined(__SSE2__)
+  if (needle_len < 2)
+  {
+    return memchr(haystack, needle[0], len);
+  }
+
+  // compare the first and the last byte of the needle at 16 positions
+  // at once, only the positions where both match are fully compared
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last  = _mm_set1_epi8(needle[needle_len - 1]);
+
+  while (end - ptr >= 16)
+  {
+    __m128i block_first = _mm_loadu_si128((const __m128i*)ptr);
+    __m128i block_last  = _mm_loadu_si128((const __m128i*)(ptr + needle_len - 1));
+
+    unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+
+    while (mask != 0)
+    {
+      int bit = __builtin_ctz(mask);
+
+      if (memcmp(ptr + bit + 1, needle + 1, needle_len - 2) == 0)
+      {
+        return ptr + bit;
+      }
+
+      mask &= mask - 1;
+    }
+
+    ptr += 16;
+  }
+#endif
+
+  // the positions left (or all of them without SIMD)
+  while (ptr < end)
+  {
+    ptr = memchr(ptr, needle[0], end - ptr);
+    if (ptr == NULL)
+    {
+      return NULL;
+    }
+
+    if (memcmp(ptr, needle, needle_len) == 0)
+    {
+      return ptr;
+    }
+
+    ++ptr;
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _header_param(const char* value, size_t len, const char* key, char* dest, size_t dest_size)
+{
+  const char* end = value + len;
+  const char* ptr = memchr(value, ';', len);
+
+  size_t key_len = strlen(key);
+
+  // the parameters follow the value (ex: form-data; name="file")
+  while (ptr != NULL && ptr < end)
+  {
+    ++ptr;
+
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+    {
+      ++ptr;
+    }
+
+    const char* equal = memchr(ptr, '=', end - ptr);
+    if (equal == NULL)
+    {
+      return false;
+    }
+
+    bool match = ((size_t)(equal - ptr) == key_len && strncasecmp(ptr, key, key_len) == 0);
+
+    // read the value, quoted or not
+    ptr = equal + 1;
+    size_t n = 0;
+
+    if (ptr < end && *ptr == '"')
+    {
+      ++ptr;
+
+      while (ptr < end && *ptr != '"')
+      {
+        if (*ptr == '\\' && ptr + 1 < end)
+        {
+          ++ptr;
+        }
+
+        if (match && n + 1 < dest_size)
+        {
+          dest[n++] = *ptr;
+        }
+
+        ++ptr;
+      }
+
+      // skip the closing quote
+      if (ptr < end)
+      {
+        ++ptr;
+      }
+    }
+    else
+    {
+      while (ptr < end && *ptr != ';' && *ptr != ' ' && *ptr != '\t' && *ptr != '\r')
+      {
+        if (match && n + 1 < dest_size)
+        {
+          dest[n++] = *ptr;
+        }
+
+        ++ptr;
+      }
+    }
+
+    if (match)
+    {
+      dest[n] = '\0';
+      return true;
+    }
+
+    ptr = memchr(ptr, ';', end - ptr);
+  }
+
+  return false;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _emit(struct kc_multipart_t* self, const char* data, size_t len)
+{
+  // the preamble is ignored
+  if (self->_state != _MULTIPART_DATA || len == 0 || self->on_part_data == NULL)
+  {
+    return KC_SUCCESS;
+  }
+
+  return self->on_part_data(self, data, len);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _delimiter_found(struct kc_multipart_t* self)
+{
+  int ret = KC_SUCCESS;
+
+  if (self->_state == _MULTIPART_DATA && self->on_part_end != NULL)
+  {
+    ret = self->on_part_end(self);
+  }
+
+  self->_state = _MULTIPART_AFTER_DELIM;
+  self->_buffer_len = 0;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _consume_data(struct kc_multipart_t* self, const char** chunk, size_t* len)
+{
+  size_t delimiter_len = self->_delimiter_len;
+  int ret = KC_SUCCESS;
+
+  // the previous chunk ended with the beginning of a delimiter (maybe), so
+  // join it with enough bytes of this chunk to tell if it really was one
+  if (self->_buffer_len > 0)
+  {
+    size_t carry = self->_buffer_len;
+    size_t take  = (*len < delimiter_len - 1) ? *len : delimiter_len - 1;
+
+    memcpy(self->_buffer + carry, *chunk, take);
+    self->_buffer_len += take;
+
+    const char* found = _memmem(self->_buffer, self->_buffer_len,
+        self->_delimiter, delimiter_len);
+
+    if (found != NULL)
+    {
+      size_t pos = found - self->_buffer;
+
+      ret = _emit(self, self->_buffer, pos);
+      if (ret != KC_SUCCESS)
+      {
+        return ret;
+      }
+
+      // the delimiter always ends in this chunk
+      (*chunk) += pos + delimiter_len - carry;
+      (*len)   -= pos + delimiter_len - carry;
+
+      return _delimiter_found(self);
+    }
+
+    // this chunk is too small to tell, keep only the possible beginning
+    if (take < delimiter_len - 1)
+    {
+      size_t safe = self->_buffer_len - (delimiter_len - 1);
+      if (self->_buffer_len < delimiter_len - 1)
+      {
+        safe = 0;
+      }
+
+      ret = _emit(self, self->_buffer, safe);
+
+      memmove(self->_buffer, self->_buffer + safe, self->_buffer_len - safe);
+      self->_buffer_len -= safe;
+
+      (*chunk) += take;
+      (*len)   -= take;
+
+      return ret;
+    }
+
+    // it was not a delimiter, the bytes taken from this
+    // chunk are searched again together with the rest
+    self->_buffer_len = 0;
+
+    ret = _emit(self, self->_buffer, carry);
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
+  }
+
+  const char* found = _memmem(*chunk, *len, self->_delimiter, delimiter_len);
+  if (found != NULL)
+  {
+    size_t pos = found - *chunk;
+
+    ret = _emit(self, *chunk, pos);
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
+
+    (*chunk) += pos + delimiter_len;
+    (*len)   -= pos + delimiter_len;
+
+    return _delimiter_found(self);
+  }
+
+  // keep the bytes that may be the beginning of a delimiter
+  size_t keep = (*len < delimiter_len - 1) ? *len : delimiter_len - 1;
+
+  ret = _emit(self, *chunk, *len - keep);
+
+  memcpy(self->_buffer, *chunk + *len - keep, keep);
+  self->_buffer_len = keep;
+
+  (*chunk) += *len;
+  (*len)    = 0;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _consume_headers(struct kc_multipart_t* self, const char** chunk, size_t* len)
+{
+  while (*len > 0)
+  {
+    if (self->_buffer_len == sizeof(self->_buffer))
+    {
+      return KC_OVERFLOW;
+    }
+
+    self->_buffer[self->_buffer_len++] = **chunk;
+    (*chunk)++;
+    (*len)--;
+
+    // the headers end with an empty line (there can be no headers at all)
+    if ((self->_buffer_len == 2 && memcmp(self->_buffer, "\r\n", 2) == 0) ||
+        (self->_buffer_len >= 4 &&
+        memcmp(self->_buffer + self->_buffer_len - 4, "\r\n\r\n", 4) == 0))
+    {
+      return _begin_part(self);
+    }
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _begin_part(struct kc_multipart_t* self)
+{
+  struct kc_multipart_part_t* part = &self->part;
+  memset(part, 0, sizeof(struct kc_multipart_part_t));
+
+  const char* line = self->_buffer;
+  const char* end  = self->_buffer + self->_buffer_len;
+
+  while (line < end)
+  {
+    const char* line_end = _memmem(line, end - line, "\r\n", 2);
+    if (line_end == NULL)
+    {
+      line_end = end;
+    }
+
+    const char* colon = memchr(line, ':', line_end - line);
+    if (colon != NULL)
+    {
+      size_t key_len = colon - line;
+      const char* val = colon + 1;
+
+      while (val < line_end && (*val == ' ' || *val == '\t'))
+      {
+        ++val;
+      }
+
+      if (key_len == strlen("Content-Disposition") &&
+          strncasecmp(line, "Content-Disposition", key_len) == 0)
+      {
+        _header_param(val, line_end - val, "name", part->name, sizeof(part->name));
+        part->is_file = _header_param(val, line_end - val, "filename",
+            part->filename, sizeof(part->filename));
+      }
+      else if (key_len == strlen("Content-Type") &&
+          strncasecmp(line, "Content-Type", key_len) == 0)
+      {
+        size_t val_len = line_end - val;
+        if (val_len >= sizeof(part->content_type))
+        {
+          val_len = sizeof(part->content_type) - 1;
+        }
+
+        memcpy(part->content_type, val, val_len);
+      }
+    }
+
+    line = line_end + 2;
+  }
+
+  self->_state = _MULTIPART_DATA;
+  self->_buffer_len = 0;
+
+  if (self->on_part_begin != NULL)
+  {
+    return self->on_part_begin(self, part);
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _save_part_begin(struct kc_multipart_t* self, struct kc_multipart_part_t* part)
+{
+  self->_field_len = 0;
+
+  if (part->is_file == false)
+  {
+    return KC_SUCCESS;
+  }
+
+  // never trust the path sent by the client, keep only the file name
+  const char* name = part->filename;
+  for (const char* ptr = part->filename; *ptr != '\0'; ++ptr)
+  {
+    if (*ptr == '/' || *ptr == '\\')
+    {
+      name = ptr + 1;
+    }
+  }
+
+  // the part is dropped if there is no usable name
+  if (name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+  {
+    return KC_SUCCESS;
+  }
+
+  char path[KC_MAX_PATH];
+  int path_len = snprintf(path, sizeof(path), "%s/%s", self->_directory, name);
+
+  if (path_len < 0 || (size_t)path_len >= sizeof(path))
+  {
+    return KC_SUCCESS;
+  }
+
+  int ret = self->_file->open(self->_file, path, KC_FILE_WRITE);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  // let the handler know where the file was saved
+  if (self->_fields != NULL && part->name[0] != '\0')
+  {
+    return self->_fields->set(self->_fields, part->name, path, path_len + 1);
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _save_part_data(struct kc_multipart_t* self, const char* data, size_t len)
+{
+  if (self->part.is_file)
+  {
+    // the file could not be opened, the part is dropped
+    if (self->_file->opened == false)
+    {
+      return KC_SUCCESS;
+    }
+
+    return self->_file->write_bytes(self->_file, data, len);
+  }
+
+  // the fields are small, keep as much as fits
+  size_t room = sizeof(self->_field) - 1 - self->_field_len;
+  if (len > room)
+  {
+    len = room;
+  }
+
+  memcpy(self->_field + self->_field_len, data, len);
+  self->_field_len += len;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _save_part_end(struct kc_multipart_t* self)
+{
+  if (self->part.is_file)
+  {
+    return self->_file->close(self->_file);
+  }
+
+  if (self->_fields == NULL || self->part.name[0] == '\0')
+  {
+    return KC_SUCCESS;
+  }
+
+  self->_field[self->_field_len] = '\0';
+
+  return self->_fields->set(self->_fields, self->part.name,
+      self->_field, self->_field_len + 1);
+}
+
+//---------------------------------------------------------------------------//
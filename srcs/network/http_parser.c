@@ -9,19 +9,49 @@
 #include "../../hdrs/network/http_parser.h"
 #include "../../hdrs/common.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 
 //--- MARK: PUBLIC GLOBAL FUNCTION PROTOTYPES -------------------------------//
 
 int http_parse_request_line     (char* request_line, struct kc_http_request_t* req);
 int http_parse_request_headers  (char* request_headers, struct kc_http_request_t* req);
 int http_parse_request_body     (char* request_body, struct kc_http_request_t* req);
+int http_parse_header_fields    (const char* raw, size_t raw_len, struct kc_map_t* headers);
+int http_parse_query_string     (const char* raw, size_t raw_len, struct kc_map_t* params);
+size_t http_url_decode          (char* dest, const char* src, size_t src_len);
+int http_parse_content_type     (const char* content_type);
+int http_parse_date             (const char* date, time_t* time);
+size_t http_format_date         (time_t time, char* buffer);
+int http_parse_range            (const char* range, size_t size, struct kc_http_range_t* ranges, int* ranges_len);
+int http_match_etag             (const char* list, const char* etag);
+int http_accept_encoding        (const char* accept_encoding, const char* encoding);
 int validate_http_method        (char* method);
 int validate_http_url           (char* url);
 int validate_http_ver           (char* http_ver);
 int validate_http_body          (char* body);
 
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int _hex_to_int  (char c);
+static int _parse_int   (const char* str, int digits);
+
+//---------------------------------------------------------------------------//
+
+static const char* const _week_days[7] =
+{
+  "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+static const char* const _months[12] =
+{
+  "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
 //---------------------------------------------------------------------------//
 
 int http_parse_request_line(char* request_line, struct kc_http_request_t* req)
@@ -49,6 +79,18 @@ int http_parse_request_line(char* request_line, struct kc_http_request_t* req)
     return KC_FORMAT_ERROR;
   }
 
+  // split the query string from the path, it will
+  // be parsed only when a parameter is requested
+  char* tmp_query = strchr(tmp_url, '?');
+  if (tmp_query != NULL)
+  {
+    (*tmp_query) = '\0';
+    ++tmp_query;
+
+    req->_raw_query     = tmp_query;
+    req->_raw_query_len = strlen(tmp_query);
+  }
+
   ret = _set_req_method(req, tmp_method);
   if (ret != KC_SUCCESS)
   {
@@ -85,76 +127,588 @@ int http_parse_request_headers(char* request_headers, struct kc_http_request_t*
     return KC_NULL_REFERENCE;
   }
 
-  // parse the headers
-  char* tmp_header = strtok(request_headers, "\r\n");
-  while (tmp_header != NULL)
+  // only remember where the headers are, most of the handlers
+  // read one or two of them (if any), so the header fields are
+  // parsed into the map only on the first call of get_header()
+  req->_raw_headers     = request_headers;
+  req->_raw_headers_len = strlen(request_headers);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int http_parse_request_body(char* request_body, struct kc_http_request_t* req)
+{
+  // make sure the request_body exists
+  if (request_body == NULL)
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  if (req == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  _set_req_body(req, request_body);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int http_parse_header_fields(const char* raw, size_t raw_len, struct kc_map_t* headers)
+{
+  if (headers == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // nothing to parse
+  if (raw == NULL || raw_len == 0)
+  {
+    return KC_SUCCESS;
+  }
+
+  const char* end  = raw + raw_len;
+  const char* line = raw;
+
+  char key[KC_HTTP_HEADER_MAX_SIZE];
+  char val[KC_HTTP_HEADER_MAX_SIZE];
+
+  while (line < end)
   {
-    int i = 0, j = 0;
+    // find the end of the current header line
+    const char* line_end = memchr(line, '\n', end - line);
+    if (line_end == NULL)
+    {
+      line_end = end;
+    }
+
+    // find the key/value separator
+    const char* colon = memchr(line, ':', line_end - line);
+    if (colon == NULL)
+    {
+      line = line_end + 1;
+      continue;
+    }
+
+    // skip the optional white spaces around the value
+    const char* val_start = colon + 1;
+    const char* val_end   = line_end;
 
-    // parse the key
-    char key[1024];
-    while (tmp_header[i] != ':')
+    while (val_start < val_end && (*val_start == ' ' || *val_start == '\t'))
     {
-      key[i] = tmp_header[i];
-      ++i;
+      ++val_start;
     }
-    key[i + 1] = '\0';
 
-    // skip the space
-    if (tmp_header[++i] == ' ')
+    while (val_end > val_start && (val_end[-1] == '\r' ||
+        val_end[-1] == ' ' || val_end[-1] == '\t'))
     {
-      ++i;
+      --val_end;
     }
 
-    // parse the value
-    char val[1024];
-    while (tmp_header[i] != '\r')
+    size_t key_len = colon - line;
+    size_t val_len = val_end - val_start;
+
+    // ignore the malformed or oversized headers
+    if (key_len == 0 || val_len == 0 ||
+        key_len >= sizeof(key) || val_len >= sizeof(val))
     {
-      val[j++] = tmp_header[i];
-      ++i;
+      line = line_end + 1;
+      continue;
     }
-    val[j + 1] = '\0';
 
-    // create the header
-    if (key[0] != '\0' && val[0] != '\0')
+    memcpy(key, line, key_len);
+    memcpy(val, val_start, val_len);
+    key[key_len] = '\0';
+    val[val_len] = '\0';
+
+    // the map will handle dublicates and everything else
+    int ret = headers->set(headers, key, val, val_len + 1);
+    if (ret != KC_SUCCESS)
     {
-      // the map will handle dublicates and everything else
-      int ret = req->headers->set(req->headers, key,
-          val, (sizeof(char) * strlen(val) + 1));
+      return ret;
+    }
+
+    line = line_end + 1;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int http_parse_query_string(const char* raw, size_t raw_len, struct kc_map_t* params)
+{
+  if (params == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // nothing to parse
+  if (raw == NULL || raw_len == 0)
+  {
+    return KC_SUCCESS;
+  }
+
+  const char* end  = raw + raw_len;
+  const char* pair = raw;
+
+  char key[KC_HTTP_HEADER_MAX_SIZE];
+  char val[KC_HTTP_HEADER_MAX_SIZE];
+
+  while (pair < end)
+  {
+    // each pair is separated by '&' (ex: id=1&name=john)
+    const char* pair_end = memchr(pair, '&', end - pair);
+    if (pair_end == NULL)
+    {
+      pair_end = end;
+    }
 
-      // make sure the insertion was made
-      if (ret != KC_SUCCESS)
+    // a key without '=' has an empty value (ex: ?debug)
+    const char* equal = memchr(pair, '=', pair_end - pair);
+    const char* key_end = (equal != NULL) ? equal : pair_end;
+    const char* val_start = (equal != NULL) ? equal + 1 : pair_end;
+
+    size_t key_len = key_end - pair;
+    size_t val_len = pair_end - val_start;
+
+    // the decoded strings are never longer than the encoded ones
+    if (key_len == 0 || key_len >= sizeof(key) || val_len >= sizeof(val))
+    {
+      pair = pair_end + 1;
+      continue;
+    }
+
+    key_len = http_url_decode(key, pair, key_len);
+    val_len = http_url_decode(val, val_start, val_len);
+
+    int ret = params->set(params, key, val, val_len + 1);
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
+
+    pair = pair_end + 1;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+size_t http_url_decode(char* dest, const char* src, size_t src_len)
+{
+  size_t len = 0;
+
+  for (size_t i = 0; i < src_len; ++i)
+  {
+    // '+' is the form encoding of a space
+    if (src[i] == '+')
+    {
+      dest[len++] = ' ';
+      continue;
+    }
+
+    // decode the "%XX" sequences, keep the invalid ones as they are
+    if (src[i] == '%' && i + 2 < src_len)
+    {
+      int hi = _hex_to_int(src[i + 1]);
+      int lo = _hex_to_int(src[i + 2]);
+
+      if (hi >= 0 && lo >= 0)
       {
-        return ret;
+        dest[len++] = (char)((hi << 4) | lo);
+        i += 2;
+        continue;
       }
     }
 
-    tmp_header = strtok(NULL, "\r\n");
+    dest[len++] = src[i];
   }
 
+  dest[len] = '\0';
+
+  return len;
+}
+
+//---------------------------------------------------------------------------//
+
+int http_parse_content_type(const char* content_type)
+{
+  if (content_type == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // the media type can be followed by parameters (ex: ; charset=utf-8)
+  size_t len = strcspn(content_type, "; \t");
+
+  if (len == strlen("application/json") &&
+      strncasecmp(content_type, "application/json", len) == 0)
+  {
+    return KC_BODY_CONTENT_TYPE_JSON;
+  }
+
+  if (len == strlen("text/html") &&
+      strncasecmp(content_type, "text/html", len) == 0)
+  {
+    return KC_BODY_CONTENT_TYPE_HTML;
+  }
+
+  if (len == strlen("text/plain") &&
+      strncasecmp(content_type, "text/plain", len) == 0)
+  {
+    return KC_BODY_CONTENT_TYPE_TEXT;
+  }
+
+  if (len == strlen("application/x-www-form-urlencoded") &&
+      strncasecmp(content_type, "application/x-www-form-urlencoded", len) == 0)
+  {
+    return KC_BODY_CONTENT_TYPE_FORM;
+  }
+
+  if (len == strlen("multipart/form-data") &&
+      strncasecmp(content_type, "multipart/form-data", len) == 0)
+  {
+    return KC_BODY_CONTENT_TYPE_MULTIPART;
+  }
+
+  return KC_INVALID;
+}
+
+//---------------------------------------------------------------------------//
+
+int http_parse_date(const char* date, time_t* time)
+{
+  if (date == NULL || time == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // only the fixed format is accepted (ex: Sun, 06 Nov 1994 08:49:37 GMT)
+  if (strlen(date) != KC_HTTP_DATE_SIZE - 1 || date[3] != ',' ||
+      date[7] != ' ' || date[11] != ' ' || date[16] != ' ' ||
+      date[19] != ':' || date[22] != ':' || strcmp(date + 25, " GMT") != 0)
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  int month = -1;
+  for (int i = 0; i < 12; ++i)
+  {
+    if (strncmp(date + 8, _months[i], 3) == 0)
+    {
+      month = i + 1;
+      break;
+    }
+  }
+
+  int day    = _parse_int(date + 5, 2);
+  int year   = _parse_int(date + 12, 4);
+  int hour   = _parse_int(date + 17, 2);
+  int minute = _parse_int(date + 20, 2);
+  int second = _parse_int(date + 23, 2);
+
+  if (month < 0 || day < 1 || day > 31 || year < 1970 ||
+      hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 60)
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  // the days since the epoch of a civil date (the year starts in March,
+  // so the leap day is the last day of the year)
+  int y = (month <= 2) ? year - 1 : year;
+  int era = y / 400;
+  int year_of_era = y - era * 400;
+  int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  long days = (long)era * 146097 + day_of_era - 719468;
+
+  (*time) = (time_t)(days * 86400 + hour * 3600 + minute * 60 + second);
+
   return KC_SUCCESS;
 }
 
 //---------------------------------------------------------------------------//
 
-int http_parse_request_body(char* request_body, struct kc_http_request_t* req)
+size_t http_format_date(time_t time, char* buffer)
 {
-  // make sure the request_body exists
-  if (request_body == NULL)
+  struct tm tm;
+  gmtime_r(&time, &tm);
+
+  // the format is fixed, so the fields are written in place
+  memcpy(buffer, _week_days[tm.tm_wday], 3);
+  memcpy(buffer + 8, _months[tm.tm_mon], 3);
+
+  int year = tm.tm_year + 1900;
+
+  buffer[3]  = ',';
+  buffer[4]  = ' ';
+  buffer[5]  = '0' + tm.tm_mday / 10;
+  buffer[6]  = '0' + tm.tm_mday % 10;
+  buffer[7]  = ' ';
+  buffer[11] = ' ';
+  buffer[12] = '0' + (year / 1000) % 10;
+  buffer[13] = '0' + (year / 100) % 10;
+  buffer[14] = '0' + (year / 10) % 10;
+  buffer[15] = '0' + year % 10;
+  buffer[16] = ' ';
+  buffer[17] = '0' + tm.tm_hour / 10;
+  buffer[18] = '0' + tm.tm_hour % 10;
+  buffer[19] = ':';
+  buffer[20] = '0' + tm.tm_min / 10;
+  buffer[21] = '0' + tm.tm_min % 10;
+  buffer[22] = ':';
+  buffer[23] = '0' + tm.tm_sec / 10;
+  buffer[24] = '0' + tm.tm_sec % 10;
+
+  memcpy(buffer + 25, " GMT", 5);
+
+  return KC_HTTP_DATE_SIZE - 1;
+}
+
+//---------------------------------------------------------------------------//
+
+int http_parse_range(const char* range, size_t size, struct kc_http_range_t* ranges, int* ranges_len)
+{
+  if (range == NULL || ranges == NULL || ranges_len == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  (*ranges_len) = 0;
+
+  // only the byte ranges are known
+  if (strncmp(range, "bytes=", 6) != 0)
   {
     return KC_FORMAT_ERROR;
   }
 
-  if (req == NULL)
+  const char* cursor = range + 6;
+  bool specified = false;
+
+  // (ex: bytes=0-499, 1000-, -500)
+  while (1)
+  {
+    while (*cursor == ' ' || *cursor == '\t')
+    {
+      ++cursor;
+    }
+
+    bool has_first = (*cursor >= '0' && *cursor <= '9');
+    char* end = NULL;
+
+    size_t first = has_first ? strtoull(cursor, &end, 10) : 0;
+    if (has_first)
+    {
+      cursor = end;
+    }
+
+    if (*cursor != '-')
+    {
+      return KC_FORMAT_ERROR;
+    }
+
+    ++cursor;
+
+    bool has_last = (*cursor >= '0' && *cursor <= '9');
+    size_t last = has_last ? strtoull(cursor, &end, 10) : 0;
+    if (has_last)
+    {
+      cursor = end;
+    }
+
+    // "-" alone, or the last byte before the first one
+    if ((has_first == false && has_last == false) || (has_first && has_last && last < first))
+    {
+      return KC_FORMAT_ERROR;
+    }
+
+    specified = true;
+
+    // the suffix ranges (ex: -500) are the last bytes
+    if (has_first == false)
+    {
+      first = (last < size) ? size - last : 0;
+      last  = size - 1;
+    }
+    else if (has_last == false || last >= size)
+    {
+      last = size - 1;
+    }
+
+    // only the ranges that overlap the representation are kept
+    if (first < size)
+    {
+      if (*ranges_len == KC_HTTP_MAX_RANGES)
+      {
+        return KC_OVERFLOW;
+      }
+
+      ranges[*ranges_len].start = first;
+      ranges[*ranges_len].len   = last - first + 1;
+      ++(*ranges_len);
+    }
+
+    while (*cursor == ' ' || *cursor == '\t')
+    {
+      ++cursor;
+    }
+
+    if (*cursor == '\0')
+    {
+      break;
+    }
+
+    if (*cursor != ',')
+    {
+      return KC_FORMAT_ERROR;
+    }
+
+    ++cursor;
+  }
+
+  if (specified == false)
+  {
+    return KC_FORMAT_ERROR;
+  }
+
+  return (*ranges_len > 0) ? KC_SUCCESS : KC_INVALID;
+}
+
+//---------------------------------------------------------------------------//
+
+int http_match_etag(const char* list, const char* etag)
+{
+  if (list == NULL || etag == NULL)
   {
     return KC_NULL_REFERENCE;
   }
 
-  _set_req_body(req, request_body);
+  // the weak prefix does not matter for the comparison
+  if (strncmp(etag, "W/", 2) == 0)
+  {
+    etag += 2;
+  }
 
-  return KC_SUCCESS;
+  size_t etag_len = strlen(etag);
+  const char* cursor = list;
+
+  while (*cursor != '\0')
+  {
+    while (*cursor == ' ' || *cursor == '\t' || *cursor == ',')
+    {
+      ++cursor;
+    }
+
+    if (*cursor == '*')
+    {
+      return KC_SUCCESS;
+    }
+
+    if (strncmp(cursor, "W/", 2) == 0)
+    {
+      cursor += 2;
+    }
+
+    // the tags are quoted, so they end with the next quote
+    if (*cursor != '"')
+    {
+      return KC_INVALID;
+    }
+
+    const char* tag_end = strchr(cursor + 1, '"');
+    if (tag_end == NULL)
+    {
+      return KC_INVALID;
+    }
+
+    size_t tag_len = tag_end - cursor + 1;
+    if (tag_len == etag_len && strncmp(cursor, etag, tag_len) == 0)
+    {
+      return KC_SUCCESS;
+    }
+
+    cursor = tag_end + 1;
+  }
+
+  return KC_INVALID;
 }
 
+//---------------------------------------------------------------------------//
+
+int http_accept_encoding(const char* accept_encoding, const char* encoding)
+{
+  if (accept_encoding == NULL || encoding == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  size_t encoding_len = strlen(encoding);
+
+  // the quality of the coding, or of "*" when it's not listed
+  int quality = -1;
+  int any     = -1;
+
+  // ex: "gzip, deflate;q=0.5, br;q=0"
+  for (const char* item = accept_encoding; *item != '\0'; )
+  {
+    while (*item == ' ' || *item == '\t' || *item == ',')
+    {
+      ++item;
+    }
+
+    const char* name = item;
+    while (*item != '\0' && *item != ',' && *item != ';' && *item != ' ' && *item != '\t')
+    {
+      ++item;
+    }
+
+    size_t name_len = item - name;
+
+    // only "q=0", "q=0.0", ... refuse a coding
+    int accepted = 1;
+    const char* end = strchr(item, ',');
+    const char* q   = strstr(item, "q=");
+
+    if (q != NULL && (end == NULL || q < end))
+    {
+      accepted = 0;
+      for (q += 2; *q != '\0' && *q != ',' && *q != ';' && *q != ' '; ++q)
+      {
+        if (*q >= '1' && *q <= '9')
+        {
+          accepted = 1;
+        }
+      }
+    }
+
+    if (name_len == encoding_len && strncasecmp(name, encoding, name_len) == 0)
+    {
+      quality = accepted;
+    }
+    else if (name_len == 1 && name[0] == '*')
+    {
+      any = accepted;
+    }
+
+    item = (end != NULL) ? end : item + strlen(item);
+  }
+
+  if (quality == -1)
+  {
+    quality = any;
+  }
+
+  return (quality == 1) ? KC_SUCCESS : KC_INVALID;
+}
+
+//---------------------------------------------------------------------------//
+
 int validate_http_method(char* method)
 {
   // make sure the method exists
@@ -189,12 +743,12 @@ int validate_http_url(char* url)
     return KC_NULL_REFERENCE;
   }
 
-  // reserved characters
-  // TODO: use encoding characters too .-_~!$&\'()*+,;=:@
-  const char valid_chars[66] =
+  // reserved characters (the unreserved ones and the percent encoding)
+  // TODO: use encoding characters too !$&\'()*+,;=:@
+  const char valid_chars[] =
       "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
       "abcdefghijklmnopqrstuvwxyz"
-      "0123456789-_/";
+      "0123456789-_/.~%";
 
   const int CONTROL_CHAR   = 32;
   const int NON_ASCII_CHAR = 127;
@@ -264,3 +818,44 @@ int validate_http_body(char* body)
 }
 
 //---------------------------------------------------------------------------//
+
+static int _hex_to_int(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+
+  if (c >= 'A' && c <= 'F')
+  {
+    return c - 'A' + 10;
+  }
+
+  return KC_INVALID;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _parse_int(const char* str, int digits)
+{
+  int val = 0;
+
+  for (int i = 0; i < digits; ++i)
+  {
+    if (str[i] < '0' || str[i] > '9')
+    {
+      return -1;
+    }
+
+    val = val * 10 + (str[i] - '0');
+  }
+
+  return val;
+}
+
+//---------------------------------------------------------------------------//
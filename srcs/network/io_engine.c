@@ -0,0 +1,1043 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// io_engine.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/io_engine.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+// what the completions of the ring are for (a receive carries its connection)
+#define KC_IO_URING_ACCEPT                                                    1
+#define KC_IO_URING_STOP                                                      2
+#define KC_IO_URING_IGNORED                                                   3
+#define KC_IO_URING_WATCHED                                                   4
+
+// what is written in the stop pipe
+#define KC_IO_ENGINE_STOP                                                     1
+#define KC_IO_ENGINE_DRAIN                                                    2
+#define KC_IO_ENGINE_WAKE                                                     3
+
+//---------------------------------------------------------------------------//
+
+struct kc_io_connection_t
+{
+  int   fd;
+  void* conn;  // the context given by the handler
+
+  struct kc_io_connection_t* prev;
+  struct kc_io_connection_t* next;
+};
+
+//---------------------------------------------------------------------------//
+
+// the queues shared with the kernel, mapped in the memory of the process
+struct kc_io_uring_t
+{
+  void*  rings;
+  size_t rings_size;
+
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_array;
+  unsigned  sq_mask;
+  unsigned  sq_pending;  // queued, but not submitted yet
+
+  struct io_uring_sqe* sqes;
+  size_t               sqes_size;
+
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned  cq_mask;
+
+  struct io_uring_cqe* cqes;
+
+  // the buffers the kernel picks from when a receive completes
+  struct io_uring_buf_ring* buf_ring;
+  size_t                    buf_ring_size;
+  unsigned short            buf_tail;
+  char*                     buffers;
+};
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int  run_io_engine    (struct kc_io_engine_t* self);
+static void stop_io_engine   (struct kc_io_engine_t* self);
+static void drain_io_engine  (struct kc_io_engine_t* self);
+static void wake_io_engine   (struct kc_io_engine_t* self);
+static int  watch_io_engine  (struct kc_io_engine_t* self, int fd);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static struct kc_io_connection_t* _add_connection  (struct kc_io_engine_t* self, int fd);
+static void _close_connection  (struct kc_io_engine_t* self, struct kc_io_connection_t* io_conn);
+static void _close_all         (struct kc_io_engine_t* self);
+static void _read_stop         (struct kc_io_engine_t* self);
+static bool _is_running        (struct kc_io_engine_t* self);
+static void _signal            (struct kc_io_engine_t* self, char byte);
+
+static int  _epoll_init      (struct kc_io_engine_t* self);
+static int  _epoll_run       (struct kc_io_engine_t* self);
+static void _epoll_accept    (struct kc_io_engine_t* self);
+static void _epoll_receive   (struct kc_io_engine_t* self, struct kc_io_connection_t* io_conn);
+
+static int  _uring_init      (struct kc_io_engine_t* self);
+static void _uring_destroy   (struct kc_io_uring_t* uring);
+static int  _uring_run       (struct kc_io_engine_t* self);
+static int  _uring_submit    (struct kc_io_engine_t* self, bool wait);
+static struct io_uring_sqe* _uring_sqe  (struct kc_io_engine_t* self);
+static void _uring_complete  (struct kc_io_engine_t* self, struct io_uring_cqe* cqe);
+static void _uring_accept    (struct kc_io_engine_t* self);
+static void _uring_watch_stop  (struct kc_io_engine_t* self);
+static void _uring_watch       (struct kc_io_engine_t* self);
+static void _uring_receive   (struct kc_io_engine_t* self, struct kc_io_connection_t* io_conn);
+static void _uring_received  (struct kc_io_engine_t* self, struct kc_io_connection_t* io_conn, struct io_uring_cqe* cqe);
+static void _uring_provide   (struct kc_io_uring_t* uring, unsigned short bid);
+
+//---------------------------------------------------------------------------//
+
+struct kc_io_engine_t* new_io_engine(int type, int listen_fd, struct kc_io_handler_t handler)
+{
+  if ((type != KC_IO_ENGINE_EPOLL && type != KC_IO_ENGINE_IO_URING) || listen_fd < 0 ||
+      handler.accepted == NULL || handler.buffer == NULL ||
+      handler.received == NULL || handler.closed == NULL)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
+  // create an engine instance to be returned
+  struct kc_io_engine_t* new_engine = malloc(sizeof(struct kc_io_engine_t));
+
+  // confirm that there is memory to allocate
+  if (new_engine == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_engine->listen_fd    = listen_fd;
+  new_engine->handler      = handler;
+  new_engine->_fd          = -1;
+  new_engine->_stopped     = false;
+  new_engine->_draining    = false;
+  new_engine->_watched     = -1;
+  new_engine->_connections = NULL;
+  new_engine->_uring       = NULL;
+
+  if (pipe(new_engine->_stop_fds) != 0)
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+    free(new_engine);
+    return NULL;
+  }
+
+  // stop never blocks, even with a full pipe, and the loop reads
+  // only what's in it
+  fcntl(new_engine->_stop_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(new_engine->_stop_fds[1], F_SETFL, O_NONBLOCK);
+
+  // an older kernel (or a forbidden io_uring) falls back to epoll
+  if (type == KC_IO_ENGINE_IO_URING && _uring_init(new_engine) == KC_SUCCESS)
+  {
+    new_engine->type = KC_IO_ENGINE_IO_URING;
+  }
+  else if (_epoll_init(new_engine) == KC_SUCCESS)
+  {
+    new_engine->type = KC_IO_ENGINE_EPOLL;
+  }
+  else
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+
+    close(new_engine->_stop_fds[0]);
+    close(new_engine->_stop_fds[1]);
+    free(new_engine);
+
+    return NULL;
+  }
+
+  // assigns the public member methods
+  new_engine->run   = run_io_engine;
+  new_engine->stop  = stop_io_engine;
+  new_engine->drain = drain_io_engine;
+  new_engine->wake  = wake_io_engine;
+  new_engine->watch = watch_io_engine;
+
+  return new_engine;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_io_engine(struct kc_io_engine_t* engine)
+{
+  if (engine == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // the connections of an engine that never ran (or is destroyed early)
+  _close_all(engine);
+
+  // closing the ring cancels whatever is still in flight
+  close(engine->_fd);
+
+  if (engine->_uring != NULL)
+  {
+    _uring_destroy(engine->_uring);
+  }
+
+  close(engine->_stop_fds[0]);
+  close(engine->_stop_fds[1]);
+
+  free(engine);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int run_io_engine(struct kc_io_engine_t* self)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // the listening socket is known to be final only now (ex: it can be
+  // replaced by one handed off by another process), and the connections
+  // are accepted until there are no more waiting
+  fcntl(self->listen_fd, F_SETFL, fcntl(self->listen_fd, F_GETFL) | O_NONBLOCK);
+
+  int ret = (self->type == KC_IO_ENGINE_IO_URING) ?
+      _uring_run(self) : _epoll_run(self);
+
+  // the clients see the connections closed right away
+  _close_all(self);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static void stop_io_engine(struct kc_io_engine_t* self)
+{
+  if (self == NULL)
+  {
+    return;
+  }
+
+  _signal(self, KC_IO_ENGINE_STOP);
+}
+
+//---------------------------------------------------------------------------//
+
+static void drain_io_engine(struct kc_io_engine_t* self)
+{
+  if (self == NULL)
+  {
+    return;
+  }
+
+  _signal(self, KC_IO_ENGINE_DRAIN);
+}
+
+//---------------------------------------------------------------------------//
+
+static void wake_io_engine(struct kc_io_engine_t* self)
+{
+  if (self == NULL)
+  {
+    return;
+  }
+
+  _signal(self, KC_IO_ENGINE_WAKE);
+}
+
+//---------------------------------------------------------------------------//
+
+static int watch_io_engine(struct kc_io_engine_t* self, int fd)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (fd < 0 || self->handler.ready == NULL)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // one at a time, before the loop runs
+  if (self->_watched != -1)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  self->_watched = fd;
+
+  return KC_SUCCESS;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static struct kc_io_connection_t* _add_connection(struct kc_io_engine_t* self, int fd)
+{
+  struct kc_io_connection_t* io_conn = malloc(sizeof(struct kc_io_connection_t));
+  if (io_conn == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    close(fd);
+    return NULL;
+  }
+
+  io_conn->fd   = fd;
+  io_conn->conn = self->handler.accepted(self->handler.data, fd);
+
+  // the handler refused the connection
+  if (io_conn->conn == NULL)
+  {
+    close(fd);
+    free(io_conn);
+    return NULL;
+  }
+
+  io_conn->prev = NULL;
+  io_conn->next = self->_connections;
+
+  if (self->_connections != NULL)
+  {
+    self->_connections->prev = io_conn;
+  }
+
+  self->_connections = io_conn;
+
+  return io_conn;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _close_connection(struct kc_io_engine_t* self, struct kc_io_connection_t* io_conn)
+{
+  if (io_conn->prev != NULL)
+  {
+    io_conn->prev->next = io_conn->next;
+  }
+  else
+  {
+    self->_connections = io_conn->next;
+  }
+
+  if (io_conn->next != NULL)
+  {
+    io_conn->next->prev = io_conn->prev;
+  }
+
+  // the handler lets the connection go while its socket is still open
+  self->handler.closed(io_conn->conn);
+
+  // the ring closes the socket with the next batch of requests
+  if (self->type == KC_IO_ENGINE_IO_URING)
+  {
+    struct io_uring_sqe* sqe = _uring_sqe(self);
+
+    sqe->opcode    = IORING_OP_CLOSE;
+    sqe->fd        = io_conn->fd;
+    sqe->user_data = KC_IO_URING_IGNORED;
+  }
+  else
+  {
+    // the socket can outlive the descriptor (ex: handed over to an SSE
+    // broadcaster with dup), and would stay in the interest list with it
+    epoll_ctl(self->_fd, EPOLL_CTL_DEL, io_conn->fd, NULL);
+    close(io_conn->fd);
+  }
+
+  free(io_conn);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _close_all(struct kc_io_engine_t* self)
+{
+  while (self->_connections != NULL)
+  {
+    struct kc_io_connection_t* io_conn = self->_connections;
+    self->_connections = io_conn->next;
+
+    // a receive still in flight holds the socket open, but not the connection
+    shutdown(io_conn->fd, SHUT_RDWR);
+    self->handler.closed(io_conn->conn);
+
+    close(io_conn->fd);
+    free(io_conn);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _read_stop(struct kc_io_engine_t* self)
+{
+  char bytes[16];
+  ssize_t len = 0;
+  bool woken = false;
+
+  while ((len = read(self->_stop_fds[0], bytes, sizeof(bytes))) > 0)
+  {
+    for (ssize_t i = 0; i < len; ++i)
+    {
+      // the wake ups are merged, the handler is called once for all
+      if (bytes[i] == KC_IO_ENGINE_WAKE)
+      {
+        woken = true;
+      }
+      else if (bytes[i] == KC_IO_ENGINE_STOP)
+      {
+        self->_stopped = true;
+      }
+      else if (bytes[i] == KC_IO_ENGINE_DRAIN && self->_draining == false)
+      {
+        self->_draining = true;
+
+        // no more connections, those waiting are left for another process
+        // that listens on the same socket (if any)
+        if (self->type == KC_IO_ENGINE_IO_URING)
+        {
+          struct io_uring_sqe* sqe = _uring_sqe(self);
+
+          sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+          sqe->addr      = KC_IO_URING_ACCEPT;
+          sqe->user_data = KC_IO_URING_IGNORED;
+        }
+        else
+        {
+          epoll_ctl(self->_fd, EPOLL_CTL_DEL, self->listen_fd, NULL);
+        }
+
+        if (self->handler.draining != NULL)
+        {
+          self->handler.draining(self->handler.data);
+        }
+      }
+    }
+  }
+
+  // a stopped loop is closing its connections, there's nothing left to do
+  if (woken && self->_stopped == false && self->handler.woken != NULL)
+  {
+    self->handler.woken(self->handler.data);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _is_running(struct kc_io_engine_t* self)
+{
+  // a draining engine runs until its last connection is closed
+  return self->_stopped == false &&
+      (self->_draining == false || self->_connections != NULL);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _signal(struct kc_io_engine_t* self, char byte)
+{
+  // wake the loop up, it reads the byte at the next iteration
+  ssize_t ret = write(self->_stop_fds[1], &byte, 1);
+  (void)ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _epoll_init(struct kc_io_engine_t* self)
+{
+  self->_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (self->_fd < 0)
+  {
+    return KC_SYSTEM_ERROR;
+  }
+
+  // the stop pipe is told apart from the connections by its data
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+
+  event.events   = EPOLLIN;
+  event.data.ptr = self->_stop_fds;
+
+  if (epoll_ctl(self->_fd, EPOLL_CTL_ADD, self->_stop_fds[0], &event) != 0)
+  {
+    close(self->_fd);
+    self->_fd = -1;
+
+    return KC_SYSTEM_ERROR;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _epoll_run(struct kc_io_engine_t* self)
+{
+  struct epoll_event events[KC_IO_ENGINE_QUEUE_SIZE];
+
+  // the listening socket is the only one without data
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+
+  event.events   = EPOLLIN;
+  event.data.ptr = NULL;
+
+  if (self->_stopped == false && self->_draining == false &&
+      epoll_ctl(self->_fd, EPOLL_CTL_ADD, self->listen_fd, &event) != 0)
+  {
+    log_error(KC_NETWORK_ERROR_LOG);
+    return KC_NETWORK_ERROR;
+  }
+
+  // the watched descriptor is told apart by the address of its field
+  event.data.ptr = &self->_watched;
+
+  if (self->_watched != -1 &&
+      epoll_ctl(self->_fd, EPOLL_CTL_ADD, self->_watched, &event) != 0)
+  {
+    log_error(KC_NETWORK_ERROR_LOG);
+    return KC_NETWORK_ERROR;
+  }
+
+  // a drain asked for before the loop started
+  _read_stop(self);
+
+  while (_is_running(self))
+  {
+    int len = epoll_wait(self->_fd, events, KC_IO_ENGINE_QUEUE_SIZE, -1);
+    if (len < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      log_error(KC_NETWORK_ERROR_LOG);
+      return KC_NETWORK_ERROR;
+    }
+
+    for (int i = 0; i < len; ++i)
+    {
+      // a connection closed by an earlier event doesn't come again, but
+      // the listening socket can, after it was removed by a drain
+      if (events[i].data.ptr == NULL && self->_draining == false)
+      {
+        _epoll_accept(self);
+      }
+      else if (events[i].data.ptr == self->_stop_fds)
+      {
+        _read_stop(self);
+      }
+      else if (events[i].data.ptr == &self->_watched)
+      {
+        self->handler.ready(self->handler.data, self->_watched);
+      }
+      else if (events[i].data.ptr == NULL)
+      {
+        continue;
+      }
+      else
+      {
+        _epoll_receive(self, events[i].data.ptr);
+      }
+    }
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _epoll_accept(struct kc_io_engine_t* self)
+{
+  // all the connections waiting, the listening socket doesn't block
+  for (;;)
+  {
+    int fd = accept(self->listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        log_error(KC_NETWORK_ERROR_LOG);
+      }
+
+      return;
+    }
+
+    struct kc_io_connection_t* io_conn = _add_connection(self, fd);
+    if (io_conn == NULL)
+    {
+      continue;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(struct epoll_event));
+
+    event.events   = EPOLLIN;
+    event.data.ptr = io_conn;
+
+    if (epoll_ctl(self->_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+      log_error(KC_SYSTEM_ERROR_LOG);
+      _close_connection(self, io_conn);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _epoll_receive(struct kc_io_engine_t* self, struct kc_io_connection_t* io_conn)
+{
+  size_t size = 0;
+  char* buffer = self->handler.buffer(io_conn->conn, &size);
+
+  // the socket is readable, so this doesn't block
+  ssize_t ret = recv(io_conn->fd, buffer, size, 0);
+  if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+  {
+    return;
+  }
+
+  // the client left (or the handler is done with it)
+  if (ret <= 0 || self->handler.received(io_conn->conn, ret) == false)
+  {
+    _close_connection(self, io_conn);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int _uring_init(struct kc_io_engine_t* self)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(struct io_uring_params));
+
+  // the completions of a busy loop iteration may outnumber its submissions
+  params.flags      = IORING_SETUP_CQSIZE;
+  params.cq_entries = KC_IO_ENGINE_QUEUE_SIZE * 4;
+
+  int fd = syscall(__NR_io_uring_setup, KC_IO_ENGINE_QUEUE_SIZE, &params);
+  if (fd < 0)
+  {
+    return KC_UNSUPPORTED_FEATURE;
+  }
+
+  struct kc_io_uring_t* uring = calloc(1, sizeof(struct kc_io_uring_t));
+  if (uring == NULL)
+  {
+    close(fd);
+    return KC_OUT_OF_MEMORY;
+  }
+
+  uring->rings    = MAP_FAILED;
+  uring->sqes     = MAP_FAILED;
+  uring->buf_ring = MAP_FAILED;
+
+  // both rings are in the same mapping (since Linux 5.4)
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+  uring->rings_size    = (sq_size > cq_size) ? sq_size : cq_size;
+  uring->sqes_size     = params.sq_entries * sizeof(struct io_uring_sqe);
+  uring->buf_ring_size = KC_IO_ENGINE_BUFFERS * sizeof(struct io_uring_buf);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    uring->rings = mmap(NULL, uring->rings_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, IORING_OFF_SQ_RING);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, IORING_OFF_SQES);
+  }
+
+  // the ring of provided buffers must be page aligned
+  uring->buf_ring = mmap(NULL, uring->buf_ring_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  uring->buffers = malloc((size_t)KC_IO_ENGINE_BUFFERS * KC_IO_ENGINE_BUFFER_SIZE);
+
+  if (uring->rings == MAP_FAILED || uring->sqes == MAP_FAILED ||
+      uring->buf_ring == MAP_FAILED || uring->buffers == NULL)
+  {
+    _uring_destroy(uring);
+    close(fd);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  char* rings = uring->rings;
+
+  uring->sq_head  = (unsigned*)(rings + params.sq_off.head);
+  uring->sq_tail  = (unsigned*)(rings + params.sq_off.tail);
+  uring->sq_array = (unsigned*)(rings + params.sq_off.array);
+  uring->sq_mask  = *(unsigned*)(rings + params.sq_off.ring_mask);
+
+  uring->cq_head  = (unsigned*)(rings + params.cq_off.head);
+  uring->cq_tail  = (unsigned*)(rings + params.cq_off.tail);
+  uring->cq_mask  = *(unsigned*)(rings + params.cq_off.ring_mask);
+  uring->cqes     = (struct io_uring_cqe*)(rings + params.cq_off.cqes);
+
+  // the provided buffers came with Linux 5.19, like the multishot accept,
+  // so a kernel that takes them can do everything the engine needs
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(struct io_uring_buf_reg));
+
+  reg.ring_addr    = (uintptr_t)uring->buf_ring;
+  reg.ring_entries = KC_IO_ENGINE_BUFFERS;
+  reg.bgid         = 0;
+
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+  {
+    _uring_destroy(uring);
+    close(fd);
+
+    return KC_UNSUPPORTED_FEATURE;
+  }
+
+  for (unsigned short bid = 0; bid < KC_IO_ENGINE_BUFFERS; ++bid)
+  {
+    _uring_provide(uring, bid);
+  }
+
+  self->_fd    = fd;
+  self->_uring = uring;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _uring_destroy(struct kc_io_uring_t* uring)
+{
+  if (uring->rings != MAP_FAILED)
+  {
+    munmap(uring->rings, uring->rings_size);
+  }
+
+  if (uring->sqes != MAP_FAILED)
+  {
+    munmap(uring->sqes, uring->sqes_size);
+  }
+
+  if (uring->buf_ring != MAP_FAILED)
+  {
+    munmap(uring->buf_ring, uring->buf_ring_size);
+  }
+
+  free(uring->buffers);
+  free(uring);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _uring_run(struct kc_io_engine_t* self)
+{
+  struct kc_io_uring_t* uring = self->_uring;
+
+  // a stopped engine is not started again
+  if (self->_stopped || self->_draining)
+  {
+    return KC_SUCCESS;
+  }
+
+  _uring_accept(self);
+  _uring_watch_stop(self);
+
+  if (self->_watched != -1)
+  {
+    _uring_watch(self);
+  }
+
+  while (_is_running(self))
+  {
+    // submit everything queued by the last iteration, then wait
+    if (_uring_submit(self, true) != KC_SUCCESS)
+    {
+      log_error(KC_NETWORK_ERROR_LOG);
+      return KC_NETWORK_ERROR;
+    }
+
+    unsigned head = *uring->cq_head;
+    unsigned tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head)
+    {
+      // the entry is copied, so the kernel can reuse it right away
+      struct io_uring_cqe cqe = uring->cqes[head & uring->cq_mask];
+      __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+      _uring_complete(self, &cqe);
+    }
+  }
+
+  // the last connections of a drain are closed by the requests still queued
+  if (uring->sq_pending > 0)
+  {
+    _uring_submit(self, false);
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _uring_submit(struct kc_io_engine_t* self, bool wait)
+{
+  struct kc_io_uring_t* uring = self->_uring;
+
+  int ret = syscall(__NR_io_uring_enter, self->_fd, uring->sq_pending,
+      wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+  if (ret >= 0)
+  {
+    uring->sq_pending -= ret;
+    return KC_SUCCESS;
+  }
+
+  // a signal, or too many completions not reaped yet: the loop
+  // reaps them and submits the rest with the next iteration
+  if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+  {
+    return KC_SUCCESS;
+  }
+
+  return KC_NETWORK_ERROR;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct io_uring_sqe* _uring_sqe(struct kc_io_engine_t* self)
+{
+  struct kc_io_uring_t* uring = self->_uring;
+  unsigned tail = *uring->sq_tail;
+
+  // the queue is full, submit it without waiting
+  if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) > uring->sq_mask)
+  {
+    _uring_submit(self, false);
+  }
+
+  unsigned index = tail & uring->sq_mask;
+  struct io_uring_sqe* sqe = &uring->sqes[index];
+
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  uring->sq_array[index] = index;
+
+  // the kernel reads the entry only when it's submitted,
+  // so it can be published before the caller fills it
+  __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  uring->sq_pending++;
+
+  return sqe;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _uring_complete(struct kc_io_engine_t* self, struct io_uring_cqe* cqe)
+{
+  switch (cqe->user_data)
+  {
+    case KC_IO_URING_ACCEPT:
+    {
+      if (cqe->res >= 0)
+      {
+        struct kc_io_connection_t* io_conn = _add_connection(self, cqe->res);
+
+        if (io_conn != NULL)
+        {
+          _uring_receive(self, io_conn);
+        }
+      }
+      else if (cqe->res != -EINTR && cqe->res != -EAGAIN && cqe->res != -ECANCELED)
+      {
+        log_error(KC_NETWORK_ERROR_LOG);
+      }
+
+      // the kernel ended the multishot accept (ex: on an error)
+      if ((cqe->flags & IORING_CQE_F_MORE) == 0 && self->_draining == false)
+      {
+        _uring_accept(self);
+      }
+
+      break;
+    }
+
+    case KC_IO_URING_STOP:
+    {
+      _read_stop(self);
+
+      if (self->_stopped == false)
+      {
+        _uring_watch_stop(self);
+      }
+
+      break;
+    }
+
+    case KC_IO_URING_WATCHED:
+    {
+      if (self->_stopped == false)
+      {
+        self->handler.ready(self->handler.data, self->_watched);
+        _uring_watch(self);
+      }
+
+      break;
+    }
+
+    case KC_IO_URING_IGNORED:
+    {
+      break;
+    }
+
+    default:
+    {
+      _uring_received(self, (struct kc_io_connection_t*)(uintptr_t)cqe->user_data, cqe);
+      break;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _uring_accept(struct kc_io_engine_t* self)
+{
+  // a single request accepts all the connections that come
+  struct io_uring_sqe* sqe = _uring_sqe(self);
+
+  sqe->opcode    = IORING_OP_ACCEPT;
+  sqe->fd        = self->listen_fd;
+  sqe->ioprio    = IORING_ACCEPT_MULTISHOT;
+  sqe->user_data = KC_IO_URING_ACCEPT;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _uring_watch_stop(struct kc_io_engine_t* self)
+{
+  // the stop pipe is watched like any other request
+  struct io_uring_sqe* sqe = _uring_sqe(self);
+
+  sqe->opcode        = IORING_OP_POLL_ADD;
+  sqe->fd            = self->_stop_fds[0];
+  sqe->poll32_events = POLLIN;
+  sqe->user_data     = KC_IO_URING_STOP;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _uring_watch(struct kc_io_engine_t* self)
+{
+  // a single poll at a time, asked for again once it completed
+  struct io_uring_sqe* sqe = _uring_sqe(self);
+
+  sqe->opcode        = IORING_OP_POLL_ADD;
+  sqe->fd            = self->_watched;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data     = KC_IO_URING_WATCHED;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _uring_receive(struct kc_io_engine_t* self, struct kc_io_connection_t* io_conn)
+{
+  size_t size = 0;
+  self->handler.buffer(io_conn->conn, &size);
+
+  // the kernel picks the buffer when the bytes arrive, so the idle
+  // connections hold no memory (only what fits in the handler's buffer)
+  struct io_uring_sqe* sqe = _uring_sqe(self);
+
+  sqe->opcode    = IORING_OP_RECV;
+  sqe->fd        = io_conn->fd;
+  sqe->flags     = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->len       = (size < KC_IO_ENGINE_BUFFER_SIZE) ? size : KC_IO_ENGINE_BUFFER_SIZE;
+  sqe->user_data = (uintptr_t)io_conn;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _uring_received(struct kc_io_engine_t* self, struct kc_io_connection_t* io_conn,
+    struct io_uring_cqe* cqe)
+{
+  size_t len = 0;
+
+  // copy the bytes to the handler and give the buffer back to the kernel
+  if (cqe->flags & IORING_CQE_F_BUFFER)
+  {
+    unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+    if (cqe->res > 0)
+    {
+      size_t size = 0;
+      char* buffer = self->handler.buffer(io_conn->conn, &size);
+
+      len = ((size_t)cqe->res < size) ? (size_t)cqe->res : size;
+      memcpy(buffer, self->_uring->buffers + (size_t)bid * KC_IO_ENGINE_BUFFER_SIZE, len);
+    }
+
+    _uring_provide(self->_uring, bid);
+  }
+
+  // no buffer was free when the bytes came, try again
+  if (cqe->res == -ENOBUFS || cqe->res == -EINTR || cqe->res == -EAGAIN)
+  {
+    _uring_receive(self, io_conn);
+    return;
+  }
+
+  // the client left (or the handler is done with it)
+  if (cqe->res <= 0 || self->handler.received(io_conn->conn, len) == false)
+  {
+    _close_connection(self, io_conn);
+    return;
+  }
+
+  _uring_receive(self, io_conn);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _uring_provide(struct kc_io_uring_t* uring, unsigned short bid)
+{
+  struct io_uring_buf* buf = &uring->buf_ring->bufs[uring->buf_tail & (KC_IO_ENGINE_BUFFERS - 1)];
+
+  buf->addr = (uintptr_t)(uring->buffers + (size_t)bid * KC_IO_ENGINE_BUFFER_SIZE);
+  buf->len  = KC_IO_ENGINE_BUFFER_SIZE;
+  buf->bid  = bid;
+
+  // the kernel sees the buffer once the tail moves past it
+  uring->buf_tail++;
+  __atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+}
+
+//---------------------------------------------------------------------------//
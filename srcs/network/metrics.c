@@ -0,0 +1,894 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// metrics.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/metrics.h"
+#include "../../hdrs/datastructs/histogram.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/system/worker_pool.h"
+#include "../../hdrs/common.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the bounds of the Prometheus buckets, in seconds
+#define KC_METRICS_BOUNDS                                                    19
+
+//---------------------------------------------------------------------------//
+
+struct kc_metrics_route_t
+{
+  uint64_t requests;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+
+  struct kc_histogram_t* latency;
+};
+
+struct kc_metrics_shard_t
+{
+  uint64_t opened;
+  uint64_t closed;
+  uint64_t statuses[KC_METRICS_STATUSES];
+
+  struct kc_histogram_t*     phases[KC_METRICS_PHASES];
+  struct kc_metrics_route_t* routes[KC_METRICS_ROUTES];  // made when first used
+};
+
+// the text being rendered
+struct kc_metrics_text_t
+{
+  char*  data;
+  size_t len;
+  size_t size;
+  bool   failed;
+};
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int      add_route_metrics  (struct kc_metrics_t* self, const char* method, const char* url);
+static void     opened_metrics     (struct kc_metrics_t* self);
+static void     closed_metrics     (struct kc_metrics_t* self);
+static void     record_metrics     (struct kc_metrics_t* self, struct kc_metrics_sample_t* sample);
+static uint64_t requests_metrics   (struct kc_metrics_t* self, int route);
+static uint64_t responses_metrics  (struct kc_metrics_t* self, int status);
+static uint64_t active_metrics     (struct kc_metrics_t* self);
+static uint64_t latency_metrics    (struct kc_metrics_t* self, int route, int phase, double percentile);
+static int      render_metrics     (struct kc_metrics_t* self, char** text, size_t* len);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static struct kc_metrics_shard_t* _shard          (struct kc_metrics_t* self);
+static struct kc_metrics_shard_t* _new_shard      (void);
+static void                       _destroy_shard  (struct kc_metrics_shard_t* shard);
+static struct kc_metrics_route_t* _route          (struct kc_metrics_shard_t* shard, int route);
+static struct kc_metrics_route_t* _new_route      (void);
+static void                       _destroy_route  (struct kc_metrics_route_t* route);
+
+static void     _add            (uint64_t* counter, uint64_t value);
+static uint64_t _load           (uint64_t* counter);
+static void     _merge_route    (struct kc_metrics_t* self, int route, struct kc_metrics_route_t* into);
+static void     _merge_phase    (struct kc_metrics_t* self, int phase, struct kc_histogram_t* into);
+static void     _append         (struct kc_metrics_text_t* text, const char* format, ...);
+static void     _append_label   (struct kc_metrics_text_t* text, const char* value);
+static void     _append_histogram  (struct kc_metrics_text_t* text, const char* name, const char* labels, struct kc_histogram_t* histogram);
+
+//--- MARK: PRIVATE MEMBERS -------------------------------------------------//
+
+// the shard of every thread is picked once, one after the other
+static __thread int shard_index = -1;
+static int          next_shard  = 0;
+
+static const char* const phase_names[KC_METRICS_PHASES] =
+{
+  "parse", "handler", "serialize", "send"
+};
+
+static const double bounds[KC_METRICS_BOUNDS] =
+{
+  0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+  0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+//---------------------------------------------------------------------------//
+
+struct kc_metrics_t* new_metrics(void)
+{
+  // create a metrics instance to be returned
+  struct kc_metrics_t* new_metrics = malloc(sizeof(struct kc_metrics_t));
+
+  // confirm that there is memory to allocate
+  if (new_metrics == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  memset(new_metrics, 0, sizeof(struct kc_metrics_t));
+
+  // the requests without a route
+  new_metrics->methods[KC_METRICS_OTHER_ROUTE] = strdup("");
+  new_metrics->urls[KC_METRICS_OTHER_ROUTE]    = strdup("");
+  new_metrics->routes_len = 1;
+
+  if (new_metrics->methods[KC_METRICS_OTHER_ROUTE] == NULL || new_metrics->urls[KC_METRICS_OTHER_ROUTE] == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+
+    free(new_metrics->methods[KC_METRICS_OTHER_ROUTE]);
+    free(new_metrics->urls[KC_METRICS_OTHER_ROUTE]);
+    free(new_metrics);
+
+    return NULL;
+  }
+
+  pthread_mutex_init(&new_metrics->_lock, NULL);
+
+  // assigns the public member methods
+  new_metrics->add_route = add_route_metrics;
+  new_metrics->opened    = opened_metrics;
+  new_metrics->closed    = closed_metrics;
+  new_metrics->record    = record_metrics;
+  new_metrics->requests  = requests_metrics;
+  new_metrics->responses = responses_metrics;
+  new_metrics->active    = active_metrics;
+  new_metrics->latency   = latency_metrics;
+  new_metrics->render    = render_metrics;
+
+  return new_metrics;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_metrics(struct kc_metrics_t* metrics)
+{
+  if (metrics == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  for (int i = 0; i < KC_METRICS_SHARDS; ++i)
+  {
+    if (metrics->_shards[i] != NULL)
+    {
+      _destroy_shard(metrics->_shards[i]);
+    }
+  }
+
+  for (int i = 0; i < metrics->routes_len; ++i)
+  {
+    free(metrics->methods[i]);
+    free(metrics->urls[i]);
+  }
+
+  pthread_mutex_destroy(&metrics->_lock);
+  free(metrics);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int add_route_metrics(struct kc_metrics_t* self, const char* method, const char* url)
+{
+  if (self == NULL || method == NULL || url == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_METRICS_OTHER_ROUTE;
+  }
+
+  pthread_mutex_lock(&self->_lock);
+
+  int route = KC_METRICS_OTHER_ROUTE;
+
+  // the same route can be added again (ex: replaced)
+  for (int i = 1; i < self->routes_len; ++i)
+  {
+    if (strcmp(self->methods[i], method) == 0 && strcmp(self->urls[i], url) == 0)
+    {
+      route = i;
+      break;
+    }
+  }
+
+  if (route == KC_METRICS_OTHER_ROUTE && self->routes_len < KC_METRICS_ROUTES)
+  {
+    char* method_copy = strdup(method);
+    char* url_copy    = strdup(url);
+
+    if (method_copy != NULL && url_copy != NULL)
+    {
+      route = self->routes_len;
+
+      self->methods[route] = method_copy;
+      self->urls[route]    = url_copy;
+
+      // the readers only look at the routes already published
+      __atomic_store_n(&self->routes_len, route + 1, __ATOMIC_RELEASE);
+    }
+    else
+    {
+      log_error(KC_OUT_OF_MEMORY_LOG);
+
+      free(method_copy);
+      free(url_copy);
+    }
+  }
+
+  pthread_mutex_unlock(&self->_lock);
+
+  return route;
+}
+
+//---------------------------------------------------------------------------//
+
+static void opened_metrics(struct kc_metrics_t* self)
+{
+  struct kc_metrics_shard_t* shard = _shard(self);
+
+  if (shard != NULL)
+  {
+    _add(&shard->opened, 1);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void closed_metrics(struct kc_metrics_t* self)
+{
+  struct kc_metrics_shard_t* shard = _shard(self);
+
+  if (shard != NULL)
+  {
+    _add(&shard->closed, 1);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void record_metrics(struct kc_metrics_t* self, struct kc_metrics_sample_t* sample)
+{
+  struct kc_metrics_shard_t* shard = _shard(self);
+
+  if (shard == NULL || sample == NULL)
+  {
+    return;
+  }
+
+  int status = (sample->status > 0 && sample->status < KC_METRICS_STATUSES) ? sample->status : 0;
+  _add(&shard->statuses[status], 1);
+
+  uint64_t total = 0;
+
+  for (int phase = 0; phase < KC_METRICS_PHASES; ++phase)
+  {
+    if (sample->phases[phase] > 0)
+    {
+      shard->phases[phase]->record_atomic(shard->phases[phase], sample->phases[phase]);
+      total += sample->phases[phase];
+    }
+  }
+
+  int index = (sample->route > 0 && sample->route < KC_METRICS_ROUTES) ? sample->route : KC_METRICS_OTHER_ROUTE;
+
+  struct kc_metrics_route_t* route = _route(shard, index);
+  if (route == NULL)
+  {
+    return;
+  }
+
+  _add(&route->requests,  1);
+  _add(&route->bytes_in,  sample->bytes_in);
+  _add(&route->bytes_out, sample->bytes_out);
+
+  route->latency->record_atomic(route->latency, total);
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t requests_metrics(struct kc_metrics_t* self, int route)
+{
+  if (self == NULL || route >= KC_METRICS_ROUTES)
+  {
+    return 0;
+  }
+
+  uint64_t requests = 0;
+
+  for (int i = 0; i < KC_METRICS_SHARDS; ++i)
+  {
+    struct kc_metrics_shard_t* shard = __atomic_load_n(&self->_shards[i], __ATOMIC_ACQUIRE);
+    if (shard == NULL)
+    {
+      continue;
+    }
+
+    for (int j = 0; j < KC_METRICS_ROUTES; ++j)
+    {
+      struct kc_metrics_route_t* counters = __atomic_load_n(&shard->routes[j], __ATOMIC_ACQUIRE);
+
+      if (counters != NULL && (route < 0 || route == j))
+      {
+        requests += _load(&counters->requests);
+      }
+    }
+  }
+
+  return requests;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t responses_metrics(struct kc_metrics_t* self, int status)
+{
+  if (self == NULL || status < 0 || status >= KC_METRICS_STATUSES)
+  {
+    return 0;
+  }
+
+  uint64_t responses = 0;
+
+  for (int i = 0; i < KC_METRICS_SHARDS; ++i)
+  {
+    struct kc_metrics_shard_t* shard = __atomic_load_n(&self->_shards[i], __ATOMIC_ACQUIRE);
+
+    if (shard != NULL)
+    {
+      responses += _load(&shard->statuses[status]);
+    }
+  }
+
+  return responses;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t active_metrics(struct kc_metrics_t* self)
+{
+  if (self == NULL)
+  {
+    return 0;
+  }
+
+  uint64_t opened = 0;
+  uint64_t closed = 0;
+
+  for (int i = 0; i < KC_METRICS_SHARDS; ++i)
+  {
+    struct kc_metrics_shard_t* shard = __atomic_load_n(&self->_shards[i], __ATOMIC_ACQUIRE);
+
+    if (shard != NULL)
+    {
+      opened += _load(&shard->opened);
+      closed += _load(&shard->closed);
+    }
+  }
+
+  // a connection can be closed by another thread than the one that opened
+  // it, and its shard can be read first
+  return (opened > closed) ? opened - closed : 0;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t latency_metrics(struct kc_metrics_t* self, int route, int phase, double percentile)
+{
+  if (self == NULL || route >= KC_METRICS_ROUTES || phase >= KC_METRICS_PHASES)
+  {
+    return 0;
+  }
+
+  struct kc_metrics_route_t* counters = _new_route();
+  if (counters == NULL)
+  {
+    return 0;
+  }
+
+  if (phase >= 0)
+  {
+    _merge_phase(self, phase, counters->latency);
+  }
+  else
+  {
+    for (int i = 0; i < KC_METRICS_ROUTES; ++i)
+    {
+      if (route < 0 || route == i)
+      {
+        _merge_route(self, i, counters);
+      }
+    }
+  }
+
+  uint64_t latency = counters->latency->percentile(counters->latency, percentile);
+  _destroy_route(counters);
+
+  return latency;
+}
+
+//---------------------------------------------------------------------------//
+
+static int render_metrics(struct kc_metrics_t* self, char** text, size_t* len)
+{
+  if (self == NULL || text == NULL || len == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct kc_metrics_text_t out = { NULL, 0, 0, false };
+
+  int routes_len = __atomic_load_n(&self->routes_len, __ATOMIC_ACQUIRE);
+
+  // the sums of every route, over all the shards
+  struct kc_metrics_route_t* routes[KC_METRICS_ROUTES];
+
+  for (int i = 0; i < routes_len; ++i)
+  {
+    routes[i] = _new_route();
+
+    if (routes[i] == NULL)
+    {
+      for (int j = 0; j < i; ++j)
+      {
+        _destroy_route(routes[j]);
+      }
+
+      return KC_OUT_OF_MEMORY;
+    }
+
+    _merge_route(self, i, routes[i]);
+  }
+
+  _append(&out, "# HELP kc_http_connections_active The connections open right now.\n");
+  _append(&out, "# TYPE kc_http_connections_active gauge\n");
+  _append(&out, "kc_http_connections_active %llu\n", (unsigned long long)active_metrics(self));
+
+  // the counters of every route
+  const char* counters[3][2] =
+  {
+    { "kc_http_requests_total",       "The requests served." },
+    { "kc_http_received_bytes_total", "The bytes of the requests." },
+    { "kc_http_sent_bytes_total",     "The bytes of the responses." }
+  };
+
+  for (int counter = 0; counter < 3; ++counter)
+  {
+    _append(&out, "# HELP %s %s\n", counters[counter][0], counters[counter][1]);
+    _append(&out, "# TYPE %s counter\n", counters[counter][0]);
+
+    for (int i = 0; i < routes_len; ++i)
+    {
+      // the requests without a route are shown only when there are some
+      if (i == KC_METRICS_OTHER_ROUTE && routes[i]->requests == 0)
+      {
+        continue;
+      }
+
+      uint64_t value = (counter == 0) ? routes[i]->requests :
+          (counter == 1) ? routes[i]->bytes_in : routes[i]->bytes_out;
+
+      _append(&out, "%s{method=\"", counters[counter][0]);
+      _append_label(&out, self->methods[i]);
+      _append(&out, "\",route=\"");
+      _append_label(&out, self->urls[i]);
+      _append(&out, "\"} %llu\n", (unsigned long long)value);
+    }
+  }
+
+  _append(&out, "# HELP kc_http_responses_total The responses sent, by status.\n");
+  _append(&out, "# TYPE kc_http_responses_total counter\n");
+
+  for (int status = 0; status < KC_METRICS_STATUSES; ++status)
+  {
+    uint64_t responses = responses_metrics(self, status);
+
+    if (responses > 0)
+    {
+      _append(&out, "kc_http_responses_total{status=\"%d\"} %llu\n", status, (unsigned long long)responses);
+    }
+  }
+
+  _append(&out, "# HELP kc_http_request_duration_seconds The time taken by the requests.\n");
+  _append(&out, "# TYPE kc_http_request_duration_seconds histogram\n");
+
+  for (int i = 0; i < routes_len; ++i)
+  {
+    if (i == KC_METRICS_OTHER_ROUTE && routes[i]->requests == 0)
+    {
+      continue;
+    }
+
+    // the labels are escaped once, then repeated on every bucket
+    struct kc_metrics_text_t labels = { NULL, 0, 0, false };
+
+    _append(&labels, "method=\"");
+    _append_label(&labels, self->methods[i]);
+    _append(&labels, "\",route=\"");
+    _append_label(&labels, self->urls[i]);
+    _append(&labels, "\",");
+
+    out.failed |= labels.failed;
+
+    if (labels.failed == false)
+    {
+      _append_histogram(&out, "kc_http_request_duration_seconds", labels.data, routes[i]->latency);
+    }
+
+    free(labels.data);
+  }
+
+  _append(&out, "# HELP kc_http_phase_duration_seconds The time taken by every phase of the requests.\n");
+  _append(&out, "# TYPE kc_http_phase_duration_seconds histogram\n");
+
+  for (int phase = 0; phase < KC_METRICS_PHASES; ++phase)
+  {
+    // the routes are done with, their room is reused
+    _merge_phase(self, phase, routes[0]->latency);
+
+    char labels[32];
+    snprintf(labels, sizeof(labels), "phase=\"%s\",", phase_names[phase]);
+
+    _append_histogram(&out, "kc_http_phase_duration_seconds", labels, routes[0]->latency);
+  }
+
+  // the pool of the blocking routes, its counters as they are right now
+  if (self->pool != NULL)
+  {
+    struct kc_worker_pool_t* pool = self->pool;
+
+    const char* gauges[3][2] =
+    {
+      { "kc_blocking_threads", "The threads of the blocking routes." },
+      { "kc_blocking_busy",    "The threads of the blocking routes running a request." },
+      { "kc_blocking_queued",  "The requests of the blocking routes waiting for a thread." }
+    };
+
+    size_t values[3] =
+    {
+      pool->threads,
+      __atomic_load_n(&pool->busy, __ATOMIC_RELAXED),
+      __atomic_load_n(&pool->queued, __ATOMIC_RELAXED)
+    };
+
+    for (int gauge = 0; gauge < 3; ++gauge)
+    {
+      _append(&out, "# HELP %s %s\n", gauges[gauge][0], gauges[gauge][1]);
+      _append(&out, "# TYPE %s gauge\n", gauges[gauge][0]);
+      _append(&out, "%s %zu\n", gauges[gauge][0], values[gauge]);
+    }
+
+    _append(&out, "# HELP kc_blocking_done_total The requests handled by the blocking routes.\n");
+    _append(&out, "# TYPE kc_blocking_done_total counter\n");
+    _append(&out, "kc_blocking_done_total %llu\n",
+        (unsigned long long)__atomic_load_n(&pool->done, __ATOMIC_RELAXED));
+
+    _append(&out, "# HELP kc_blocking_refused_total The requests refused, the queue was full.\n");
+    _append(&out, "# TYPE kc_blocking_refused_total counter\n");
+    _append(&out, "kc_blocking_refused_total %llu\n",
+        (unsigned long long)__atomic_load_n(&pool->refused, __ATOMIC_RELAXED));
+
+    // the waits are still recorded, they are read from a copy
+    routes[0]->latency->reset(routes[0]->latency);
+    routes[0]->latency->merge(routes[0]->latency, pool->waits);
+
+    _append(&out, "# HELP kc_blocking_wait_seconds The time the requests waited for a thread.\n");
+    _append(&out, "# TYPE kc_blocking_wait_seconds histogram\n");
+
+    _append_histogram(&out, "kc_blocking_wait_seconds", "", routes[0]->latency);
+  }
+
+  for (int i = 0; i < routes_len; ++i)
+  {
+    _destroy_route(routes[i]);
+  }
+
+  if (out.failed)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    free(out.data);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  (*text) = out.data;
+  (*len)  = out.len;
+
+  return KC_SUCCESS;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static struct kc_metrics_shard_t* _shard(struct kc_metrics_t* self)
+{
+  if (shard_index < 0)
+  {
+    shard_index = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) % KC_METRICS_SHARDS;
+  }
+
+  struct kc_metrics_shard_t* shard = __atomic_load_n(&self->_shards[shard_index], __ATOMIC_ACQUIRE);
+  if (shard != NULL)
+  {
+    return shard;
+  }
+
+  // another thread of the same shard can make it at the same time
+  struct kc_metrics_shard_t* new_shard = _new_shard();
+  if (new_shard == NULL)
+  {
+    return NULL;
+  }
+
+  if (__atomic_compare_exchange_n(&self->_shards[shard_index], &shard, new_shard,
+      false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false)
+  {
+    _destroy_shard(new_shard);
+    return shard;
+  }
+
+  return new_shard;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_metrics_shard_t* _new_shard(void)
+{
+  struct kc_metrics_shard_t* shard = calloc(1, sizeof(struct kc_metrics_shard_t));
+  if (shard == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  for (int phase = 0; phase < KC_METRICS_PHASES; ++phase)
+  {
+    shard->phases[phase] = new_histogram(KC_METRICS_SUB_BITS, KC_METRICS_MAX_BITS);
+
+    if (shard->phases[phase] == NULL)
+    {
+      _destroy_shard(shard);
+      return NULL;
+    }
+  }
+
+  return shard;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _destroy_shard(struct kc_metrics_shard_t* shard)
+{
+  for (int phase = 0; phase < KC_METRICS_PHASES; ++phase)
+  {
+    if (shard->phases[phase] != NULL)
+    {
+      destroy_histogram(shard->phases[phase]);
+    }
+  }
+
+  for (int route = 0; route < KC_METRICS_ROUTES; ++route)
+  {
+    if (shard->routes[route] != NULL)
+    {
+      _destroy_route(shard->routes[route]);
+    }
+  }
+
+  free(shard);
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_metrics_route_t* _route(struct kc_metrics_shard_t* shard, int route)
+{
+  struct kc_metrics_route_t* counters = __atomic_load_n(&shard->routes[route], __ATOMIC_ACQUIRE);
+  if (counters != NULL)
+  {
+    return counters;
+  }
+
+  struct kc_metrics_route_t* new_counters = _new_route();
+  if (new_counters == NULL)
+  {
+    return NULL;
+  }
+
+  if (__atomic_compare_exchange_n(&shard->routes[route], &counters, new_counters,
+      false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == false)
+  {
+    _destroy_route(new_counters);
+    return counters;
+  }
+
+  return new_counters;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_metrics_route_t* _new_route(void)
+{
+  struct kc_metrics_route_t* route = calloc(1, sizeof(struct kc_metrics_route_t));
+  if (route == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  // 16 buckets for every power of 2, see metrics.h
+  route->latency = new_histogram(KC_METRICS_SUB_BITS, KC_METRICS_MAX_BITS);
+  if (route->latency == NULL)
+  {
+    free(route);
+    return NULL;
+  }
+
+  return route;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _destroy_route(struct kc_metrics_route_t* route)
+{
+  destroy_histogram(route->latency);
+  free(route);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _add(uint64_t* counter, uint64_t value)
+{
+  // a shard is shared only by the threads beyond the number of shards
+  __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t _load(uint64_t* counter)
+{
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _merge_route(struct kc_metrics_t* self, int route, struct kc_metrics_route_t* into)
+{
+  for (int i = 0; i < KC_METRICS_SHARDS; ++i)
+  {
+    struct kc_metrics_shard_t* shard = __atomic_load_n(&self->_shards[i], __ATOMIC_ACQUIRE);
+    if (shard == NULL)
+    {
+      continue;
+    }
+
+    struct kc_metrics_route_t* counters = __atomic_load_n(&shard->routes[route], __ATOMIC_ACQUIRE);
+    if (counters == NULL)
+    {
+      continue;
+    }
+
+    into->requests  += _load(&counters->requests);
+    into->bytes_in  += _load(&counters->bytes_in);
+    into->bytes_out += _load(&counters->bytes_out);
+
+    into->latency->merge(into->latency, counters->latency);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _merge_phase(struct kc_metrics_t* self, int phase, struct kc_histogram_t* into)
+{
+  into->reset(into);
+
+  for (int i = 0; i < KC_METRICS_SHARDS; ++i)
+  {
+    struct kc_metrics_shard_t* shard = __atomic_load_n(&self->_shards[i], __ATOMIC_ACQUIRE);
+
+    if (shard != NULL)
+    {
+      into->merge(into, shard->phases[phase]);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _append(struct kc_metrics_text_t* text, const char* format, ...)
+{
+  if (text->failed)
+  {
+    return;
+  }
+
+  for (;;)
+  {
+    va_list args;
+    va_start(args, format);
+
+    int len = vsnprintf(text->data + text->len, text->size - text->len, format, args);
+    va_end(args);
+
+    if (len < 0)
+    {
+      text->failed = true;
+      return;
+    }
+
+    if (text->len + len < text->size)
+    {
+      text->len += len;
+      return;
+    }
+
+    // double the buffer until the line fits
+    size_t size = (text->size == 0) ? 4096 : text->size * 2;
+    while (size <= text->len + len)
+    {
+      size *= 2;
+    }
+
+    char* data = realloc(text->data, size);
+    if (data == NULL)
+    {
+      text->failed = true;
+      return;
+    }
+
+    text->data = data;
+    text->size = size;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _append_label(struct kc_metrics_text_t* text, const char* value)
+{
+  // the backslashes, the quotes and the new lines are escaped
+  for (const char* c = value; *c != '\0'; ++c)
+  {
+    switch (*c)
+    {
+      case '\\': _append(text, "\\\\"); break;
+      case '"':  _append(text, "\\\""); break;
+      case '\n': _append(text, "\\n");  break;
+      default:   _append(text, "%c", *c); break;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _append_histogram(struct kc_metrics_text_t* text, const char* name,
+    const char* labels, struct kc_histogram_t* histogram)
+{
+  // a bucket is counted under the first bound that holds all its values
+  for (int i = 0; i < KC_METRICS_BOUNDS; ++i)
+  {
+    uint64_t seen = histogram->count_below(histogram, (uint64_t)(bounds[i] * 1e9));
+    _append(text, "%s_bucket{%sle=\"%g\"} %llu\n", name, labels, bounds[i], (unsigned long long)seen);
+  }
+
+  // the buckets are counted again, so the last one is never below the others
+  uint64_t seen = histogram->count_below(histogram, UINT64_MAX);
+
+  _append(text, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, labels, (unsigned long long)seen);
+
+  // the labels end with a comma, which the last two lines can't have
+  size_t labels_len = strlen(labels);
+
+  if (labels_len == 0)
+  {
+    _append(text, "%s_sum %.9f\n", name, histogram->sum / 1e9);
+    _append(text, "%s_count %llu\n", name, (unsigned long long)seen);
+    return;
+  }
+
+  _append(text, "%s_sum{%.*s} %.9f\n", name, (int)(labels_len - 1), labels, histogram->sum / 1e9);
+  _append(text, "%s_count{%.*s} %llu\n", name, (int)(labels_len - 1), labels, (unsigned long long)seen);
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,345 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// response_cache.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/response_cache.h"
+#include "../../hdrs/system/clock.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------//
+
+// a key, as kept in the map
+struct kc_response_slot_t
+{
+  struct kc_cached_response_t* response;  // NULL while it's being produced
+};
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int  acquire_response_cache  (struct kc_response_cache_t* self, const char* key, struct kc_cached_response_t** response);
+static int  fill_response_cache     (struct kc_response_cache_t* self, const char* key, char* data, size_t head_len, size_t len);
+static void abandon_response_cache  (struct kc_response_cache_t* self, const char* key);
+static void release_response_cache  (struct kc_response_cache_t* self, struct kc_cached_response_t* response);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static void _drop_response  (struct kc_response_cache_t* self, struct kc_cached_response_t* response);
+static void _drop_expired   (struct kc_response_cache_t* self, time_t now);
+
+//---------------------------------------------------------------------------//
+
+struct kc_response_cache_t* new_response_cache(int ttl, size_t max_size, const char* headers)
+{
+  if (ttl <= 0 || max_size == 0)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
+  // create a cache instance to be returned
+  struct kc_response_cache_t* new_cache = malloc(sizeof(struct kc_response_cache_t));
+
+  // confirm that there is memory to allocate
+  if (new_cache == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_cache->ttl         = ttl;
+  new_cache->max_size    = max_size;
+  new_cache->size        = 0;
+  new_cache->headers_len = 0;
+
+  new_cache->_responses = new_map();
+  if (new_cache->_responses == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    free(new_cache);
+    return NULL;
+  }
+
+  // split the list of headers (ex: "Accept-Language, Accept")
+  for (const char* name = headers; name != NULL && *name != '\0'; )
+  {
+    while (*name == ' ' || *name == ',')
+    {
+      ++name;
+    }
+
+    size_t name_len = strcspn(name, " ,");
+    if (name_len == 0)
+    {
+      break;
+    }
+
+    if (new_cache->headers_len == KC_RESPONSE_CACHE_MAX_HEADERS)
+    {
+      log_error(KC_OVERFLOW_LOG);
+      break;
+    }
+
+    char* header = malloc(name_len + 1);
+    if (header == NULL)
+    {
+      log_error(KC_OUT_OF_MEMORY_LOG);
+      break;
+    }
+
+    memcpy(header, name, name_len);
+    header[name_len] = '\0';
+
+    new_cache->headers[new_cache->headers_len++] = header;
+    name += name_len;
+  }
+
+  pthread_mutex_init(&new_cache->_lock, NULL);
+  pthread_cond_init(&new_cache->_filled, NULL);
+
+  // assigns the public member methods
+  new_cache->acquire = acquire_response_cache;
+  new_cache->fill    = fill_response_cache;
+  new_cache->abandon = abandon_response_cache;
+  new_cache->release = release_response_cache;
+
+  return new_cache;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_response_cache(struct kc_response_cache_t* cache)
+{
+  if (cache == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // the responses still being sent are freed by their last release
+  for (int i = 0; i < KC_MAP_MAX_SIZE; ++i)
+  {
+    for (struct kc_entry_t* entry = cache->_responses->entries[i]; entry != NULL; entry = entry->next)
+    {
+      struct kc_response_slot_t* slot = entry->val;
+
+      if (slot->response != NULL)
+      {
+        _drop_response(cache, slot->response);
+      }
+    }
+  }
+
+  destroy_map(cache->_responses);
+
+  for (int i = 0; i < cache->headers_len; ++i)
+  {
+    free(cache->headers[i]);
+  }
+
+  pthread_mutex_destroy(&cache->_lock);
+  pthread_cond_destroy(&cache->_filled);
+
+  free(cache);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int acquire_response_cache(struct kc_response_cache_t* self, const char* key,
+    struct kc_cached_response_t** response)
+{
+  if (self == NULL || key == NULL || response == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  pthread_mutex_lock(&self->_lock);
+
+  struct kc_response_slot_t* slot = NULL;
+  time_t now = kc_clock_monotonic();
+
+  while (self->_responses->get(self->_responses, key, (void**)&slot) == KC_SUCCESS)
+  {
+    // another request is producing the response, wait for it
+    if (slot->response == NULL)
+    {
+      pthread_cond_wait(&self->_filled, &self->_lock);
+      continue;
+    }
+
+    if (slot->response->expires > now)
+    {
+      __atomic_add_fetch(&slot->response->_refs, 1, __ATOMIC_RELAXED);
+      *response = slot->response;
+
+      pthread_mutex_unlock(&self->_lock);
+      return KC_SUCCESS;
+    }
+
+    // the response expired, this request produces the next one
+    _drop_response(self, slot->response);
+    slot->response = NULL;
+
+    pthread_mutex_unlock(&self->_lock);
+    return KC_PENDING;
+  }
+
+  // the key is claimed, the next requests will wait for it
+  struct kc_response_slot_t claimed = { NULL };
+  int ret = self->_responses->set(self->_responses, key, &claimed, sizeof(struct kc_response_slot_t));
+
+  pthread_mutex_unlock(&self->_lock);
+
+  return (ret == KC_SUCCESS) ? KC_PENDING : ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int fill_response_cache(struct kc_response_cache_t* self, const char* key,
+    char* data, size_t head_len, size_t len)
+{
+  if (self == NULL || key == NULL || data == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct kc_cached_response_t* response = malloc(sizeof(struct kc_cached_response_t));
+  if (response == NULL)
+  {
+    free(data);
+    abandon_response_cache(self, key);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // the cache takes the data over
+  response->data     = data;
+  response->head_len = head_len;
+  response->len      = len;
+  response->expires  = kc_clock_monotonic() + self->ttl;
+  response->_refs    = 1;
+
+  pthread_mutex_lock(&self->_lock);
+
+  // make room with the responses that are no longer good anyway
+  if (self->size + len > self->max_size)
+  {
+    _drop_expired(self, kc_clock_monotonic());
+  }
+
+  struct kc_response_slot_t* slot = NULL;
+  int ret = self->_responses->get(self->_responses, key, (void**)&slot);
+
+  if (ret == KC_SUCCESS && slot->response == NULL && self->size + len <= self->max_size)
+  {
+    slot->response = response;
+    self->size += len;
+  }
+  else
+  {
+    // there is no room left, the next request produces it again
+    if (ret == KC_SUCCESS && slot->response == NULL)
+    {
+      self->_responses->remove(self->_responses, key);
+    }
+
+    free(response->data);
+    free(response);
+
+    ret = KC_OVERFLOW;
+  }
+
+  pthread_cond_broadcast(&self->_filled);
+  pthread_mutex_unlock(&self->_lock);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static void abandon_response_cache(struct kc_response_cache_t* self, const char* key)
+{
+  if (self == NULL || key == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  struct kc_response_slot_t* slot = NULL;
+
+  // one of the waiting requests claims the key again
+  pthread_mutex_lock(&self->_lock);
+
+  if (self->_responses->get(self->_responses, key, (void**)&slot) == KC_SUCCESS &&
+      slot->response == NULL)
+  {
+    self->_responses->remove(self->_responses, key);
+  }
+
+  pthread_cond_broadcast(&self->_filled);
+  pthread_mutex_unlock(&self->_lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static void release_response_cache(struct kc_response_cache_t* self,
+    struct kc_cached_response_t* response)
+{
+  if (self == NULL || response == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  if (__atomic_sub_fetch(&response->_refs, 1, __ATOMIC_ACQ_REL) == 0)
+  {
+    free(response->data);
+    free(response);
+  }
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static void _drop_response(struct kc_response_cache_t* self, struct kc_cached_response_t* response)
+{
+  self->size -= response->len;
+
+  // the requests still sending it keep it alive
+  release_response_cache(self, response);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _drop_expired(struct kc_response_cache_t* self, time_t now)
+{
+  for (int i = 0; i < KC_MAP_MAX_SIZE; ++i)
+  {
+    struct kc_entry_t* entry = self->_responses->entries[i];
+
+    while (entry != NULL)
+    {
+      struct kc_entry_t* next = entry->next;
+      struct kc_response_slot_t* slot = entry->val;
+
+      // the keys being produced are left to their requests
+      if (slot->response != NULL && slot->response->expires <= now)
+      {
+        _drop_response(self, slot->response);
+        self->_responses->remove(self->_responses, entry->key);
+      }
+
+      entry = next;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
@@ -7,18 +7,47 @@
 // SPDX-License-Identifier: MIT License
 
 #include "../../hdrs/datastructs/map.h"
+#include "../../hdrs/network/asset_cache.h"
+#include "../../hdrs/network/response_cache.h"
+#include "../../hdrs/system/arena.h"
+#include "../../hdrs/system/clock.h"
 #include "../../hdrs/system/logger.h"
 #include "../../hdrs/network/server.h"
+#include "../../hdrs/security/base64.h"
+#include "../../hdrs/security/sha1.h"
 #include "../../hdrs/common.h"
 
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <netinet/in.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <pthread.h>
 
+// the most pieces a single sendmsg call takes (1024 on Linux)
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// what a connection waits for, each with its own deadline
+#define KC_SERVER_PHASE_NONE                                                  0
+#define KC_SERVER_PHASE_IDLE                                                  1
+#define KC_SERVER_PHASE_HEADER                                                2
+#define KC_SERVER_PHASE_BODY                                                  3
+#define KC_SERVER_PHASE_WRITE                                                 4
+
+// the states of a deferred response
+#define KC_SERVER_DEFERRED_PENDING                                            0
+#define KC_SERVER_DEFERRED_COMPLETED                                          1
+
 //--- MARK: ENDPOINT STRUCT -------------------------------------------------//
 
 struct kc_endpoint_t
@@ -28,25 +57,140 @@ struct kc_endpoint_t
 
   // the callback function to get called
   int (*callback)  (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+
+  struct kc_response_cache_t* cache;  // NULL unless the responses are cached
+  struct kc_sse_broadcaster_t* sse;   // the subscribers of an SSE route
+
+  // what is done with the connections of a WebSocket route (the message
+  // handler is NULL for the other routes)
+  struct kc_websocket_handler_t websocket;
+
+  int metrics_route;  // the requests are counted under it
+
+  bool blocking;  // handled on the threads of the blocking routes
+
+  // the middleware of the route, and the chain resolved by start (the
+  // middleware of the server, the ones of the route, then the callback)
+  int (*middleware[KC_SERVER_MIDDLEWARE_SIZE])  (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+  size_t middleware_len;
+  int (**chain)  (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+  size_t chain_len;
 };
 
 static struct kc_endpoint_t* new_endpoint      (char* method, char* url);
 static void                  destroy_endpoint  (struct kc_endpoint_t* endpoint);
 
+//--- MARK: STATIC ROUTE STRUCT ---------------------------------------------//
+
+struct kc_static_route_t
+{
+  char*  prefix;         // the URL prefix, without the last slash (ex: /assets)
+  size_t prefix_len;
+  char*  directory;      // the resolved path of the directory
+  size_t directory_len;
+
+  struct kc_asset_cache_t* cache;  // NULL if the files can't be watched
+
+  int metrics_route;  // the requests are counted under it
+};
+
+// the entity tag of a file, valid as long as the file is not changed
+struct kc_etag_t
+{
+  unsigned long inode;
+  time_t        modified;
+  size_t        size;
+
+  char etag[KC_SERVER_ETAG_SIZE];
+};
+
 //--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
 
-struct kc_server_t* new_server_IPv4  (const char* IP, const unsigned int PORT);
-struct kc_server_t* new_server_IPv6  (const char* IP, const unsigned int PORT);
-struct kc_server_t* new_server       (const int AF, const char* IP, const unsigned int PORT);
-void                destroy_server   (struct kc_server_t* server);
-int                 start_server     (struct kc_server_t* self);
-int                 send_msg_server  (int client_fd, struct kc_http_response_t* res);
+struct kc_server_t* new_server_IPv4      (const char* IP, const unsigned int PORT);
+struct kc_server_t* new_server_IPv6      (const char* IP, const unsigned int PORT);
+struct kc_server_t* new_server           (const int AF, const char* IP, const unsigned int PORT);
+struct kc_server_t* new_server_engine    (const int AF, const char* IP, const unsigned int PORT, const int ENGINE);
+void                destroy_server       (struct kc_server_t* server);
+int                 start_server         (struct kc_server_t* self);
+void                stop_server          (struct kc_server_t* self, unsigned drain_timeout);
+int                 hand_off_server      (struct kc_server_t* self, const char* path, unsigned drain_timeout);
+int                 take_over_server     (struct kc_server_t* self, const char* path);
+int                 send_msg_server      (int client_fd, struct kc_http_response_t* res);
 
-static void* dispatch  (void* dispatch_information);
+static void* dispatch  (void* connection);
 
 //--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
 
+struct kc_connection_t;
+struct kc_exchange_t;
+
 static int _accept_connection      (int server_fd, struct kc_socket_t* socket);
+static int _accept_connections     (struct kc_server_t* self);
+static struct kc_connection_t* _new_connection  (struct kc_server_t* server, int client_fd);
+static void _destroy_connection    (struct kc_connection_t* conn);
+static void _free_connection       (struct kc_connection_t* conn);
+static void _lose_handler          (struct kc_server_t* server, struct kc_fiber_t* fiber);
+static void* _engine_accepted      (void* server, int client_fd);
+static char* _engine_buffer        (void* connection, size_t* size);
+static bool _engine_received       (void* connection, size_t len);
+static void _engine_closed         (void* connection);
+static void _engine_draining       (void* server);
+static void _engine_woken          (void* server);
+static void _engine_ready          (void* server, int fd);
+static int _call_handler           (struct kc_connection_t* conn, struct kc_http_request_t* req, struct kc_http_response_t* res);
+static void _fiber_handler         (void* call);
+static void _fiber_switched        (struct kc_fiber_t* fiber);
+static int _queue_blocking         (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+static void _blocking_handler      (void* call);
+static int _receive_body           (struct kc_http_request_t* req, char* buffer, size_t size, size_t* len);
+static int _defer_response         (struct kc_connection_t* conn, struct kc_http_response_t* res);
+static void _begin_drain           (struct kc_server_t* self);
+static void _drain_expired         (struct kc_timer_t* deadline);
+static void _close_idle            (struct kc_connection_t* conn);
+static void* _wait_hand_off        (void* server);
+static void _set_deadline          (struct kc_connection_t* conn, int phase);
+static void _deadline_expired      (struct kc_timer_t* deadline);
+static void* _watch_deadlines      (void* server);
+static int _next_request           (struct kc_connection_t* conn, size_t* head_len);
+static int _recv_request           (struct kc_connection_t* conn, size_t* head_len);
+static bool _handle_request        (struct kc_connection_t* conn, size_t head_len);
+static bool _finish_request        (struct kc_connection_t* conn, struct kc_exchange_t* exchange);
+static void _finish_http2_request  (struct kc_connection_t* conn, struct kc_exchange_t* exchange);
+static void _await_deferred        (struct kc_connection_t* conn, struct kc_http_request_t* req, struct kc_http_response_t* res);
+static void _answer_deferred       (struct kc_http_request_t* req, struct kc_http_response_t* res);
+static void _finish_deferred       (struct kc_deferred_t* deferred);
+static void _drop_deferred         (struct kc_deferred_t* deferred);
+static bool _is_keep_alive         (struct kc_http_request_t* req);
+static bool _has_token             (const char* list, const char* token);
+static void _serve_websocket       (struct kc_connection_t* conn);
+static bool _start_http2           (struct kc_connection_t* conn);
+static int _upgrade_http2          (struct kc_connection_t* conn, struct kc_http_request_t* req, size_t request_len, struct kc_http_response_t* res);
+static void _serve_http2           (struct kc_connection_t* conn);
+static bool _http2_received        (struct kc_connection_t* conn, char* data, size_t len);
+static bool _http2_open            (struct kc_connection_t* conn);
+static void _handle_http2_request  (struct kc_http2_t* h2, struct kc_http2_stream_t* stream);
+static int _send_http2             (struct kc_http_response_t* res, bool streaming);
+static int _send_http2_file        (struct kc_http2_t* h2, struct kc_http2_stream_t* stream, struct kc_file_t* file, size_t offset, size_t len);
+static int _route_request          (struct kc_connection_t* conn, struct kc_http_request_t* req, struct kc_http_response_t* res, bool record);
+static int _serve_unrouted         (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+static int _resolve_chains         (struct kc_server_t* self);
+static int _send_cached_response   (struct kc_connection_t* conn, size_t head_len, struct kc_endpoint_t** endpoint, char** key, bool* keep_alive);
+static const char* _raw_header     (const char* head, size_t head_len, const char* name, size_t* val_len);
+static void _record_response       (struct kc_http_response_t* res, const char* status_line, size_t status_len, const char* content_length, size_t content_length_len);
+static int _send_iovec             (int client_fd, struct iovec* iov, int iov_len, int flags);
+static int _stream_sent            (struct kc_http_response_t* res, int ret);
+static size_t _date_header         (char buffer[KC_CLOCK_DATE_SIZE + 8]);
+static void _send_error            (int client_fd, struct kc_http_response_t* res, int status, char* body);
+static void _add_static_route      (char* prefix, char* directory);
+static struct kc_static_route_t* _find_static_route  (const char* url);
+static void _serve_static          (struct kc_connection_t* conn, struct kc_http_request_t* req, struct kc_http_response_t* res, struct kc_static_route_t* route);
+static struct kc_file_t* _open_static_file  (struct kc_static_route_t* route, const char* url, struct kc_file_info_t* info);
+static bool _static_relative_path  (struct kc_static_route_t* route, const char* url, char relative[PATH_MAX]);
+static void _send_asset            (struct kc_connection_t* conn, struct kc_http_request_t* req, struct kc_http_response_t* res, struct kc_asset_t* asset);
+static bool _is_not_modified       (struct kc_http_request_t* req, const char* etag, const char* last_modified, time_t modified);
+static void _send_ranges           (struct kc_connection_t* conn, struct kc_http_request_t* req, struct kc_http_response_t* res, struct kc_file_t* file, struct kc_file_info_t* info, const char* etag, const char* last_modified);
+static void _send_byteranges       (struct kc_connection_t* conn, struct kc_http_response_t* res, struct kc_file_t* file, struct kc_file_info_t* info, struct kc_http_range_t* ranges, int ranges_len, const char* etag);
+static int _file_etag              (struct kc_file_t* file, struct kc_file_info_t* info, char etag[KC_SERVER_ETAG_SIZE]);
 static void _add_options_endpoint  (char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
 static void _add_get_endpoint      (char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
 static void _add_head_endpoint     (char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
@@ -56,24 +200,156 @@ static void _add_delete_endpoint   (char* url, int (*callback)(struct kc_server_
 static void _add_trace_endpoint    (char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
 static void _add_connect_endpoint  (char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
 static void _add_endpoint          (char* method, char* url, int (*callback)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
-static int _parse_request          (struct kc_http_request_t* req, char recv_buffer[KC_HTTP_REQUEST_MAX_SIZE]);
+static void _add_endpoint_cache    (char* url, int ttl, size_t max_size, char* headers);
+static void _add_route_middleware  (char* url, int (*middleware)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res));
+static void _add_blocking_endpoint (char* url);
+static void _add_metrics_endpoint  (char* url);
+static void _add_sse_endpoint      (char* url, struct kc_sse_broadcaster_t* broadcaster);
+static int _subscribe_sse          (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+static void _add_websocket_endpoint  (char* url, struct kc_websocket_handler_t handler);
+static int _upgrade_websocket      (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+static int _send_metrics           (struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res);
+static void _record_request        (struct kc_connection_t* conn, int route, int status, size_t bytes_in, uint64_t parse, uint64_t handled);
+static int _send_file              (int client_fd, struct kc_file_t* file, size_t offset, size_t len);
+static int _parse_request          (struct kc_http_request_t* req, char recv_buffer[KC_HTTP_REQUEST_MAX_SIZE], size_t recv_len);
 
 //---------------------------------------------------------------------------//
 
 //--- MARK: PRIVATE MEMBERS -------------------------------------------------//
 
-struct kc_dispatch_info_t
+// every connection is served by its own thread (or by the event loop), the
+// requests that come on it (one after the other) share the same arena and
+// receive buffer
+struct kc_connection_t
 {
   struct kc_server_t* server;
   int client_fd;
+
+  // the other connections of the server
+  struct kc_connection_t* prev;
+  struct kc_connection_t* next;
+
+  // the memory of the current request, reset after every response
+  struct kc_arena_t* arena;
+
+  // the bytes received so far (the next request may already be here)
+  char   buffer[KC_HTTP_REQUEST_MAX_SIZE];
+  size_t buffer_len;
+
+  // when the current phase must be over, or the connection is closed (in
+  // the wheel of the server while the phase has a deadline)
+  struct kc_timer_t deadline;
+  int               phase;
+
+  unsigned requests;  // served so far
+
+  // the connection speaks WebSocket once it's upgraded (NULL until then)
+  struct kc_websocket_t* websocket;
+
+  // or HTTP/2, from the preface or once it's upgraded (NULL until then)
+  struct kc_http2_t* http2;
+
+  // the time the current response took to be serialized and sent, and its
+  // size (it can be sent in pieces)
+  uint64_t serialize_ns;
+  uint64_t send_ns;
+  size_t   bytes_out;
+
+  // the responses deferred by the handlers and not finished yet, a closed
+  // connection is freed only once the last of them is completed
+  size_t          deferred;
+  bool            closed;
+  pthread_mutex_t deferred_lock;
+  pthread_cond_t  deferred_completed;  // the thread of the connection waits
+
+  // the HTTP/1 request that waits for its deferred response (the ones
+  // after it wait too, the responses go out in order)
+  struct kc_deferred_t* parked;
+
+  // the handler of the request runs on a fiber (NULL for none), that
+  // waits for the loop to receive more of the body when reading
+  struct kc_fiber_t* fiber;
+  bool               reading;
+
+  // where the body starts in the buffer, and the part received after the
+  // headers (what's before it makes room for the rest, once it's read)
+  size_t body_start;
+  size_t request_len;
+};
+
+// a request being answered, from its parsing to the end of its response
+struct kc_exchange_t
+{
+  struct kc_http_request_t*  req;
+  struct kc_http_response_t* res;
+
+  // the route whose cache waits for the response (if any)
+  struct kc_endpoint_t* cached;
+  char*                 cache_key;
+
+  uint64_t start;          // when the parsing started
+  uint64_t parsed;         // and when it was done
+  size_t   body_len;       // the body that was left to receive
+  size_t   request_len;    // where the request ends in the buffer
+  int      metrics_route;
+  bool     keep_alive;
+};
+
+// a response the handler completes later (see res->defer), the request
+// waits for it along with the arena it was handled in
+struct kc_deferred_t
+{
+  struct kc_connection_t* conn;
+  struct kc_exchange_t    exchange;  // set once the handler returned
+  struct kc_arena_t*      arena;     // NULL when it's the one of the connection
+  int                     state;     // see KC_SERVER_DEFERRED_PENDING
+
+  // the fiber of the handler, that completes the response as it returns
+  // (NULL when the handler deferred it itself)
+  struct kc_fiber_t* fiber;
+
+  struct kc_deferred_t* next;  // the next one completed
+};
+
+// the connection whose request is handled on this thread (if any),
+// so its deadline moves on when the response starts being written
+static __thread struct kc_connection_t* serving;
+
+// where the rest of a body nobody reads anymore is received (and dropped)
+static __thread char discarded[KC_HTTP_REQUEST_MAX_SIZE];
+
+// the response of the handler this thread of the blocking routes runs,
+// sent by the thread of the connection once the handler returned (NULL
+// when the handler deferred it again, to complete it itself)
+static __thread struct kc_deferred_t* pooled;
+
+// a handler running on a fiber (the connection is NULL once it's closed),
+// or on the threads of the blocking routes
+struct kc_handler_call_t
+{
+  struct kc_server_t*        server;
+  struct kc_connection_t*    conn;
+  struct kc_http_request_t*  req;
+  struct kc_http_response_t* res;
 };
 
 // the list of endpoints has to be private
 static struct kc_map_t* endpoints;
 
+// the metrics of the server, the routes are added along the endpoints
+static struct kc_metrics_t* metrics;
+
 // private member for logging
 static struct kc_logger_t* logger;
 
+// the directories served as static files
+static struct kc_static_route_t static_routes[KC_SERVER_STATIC_ROUTES_SIZE];
+static int static_routes_len;
+
+// the entity tags of the static files (by path), computed only once
+static struct kc_map_t* etags;
+static pthread_mutex_t  etags_lock = PTHREAD_MUTEX_INITIALIZER;
+
 //---------------------------------------------------------------------------//
 
 struct kc_server_t* new_server_IPv4(const char* IP, const unsigned int PORT)
@@ -94,6 +370,21 @@ struct kc_server_t* new_server_IPv6(const char* IP, const unsigned int PORT)
 
 struct kc_server_t* new_server(const int AF, const char* IP, const unsigned int PORT)
 {
+  // a thread for every connection
+  return new_server_engine(AF, IP, PORT, KC_SERVER_ENGINE_THREADS);
+}
+
+//---------------------------------------------------------------------------//
+
+struct kc_server_t* new_server_engine(const int AF, const char* IP, const unsigned int PORT, const int ENGINE)
+{
+  if (ENGINE != KC_SERVER_ENGINE_THREADS && ENGINE != KC_SERVER_ENGINE_EPOLL &&
+      ENGINE != KC_SERVER_ENGINE_IO_URING)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
   // create a server instance to be returned
   struct kc_server_t* new_server = malloc(sizeof(struct kc_server_t));
   if (new_server == NULL)
@@ -142,19 +433,139 @@ struct kc_server_t* new_server(const int AF, const char* IP, const unsigned int
   }
 
   endpoints = new_map();
-  if (endpoints == NULL)
+  etags = new_map();
+  metrics = new_metrics();
+
+  if (endpoints == NULL || etags == NULL || metrics == NULL)
   {
     log_error(KC_OUT_OF_MEMORY_LOG);
 
     // free the server and socket
     destroy_socket(new_server->socket);
     destroy_logger(logger);
+    destroy_map(endpoints);
+    destroy_map(etags);
+    destroy_metrics(metrics);
+    free(new_server->routes);
+    free(new_server);
+
+    return NULL;
+  }
+
+  new_server->engine     = KC_SERVER_ENGINE_THREADS;
+  new_server->metrics    = metrics;
+  new_server->_io_engine = NULL;
+  new_server->_fibers    = NULL;
+  new_server->_blocking  = NULL;
+
+  new_server->fiber_stack_size    = 0;
+  new_server->blocking_threads    = KC_SERVER_BLOCKING_THREADS;
+  new_server->blocking_queue_size = KC_SERVER_BLOCKING_QUEUE_SIZE;
+
+  new_server->idle_timeout   = KC_SERVER_IDLE_TIMEOUT;
+  new_server->header_timeout = KC_SERVER_HEADER_TIMEOUT;
+  new_server->body_timeout   = KC_SERVER_BODY_TIMEOUT;
+  new_server->write_timeout  = KC_SERVER_WRITE_TIMEOUT;
+
+  new_server->_deadlines = new_timer_wheel(KC_SERVER_DEADLINE_TICK, kc_clock_monotonic_ms());
+  if (new_server->_deadlines == NULL)
+  {
+    // free the server and socket
+    destroy_socket(new_server->socket);
+    destroy_logger(logger);
+    destroy_map(endpoints);
+    destroy_map(etags);
+    destroy_metrics(metrics);
+    free(new_server->routes);
+    free(new_server);
+
+    return NULL;
+  }
+
+  // stop wakes up whoever waits for connections (and can't block)
+  if (pipe(new_server->_stop_fds) != 0)
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+
+    // free the server and socket
+    destroy_timer_wheel(new_server->_deadlines);
+    destroy_socket(new_server->socket);
+    destroy_logger(logger);
+    destroy_map(endpoints);
+    destroy_map(etags);
+    destroy_metrics(metrics);
     free(new_server->routes);
     free(new_server);
 
     return NULL;
   }
 
+  fcntl(new_server->_stop_fds[1], F_SETFL, O_NONBLOCK);
+
+  pthread_mutex_init(&new_server->_lock, NULL);
+  pthread_mutex_init(&new_server->_deadlines_lock, NULL);
+  pthread_cond_init(&new_server->_deadlines_added, NULL);
+  pthread_cond_init(&new_server->_drained, NULL);
+
+  new_server->_watching         = false;
+  new_server->_drain_due        = false;
+  new_server->_connections      = NULL;
+  new_server->_connections_len  = 0;
+  new_server->_stopping         = 0;
+  new_server->_draining         = false;
+  new_server->_drain_timeout    = 0;
+  new_server->_listening        = false;
+  new_server->_handoff_fd       = -1;
+  new_server->_handoff_path     = NULL;
+  new_server->_middleware_len   = 0;
+  new_server->_chain            = NULL;
+  new_server->_chain_len        = 0;
+  new_server->_completed        = NULL;
+
+  kc_timer_init(&new_server->_drain_deadline, _drain_expired, new_server);
+
+  // the event loop is set up right away, so the engine in use is known
+  // (and can be checked) as soon as the server is created
+  if (ENGINE != KC_SERVER_ENGINE_THREADS)
+  {
+    struct kc_io_handler_t handler =
+    {
+      .data     = new_server,
+      .accepted = _engine_accepted,
+      .buffer   = _engine_buffer,
+      .received = _engine_received,
+      .closed   = _engine_closed,
+      .draining = _engine_draining,
+      .woken    = _engine_woken,
+      .ready    = _engine_ready
+    };
+
+    new_server->_io_engine = new_io_engine(ENGINE, new_server->socket->fd, handler);
+    if (new_server->_io_engine == NULL)
+    {
+      destroy_timer_wheel(new_server->_deadlines);
+      pthread_mutex_destroy(&new_server->_lock);
+      pthread_mutex_destroy(&new_server->_deadlines_lock);
+      pthread_cond_destroy(&new_server->_deadlines_added);
+      pthread_cond_destroy(&new_server->_drained);
+      close(new_server->_stop_fds[0]);
+      close(new_server->_stop_fds[1]);
+
+      // free the server and socket
+      destroy_socket(new_server->socket);
+      destroy_logger(logger);
+      destroy_map(endpoints);
+      destroy_map(etags);
+      destroy_metrics(metrics);
+      free(new_server->routes);
+      free(new_server);
+
+      return NULL;
+    }
+
+    new_server->engine = new_server->_io_engine->type;
+  }
+
   // asign public member functions for server' routes
   new_server->routes->options = _add_options_endpoint;
   new_server->routes->get     = _add_get_endpoint;
@@ -165,9 +576,22 @@ struct kc_server_t* new_server(const int AF, const char* IP, const unsigned int
   new_server->routes->trace   = _add_trace_endpoint;
   new_server->routes->connect = _add_connect_endpoint;
 
+  new_server->routes->static_files = _add_static_route;
+  new_server->routes->cache        = _add_endpoint_cache;
+  new_server->routes->metrics      = _add_metrics_endpoint;
+  new_server->routes->sse          = _add_sse_endpoint;
+  new_server->routes->websocket    = _add_websocket_endpoint;
+  new_server->routes->use          = _add_route_middleware;
+  new_server->routes->blocking     = _add_blocking_endpoint;
+
   // asign public member functions
-  new_server->start = start_server;
-  new_server->send  = send_msg_server;
+  new_server->start     = start_server;
+  new_server->send      = send_msg_server;
+  new_server->stop      = stop_server;
+  new_server->hand_off  = hand_off_server;
+  new_server->take_over = take_over_server;
+  new_server->use       = use_server;
+  new_server->next      = next_server;
 
   return new_server;
 }
@@ -182,221 +606,4139 @@ void destroy_server(struct kc_server_t* server)
     return;
   }
 
-  // TODO: destroy all endpoints
-  destroy_endpoint(endpoints->entries[0]->val);
-
-  destroy_socket(server->socket);
-  destroy_logger(logger);
-  destroy_map(endpoints);
-  free(server);
+  // the process waiting to take the socket over is not coming anymore
+  if (server->_handoff_fd >= 0)
+  {
+    char byte = 1;
+    ssize_t ret = write(server->_stop_fds[1], &byte, 1);
+    (void)ret;
+
+    pthread_join(server->_handoff, NULL);
+
+    close(server->_handoff_fd);
+    free(server->_handoff_path);
+  }
+
+  // the requests still on the blocking threads are completed (and dropped,
+  // their connections are closed)
+  if (server->_blocking != NULL)
+  {
+    destroy_worker_pool(server->_blocking);
+  }
+
+  // the endpoints (and their cached responses)
+  for (int i = 0; i < KC_MAP_MAX_SIZE; ++i)
+  {
+    for (struct kc_entry_t* entry = endpoints->entries[i]; entry != NULL; entry = entry->next)
+    {
+      destroy_endpoint(entry->val);
+    }
+  }
+
+  for (int i = 0; i < static_routes_len; ++i)
+  {
+    free(static_routes[i].prefix);
+    free(static_routes[i].directory);
+
+    if (static_routes[i].cache != NULL)
+    {
+      destroy_asset_cache(static_routes[i].cache);
+    }
+  }
+
+  static_routes_len = 0;
+
+  if (server->_io_engine != NULL)
+  {
+    destroy_io_engine(server->_io_engine);
+  }
+
+  if (server->_fibers != NULL)
+  {
+    destroy_fiber_scheduler(server->_fibers);
+  }
+
+  destroy_timer_wheel(server->_deadlines);
+  pthread_mutex_destroy(&server->_lock);
+  pthread_mutex_destroy(&server->_deadlines_lock);
+  pthread_cond_destroy(&server->_deadlines_added);
+  pthread_cond_destroy(&server->_drained);
+
+  close(server->_stop_fds[0]);
+  close(server->_stop_fds[1]);
+
+  free(server->_chain);
+
+  destroy_socket(server->socket);
+  destroy_logger(logger);
+  destroy_map(endpoints);
+  destroy_map(etags);
+  destroy_metrics(metrics);
+  free(server->routes);
+  free(server);
+}
+
+//---------------------------------------------------------------------------//
+
+int start_server(struct kc_server_t* self)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // a socket that was taken over is already bound and listening
+  if (self->_listening == false)
+  {
+    // a restarted server binds again while the old connections linger
+    int reuse = 1;
+    setsockopt(self->socket->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(int));
+
+    // bind the server socket to the IP address
+    int ret = bind(self->socket->fd, (struct sockaddr*)self->socket->addr, sizeof(*self->socket->addr));
+    if (ret != KC_SUCCESS)
+    {
+      logger->log(logger, KC_FATAL_LOG,
+        KC_NETWORK_ERROR, __FILE__, __LINE__, __func__);
+      return KC_NETWORK_ERROR;
+    }
+
+    // start listening for connections
+    ret = listen(self->socket->fd, KC_SERVER_MAX_CONNECTIONS);
+    if (ret != KC_SUCCESS)
+    {
+      logger->log(logger, KC_FATAL_LOG,
+        KC_LOST_CONNECTION, __FILE__, __LINE__, __func__);
+      return KC_LOST_CONNECTION;
+    }
+
+    self->_listening = true;
+  }
+
+  // the chains of the requests are built once, they are only walked after
+  if (_resolve_chains(self) != KC_SUCCESS)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // the fibers of the handlers wait for their sockets along the connections
+  // (an event loop never runs a handler itself, see _call_handler)
+  if (self->_io_engine != NULL && self->_fibers == NULL)
+  {
+    self->_fibers = new_fiber_scheduler(self->fiber_stack_size);
+    if (self->_fibers == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+
+    self->_fibers->switched = _fiber_switched;
+    self->_io_engine->watch(self->_io_engine, self->_fibers->fd);
+  }
+
+  printf("\nApplication listening on %s:%d ... \n\n", self->socket->ip, self->socket->port);
+
+  // the connections that miss their deadlines are closed by another thread
+  self->_watching = true;
+  if (pthread_create(&self->_watcher, NULL, &_watch_deadlines, (void*)self) != 0)
+  {
+    self->_watching = false;
+
+    logger->log(logger, KC_FATAL_LOG,
+      KC_THREAD_ERROR, __FILE__, __LINE__, __func__);
+    return KC_THREAD_ERROR;
+  }
+
+  int ret = KC_SUCCESS;
+
+  // the event loop serves all the connections on this thread
+  if (self->_io_engine != NULL)
+  {
+    ret = self->_io_engine->run(self->_io_engine);
+  }
+  else
+  {
+    ret = _accept_connections(self);
+  }
+
+  // every connection is closed by now
+  pthread_mutex_lock(&self->_deadlines_lock);
+
+  self->_deadlines->cancel(self->_deadlines, &self->_drain_deadline);
+  self->_watching = false;
+
+  pthread_cond_signal(&self->_deadlines_added);
+  pthread_mutex_unlock(&self->_deadlines_lock);
+
+  pthread_join(self->_watcher, NULL);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+void stop_server(struct kc_server_t* self, unsigned drain_timeout)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // only the first call counts (ex: the same signal sent twice)
+  if (__atomic_exchange_n(&self->_stopping, 1, __ATOMIC_SEQ_CST) != 0)
+  {
+    return;
+  }
+
+  self->_drain_timeout = drain_timeout;
+
+  // nothing but writes from here on, so a signal handler can stop the server
+  char byte = 1;
+  ssize_t ret = write(self->_stop_fds[1], &byte, 1);
+  (void)ret;
+
+  if (self->_io_engine != NULL)
+  {
+    self->_io_engine->drain(self->_io_engine);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+int hand_off_server(struct kc_server_t* self, const char* path, unsigned drain_timeout)
+{
+  if (self == NULL || path == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path) || self->_handoff_fd >= 0)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    log_error(KC_NETWORK_ERROR_LOG);
+    return KC_NETWORK_ERROR;
+  }
+
+  // a path left behind by a previous server is replaced
+  unlink(path);
+
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un)) != 0 || listen(fd, 1) != 0)
+  {
+    log_error(KC_NETWORK_ERROR_LOG);
+    close(fd);
+    return KC_NETWORK_ERROR;
+  }
+
+  self->_handoff_fd            = fd;
+  self->_handoff_path          = strdup(path);
+  self->_handoff_drain_timeout = drain_timeout;
+
+  if (self->_handoff_path == NULL ||
+      pthread_create(&self->_handoff, NULL, &_wait_hand_off, (void*)self) != 0)
+  {
+    log_error(KC_THREAD_ERROR_LOG);
+
+    unlink(path);
+    close(fd);
+    free(self->_handoff_path);
+
+    self->_handoff_fd   = -1;
+    self->_handoff_path = NULL;
+
+    return KC_THREAD_ERROR;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int take_over_server(struct kc_server_t* self, const char* path)
+{
+  if (self == NULL || path == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path))
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    log_error(KC_NETWORK_ERROR_LOG);
+    return KC_NETWORK_ERROR;
+  }
+
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un)) != 0)
+  {
+    log_error(KC_NETWORK_ERROR_LOG);
+    close(fd);
+    return KC_NETWORK_ERROR;
+  }
+
+  // the listening socket comes along a single byte
+  char byte = 0;
+  struct iovec iov = { &byte, 1 };
+
+  union
+  {
+    char buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+
+  ssize_t ret = 0;
+  do
+  {
+    ret = recvmsg(fd, &msg, 0);
+  } while (ret < 0 && errno == EINTR);
+
+  close(fd);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (ret != 1 || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+  {
+    log_error(KC_NETWORK_ERROR_LOG);
+    return KC_NETWORK_ERROR;
+  }
+
+  int listen_fd = -1;
+  memcpy(&listen_fd, CMSG_DATA(cmsg), sizeof(int));
+
+  // the socket keeps its number, the engine already knows it
+  if (dup2(listen_fd, self->socket->fd) < 0)
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+    close(listen_fd);
+    return KC_SYSTEM_ERROR;
+  }
+
+  close(listen_fd);
+  self->_listening = true;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int send_msg_server(int client_fd, struct kc_http_response_t* res)
+{
+  // the file descriptor must be greater then 1
+  if (client_fd <= 0)
+  {
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // check if the response was generated
+  if (res == NULL)
+  {
+    return KC_NULL_REFERENCE;
+  }
+
+  // the head of a stream goes only once
+  bool streaming = (res->_stream == KC_HTTP_STREAM_OPEN);
+  if (res->_sent && res->_stream != KC_HTTP_STREAM_NONE)
+  {
+    return KC_INVALID_OPERATION;
+  }
+
+  // a handler on the threads of the blocking routes leaves the response to
+  // the thread of the connection, that sends it once the handler returned
+  if (pooled != NULL && res->_deferred == pooled && streaming == false)
+  {
+    return KC_SERVER_SEND_MSG;
+  }
+
+  // the response goes in the frames of its stream
+  if (res->_h2 != NULL)
+  {
+    return _send_http2(res, streaming);
+  }
+
+  uint64_t start = kc_clock_monotonic_ns();
+
+  // every piece of the response is sent from where it already is: the
+  // status line, the headers (rendered key, value, CRLF) and the body
+  struct iovec stack_iov[KC_SERVER_IOVEC_SIZE];
+  struct iovec* iov = stack_iov;
+  int iov_len = 0;
+
+  // only a response with a lot of headers needs a bigger list
+  int iov_needed = (3 * res->headers_len) + 8;
+  if (iov_needed > KC_SERVER_IOVEC_SIZE)
+  {
+    iov = malloc(sizeof(struct iovec) * iov_needed);
+    if (iov == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+  }
+
+  size_t status_len = 0;
+  const char* status_line = http_status_line(res->status, &status_len);
+
+  // the status line is a constant, unless the code is an unusual one
+  char custom_status[32];
+  if (status_line == NULL)
+  {
+    status_len = sprintf(custom_status, "%s %d \r\n", KC_HTTP_1, res->status % 1000);
+    status_line = custom_status;
+  }
+
+  // "HTTP/1.1" is replaced by the other versions
+  if (strcmp(res->http_ver, KC_HTTP_1) != 0)
+  {
+    iov[iov_len++] = (struct iovec){ (char*)res->http_ver, strlen(res->http_ver) };
+    status_line += strlen(KC_HTTP_1);
+    status_len  -= strlen(KC_HTTP_1);
+  }
+
+  iov[iov_len++] = (struct iovec){ (char*)status_line, status_len };
+
+  bool has_content_length = false;
+  bool has_date = false;
+
+  for (int i = 0; i < res->headers_len; ++i)
+  {
+    struct kc_http_header_t* header = &res->headers[i];
+
+    iov[iov_len++] = (struct iovec){ (char*)header->key, header->key_len };
+    iov[iov_len++] = (struct iovec){ (char*)header->val, header->val_len };
+    iov[iov_len++] = (struct iovec){ "\r\n", 2 };
+
+    if (header->key_len == strlen(KC_HTTP_HEADER_CONTENT_LENGTH ": ") &&
+        strncasecmp(header->key, KC_HTTP_HEADER_CONTENT_LENGTH, header->key_len - 2) == 0)
+    {
+      has_content_length = true;
+    }
+
+    if (header->key_len == strlen(KC_HTTP_HEADER_DATE ": ") &&
+        strncasecmp(header->key, KC_HTTP_HEADER_DATE, header->key_len - 2) == 0)
+    {
+      has_date = true;
+    }
+  }
+
+  // the date is formatted once per second, for all the responses
+  char date[KC_CLOCK_DATE_SIZE + 8];
+  if (has_date == false)
+  {
+    iov[iov_len++] = (struct iovec){ date, _date_header(date) };
+  }
+
+  // the informational, "204 No Content" and "304 Not Modified"
+  // responses never have a body, so they need no length either
+  bool has_body = res->status >= 200 &&
+      res->status != KC_HTTP_NO_CONTENT && res->status != KC_HTTP_NOT_MODIFIED;
+
+  size_t body_len = (res->_file != NULL) ? res->_file_len : res->body_len;
+
+  // the body length is known, let the client know where it ends
+  char content_length[48];
+  content_length[0] = '\0';
+
+  if (has_content_length == false && has_body && streaming == false)
+  {
+    int len = sprintf(content_length, KC_HTTP_HEADER_CONTENT_LENGTH ": %zu\r\n", body_len);
+    iov[iov_len++] = (struct iovec){ content_length, len };
+  }
+
+  // the length of a stream is known only when it ends, so it goes in
+  // chunks (or until the connection is closed, for the older clients)
+  if (streaming)
+  {
+    res->_chunked     = res->_chunked && has_body && has_content_length == false;
+    res->_until_close = has_body && has_content_length == false && res->_chunked == false;
+
+    if (res->_chunked)
+    {
+      iov[iov_len++] = (struct iovec){ KC_HTTP_HEADER_TRANSFER_ENCODING ": chunked\r\n",
+          strlen(KC_HTTP_HEADER_TRANSFER_ENCODING ": chunked\r\n") };
+    }
+
+    // there's nothing to stream after the head
+    if (has_body == false)
+    {
+      res->_stream = KC_HTTP_STREAM_ENDED;
+    }
+  }
+
+  iov[iov_len++] = (struct iovec){ "\r\n", 2 };
+
+  // the body set before a stream begins is its first chunk
+  char chunk_size[24];
+  bool first_chunk = (res->_chunked && streaming && res->body != NULL && res->body_len > 0);
+
+  if (first_chunk)
+  {
+    iov[iov_len++] = (struct iovec){ chunk_size, sprintf(chunk_size, "%zx\r\n", res->body_len) };
+  }
+
+  if (res->_file == NULL && res->body != NULL && res->body_len > 0 && has_body)
+  {
+    iov[iov_len++] = (struct iovec){ res->body, res->body_len };
+  }
+
+  if (first_chunk)
+  {
+    iov[iov_len++] = (struct iovec){ "\r\n", 2 };
+  }
+
+  // a copy for the response cache, only of the complete "200 OK" responses
+  if (res->_record_max > 0 && res->_file == NULL && res->status == KC_HTTP_OK && streaming == false)
+  {
+    _record_response(res, status_line, status_len,
+        has_content_length ? "" : content_length, has_content_length ? 0 : strlen(content_length));
+  }
+
+  // the time taken by the handler to build the response is not counted
+  if (serving != NULL && serving->client_fd == client_fd)
+  {
+    serving->serialize_ns += kc_clock_monotonic_ns() - start;
+  }
+
+  // send a HTTP response, when the file follows the kernel is told
+  // to hold the headers back and send them together with its start
+  bool send_file = (res->_file != NULL && res->_file_len > 0 && has_body);
+  int ret = _send_iovec(client_fd, iov, iov_len, send_file ? MSG_MORE : 0);
+
+  if (iov != stack_iov)
+  {
+    free(iov);
+  }
+
+  if (ret == KC_SUCCESS && send_file)
+  {
+    ret = _send_file(client_fd, res->_file, res->_file_offset, res->_file_len);
+  }
+
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  res->_sent = true;
+
+  return KC_SERVER_SEND_MSG;
+}
+
+//---------------------------------------------------------------------------//
+
+int begin_stream_server(struct kc_http_response_t* res, int client_fd)
+{
+  if (res == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (client_fd <= 0)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  // the head is sent only once, and a file can't be streamed
+  if (res->_sent || res->_stream != KC_HTTP_STREAM_NONE || res->_file != NULL)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  res->_stream    = KC_HTTP_STREAM_OPEN;
+  res->_stream_fd = client_fd;
+
+  int ret = send_msg_server(client_fd, res);
+
+  return _stream_sent(res, (ret == KC_SERVER_SEND_MSG) ? KC_SUCCESS : ret);
+}
+
+//---------------------------------------------------------------------------//
+
+int write_chunk_server(struct kc_http_response_t* res, const char* data, size_t len)
+{
+  if (res == NULL || (data == NULL && len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // the client is gone, there's no point in producing more
+  if (res->_stream == KC_HTTP_STREAM_BROKEN)
+  {
+    return KC_NETWORK_ERROR;
+  }
+
+  if (res->_stream != KC_HTTP_STREAM_OPEN)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  // an empty chunk would end the body
+  if (len == 0)
+  {
+    return KC_SUCCESS;
+  }
+
+  // a chunk of a stream is a DATA frame
+  if (res->_h2 != NULL)
+  {
+    struct kc_connection_t* conn = (struct kc_connection_t*)res->_h2->data;
+    return _stream_sent(res, conn->http2->send_data(conn->http2, res->_h2, data, len, false));
+  }
+
+  // the size of the chunk (in hex), the data, and the end of the chunk
+  char chunk_size[24];
+  struct iovec iov[3];
+  int iov_len = 0;
+
+  if (res->_chunked)
+  {
+    iov[iov_len++] = (struct iovec){ chunk_size, sprintf(chunk_size, "%zx\r\n", len) };
+  }
+
+  iov[iov_len++] = (struct iovec){ (char*)data, len };
+
+  if (res->_chunked)
+  {
+    iov[iov_len++] = (struct iovec){ "\r\n", 2 };
+  }
+
+  return _stream_sent(res, _send_iovec(res->_stream_fd, iov, iov_len, 0));
+}
+
+//---------------------------------------------------------------------------//
+
+int end_stream_server(struct kc_http_response_t* res)
+{
+  if (res == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (res->_stream == KC_HTTP_STREAM_BROKEN)
+  {
+    return KC_NETWORK_ERROR;
+  }
+
+  if (res->_stream != KC_HTTP_STREAM_OPEN)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  int ret = KC_SUCCESS;
+
+  // the last chunk is empty, the others end when the connection closes
+  // (or with the last frame of the stream)
+  if (res->_h2 != NULL)
+  {
+    struct kc_connection_t* conn = (struct kc_connection_t*)res->_h2->data;
+    ret = conn->http2->send_data(conn->http2, res->_h2, NULL, 0, true);
+  }
+  else if (res->_chunked)
+  {
+    struct iovec iov = { "0\r\n\r\n", 5 };
+    ret = _send_iovec(res->_stream_fd, &iov, 1, 0);
+  }
+
+  ret = _stream_sent(res, ret);
+
+  if (ret == KC_SUCCESS)
+  {
+    res->_stream = KC_HTTP_STREAM_ENDED;
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int defer_server(struct kc_http_response_t* res)
+{
+  if (res == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct kc_connection_t* conn = serving;
+  struct kc_deferred_t* deferred = res->_deferred;
+
+  // the handler on a fiber that already waited completes it itself now
+  if (conn != NULL && deferred != NULL && deferred->fiber != NULL &&
+      deferred->fiber == kc_fiber_current())
+  {
+    deferred->fiber = NULL;
+    return KC_SUCCESS;
+  }
+
+  // and so does a handler on the threads of the blocking routes
+  if (deferred != NULL && deferred == pooled)
+  {
+    pooled = NULL;
+    return KC_SUCCESS;
+  }
+
+  // only a handler of the server can defer its response, once and
+  // before anything of it was sent
+  if (conn == NULL || deferred != NULL || res->_sent || res->_stream != KC_HTTP_STREAM_NONE)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  return _defer_response(conn, res);
+}
+
+//---------------------------------------------------------------------------//
+
+int complete_server(struct kc_http_response_t* res)
+{
+  if (res == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct kc_deferred_t* deferred = res->_deferred;
+  if (deferred == NULL)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  struct kc_connection_t* conn = deferred->conn;
+
+  pthread_mutex_lock(&conn->deferred_lock);
+
+  // a response is completed only once
+  if (deferred->state != KC_SERVER_DEFERRED_PENDING)
+  {
+    pthread_mutex_unlock(&conn->deferred_lock);
+
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  deferred->state = KC_SERVER_DEFERRED_COMPLETED;
+
+  // the client left meanwhile (or missed its deadline), nobody waits
+  if (conn->closed)
+  {
+    pthread_mutex_unlock(&conn->deferred_lock);
+    _drop_deferred(deferred);
+
+    return KC_LOST_CONNECTION;
+  }
+
+  struct kc_server_t* server = conn->server;
+
+  // the event loop sends it, woken up only by the first one it has to take
+  if (server->_io_engine != NULL)
+  {
+    pthread_mutex_lock(&server->_lock);
+
+    bool wake = (server->_completed == NULL);
+
+    deferred->next = server->_completed;
+    server->_completed = deferred;
+
+    pthread_mutex_unlock(&server->_lock);
+
+    if (wake)
+    {
+      server->_io_engine->wake(server->_io_engine);
+    }
+  }
+  else
+  {
+    pthread_cond_broadcast(&conn->deferred_completed);
+  }
+
+  pthread_mutex_unlock(&conn->deferred_lock);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int use_server(struct kc_server_t* self, int (*middleware)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res))
+{
+  if (self == NULL || middleware == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // the chains are resolved when the server starts
+  if (self->_watching)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  if (self->_middleware_len == KC_SERVER_MIDDLEWARE_SIZE)
+  {
+    log_error(KC_OVERFLOW_LOG);
+    return KC_OVERFLOW;
+  }
+
+  self->_middleware[self->_middleware_len++] = middleware;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int next_server(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res)
+{
+  if (self == NULL || req == NULL || res == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // the handler is the last one, there's nothing after it
+  if (req->_chain == NULL || req->_chain_pos >= req->_chain_len)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  return req->_chain[req->_chain_pos++](self, req, res);
+}
+
+//---------------------------------------------------------------------------//
+
+void* dispatch(void* connection)
+{
+  struct kc_connection_t* conn = (struct kc_connection_t*)connection;
+
+  // serve the requests one after the other, until one of the sides
+  // wants to close the connection or the client stays idle too long
+  bool keep_alive = true;
+  while (keep_alive)
+  {
+    size_t head_len = 0;
+    if (_recv_request(conn, &head_len) != KC_SUCCESS)
+    {
+      break;
+    }
+
+    keep_alive = _handle_request(conn, head_len);
+
+    // everything allocated for the request is released at once
+    conn->arena->reset(conn->arena);
+
+    // an upgraded connection has no more requests, only frames
+    if (keep_alive && conn->websocket != NULL)
+    {
+      _serve_websocket(conn);
+      break;
+    }
+
+    if (keep_alive && conn->http2 != NULL)
+    {
+      _serve_http2(conn);
+      break;
+    }
+  }
+
+  int client_fd = conn->client_fd;
+
+  // the deadline is gone before the socket, so its number can't be reused
+  // by another connection while the deadline still shuts it down
+  _destroy_connection(conn);
+
+  // close the socket
+  close(client_fd);
+
+  pthread_exit((void*)KC_SUCCESS);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _accept_connection(int server_fd, struct kc_socket_t* socket)
+{
+  // create a new socket for the client
+  struct sockaddr_in client_addr;
+  int client_addr_size = sizeof(struct sockaddr_in);
+
+  // accept the connection
+  int client_fd = accept(server_fd, (struct sockaddr*)&client_addr,
+    (socklen_t * restrict)&client_addr_size);
+
+  // serialize the data
+  socket->addr = &client_addr;
+  socket->fd = client_fd;
+
+  // make sure the connection was made succesfully
+  if (client_fd < 0)
+  {
+    return KC_INVALID;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _accept_connections(struct kc_server_t* self)
+{
+  // the stop is noticed while waiting for the next connection
+  fcntl(self->socket->fd, F_SETFL, fcntl(self->socket->fd, F_GETFL) | O_NONBLOCK);
+
+  struct pollfd fds[2] =
+  {
+    { .fd = self->socket->fd,    .events = POLLIN },
+    { .fd = self->_stop_fds[0],  .events = POLLIN }
+  };
+
+  int status = KC_SUCCESS;
+
+  // separate the connections on different threads
+  while (1)
+  {
+    if (poll(fds, 2, -1) < 0 && errno != EINTR)
+    {
+      status = KC_SYSTEM_ERROR;
+      break;
+    }
+
+    if (fds[1].revents != 0)
+    {
+      break;
+    }
+
+    if (fds[0].revents == 0)
+    {
+      continue;
+    }
+
+    // create a new socket for new connections
+    struct kc_socket_t socket;
+
+    // accept the connection for the new socket
+    int ret = _accept_connection(self->socket->fd, &socket);
+    if (ret != KC_SUCCESS)
+    {
+      // another process took it, or the client gave up meanwhile
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED || errno == EINTR)
+      {
+        continue;
+      }
+
+      logger->log(logger, KC_FATAL_LOG,
+        ret, __FILE__, __LINE__, __func__);
+
+      status = ret;
+      break;
+    }
+
+    struct kc_connection_t* conn = _new_connection(self, socket.fd);
+    if (conn == NULL)
+    {
+      close(socket.fd);
+      continue;
+    }
+
+    pthread_t id;
+
+    // create a new thread to process the new connection
+    if (pthread_create(&id, NULL, &dispatch, (void*)conn) != 0)
+    {
+      _destroy_connection(conn);
+      close(socket.fd);
+      continue;
+    }
+
+    // nobody waits for the connection threads
+    pthread_detach(id);
+  }
+
+  // wind the connections down, then wait for the last of them
+  _begin_drain(self);
+
+  pthread_mutex_lock(&self->_lock);
+
+  while (self->_connections_len > 0)
+  {
+    pthread_cond_wait(&self->_drained, &self->_lock);
+  }
+
+  pthread_mutex_unlock(&self->_lock);
+
+  return status;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _send_iovec(int client_fd, struct iovec* iov, int iov_len, int flags)
+{
+  struct kc_connection_t* conn = (serving != NULL && serving->client_fd == client_fd) ? serving : NULL;
+  uint64_t start = 0;
+
+  if (conn != NULL)
+  {
+    // the client must take the response in time
+    _set_deadline(conn, KC_SERVER_PHASE_WRITE);
+
+    for (int i = 0; i < iov_len; ++i)
+    {
+      conn->bytes_out += iov[i].iov_len;
+    }
+
+    start = kc_clock_monotonic_ns();
+  }
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(struct msghdr));
+
+  msg.msg_iov = iov;
+
+  // a handler on a fiber never blocks the loop, it waits for the socket
+  if (kc_fiber_current() != NULL)
+  {
+    flags |= MSG_DONTWAIT;
+  }
+
+  while (iov_len > 0)
+  {
+    // a single call takes a limited number of pieces
+    msg.msg_iovlen = (iov_len < IOV_MAX) ? iov_len : IOV_MAX;
+
+    // a closed connection must not kill the process with SIGPIPE
+    ssize_t sent = sendmsg(client_fd, &msg, MSG_NOSIGNAL | flags);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      // a socket that doesn't block is waited on until the client takes
+      // some of what was sent (or the deadline shuts it down), a handler
+      // on a fiber lets the loop go on meanwhile
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+          kc_fiber_wait(client_fd, POLLOUT) == KC_SUCCESS)
+      {
+        continue;
+      }
+
+      break;
+    }
+
+    // skip what was fully sent, then move into the partially sent piece
+    while (iov_len > 0 && (size_t)sent >= msg.msg_iov->iov_len)
+    {
+      sent -= msg.msg_iov->iov_len;
+      msg.msg_iov++;
+      iov_len--;
+    }
+
+    if (iov_len > 0)
+    {
+      msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + sent;
+      msg.msg_iov->iov_len -= sent;
+    }
+  }
+
+  if (conn != NULL)
+  {
+    conn->send_ns += kc_clock_monotonic_ns() - start;
+  }
+
+  return (iov_len > 0) ? KC_NETWORK_ERROR : KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _stream_sent(struct kc_http_response_t* res, int ret)
+{
+  if (ret != KC_SUCCESS)
+  {
+    res->_stream = KC_HTTP_STREAM_BROKEN;
+    return ret;
+  }
+
+  // only the writes have a deadline, the handler takes its time to
+  // produce the next piece
+  if (serving != NULL && serving->client_fd == res->_stream_fd)
+  {
+    _set_deadline(serving, KC_SERVER_PHASE_NONE);
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _send_file(int client_fd, struct kc_file_t* file, size_t offset, size_t len)
+{
+  struct kc_connection_t* conn = (serving != NULL && serving->client_fd == client_fd) ? serving : NULL;
+  uint64_t start = (conn != NULL) ? kc_clock_monotonic_ns() : 0;
+
+  int ret = file->send(file, client_fd, offset, len);
+
+  if (conn != NULL)
+  {
+    conn->send_ns   += kc_clock_monotonic_ns() - start;
+    conn->bytes_out += len;
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _send_http2(struct kc_http_response_t* res, bool streaming)
+{
+  struct kc_connection_t* conn = (struct kc_connection_t*)res->_h2->data;
+  struct kc_http2_t* h2 = conn->http2;
+
+  uint64_t start = kc_clock_monotonic_ns();
+
+  // the status, the headers, the date and the length (at most)
+  struct kc_http2_field_t stack_fields[KC_SERVER_IOVEC_SIZE];
+  struct kc_http2_field_t* fields = stack_fields;
+  size_t fields_len = 0;
+
+  size_t names_len = 0;
+  for (int i = 0; i < res->headers_len; ++i)
+  {
+    names_len += res->headers[i].key_len;
+  }
+
+  if ((size_t)res->headers_len + 3 > KC_SERVER_IOVEC_SIZE)
+  {
+    fields = malloc(sizeof(struct kc_http2_field_t) * (res->headers_len + 3));
+  }
+
+  // the names are sent in lowercase, without the ": " they are kept with
+  char* names = conn->arena->alloc(conn->arena, names_len + 1);
+
+  if (fields == NULL || names == NULL)
+  {
+    if (fields != stack_fields)
+    {
+      free(fields);
+    }
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  char status[8];
+  fields[fields_len++] = (struct kc_http2_field_t){ ":status", 7, status,
+      sprintf(status, "%03d", res->status % 1000) };
+
+  bool has_content_length = false;
+  bool has_date = false;
+
+  for (int i = 0; i < res->headers_len; ++i)
+  {
+    struct kc_http_header_t* header = &res->headers[i];
+    size_t name_len = header->key_len - 2;
+
+    for (size_t j = 0; j < name_len; ++j)
+    {
+      names[j] = (header->key[j] >= 'A' && header->key[j] <= 'Z') ?
+          header->key[j] + ('a' - 'A') : header->key[j];
+    }
+
+    // the headers about the connection mean nothing on a stream
+    if ((name_len == 10 && strncmp(names, "connection", 10) == 0) ||
+        (name_len == 10 && strncmp(names, "keep-alive", 10) == 0) ||
+        (name_len == 17 && strncmp(names, "transfer-encoding", 17) == 0) ||
+        (name_len == 7  && strncmp(names, "upgrade", 7) == 0) ||
+        (name_len == 16 && strncmp(names, "proxy-connection", 16) == 0))
+    {
+      continue;
+    }
+
+    has_content_length |= (name_len == 14 && strncmp(names, "content-length", 14) == 0);
+    has_date           |= (name_len == 4  && strncmp(names, "date", 4) == 0);
+
+    fields[fields_len++] = (struct kc_http2_field_t){ names, name_len, header->val, header->val_len };
+    names += name_len;
+  }
+
+  // the date is formatted once per second, without the name and the CRLF
+  char date[KC_CLOCK_DATE_SIZE + 8];
+  if (has_date == false)
+  {
+    size_t date_len = _date_header(date);
+    fields[fields_len++] = (struct kc_http2_field_t){ "date", 4,
+        date + strlen(KC_HTTP_HEADER_DATE ": "), date_len - strlen(KC_HTTP_HEADER_DATE ": \r\n") };
+  }
+
+  bool has_body = res->status >= 200 &&
+      res->status != KC_HTTP_NO_CONTENT && res->status != KC_HTTP_NOT_MODIFIED;
+
+  size_t body_len = (res->_file != NULL) ? res->_file_len : res->body_len;
+
+  // a stream ends with its last frame, the length only helps the client
+  char content_length[24];
+  if (has_content_length == false && has_body && streaming == false)
+  {
+    fields[fields_len++] = (struct kc_http2_field_t){ "content-length", 14,
+        content_length, sprintf(content_length, "%zu", body_len) };
+  }
+
+  // a HEAD response has the length, but no body
+  bool has_data = has_body && (streaming || (res->_file != NULL ? res->_file_len > 0 :
+      (res->body != NULL && res->body_len > 0)));
+
+  if (serving == conn)
+  {
+    serving->serialize_ns += kc_clock_monotonic_ns() - start;
+  }
+
+  int ret = h2->send_headers(h2, res->_h2, fields, fields_len, has_data == false);
+
+  if (fields != stack_fields)
+  {
+    free(fields);
+  }
+
+  // the body set before a stream begins is its first piece
+  if (ret == KC_SUCCESS && has_data && res->_file != NULL)
+  {
+    ret = _send_http2_file(h2, res->_h2, res->_file, res->_file_offset, res->_file_len);
+  }
+  else if (ret == KC_SUCCESS && has_data && res->body != NULL && res->body_len > 0)
+  {
+    ret = h2->send_data(h2, res->_h2, res->body, res->body_len, streaming == false);
+  }
+
+  if (streaming && has_body == false)
+  {
+    res->_stream = KC_HTTP_STREAM_ENDED;
+  }
+
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  res->_sent = true;
+
+  return KC_SERVER_SEND_MSG;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _send_http2_file(struct kc_http2_t* h2, struct kc_http2_stream_t* stream,
+    struct kc_file_t* file, size_t offset, size_t len)
+{
+  // the file is read in frames, there's no sendfile for them
+  char buffer[KC_HTTP2_MAX_FRAME_SIZE];
+  int fd = fileno(file->file);
+
+  while (len > 0)
+  {
+    ssize_t ret = pread(fd, buffer, (len < sizeof(buffer)) ? len : sizeof(buffer), offset);
+
+    if (ret < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    // the file changed, the client can't be told the right length anymore
+    if (ret <= 0)
+    {
+      h2->reset(h2, stream, KC_HTTP2_INTERNAL_ERROR);
+      return KC_IO_ERROR;
+    }
+
+    len    -= ret;
+    offset += ret;
+
+    int sent = h2->send_data(h2, stream, buffer, ret, len == 0);
+    if (sent != KC_SUCCESS)
+    {
+      return sent;
+    }
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t _date_header(char buffer[KC_CLOCK_DATE_SIZE + 8])
+{
+  // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+  memcpy(buffer, KC_HTTP_HEADER_DATE ": ", 6);
+  size_t len = 6 + kc_clock_http_date(buffer + 6);
+
+  memcpy(buffer + len, "\r\n", 2);
+
+  return len + 2;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_connection_t* _new_connection(struct kc_server_t* server, int client_fd)
+{
+  struct kc_connection_t* conn = malloc(sizeof(struct kc_connection_t));
+  if (conn == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  conn->server     = server;
+  conn->client_fd  = client_fd;
+  conn->buffer_len = 0;
+  conn->requests   = 0;
+  conn->websocket  = NULL;
+  conn->http2      = NULL;
+  conn->deferred   = 0;
+  conn->closed     = false;
+  conn->parked     = NULL;
+  conn->fiber      = NULL;
+  conn->reading    = false;
+
+  // the arena lives as long as the connection
+  conn->arena = new_arena(KC_SERVER_ARENA_BLOCK_SIZE);
+  if (conn->arena == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    free(conn);
+    return NULL;
+  }
+
+  pthread_mutex_init(&conn->deferred_lock, NULL);
+  pthread_cond_init(&conn->deferred_completed, NULL);
+
+  // the client has a while to send its first request
+  kc_timer_init(&conn->deadline, _deadline_expired, conn);
+  conn->phase = KC_SERVER_PHASE_NONE;
+
+  // keep the connection where a stop (and a drain) can find it
+  pthread_mutex_lock(&server->_lock);
+
+  conn->prev = NULL;
+  conn->next = server->_connections;
+
+  if (server->_connections != NULL)
+  {
+    server->_connections->prev = conn;
+  }
+
+  server->_connections = conn;
+  server->_connections_len++;
+
+  pthread_mutex_unlock(&server->_lock);
+
+  metrics->opened(metrics);
+
+  _set_deadline(conn, KC_SERVER_PHASE_IDLE);
+
+  return conn;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _destroy_connection(struct kc_connection_t* conn)
+{
+  struct kc_server_t* server = conn->server;
+
+  _set_deadline(conn, KC_SERVER_PHASE_NONE);
+
+  pthread_mutex_lock(&server->_lock);
+
+  if (conn->prev != NULL)
+  {
+    conn->prev->next = conn->next;
+  }
+  else
+  {
+    server->_connections = conn->next;
+  }
+
+  if (conn->next != NULL)
+  {
+    conn->next->prev = conn->prev;
+  }
+
+  // a stopping server waits for the last one
+  if (--server->_connections_len == 0)
+  {
+    pthread_cond_broadcast(&server->_drained);
+  }
+
+  pthread_mutex_unlock(&server->_lock);
+
+  metrics->closed(metrics);
+
+  // the handler is told (if it wasn't already) while the socket is open
+  if (conn->websocket != NULL)
+  {
+    destroy_websocket(conn->websocket);
+    conn->websocket = NULL;
+  }
+
+  // the handler still waiting on its fiber leaves the connection alone
+  struct kc_fiber_t* fiber = conn->fiber;
+
+  if (fiber != NULL)
+  {
+    ((struct kc_handler_call_t*)fiber->data)->conn = NULL;
+    conn->fiber = NULL;
+  }
+
+  pthread_mutex_lock(&conn->deferred_lock);
+
+  conn->closed = true;
+  bool deferred = (conn->deferred > 0);
+
+  pthread_mutex_unlock(&conn->deferred_lock);
+
+  if (deferred == false)
+  {
+    _free_connection(conn);
+    _lose_handler(server, fiber);
+
+    return;
+  }
+
+  // the deferred responses still pending are dropped once they are
+  // completed, the ones waiting for the event loop right away (the last
+  // one frees the connection, its memory is still used by the requests)
+  struct kc_deferred_t* dropped = NULL;
+
+  pthread_mutex_lock(&server->_lock);
+
+  struct kc_deferred_t** link = &server->_completed;
+  while ((*link) != NULL)
+  {
+    struct kc_deferred_t* completed = (*link);
+
+    if (completed->conn == conn)
+    {
+      (*link) = completed->next;
+
+      completed->next = dropped;
+      dropped = completed;
+    }
+    else
+    {
+      link = &completed->next;
+    }
+  }
+
+  pthread_mutex_unlock(&server->_lock);
+
+  while (dropped != NULL)
+  {
+    struct kc_deferred_t* next = dropped->next;
+    _drop_deferred(dropped);
+
+    dropped = next;
+  }
+
+  // the connection can be freed by the handler as it returns
+  _lose_handler(server, fiber);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _lose_handler(struct kc_server_t* server, struct kc_fiber_t* fiber)
+{
+  if (fiber == NULL)
+  {
+    return;
+  }
+
+  // its wait (or its read) ends with the connection
+  server->_fibers->resume(server->_fibers, fiber, KC_LOST_CONNECTION);
+  server->_fibers->run(server->_fibers);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _free_connection(struct kc_connection_t* conn)
+{
+  if (conn->http2 != NULL)
+  {
+    destroy_http2(conn->http2);
+  }
+
+  pthread_mutex_destroy(&conn->deferred_lock);
+  pthread_cond_destroy(&conn->deferred_completed);
+
+  destroy_arena(conn->arena);
+  free(conn);
+}
+
+//---------------------------------------------------------------------------//
+
+static void* _engine_accepted(void* server, int client_fd)
+{
+  // the loop never waits for a client, the handlers wait on their fibers
+  // (and the writes of the loop itself in poll, see kc_fiber_wait)
+  fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+
+  return _new_connection((struct kc_server_t*)server, client_fd);
+}
+
+//---------------------------------------------------------------------------//
+
+static char* _engine_buffer(void* connection, size_t* size)
+{
+  struct kc_connection_t* conn = (struct kc_connection_t*)connection;
+
+  // the buffer still holds the request waiting for its response
+  if (conn->parked != NULL && conn->parked->exchange.keep_alive == false &&
+      conn->http2 == NULL && conn->fiber == NULL)
+  {
+    (*size) = sizeof(discarded);
+    return discarded;
+  }
+
+  // keep a byte for the NUL
+  (*size) = KC_HTTP_REQUEST_MAX_SIZE - 1 - conn->buffer_len;
+
+  return conn->buffer + conn->buffer_len;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _engine_received(void* connection, size_t len)
+{
+  struct kc_connection_t* conn = (struct kc_connection_t*)connection;
+  conn->buffer_len += len;
+
+  // a request waits for its deferred response, and so do the next ones
+  if (conn->parked != NULL)
+  {
+    struct kc_exchange_t* exchange = &conn->parked->exchange;
+
+    // the frames of a connection upgraded by the request are parsed (their
+    // requests wait for it), the request stays at the start of the buffer
+    if (conn->http2 != NULL)
+    {
+      size_t received = conn->buffer_len - exchange->request_len;
+      conn->buffer_len = exchange->request_len;
+
+      return _http2_received(conn, conn->buffer + exchange->request_len, received);
+    }
+
+    // the handler reads the rest of the body, on its fiber, as it comes
+    if (conn->fiber != NULL)
+    {
+      if (conn->reading)
+      {
+        conn->reading = false;
+
+        conn->server->_fibers->resume(conn->server->_fibers, conn->fiber, KC_SUCCESS);
+        conn->server->_fibers->run(conn->server->_fibers);
+      }
+
+      return conn->buffer_len < KC_HTTP_REQUEST_MAX_SIZE - 1;
+    }
+
+    // the rest of the body is dropped (see _engine_buffer), the
+    // connection is closed after
+    if (exchange->keep_alive == false)
+    {
+      conn->buffer_len = conn->request_len;
+      return true;
+    }
+
+    // the next requests wait in the buffer, as long as they fit
+    return conn->buffer_len < KC_HTTP_REQUEST_MAX_SIZE - 1;
+  }
+
+  // serve every request that is already whole (they can be pipelined)
+  size_t head_len = 0;
+  int ret = KC_SUCCESS;
+
+  while (conn->websocket == NULL && conn->http2 == NULL &&
+      (ret = _next_request(conn, &head_len)) == KC_SUCCESS)
+  {
+    bool keep_alive = _handle_request(conn, head_len);
+
+    // the deferred request keeps its memory, the next ones wait
+    if (conn->parked != NULL)
+    {
+      return true;
+    }
+
+    // everything allocated for the request is released at once
+    conn->arena->reset(conn->arena);
+
+    if (keep_alive == false)
+    {
+      return false;
+    }
+  }
+
+  // the frames are parsed as they come, the buffer is free again after
+  if (conn->websocket != NULL)
+  {
+    _set_deadline(conn, KC_SERVER_PHASE_NONE);
+
+    ret = conn->websocket->receive(conn->websocket, conn->buffer, conn->buffer_len);
+    conn->buffer_len = 0;
+
+    return ret == KC_SUCCESS;
+  }
+
+  // the same for the frames of HTTP/2, the requests are handled as they
+  // are whole (the streams that were waiting for an upgrade too)
+  if (conn->http2 != NULL)
+  {
+    size_t received = conn->buffer_len;
+    conn->buffer_len = 0;
+
+    return _http2_received(conn, conn->buffer, received);
+  }
+
+  // the headers do not fit in the buffer
+  if (ret != KC_PENDING)
+  {
+    return false;
+  }
+
+  _set_deadline(conn, (conn->buffer_len == 0) ? KC_SERVER_PHASE_IDLE : KC_SERVER_PHASE_HEADER);
+
+  return true;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _engine_closed(void* connection)
+{
+  _destroy_connection((struct kc_connection_t*)connection);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _engine_draining(void* server)
+{
+  _begin_drain((struct kc_server_t*)server);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _engine_woken(void* server)
+{
+  struct kc_server_t* self = (struct kc_server_t*)server;
+
+  pthread_mutex_lock(&self->_lock);
+
+  struct kc_deferred_t* completed = self->_completed;
+  self->_completed = NULL;
+
+  pthread_mutex_unlock(&self->_lock);
+
+  // the list is the newest first, the responses go out in the order
+  // they were completed
+  struct kc_deferred_t* ordered = NULL;
+
+  while (completed != NULL)
+  {
+    struct kc_deferred_t* next = completed->next;
+
+    completed->next = ordered;
+    ordered = completed;
+
+    completed = next;
+  }
+
+  while (ordered != NULL)
+  {
+    struct kc_deferred_t* next = ordered->next;
+    _finish_deferred(ordered);
+
+    ordered = next;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _engine_ready(void* server, int fd)
+{
+  struct kc_server_t* self = (struct kc_server_t*)server;
+
+  // the handlers whose sockets are ready go on
+  self->_fibers->poll(self->_fibers, 0);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _begin_drain(struct kc_server_t* self)
+{
+  pthread_mutex_lock(&self->_lock);
+
+  // read by the connections as they turn idle, without the lock
+  __atomic_store_n(&self->_draining, true, __ATOMIC_SEQ_CST);
+
+  // the idle connections have nothing left to finish, the others are
+  // closed after their response (or given until the drain deadline)
+  for (struct kc_connection_t* conn = self->_connections; conn != NULL; conn = conn->next)
+  {
+    if (self->_drain_timeout == 0)
+    {
+      shutdown(conn->client_fd, SHUT_RDWR);
+    }
+    // the HTTP/2 clients are told no new stream is taken, the connection
+    // is closed once the open ones are answered
+    else if (conn->http2 != NULL)
+    {
+      conn->http2->goaway(conn->http2, KC_HTTP2_NO_ERROR);
+
+      if (__atomic_load_n(&conn->phase, __ATOMIC_SEQ_CST) == KC_SERVER_PHASE_IDLE)
+      {
+        _close_idle(conn);
+      }
+    }
+    else if (__atomic_load_n(&conn->phase, __ATOMIC_SEQ_CST) == KC_SERVER_PHASE_IDLE)
+    {
+      _close_idle(conn);
+    }
+    // the WebSocket clients are asked to leave, their connections are
+    // closed once they answer
+    else if (conn->websocket != NULL)
+    {
+      conn->websocket->close(conn->websocket, KC_WEBSOCKET_GOING_AWAY, NULL);
+    }
+  }
+
+  if (self->_drain_timeout > 0 && self->_connections != NULL)
+  {
+    pthread_mutex_lock(&self->_deadlines_lock);
+
+    if (self->_deadlines->size == 0)
+    {
+      pthread_cond_signal(&self->_deadlines_added);
+    }
+
+    self->_deadlines->add(self->_deadlines, &self->_drain_deadline,
+        kc_clock_monotonic_ms() + self->_drain_timeout);
+
+    pthread_mutex_unlock(&self->_deadlines_lock);
+  }
+
+  pthread_mutex_unlock(&self->_lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _drain_expired(struct kc_timer_t* deadline)
+{
+  struct kc_server_t* self = (struct kc_server_t*)deadline->data;
+
+  // the watcher holds the lock of the wheel, it closes the connections
+  // once it's released (see _watch_deadlines)
+  self->_drain_due = true;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _close_idle(struct kc_connection_t* conn)
+{
+  // a new connection is about to send its first request, and a request
+  // already on the way is served; both are closed after their response
+  char byte;
+  if (conn->requests == 0 || recv(conn->client_fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) > 0)
+  {
+    return;
+  }
+
+  shutdown(conn->client_fd, SHUT_RDWR);
+}
+
+//---------------------------------------------------------------------------//
+
+static void* _wait_hand_off(void* server)
+{
+  struct kc_server_t* self = (struct kc_server_t*)server;
+
+  struct pollfd fds[2] =
+  {
+    { .fd = self->_handoff_fd,   .events = POLLIN },
+    { .fd = self->_stop_fds[0],  .events = POLLIN }
+  };
+
+  for (;;)
+  {
+    if (poll(fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      log_error(KC_SYSTEM_ERROR_LOG);
+      return NULL;
+    }
+
+    // stopped (or destroyed) before anyone came for the socket
+    if (fds[1].revents != 0)
+    {
+      return NULL;
+    }
+
+    int fd = accept(self->_handoff_fd, NULL, NULL);
+    if (fd < 0)
+    {
+      continue;
+    }
+
+    char byte = 1;
+    struct iovec iov = { &byte, 1 };
+
+    union
+    {
+      char buffer[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+    } control;
+
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(struct msghdr));
+
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+
+    memcpy(CMSG_DATA(cmsg), &self->socket->fd, sizeof(int));
+
+    ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    close(fd);
+
+    // the next process did not get it, wait for another one
+    if (sent != 1)
+    {
+      log_error(KC_NETWORK_ERROR_LOG);
+      continue;
+    }
+
+    unlink(self->_handoff_path);
+
+    // both processes accept from the same queue now, this one stops
+    // accepting and lets its connections finish
+    stop_server(self, self->_handoff_drain_timeout);
+
+    return NULL;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _set_deadline(struct kc_connection_t* conn, int phase)
+{
+  // a deadline is for the whole phase, not for every recv (ex: a client
+  // that sends its headers a byte at a time still has to be done in time)
+  if (conn->phase == phase)
+  {
+    return;
+  }
+
+  struct kc_server_t* server = conn->server;
+  unsigned timeout = 0;
+
+  switch (phase)
+  {
+    case KC_SERVER_PHASE_IDLE:   timeout = server->idle_timeout;   break;
+    case KC_SERVER_PHASE_HEADER: timeout = server->header_timeout; break;
+    case KC_SERVER_PHASE_BODY:   timeout = server->body_timeout;   break;
+    case KC_SERVER_PHASE_WRITE:  timeout = server->write_timeout;  break;
+  }
+
+  // a phase changes a few times a request, so it only takes the lock of
+  // the wheel (and the deadline is moved, not searched for)
+  pthread_mutex_lock(&server->_deadlines_lock);
+
+  if (timeout == 0)
+  {
+    server->_deadlines->cancel(server->_deadlines, &conn->deadline);
+  }
+  else
+  {
+    if (server->_deadlines->size == 0)
+    {
+      pthread_cond_signal(&server->_deadlines_added);
+    }
+
+    server->_deadlines->add(server->_deadlines, &conn->deadline,
+        kc_clock_monotonic_ms() + timeout);
+  }
+
+  pthread_mutex_unlock(&server->_deadlines_lock);
+
+  // a drain reads the phase after it marks the server as draining, and
+  // the phase is set before it's checked here, so one of them closes an
+  // idle connection (or both, which is harmless)
+  __atomic_store_n(&conn->phase, phase, __ATOMIC_SEQ_CST);
+
+  // a draining server does not wait for the next request
+  if (phase == KC_SERVER_PHASE_IDLE && __atomic_load_n(&server->_draining, __ATOMIC_SEQ_CST))
+  {
+    _close_idle(conn);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _deadline_expired(struct kc_timer_t* deadline)
+{
+  struct kc_connection_t* conn = (struct kc_connection_t*)deadline->data;
+
+  // whatever waits on the socket gives up, and the connection is closed by
+  // the thread that serves it (the deadline is cancelled before that, under
+  // the lock the watcher holds, so the connection is still there)
+  shutdown(conn->client_fd, SHUT_RDWR);
+}
+
+//---------------------------------------------------------------------------//
+
+static void* _watch_deadlines(void* server)
+{
+  struct kc_server_t* self = (struct kc_server_t*)server;
+
+  pthread_mutex_lock(&self->_deadlines_lock);
+
+  while (self->_watching)
+  {
+    while (self->_deadlines->size == 0 && self->_watching)
+    {
+      pthread_cond_wait(&self->_deadlines_added, &self->_deadlines_lock);
+    }
+
+    // only the deadlines that are due fire, the others stay in the wheel
+    self->_deadlines->advance(self->_deadlines, kc_clock_monotonic_ms());
+
+    bool drain_due = self->_drain_due;
+    self->_drain_due = false;
+
+    pthread_mutex_unlock(&self->_deadlines_lock);
+
+    // the lock of the server is never taken while the wheel's is held
+    if (drain_due)
+    {
+      pthread_mutex_lock(&self->_lock);
+
+      for (struct kc_connection_t* conn = self->_connections; conn != NULL; conn = conn->next)
+      {
+        shutdown(conn->client_fd, SHUT_RDWR);
+      }
+
+      pthread_mutex_unlock(&self->_lock);
+    }
+
+    usleep(KC_SERVER_DEADLINE_TICK * 1000);
+    pthread_mutex_lock(&self->_deadlines_lock);
+  }
+
+  pthread_mutex_unlock(&self->_deadlines_lock);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _next_request(struct kc_connection_t* conn, size_t* head_len)
+{
+  // null terminate the request data
+  conn->buffer[conn->buffer_len] = '\0';
+
+  // wait until the whole header section is here
+  char* headers_end = strstr(conn->buffer, "\r\n\r\n");
+  if (headers_end != NULL)
+  {
+    (*head_len) = (headers_end + 4) - conn->buffer;
+    return KC_SUCCESS;
+  }
+
+  // the headers do not fit in the buffer (keep a byte for the NUL)
+  if (conn->buffer_len == KC_HTTP_REQUEST_MAX_SIZE - 1)
+  {
+    return KC_OVERFLOW;
+  }
+
+  return KC_PENDING;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _recv_request(struct kc_connection_t* conn, size_t* head_len)
+{
+  while (1)
+  {
+    int status = _next_request(conn, head_len);
+    if (status != KC_PENDING)
+    {
+      return status;
+    }
+
+    _set_deadline(conn, (conn->buffer_len == 0) ? KC_SERVER_PHASE_IDLE : KC_SERVER_PHASE_HEADER);
+
+    ssize_t ret = recv(conn->client_fd, conn->buffer + conn->buffer_len,
+        KC_HTTP_REQUEST_MAX_SIZE - 1 - conn->buffer_len, 0);
+
+    if (ret < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    // the client left (or missed its deadline)
+    if (ret <= 0)
+    {
+      return (ret == 0) ? KC_LOST_CONNECTION : KC_NETWORK_ERROR;
+    }
+
+    conn->buffer_len += ret;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _serve_websocket(struct kc_connection_t* conn)
+{
+  // a WebSocket connection waits as long as the client wants
+  _set_deadline(conn, KC_SERVER_PHASE_NONE);
+
+  // the frames that came right after the handshake
+  int ret = conn->websocket->receive(conn->websocket, conn->buffer, conn->buffer_len);
+  conn->buffer_len = 0;
+
+  while (ret == KC_SUCCESS)
+  {
+    ssize_t len = recv(conn->client_fd, conn->buffer, KC_HTTP_REQUEST_MAX_SIZE, 0);
+
+    if (len < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    // the client left, without a closing handshake
+    if (len <= 0)
+    {
+      break;
+    }
+
+    ret = conn->websocket->receive(conn->websocket, conn->buffer, len);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _start_http2(struct kc_connection_t* conn)
+{
+  // a stopping server takes no new connection
+  if (__atomic_load_n(&conn->server->_stopping, __ATOMIC_RELAXED))
+  {
+    return false;
+  }
+
+  struct kc_http2_t* h2 = new_http2(conn->client_fd, _handle_http2_request);
+  if (h2 == NULL)
+  {
+    return false;
+  }
+
+  // the frames go out as the responses do (timed, with a deadline)
+  h2->data   = conn;
+  h2->writer = _send_iovec;
+
+  pthread_mutex_lock(&conn->server->_lock);
+  conn->http2 = h2;
+  pthread_mutex_unlock(&conn->server->_lock);
+
+  // the preface and the frames after it are still in the buffer
+  return true;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _upgrade_http2(struct kc_connection_t* conn, struct kc_http_request_t* req,
+    size_t request_len, struct kc_http_response_t* res)
+{
+  char* upgrade    = req->get_header(req, KC_HTTP_HEADER_UPGRADE);
+  char* connection = req->get_header(req, KC_HTTP_HEADER_CONNECTION);
+  char* settings   = req->get_header(req, "HTTP2-Settings");
+
+  // only the requests without a body are upgraded (it would have to be
+  // read before the switch), the others are answered in HTTP/1.1
+  if (upgrade == NULL || _has_token(upgrade, "h2c") == false || connection == NULL ||
+      _has_token(connection, "HTTP2-Settings") == false || settings == NULL ||
+      strcmp(req->http_ver, KC_HTTP_1) != 0 || req->_body_left > 0 || req->_body_buffered_len > 0)
+  {
+    return KC_INVALID;
+  }
+
+  // the settings are in Base64 (URL safe) without the padding, 6 bytes each
+  size_t settings_len = strcspn(settings, "=");
+  char padded[KC_HTTP_REQUEST_MAX_SIZE];
+
+  if (settings_len % 4 == 1 || settings_len + 3 >= sizeof(padded))
+  {
+    return KC_INVALID;
+  }
+
+  memcpy(padded, settings, settings_len);
+  size_t padded_len = settings_len;
+
+  while (padded_len % 4 != 0)
+  {
+    padded[padded_len++] = '=';
+  }
+
+  padded[padded_len] = '\0';
+
+  char* decoded = NULL;
+  if (kc_base64_decode(padded, padded_len, &decoded) != KC_SUCCESS)
+  {
+    return KC_INVALID;
+  }
+
+  size_t decoded_len = (settings_len * 3) / 4;
+
+  struct kc_http2_t* h2 = new_http2(conn->client_fd, _handle_http2_request);
+  if (h2 == NULL)
+  {
+    free(decoded);
+    return KC_INVALID;
+  }
+
+  h2->data   = conn;
+  h2->writer = _send_iovec;
+
+  // from the switch on, the bytes of the connection are frames
+  char switching[] = "HTTP/1.1 101 Switching Protocols\r\n"
+      KC_HTTP_HEADER_CONNECTION ": Upgrade\r\n" KC_HTTP_HEADER_UPGRADE ": h2c\r\n\r\n";
+
+  struct iovec iov = { switching, strlen(switching) };
+  struct kc_http2_stream_t* stream = NULL;
+
+  int ret = _send_iovec(conn->client_fd, &iov, 1, 0);
+
+  if (ret == KC_SUCCESS)
+  {
+    ret = h2->upgrade(h2, (uint8_t*)decoded, decoded_len, &stream);
+  }
+
+  free(decoded);
+
+  if (ret != KC_SUCCESS)
+  {
+    destroy_http2(h2);
+    return ret;
+  }
+
+  pthread_mutex_lock(&conn->server->_lock);
+  conn->http2 = h2;
+  pthread_mutex_unlock(&conn->server->_lock);
+
+  stream->data = conn;
+  res->_h2     = stream;
+
+  // the preface of the client can come right after the request, the
+  // streams it opens wait until the first one is finished
+  ret = h2->receive(h2, conn->buffer + request_len, conn->buffer_len - request_len);
+  conn->buffer_len = request_len;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _serve_http2(struct kc_connection_t* conn)
+{
+  // the frames that came with the preface (or after the upgrade)
+  bool open = _http2_received(conn, conn->buffer, conn->buffer_len);
+  conn->buffer_len = 0;
+
+  // a frame is as big as the client is allowed to make it
+  char buffer[KC_HTTP2_MAX_FRAME_SIZE];
+
+  while (open)
+  {
+    ssize_t len = recv(conn->client_fd, buffer, sizeof(buffer), 0);
+
+    if (len < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    // the client left
+    if (len <= 0)
+    {
+      break;
+    }
+
+    open = _http2_received(conn, buffer, len);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _http2_received(struct kc_connection_t* conn, char* data, size_t len)
+{
+  struct kc_http2_t* h2 = conn->http2;
+
+  // the whole requests are handled before this returns
+  if (h2->receive(h2, data, len) != KC_SUCCESS)
+  {
+    return false;
+  }
+
+  return _http2_open(conn);
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _http2_open(struct kc_connection_t* conn)
+{
+  struct kc_http2_t* h2 = conn->http2;
+
+  // a stopping server closes the connection once its streams are answered
+  size_t streams = __atomic_load_n(&h2->streams, __ATOMIC_RELAXED);
+  if (h2->closing && streams == 0)
+  {
+    return false;
+  }
+
+  // between the requests the connection is idle, a request that came
+  // only in part has to come whole in time
+  _set_deadline(conn, (streams == 0) ? KC_SERVER_PHASE_IDLE : KC_SERVER_PHASE_BODY);
+
+  return true;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _handle_http2_request(struct kc_http2_t* h2, struct kc_http2_stream_t* stream)
+{
+  struct kc_connection_t* conn = (struct kc_connection_t*)h2->data;
+  serving = conn;
+
+  conn->requests++;
+
+  uint64_t start = kc_clock_monotonic_ns();
+
+  conn->serialize_ns = 0;
+  conn->send_ns      = 0;
+  conn->bytes_out    = 0;
+
+  // the request was rebuilt as a HTTP/1 one, it's parsed as any other
+  struct kc_http_request_t*  req = new_arena_request(conn->arena);
+  struct kc_http_response_t* res = new_arena_response(conn->arena);
+
+  int ret = (req == NULL || res == NULL) ? KC_OUT_OF_MEMORY :
+      _parse_request(req, stream->request, stream->request_len);
+
+  if (ret != KC_SUCCESS)
+  {
+    log_error(kc_error_msg[ret + 1]);
+
+    // only the stream is given up, not the connection
+    _record_request(conn, KC_METRICS_OTHER_ROUTE, 0, stream->request_len, kc_clock_monotonic_ns() - start, 0);
+    h2->reset(h2, stream, KC_HTTP2_PROTOCOL_ERROR);
+  }
+  else
+  {
+    uint64_t parsed = kc_clock_monotonic_ns();
+
+    req->client_fd = conn->client_fd;
+
+    // the connection is busy, not idle (ex: for a draining server)
+    _set_deadline(conn, KC_SERVER_PHASE_WRITE);
+
+    stream->data = conn;
+    res->_h2     = stream;
+
+    struct kc_exchange_t exchange =
+    {
+      .req         = req,
+      .res         = res,
+      .start       = start,
+      .parsed      = parsed,
+      .request_len = stream->request_len
+    };
+
+    exchange.metrics_route = _route_request(conn, req, res, false);
+
+    // the stream stays open until the response is completed, the
+    // requests of the other streams are handled meanwhile
+    if (res->_deferred != NULL)
+    {
+      ((struct kc_deferred_t*)res->_deferred)->exchange = exchange;
+      stream->deferred = true;
+    }
+    else
+    {
+      _finish_http2_request(conn, &exchange);
+    }
+  }
+
+  conn->arena->reset(conn->arena);
+
+  serving = NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _finish_http2_request(struct kc_connection_t* conn, struct kc_exchange_t* exchange)
+{
+  struct kc_http_response_t* res = exchange->res;
+
+  _record_request(conn, exchange->metrics_route, res->_sent ? res->status : 0, exchange->request_len,
+      exchange->parsed - exchange->start, kc_clock_monotonic_ns() - exchange->parsed);
+
+  destroy_request(exchange->req);
+  destroy_response(res);
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _handle_request(struct kc_connection_t* conn, size_t head_len)
+{
+  // the preface of a client that knows the server speaks HTTP/2 looks like
+  // a request, the frames follow it
+  if (head_len == strlen("PRI * HTTP/2.0\r\n\r\n") &&
+      strncmp(conn->buffer, KC_HTTP2_PREFACE, head_len) == 0)
+  {
+    return _start_http2(conn);
+  }
+
+  bool keep_alive = true;
+  serving = conn;
+
+  conn->requests++;
+
+  // the phases of the request are timed from here
+  uint64_t start = kc_clock_monotonic_ns();
+
+  conn->serialize_ns = 0;
+  conn->send_ns      = 0;
+  conn->bytes_out    = 0;
+
+  // a cached response needs only the request line (and a few headers)
+  struct kc_endpoint_t* cached = NULL;
+  char* cache_key = NULL;
+
+  if (_send_cached_response(conn, head_len, &cached, &cache_key, &keep_alive) == KC_SUCCESS)
+  {
+    // the lookup stands for the parsing, there's no handler
+    uint64_t elapsed = kc_clock_monotonic_ns() - start;
+    _record_request(conn, cached->metrics_route, KC_HTTP_OK, head_len, elapsed - conn->send_ns, conn->send_ns);
+
+    serving = NULL;
+    return keep_alive;
+  }
+
+  // the request and the response live in the arena of the connection
+  struct kc_http_request_t*  req = new_arena_request(conn->arena);
+  struct kc_http_response_t* res = new_arena_response(conn->arena);
+
+  // parse the request buffer and fill the request structure
+  int ret = (req == NULL || res == NULL) ? KC_OUT_OF_MEMORY :
+      _parse_request(req, conn->buffer, conn->buffer_len);
+
+  if (ret != KC_SUCCESS)
+  {
+    log_error(kc_error_msg[ret + 1]);
+
+    // the requests waiting for the same response produce it themselves
+    if (cache_key != NULL)
+    {
+      cached->cache->abandon(cached->cache, cache_key);
+    }
+
+    _record_request(conn, KC_METRICS_OTHER_ROUTE, 0, head_len, kc_clock_monotonic_ns() - start, 0);
+
+    serving = NULL;
+    return false;
+  }
+
+  uint64_t parsed = kc_clock_monotonic_ns();
+  size_t body_len = req->_body_left;
+
+  // set the file descriptor of the client
+  req->client_fd = conn->client_fd;
+
+  // with an event loop, the rest of the body is the one the loop receives
+  if (conn->server->_io_engine != NULL)
+  {
+    req->_receive = _receive_body;
+  }
+
+  // the rest of the body has to come in time (if there is more of it)
+  _set_deadline(conn, (req->_body_left > 0) ? KC_SERVER_PHASE_BODY : KC_SERVER_PHASE_WRITE);
+
+  // where the request ends in the buffer, it must be known before the
+  // handler reads the body (the next request may follow right after)
+  size_t request_len = (req->_body_buffered != NULL) ?
+      (size_t)(req->_body_buffered - conn->buffer) + req->_body_buffered_len : head_len;
+
+  conn->body_start  = (req->_body_buffered != NULL) ? (size_t)(req->_body_buffered - conn->buffer) : head_len;
+  conn->request_len = request_len;
+
+  // a stopping server closes the connection after the response
+  keep_alive = _is_keep_alive(req) && __atomic_load_n(&conn->server->_stopping, __ATOMIC_RELAXED) == 0;
+
+  if (keep_alive == false)
+  {
+    res->set_header(res, KC_HTTP_HEADER_CONNECTION, "close");
+  }
+
+  // the client asks to go on in HTTP/2, the request is the first stream
+  int upgrade = keep_alive ? _upgrade_http2(conn, req, request_len, res) : KC_INVALID;
+
+  struct kc_exchange_t exchange =
+  {
+    .req           = req,
+    .res           = res,
+    .cached        = cached,
+    .cache_key     = cache_key,
+    .start         = start,
+    .parsed        = parsed,
+    .body_len      = body_len,
+    .request_len   = request_len,
+    .metrics_route = KC_METRICS_OTHER_ROUTE,
+    .keep_alive    = keep_alive
+  };
+
+  if (upgrade == KC_SUCCESS || upgrade == KC_INVALID)
+  {
+    exchange.metrics_route = _route_request(conn, req, res, cache_key != NULL && res->_h2 == NULL);
+  }
+  // the switch was already answered, the client expects frames
+  else
+  {
+    exchange.keep_alive = false;
+  }
+
+  // the response comes later, the request waits for it (with its memory)
+  // and the next ones wait too, so the responses go out in order
+  if (res->_deferred != NULL)
+  {
+    // what's left of the body is not received anymore (unless the
+    // handler still reads it, on its fiber)
+    if (req->_body_left > 0 && conn->fiber == NULL)
+    {
+      exchange.keep_alive = false;
+    }
+
+    // the event loop can't wait for the response to be cached, the next
+    // requests for it produce it themselves
+    if (exchange.cache_key != NULL)
+    {
+      cached->cache->abandon(cached->cache, cache_key);
+      exchange.cache_key = NULL;
+    }
+
+    struct kc_deferred_t* deferred = res->_deferred;
+    deferred->exchange = exchange;
+    conn->parked = deferred;
+
+    // the handler has as long as the client to take the response
+    _set_deadline(conn, KC_SERVER_PHASE_WRITE);
+
+    serving = NULL;
+    return true;
+  }
+
+  keep_alive = _finish_request(conn, &exchange);
+
+  serving = NULL;
+  return keep_alive;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _finish_request(struct kc_connection_t* conn, struct kc_exchange_t* exchange)
+{
+  struct kc_http_request_t*  req = exchange->req;
+  struct kc_http_response_t* res = exchange->res;
+
+  struct kc_endpoint_t* cached = exchange->cached;
+  char* cache_key = exchange->cache_key;
+
+  size_t request_len = exchange->request_len;
+  bool keep_alive = exchange->keep_alive;
+
+  // a stream that failed, or with no length, ends with the connection
+  // (only the stream is given up on HTTP/2, see finish below)
+  if (res->_h2 == NULL && (res->_stream == KC_HTTP_STREAM_BROKEN || res->_until_close))
+  {
+    keep_alive = false;
+  }
+
+  // the response (if it can be cached) is handed to the waiting requests
+  if (cache_key != NULL && res->_sent && res->_record != NULL)
+  {
+    cached->cache->fill(cached->cache, cache_key, res->_record,
+        res->_record_head_len, res->_record_len);
+    res->_record = NULL;
+  }
+  else if (cache_key != NULL)
+  {
+    cached->cache->abandon(cached->cache, cache_key);
+  }
+
+  // the client waits for a response that was never sent
+  if (res->_sent == false && res->_h2 == NULL)
+  {
+    keep_alive = false;
+  }
+
+  // skip the part of the body the handler did not read, unless
+  // it's cheaper to close the connection than to receive it
+  if (keep_alive && req->_body_left > KC_SERVER_DRAIN_MAX_SIZE)
+  {
+    keep_alive = false;
+  }
+
+  char drain[KC_HTTP_REQUEST_MAX_SIZE];
+  req->_body_buffered_len = 0;
+
+  while (keep_alive && req->_body_left > 0)
+  {
+    size_t len = 0;
+    if (req->read_body(req, drain, sizeof(drain), &len) != KC_SUCCESS || len == 0)
+    {
+      keep_alive = false;
+    }
+  }
+
+  // the whole request came in, as far as it was read
+  _record_request(conn, exchange->metrics_route, res->_sent ? res->status : 0,
+      request_len + (exchange->body_len - req->_body_left), exchange->parsed - exchange->start,
+      kc_clock_monotonic_ns() - exchange->parsed);
+
+  // move the next request (if any) at the start of the buffer (the body
+  // read on a fiber can end before the request did, see _receive_body)
+  if (keep_alive)
+  {
+    memmove(conn->buffer, conn->buffer + conn->request_len, conn->buffer_len - conn->request_len);
+    conn->buffer_len -= conn->request_len;
+  }
+
+  struct kc_http2_stream_t* stream = res->_h2;
+
+  // only the heap extras (ex: a JSON body) are freed here
+  destroy_request(req);
+  destroy_response(res);
+
+  // the first stream is over, the next ones come as frames
+  if (stream != NULL)
+  {
+    conn->http2->finish(conn->http2, stream);
+  }
+
+  return keep_alive;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _route_request(struct kc_connection_t* conn, struct kc_http_request_t* req,
+    struct kc_http_response_t* res, bool record)
+{
+  // search the callback
+  struct kc_endpoint_t* endpoint = NULL;
+  endpoints->get(endpoints, req->url, (void*)&endpoint);
+
+  bool routed = (endpoint != NULL && strcmp(endpoint->method, req->method) == 0);
+
+  // no endpoint, but the URL can be a static file
+  struct kc_static_route_t* route = NULL;
+  if (endpoint == NULL && (strcmp(req->method, KC_HTTP_METHOD_GET) == 0 ||
+      strcmp(req->method, KC_HTTP_METHOD_HEAD) == 0))
+  {
+    route = _find_static_route(req->url);
+  }
+
+  int metrics_route = (route != NULL) ? route->metrics_route :
+      routed ? endpoint->metrics_route : KC_METRICS_OTHER_ROUTE;
+
+  // the request goes through the middleware, then the callback of the
+  // endpoint (or the answer of the server, when there's none)
+  if (routed)
+  {
+    // TODO: add general headers
+    res->set_header(res, KC_HTTP_HEADER_CONTENT_TYPE, "text/plain");
+
+    if (record)
+    {
+      res->_record_max = endpoint->cache->max_size;
+    }
+
+    // the older clients can't take a body in chunks
+    res->_chunked = (strcmp(req->http_ver, KC_HTTP_1) == 0);
+
+    // an endpoint added after the start has only its callback
+    req->_chain     = (endpoint->chain != NULL) ? endpoint->chain : &endpoint->callback;
+    req->_chain_len = (endpoint->chain != NULL) ? endpoint->chain_len : 1;
+  }
+  else
+  {
+    req->_chain     = conn->server->_chain;
+    req->_chain_len = conn->server->_chain_len;
+  }
+
+  req->_chain_pos = 0;
+
+  // a JSON body is read whole (see get_json), as long as it's not too large
+  char* content_type = (req->_body_left > 0) ? req->get_header(req, "Content-Type") : NULL;
+
+  if (content_type != NULL && http_parse_content_type(content_type) == KC_BODY_CONTENT_TYPE_JSON &&
+      req->_body_buffered_len + req->_body_left > KC_HTTP_JSON_MAX_SIZE)
+  {
+    _send_error(req->client_fd, res, KC_HTTP_PAYLOAD_TOO_LARGE,
+        "<h1>413 Payload Too Large</h1>\r\n");
+  }
+  // the routes that take the connection over are answered on the loop
+  else if (routed && (endpoint->sse != NULL || endpoint->websocket.message != NULL))
+  {
+    next_server(conn->server, req, res);
+  }
+  else
+  {
+    _call_handler(conn, req, res);
+  }
+
+  // the thread of the connection waits for a deferred response, the
+  // event loop goes on and sends it once it's completed
+  if (res->_deferred != NULL && conn->server->_io_engine == NULL)
+  {
+    _await_deferred(conn, req, res);
+  }
+  // a stream the handler left open is ended for it
+  else if (res->_deferred == NULL && res->_stream == KC_HTTP_STREAM_OPEN)
+  {
+    res->end(res);
+  }
+
+  return metrics_route;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _await_deferred(struct kc_connection_t* conn, struct kc_http_request_t* req,
+    struct kc_http_response_t* res)
+{
+  struct kc_deferred_t* deferred = res->_deferred;
+
+  pthread_mutex_lock(&conn->deferred_lock);
+
+  while (deferred->state == KC_SERVER_DEFERRED_PENDING)
+  {
+    pthread_cond_wait(&conn->deferred_completed, &conn->deferred_lock);
+  }
+
+  conn->deferred--;
+
+  pthread_mutex_unlock(&conn->deferred_lock);
+
+  res->_deferred = NULL;
+  free(deferred);
+
+  _answer_deferred(req, res);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _answer_deferred(struct kc_http_request_t* req, struct kc_http_response_t* res)
+{
+  // the response as it was set, unless the handler sent it itself
+  if (res->_sent == false && res->_stream == KC_HTTP_STREAM_NONE)
+  {
+    send_msg_server(req->client_fd, res);
+  }
+  // a stream the handler left open is ended for it
+  else if (res->_stream == KC_HTTP_STREAM_OPEN)
+  {
+    res->end(res);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _finish_deferred(struct kc_deferred_t* deferred)
+{
+  struct kc_connection_t* conn = deferred->conn;
+  struct kc_exchange_t* exchange = &deferred->exchange;
+
+  // the connection is still open, it drops the completed ones it closes with
+  pthread_mutex_lock(&conn->deferred_lock);
+  conn->deferred--;
+  pthread_mutex_unlock(&conn->deferred_lock);
+
+  serving = conn;
+
+  conn->serialize_ns = 0;
+  conn->send_ns      = 0;
+  conn->bytes_out    = 0;
+
+  exchange->res->_deferred = NULL;
+  _answer_deferred(exchange->req, exchange->res);
+
+  // the request of a HTTP/1 connection (upgraded or not), the next ones
+  // that came meanwhile are served after it
+  if (conn->parked == deferred)
+  {
+    conn->parked = NULL;
+
+    bool keep_alive = _finish_request(conn, exchange);
+    destroy_arena(deferred->arena);
+
+    if (keep_alive == false || _engine_received(conn, 0) == false)
+    {
+      // the event loop closes it, as it sees the end of the socket
+      shutdown(conn->client_fd, SHUT_RDWR);
+    }
+  }
+  // the stream of a HTTP/2 connection, the others went on meanwhile
+  else
+  {
+    struct kc_http2_stream_t* stream = exchange->res->_h2;
+
+    _finish_http2_request(conn, exchange);
+    destroy_arena(deferred->arena);
+
+    conn->http2->finish(conn->http2, stream);
+
+    if (_http2_open(conn) == false)
+    {
+      shutdown(conn->client_fd, SHUT_RDWR);
+    }
+  }
+
+  free(deferred);
+
+  serving = NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _drop_deferred(struct kc_deferred_t* deferred)
+{
+  struct kc_connection_t* conn = deferred->conn;
+  struct kc_exchange_t* exchange = &deferred->exchange;
+
+  exchange->res->_deferred = NULL;
+
+  destroy_request(exchange->req);
+  destroy_response(exchange->res);
+
+  if (deferred->arena != NULL)
+  {
+    destroy_arena(deferred->arena);
+  }
+
+  free(deferred);
+
+  // the connection was kept only for its deferred responses
+  pthread_mutex_lock(&conn->deferred_lock);
+  bool last = (--conn->deferred == 0);
+  pthread_mutex_unlock(&conn->deferred_lock);
+
+  if (last)
+  {
+    _free_connection(conn);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int _defer_response(struct kc_connection_t* conn, struct kc_http_response_t* res)
+{
+  struct kc_deferred_t* deferred = malloc(sizeof(struct kc_deferred_t));
+  if (deferred == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return KC_OUT_OF_MEMORY;
+  }
+
+  memset(deferred, 0, sizeof(struct kc_deferred_t));
+
+  deferred->conn  = conn;
+  deferred->state = KC_SERVER_DEFERRED_PENDING;
+
+  // the event loop goes on with the other requests in a new arena, the
+  // request keeps the one it was handled in
+  if (conn->server->_io_engine != NULL)
+  {
+    struct kc_arena_t* arena = new_arena(KC_SERVER_ARENA_BLOCK_SIZE);
+    if (arena == NULL)
+    {
+      log_error(KC_OUT_OF_MEMORY_LOG);
+      free(deferred);
+
+      return KC_OUT_OF_MEMORY;
+    }
+
+    deferred->arena = conn->arena;
+    conn->arena     = arena;
+  }
+
+  pthread_mutex_lock(&conn->deferred_lock);
+  conn->deferred++;
+  pthread_mutex_unlock(&conn->deferred_lock);
+
+  res->_deferred = deferred;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _call_handler(struct kc_connection_t* conn, struct kc_http_request_t* req,
+    struct kc_http_response_t* res)
+{
+  struct kc_fiber_scheduler_t* fibers = conn->server->_fibers;
+
+  // the streams of HTTP/2 are answered on the loop, their frames share the
+  // socket (and its lock) with the others
+  struct kc_handler_call_t* call = (fibers != NULL && res->_h2 == NULL) ?
+      malloc(sizeof(struct kc_handler_call_t)) : NULL;
+
+  // the threads (and the streams of HTTP/2) run the handler right away
+  if (fibers == NULL || res->_h2 != NULL)
+  {
+    return next_server(conn->server, req, res);
+  }
+
+  // the loop doesn't run the handler itself, a client that stops halfway
+  // through its body would hold all the others
+  if (call == NULL)
+  {
+    _send_error(req->client_fd, res, KC_HTTP_SERVICE_UNAVAILABLE,
+        "<h1>503 Service Unavailable</h1>\r\n");
+    return KC_SERVER_SEND_MSG;
+  }
+
+  call->server = conn->server;
+  call->conn   = conn;
+  call->req    = req;
+  call->res    = res;
+
+  struct kc_fiber_t* fiber = NULL;
+  int ret = fibers->spawn(fibers, _fiber_handler, call, &fiber);
+
+  serving = conn;
+
+  if (ret == KC_SUCCESS)
+  {
+    return KC_SUCCESS;
+  }
+
+  if (ret != KC_PENDING)
+  {
+    free(call);
+
+    _send_error(req->client_fd, res, KC_HTTP_SERVICE_UNAVAILABLE,
+        "<h1>503 Service Unavailable</h1>\r\n");
+    return KC_SERVER_SEND_MSG;
+  }
+
+  // the handler waits, the request waits for it like for any deferred
+  // response (unless the handler deferred it itself)
+  conn->fiber = fiber;
+
+  if (res->_deferred == NULL && _defer_response(conn, res) == KC_SUCCESS)
+  {
+    ((struct kc_deferred_t*)res->_deferred)->fiber = fiber;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _fiber_handler(void* call)
+{
+  struct kc_handler_call_t* handler = (struct kc_handler_call_t*)call;
+  struct kc_http_response_t* res = handler->res;
+
+  next_server(handler->server, handler->req, res);
+
+  if (handler->conn != NULL)
+  {
+    handler->conn->fiber   = NULL;
+    handler->conn->reading = false;
+  }
+
+  free(handler);
+
+  // the response waited for the handler to return
+  struct kc_deferred_t* deferred = res->_deferred;
+
+  if (deferred != NULL && deferred->fiber != NULL)
+  {
+    deferred->fiber = NULL;
+    complete_server(res);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _fiber_switched(struct kc_fiber_t* fiber)
+{
+  // the connection of the handler is the one being served
+  serving = (fiber != NULL) ? ((struct kc_handler_call_t*)fiber->data)->conn : NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _receive_body(struct kc_http_request_t* req, char* buffer, size_t size, size_t* len)
+{
+  struct kc_connection_t* conn = serving;
+
+  (*len) = 0;
+
+  // the connection was closed meanwhile
+  if (conn == NULL || conn->client_fd != req->client_fd)
+  {
+    return KC_LOST_CONNECTION;
+  }
+
+  // the part of the body already read makes room for the rest
+  if (conn->request_len > conn->body_start)
+  {
+    memmove(conn->buffer + conn->body_start, conn->buffer + conn->request_len,
+        conn->buffer_len - conn->request_len);
+
+    conn->buffer_len -= conn->request_len - conn->body_start;
+    conn->request_len = conn->body_start;
+  }
+
+  while (conn->buffer_len <= conn->request_len)
+  {
+    // the loop is not waited for, the body is not here
+    if (kc_fiber_current() == NULL)
+    {
+      return KC_PENDING;
+    }
+
+    conn->reading = true;
+
+    int ret = kc_fiber_suspend();
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
+
+    // the connection can't be used once it's closed
+    conn = serving;
+    if (conn == NULL)
+    {
+      return KC_LOST_CONNECTION;
+    }
+  }
+
+  // what came after the request is taken out of the buffer
+  size_t received = conn->buffer_len - conn->request_len;
+  size_t n = (size < received) ? size : received;
+
+  memcpy(buffer, conn->buffer + conn->request_len, n);
+  memmove(conn->buffer + conn->request_len, conn->buffer + conn->request_len + n, received - n);
+  conn->buffer_len -= n;
+
+  (*len) = n;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _queue_blocking(struct kc_server_t* self, struct kc_http_request_t* req,
+    struct kc_http_response_t* res)
+{
+  // without the threads, the route is handled as any other
+  if (self->_blocking == NULL)
+  {
+    return next_server(self, req, res);
+  }
+
+  // the body is received here, the handler is given all of it in memory;
+  // with an event loop this runs on the fiber of the request, which waits
+  // while the loop receives the body (see _receive_body), so the request
+  // is queued only once the body is whole and the loop goes on meanwhile
+  if (req->_body_left > 0)
+  {
+    size_t size = req->_body_buffered_len + req->_body_left;
+
+    char* body = (size <= KC_SERVER_BLOCKING_BODY_SIZE) ?
+        req->arena->alloc(req->arena, size) : NULL;
+
+    if (body == NULL)
+    {
+      _send_error(req->client_fd, res, KC_HTTP_PAYLOAD_TOO_LARGE,
+          "<h1>413 Payload Too Large</h1>\r\n");
+      return KC_SERVER_SEND_MSG;
+    }
+
+    size_t body_len = 0;
+    while (body_len < size)
+    {
+      size_t len = 0;
+      int ret = req->read_body(req, body + body_len, size - body_len, &len);
+
+      // nothing can wait for the rest of the body without holding the loop
+      if (ret == KC_PENDING)
+      {
+        _send_error(req->client_fd, res, KC_HTTP_SERVICE_UNAVAILABLE,
+            "<h1>503 Service Unavailable</h1>\r\n");
+        return KC_SERVER_SEND_MSG;
+      }
+
+      // the client is gone, nobody waits for the response
+      if (ret != KC_SUCCESS || len == 0)
+      {
+        return KC_LOST_CONNECTION;
+      }
+
+      body_len += len;
+    }
+
+    req->_body_buffered     = body;
+    req->_body_buffered_len = body_len;
+  }
+
+  // the response waits for the thread, the connection goes on meanwhile
+  if (defer_server(res) != KC_SUCCESS)
+  {
+    return next_server(self, req, res);
+  }
+
+  struct kc_handler_call_t* call = malloc(sizeof(struct kc_handler_call_t));
+
+  if (call != NULL)
+  {
+    call->server = self;
+    call->conn   = serving;
+    call->req    = req;
+    call->res    = res;
+  }
+
+  // too many requests wait already, this one is not added to them
+  if (call == NULL || self->_blocking->submit(self->_blocking, _blocking_handler, call) != KC_SUCCESS)
+  {
+    free(call);
+
+    _send_error(req->client_fd, res, KC_HTTP_SERVICE_UNAVAILABLE,
+        "<h1>503 Service Unavailable</h1>\r\n");
+    complete_server(res);
+
+    return KC_SERVER_SEND_MSG;
+  }
+
+  return KC_PENDING;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _blocking_handler(void* call)
+{
+  struct kc_handler_call_t* handler = (struct kc_handler_call_t*)call;
+  struct kc_http_response_t* res = handler->res;
+
+  // the rest of the chain, after the step that queued it
+  pooled = res->_deferred;
+  next_server(handler->server, handler->req, res);
+
+  free(handler);
+
+  // the response goes back to the thread of the connection (unless the
+  // handler deferred it again)
+  if (pooled != NULL)
+  {
+    pooled = NULL;
+    complete_server(res);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int _serve_unrouted(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res)
+{
+  struct kc_endpoint_t* endpoint = NULL;
+  int ret = endpoints->get(endpoints, req->url, (void*)&endpoint);
+
+  struct kc_static_route_t* route = NULL;
+  if (endpoint == NULL && (strcmp(req->method, KC_HTTP_METHOD_GET) == 0 ||
+      strcmp(req->method, KC_HTTP_METHOD_HEAD) == 0))
+  {
+    route = _find_static_route(req->url);
+  }
+
+  // internal server error, return 500
+  if (ret != KC_SUCCESS && ret != KC_INVALID) // TODO: change KC_INVALID with KC_NOT_FOUND
+  {
+    _send_error(req->client_fd, res, KC_HTTP_INTERNAL_SERVER_ERROR,
+        "<h1>500 Internal server error</h1>\r\n");
+  }
+  else if (route != NULL)
+  {
+    _serve_static(serving, req, res, route);
+  }
+  // page not found, return 404
+  else if (endpoint == NULL)
+  {
+    _send_error(req->client_fd, res, KC_HTTP_NOT_FOUND,
+        "<h1>404 Page Not Found</h1>\r\n");
+  }
+  // bad request, return 400
+  else
+  {
+    _send_error(req->client_fd, res, KC_HTTP_BAD_REQUEST,
+        "<h1>400 Bad Request</h1>\r\n");
+  }
+
+  return KC_SERVER_SEND_MSG;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _resolve_chains(struct kc_server_t* self)
+{
+  size_t global_len = self->_middleware_len;
+
+  // the requests without an endpoint end with the answer of the server
+  free(self->_chain);
+
+  self->_chain = malloc(sizeof(*self->_chain) * (global_len + 1));
+  if (self->_chain == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return KC_OUT_OF_MEMORY;
+  }
+
+  memcpy(self->_chain, self->_middleware, sizeof(*self->_chain) * global_len);
+  self->_chain[global_len] = _serve_unrouted;
+  self->_chain_len = global_len + 1;
+
+  // the others with the middleware of their route, then its callback (the
+  // blocking ones start by going to their threads, the rest runs there)
+  bool blocking = false;
+
+  for (int i = 0; i < KC_MAP_MAX_SIZE; ++i)
+  {
+    for (struct kc_entry_t* entry = endpoints->entries[i]; entry != NULL; entry = entry->next)
+    {
+      struct kc_endpoint_t* endpoint = (struct kc_endpoint_t*)entry->val;
+      size_t first = endpoint->blocking ? 1 : 0;
+      size_t chain_len = first + global_len + endpoint->middleware_len + 1;
+
+      free(endpoint->chain);
+
+      endpoint->chain = malloc(sizeof(*endpoint->chain) * chain_len);
+      if (endpoint->chain == NULL)
+      {
+        log_error(KC_OUT_OF_MEMORY_LOG);
+        return KC_OUT_OF_MEMORY;
+      }
+
+      if (endpoint->blocking)
+      {
+        endpoint->chain[0] = _queue_blocking;
+      }
+
+      memcpy(endpoint->chain + first, self->_middleware, sizeof(*endpoint->chain) * global_len);
+      memcpy(endpoint->chain + first + global_len, endpoint->middleware,
+          sizeof(*endpoint->chain) * endpoint->middleware_len);
+
+      endpoint->chain[chain_len - 1] = endpoint->callback;
+      endpoint->chain_len = chain_len;
+
+      blocking |= endpoint->blocking;
+    }
+  }
+
+  // the threads of the blocking routes, made along their chains
+  if (blocking && self->blocking_threads > 0 && self->_blocking == NULL)
+  {
+    self->_blocking = new_worker_pool(self->blocking_threads, self->blocking_queue_size);
+    if (self->_blocking == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+
+    metrics->pool = self->_blocking;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _record_request(struct kc_connection_t* conn, int route, int status, size_t bytes_in, uint64_t parse, uint64_t handled)
+{
+  struct kc_metrics_sample_t sample;
+
+  sample.route     = route;
+  sample.status    = status;
+  sample.bytes_in  = bytes_in;
+  sample.bytes_out = conn->bytes_out;
+
+  // the handler is what's left once the response was serialized and sent
+  uint64_t written = conn->serialize_ns + conn->send_ns;
+
+  sample.phases[KC_METRICS_PARSE]     = parse;
+  sample.phases[KC_METRICS_HANDLER]   = (handled > written) ? handled - written : 0;
+  sample.phases[KC_METRICS_SERIALIZE] = conn->serialize_ns;
+  sample.phases[KC_METRICS_SEND]      = conn->send_ns;
+
+  metrics->record(metrics, &sample);
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _is_keep_alive(struct kc_http_request_t* req)
+{
+  char* connection = req->get_header(req, KC_HTTP_HEADER_CONNECTION);
+
+  // the body has no known length, so the request can't be delimited
+  if (req->get_header(req, KC_HTTP_HEADER_TRANSFER_ENCODING) != NULL)
+  {
+    return false;
+  }
+
+  // HTTP/1.1 keeps the connection open unless told otherwise,
+  // the older versions only when they ask for it
+  if (strcmp(req->http_ver, KC_HTTP_1) == 0)
+  {
+    return connection == NULL || strcasecmp(connection, "close") != 0;
+  }
+
+  return connection != NULL && strcasecmp(connection, "keep-alive") == 0;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _has_token(const char* list, const char* token)
+{
+  size_t token_len = strlen(token);
+
+  // the values are separated by commas (ex: "keep-alive, Upgrade")
+  while (*list != '\0')
+  {
+    list += strspn(list, " \t,");
+
+    size_t len = strcspn(list, ",");
+    size_t end = len;
+
+    while (end > 0 && (list[end - 1] == ' ' || list[end - 1] == '\t'))
+    {
+      --end;
+    }
+
+    if (end == token_len && strncasecmp(list, token, token_len) == 0)
+    {
+      return true;
+    }
+
+    list += len;
+  }
+
+  return false;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _send_cached_response(struct kc_connection_t* conn, size_t head_len,
+    struct kc_endpoint_t** endpoint, char** key, bool* keep_alive)
+{
+  // only "GET <url> HTTP/1.1" requests are looked up
+  if (strncmp(conn->buffer, "GET ", 4) != 0)
+  {
+    return KC_INVALID;
+  }
+
+  char* url      = conn->buffer + 4;
+  char* url_end  = strchr(url, ' ');
+  char* line_end = strstr(url, "\r\n");
+
+  if (url_end == NULL || line_end == NULL || url_end > line_end ||
+      (size_t)(line_end - url_end - 1) != strlen(KC_HTTP_1) ||
+      strncmp(url_end + 1, KC_HTTP_1, strlen(KC_HTTP_1)) != 0)
+  {
+    return KC_INVALID;
+  }
+
+  // the endpoints are mapped without the query string
+  size_t url_len  = url_end - url;
+  size_t path_len = strcspn(url, "? ");
+
+  char* path = conn->arena->alloc(conn->arena, path_len + 1);
+  if (path == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  memcpy(path, url, path_len);
+  path[path_len] = '\0';
+
+  struct kc_endpoint_t* found = NULL;
+  // the middleware must see every request, a route with some is not cached
+  // (the step of a blocking route is not one)
+  if (endpoints->get(endpoints, path, (void**)&found) != KC_SUCCESS ||
+      found->cache == NULL || strcmp(found->method, KC_HTTP_METHOD_GET) != 0 ||
+      found->chain_len > (found->blocking ? 2 : 1))
+  {
+    return KC_INVALID;
+  }
+
+  const char* headers = line_end + 2;
+  size_t headers_len  = conn->buffer + head_len - headers;
+  size_t val_len      = 0;
+
+  // a body can't be skipped without the parser
+  if (_raw_header(headers, headers_len, "Content-Length", &val_len) != NULL ||
+      _raw_header(headers, headers_len, "Transfer-Encoding", &val_len) != NULL)
+  {
+    return KC_INVALID;
+  }
+
+  struct kc_response_cache_t* cache = found->cache;
+
+  // the key is the URL, then the value of every header (ex: "/?a=1\nen")
+  const char* values[KC_RESPONSE_CACHE_MAX_HEADERS];
+  size_t values_len[KC_RESPONSE_CACHE_MAX_HEADERS];
+  size_t key_len = url_len;
+
+  for (int i = 0; i < cache->headers_len; ++i)
+  {
+    values[i] = _raw_header(headers, headers_len, cache->headers[i], &values_len[i]);
+    key_len  += 1 + values_len[i];
+  }
+
+  char* new_key = conn->arena->alloc(conn->arena, key_len + 1);
+  if (new_key == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  memcpy(new_key, url, url_len);
+  key_len = url_len;
+
+  for (int i = 0; i < cache->headers_len; ++i)
+  {
+    new_key[key_len++] = '\n';
+    memcpy(new_key + key_len, values[i] != NULL ? values[i] : "", values_len[i]);
+    key_len += values_len[i];
+  }
+
+  new_key[key_len] = '\0';
+
+  struct kc_cached_response_t* response = NULL;
+  int ret = cache->acquire(cache, new_key, &response);
+
+  // this request produces the response, the parser takes over
+  if (ret == KC_PENDING)
+  {
+    *endpoint = found;
+    *key      = new_key;
+
+    return KC_PENDING;
+  }
+
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  const char* connection = _raw_header(headers, headers_len, KC_HTTP_HEADER_CONNECTION, &val_len);
+  *keep_alive = (connection == NULL || val_len != 5 || strncasecmp(connection, "close", 5) != 0) &&
+      __atomic_load_n(&conn->server->_stopping, __ATOMIC_RELAXED) == 0;
+
+  struct iovec iov[5];
+  int iov_len = 0;
+
+  char date[KC_CLOCK_DATE_SIZE + 8];
+
+  iov[iov_len++] = (struct iovec){ response->data, response->head_len };
+  iov[iov_len++] = (struct iovec){ date, _date_header(date) };
+
+  if (*keep_alive == false)
+  {
+    iov[iov_len++] = (struct iovec){ KC_HTTP_HEADER_CONNECTION ": close\r\n", 19 };
+  }
+
+  iov[iov_len++] = (struct iovec){ "\r\n", 2 };
+  iov[iov_len++] = (struct iovec){ response->data + response->head_len,
+      response->len - response->head_len };
+
+  if (_send_iovec(conn->client_fd, iov, iov_len, 0) != KC_SUCCESS)
+  {
+    *keep_alive = false;
+  }
+
+  cache->release(cache, response);
+
+  // move the next request (if any) at the start of the buffer
+  if (*keep_alive)
+  {
+    memmove(conn->buffer, conn->buffer + head_len, conn->buffer_len - head_len);
+    conn->buffer_len -= head_len;
+  }
+
+  *endpoint = found;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static const char* _raw_header(const char* head, size_t head_len, const char* name, size_t* val_len)
+{
+  size_t name_len = strlen(name);
+  const char* end = head + head_len;
+
+  // the lines are scanned as they came, without being parsed
+  for (const char* line = head; line < end; )
+  {
+    const char* line_end = strstr(line, "\r\n");
+    if (line_end == NULL || line_end > end)
+    {
+      break;
+    }
+
+    if ((size_t)(line_end - line) > name_len && line[name_len] == ':' &&
+        strncasecmp(line, name, name_len) == 0)
+    {
+      const char* val = line + name_len + 1;
+      while (val < line_end && (*val == ' ' || *val == '\t'))
+      {
+        ++val;
+      }
+
+      const char* val_end = line_end;
+      while (val_end > val && (val_end[-1] == ' ' || val_end[-1] == '\t'))
+      {
+        --val_end;
+      }
+
+      *val_len = val_end - val;
+      return val;
+    }
+
+    line = line_end + 2;
+  }
+
+  *val_len = 0;
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _record_response(struct kc_http_response_t* res, const char* status_line,
+    size_t status_len, const char* content_length, size_t content_length_len)
+{
+  // the headers of the connection (ex: "Connection: close") are left
+  // out, they are added again for every request that gets the copy
+  size_t head_len = status_len + content_length_len;
+
+  for (int i = 0; i < res->headers_len; ++i)
+  {
+    struct kc_http_header_t* header = &res->headers[i];
+
+    if (strncasecmp(header->key, KC_HTTP_HEADER_CONNECTION ":", 11) != 0)
+    {
+      head_len += header->key_len + header->val_len + 2;
+    }
+  }
+
+  size_t len = head_len + res->body_len;
+  if (len > res->_record_max)
+  {
+    return;
+  }
+
+  char* record = malloc(len + 1);
+  if (record == NULL)
+  {
+    return;
+  }
+
+  char* cursor = record;
+
+  memcpy(cursor, status_line, status_len);
+  cursor += status_len;
+
+  for (int i = 0; i < res->headers_len; ++i)
+  {
+    struct kc_http_header_t* header = &res->headers[i];
+
+    if (strncasecmp(header->key, KC_HTTP_HEADER_CONNECTION ":", 11) == 0)
+    {
+      continue;
+    }
+
+    memcpy(cursor, header->key, header->key_len);
+    cursor += header->key_len;
+    memcpy(cursor, header->val, header->val_len);
+    cursor += header->val_len;
+    memcpy(cursor, "\r\n", 2);
+    cursor += 2;
+  }
+
+  memcpy(cursor, content_length, content_length_len);
+  cursor += content_length_len;
+
+  if (res->body_len > 0)
+  {
+    memcpy(cursor, res->body, res->body_len);
+  }
+
+  free(res->_record);
+
+  res->_record          = record;
+  res->_record_len      = len;
+  res->_record_head_len = head_len;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _send_error(int client_fd, struct kc_http_response_t* res, int status, char* body)
+{
+  res->set_status(res, status);
+  res->set_header(res, KC_HTTP_HEADER_CONTENT_TYPE, "text/html");
+  res->set_body(res, body);
+
+  send_msg_server(client_fd, res);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _serve_static(struct kc_connection_t* conn, struct kc_http_request_t* req,
+    struct kc_http_response_t* res, struct kc_static_route_t* route)
+{
+  // the whole files come from the memory, the ranges from the disk (and
+  // the files on HTTP/2, the cached responses are rendered for HTTP/1)
+  if (route->cache != NULL && req->get_header(req, "Range") == NULL && res->_h2 == NULL)
+  {
+    char relative[PATH_MAX];
+    struct kc_asset_t* asset = NULL;
+
+    int ret = _static_relative_path(route, req->url, relative) ?
+        route->cache->get(route->cache, relative,
+            req->get_header(req, "Accept-Encoding"), &asset) : KC_FILE_NOT_FOUND;
+
+    if (ret == KC_FILE_NOT_FOUND)
+    {
+      _send_error(conn->client_fd, res, KC_HTTP_NOT_FOUND,
+          "<h1>404 Page Not Found</h1>\r\n");
+      return;
+    }
+
+    if (ret == KC_SUCCESS)
+    {
+      _send_asset(conn, req, res, asset);
+      route->cache->release(route->cache, asset);
+      return;
+    }
+  }
+
+  struct kc_file_info_t info;
+  struct kc_file_t* file = _open_static_file(route, req->url, &info);
+
+  // the path is missing, unsafe or not a regular file
+  if (file == NULL)
+  {
+    _send_error(conn->client_fd, res, KC_HTTP_NOT_FOUND,
+        "<h1>404 Page Not Found</h1>\r\n");
+    return;
+  }
+
+  char last_modified[KC_HTTP_DATE_SIZE];
+  http_format_date(info.modified, last_modified);
+
+  char etag[KC_SERVER_ETAG_SIZE];
+  if (_file_etag(file, &info, etag) != KC_SUCCESS)
+  {
+    destroy_file(file);
+
+    _send_error(conn->client_fd, res, KC_HTTP_INTERNAL_SERVER_ERROR,
+        "<h1>500 Internal server error</h1>\r\n");
+    return;
+  }
+
+  res->set_header(res, KC_HTTP_HEADER_CONTENT_TYPE, (char*)http_mime_type(file->name));
+  res->set_header(res, KC_HTTP_HEADER_LAST_MODIFIED, last_modified);
+  res->set_header(res, KC_HTTP_HEADER_ETAG, etag);
+  res->set_header(res, KC_HTTP_HEADER_ACCEPT_RANGES, "bytes");
+
+  // the client already has this version of the file
+  if (_is_not_modified(req, etag, last_modified, info.modified))
+  {
+    destroy_file(file);
+
+    res->set_status(res, KC_HTTP_NOT_MODIFIED);
+    send_msg_server(conn->client_fd, res);
+    return;
+  }
+
+  // the same headers, but no body
+  if (strcmp(req->method, KC_HTTP_METHOD_HEAD) == 0)
+  {
+    char content_length[24];
+    sprintf(content_length, "%zu", info.size);
+
+    destroy_file(file);
+
+    res->set_header(res, KC_HTTP_HEADER_CONTENT_LENGTH, content_length);
+    send_msg_server(conn->client_fd, res);
+    return;
+  }
+
+  // only a part of the file (ex: a download that is resumed)
+  if (req->get_header(req, "Range") != NULL)
+  {
+    _send_ranges(conn, req, res, file, &info, etag, last_modified);
+    return;
+  }
+
+  res->set_file(res, file, 0, info.size);
+  send_msg_server(conn->client_fd, res);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _send_asset(struct kc_connection_t* conn, struct kc_http_request_t* req,
+    struct kc_http_response_t* res, struct kc_asset_t* asset)
+{
+  // the response is already rendered, only the headers of the
+  // connection (ex: "Connection: close") are added to it
+  struct iovec stack_iov[KC_SERVER_IOVEC_SIZE];
+  struct iovec* iov = stack_iov;
+  int iov_len = 0;
+
+  int iov_needed = (3 * res->headers_len) + 4;
+  if (iov_needed > KC_SERVER_IOVEC_SIZE)
+  {
+    iov = malloc(sizeof(struct iovec) * iov_needed);
+    if (iov == NULL)
+    {
+      return;
+    }
+  }
+
+  bool not_modified = _is_not_modified(req, asset->etag, asset->last_modified, asset->modified);
+
+  if (not_modified)
+  {
+    iov[iov_len++] = (struct iovec){ asset->not_modified, asset->not_modified_len };
+  }
+  else
+  {
+    iov[iov_len++] = (struct iovec){ asset->head, asset->head_len };
+  }
+
+  char date[KC_CLOCK_DATE_SIZE + 8];
+  iov[iov_len++] = (struct iovec){ date, _date_header(date) };
+
+  for (int i = 0; i < res->headers_len; ++i)
+  {
+    struct kc_http_header_t* header = &res->headers[i];
+
+    iov[iov_len++] = (struct iovec){ (char*)header->key, header->key_len };
+    iov[iov_len++] = (struct iovec){ (char*)header->val, header->val_len };
+    iov[iov_len++] = (struct iovec){ "\r\n", 2 };
+  }
+
+  iov[iov_len++] = (struct iovec){ "\r\n", 2 };
+
+  if (not_modified == false && strcmp(req->method, KC_HTTP_METHOD_HEAD) != 0)
+  {
+    iov[iov_len++] = (struct iovec){ asset->body, asset->body_len };
+  }
+
+  if (_send_iovec(conn->client_fd, iov, iov_len, 0) == KC_SUCCESS)
+  {
+    res->_sent = true;
+  }
+
+  if (iov != stack_iov)
+  {
+    free(iov);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _is_not_modified(struct kc_http_request_t* req, const char* etag,
+    const char* last_modified, time_t modified)
+{
+  // the entity tags are more precise, the date is checked only without them
+  char* if_none_match = req->get_header(req, "If-None-Match");
+  if (if_none_match != NULL)
+  {
+    return http_match_etag(if_none_match, etag) == KC_SUCCESS;
+  }
+
+  time_t since = 0;
+  char* if_modified_since = req->get_header(req, "If-Modified-Since");
+
+  return if_modified_since != NULL &&
+      http_parse_date(if_modified_since, &since) == KC_SUCCESS &&
+      modified <= since;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _send_ranges(struct kc_connection_t* conn, struct kc_http_request_t* req,
+    struct kc_http_response_t* res, struct kc_file_t* file, struct kc_file_info_t* info,
+    const char* etag, const char* last_modified)
+{
+  struct kc_http_range_t ranges[KC_HTTP_MAX_RANGES];
+  int ranges_len = 0;
+
+  int ret = http_parse_range(req->get_header(req, "Range"), info->size, ranges, &ranges_len);
+
+  // the ranges are for another version of the file, send the whole new one
+  char* if_range = req->get_header(req, "If-Range");
+  if (if_range != NULL && strcmp(if_range, etag) != 0 && strcmp(if_range, last_modified) != 0)
+  {
+    ret = KC_FORMAT_ERROR;
+  }
+
+  // none of the ranges is inside the file
+  if (ret == KC_INVALID)
+  {
+    char content_range[48];
+    sprintf(content_range, "bytes */%zu", info->size);
+
+    destroy_file(file);
+
+    res->set_header(res, KC_HTTP_HEADER_CONTENT_RANGE, content_range);
+    _send_error(conn->client_fd, res, KC_HTTP_RANGE_NOT_SATISFIABLE,
+        "<h1>416 Range Not Satisfiable</h1>\r\n");
+    return;
+  }
+
+  // a malformed header (or too many ranges) is ignored, the parts of a
+  // multipart body are written as HTTP/1 bytes so HTTP/2 gets the file
+  if (ret != KC_SUCCESS || (ranges_len > 1 && res->_h2 != NULL))
+  {
+    res->set_file(res, file, 0, info->size);
+    send_msg_server(conn->client_fd, res);
+    return;
+  }
+
+  if (ranges_len > 1)
+  {
+    _send_byteranges(conn, res, file, info, ranges, ranges_len, etag);
+    return;
+  }
+
+  char content_range[64];
+  sprintf(content_range, "bytes %zu-%zu/%zu", ranges[0].start,
+      ranges[0].start + ranges[0].len - 1, info->size);
+
+  res->set_status(res, KC_HTTP_PARTIAL_CONTENT);
+  res->set_header(res, KC_HTTP_HEADER_CONTENT_RANGE, content_range);
+  res->set_file(res, file, ranges[0].start, ranges[0].len);
+
+  send_msg_server(conn->client_fd, res);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _send_byteranges(struct kc_connection_t* conn, struct kc_http_response_t* res,
+    struct kc_file_t* file, struct kc_file_info_t* info, struct kc_http_range_t* ranges,
+    int ranges_len, const char* etag)
+{
+  const char* mime_type = http_mime_type(file->name);
+
+  // the boundary comes from the entity tag (a hash), so it can't be
+  // confused with the content of the file
+  char boundary[KC_SERVER_ETAG_SIZE + 16];
+  sprintf(boundary, "KC_BYTERANGES_%.*s", (int)strlen(etag) - 2, etag + 1);
+
+  // every part starts with its own headers, then the bytes of the file
+  char* parts[KC_HTTP_MAX_RANGES];
+  size_t parts_len[KC_HTTP_MAX_RANGES];
+  size_t total = 0;
+
+  size_t part_size = strlen(boundary) + strlen(mime_type) + 128;
+
+  for (int i = 0; i < ranges_len; ++i)
+  {
+    parts[i] = conn->arena->alloc(conn->arena, part_size);
+    if (parts[i] == NULL)
+    {
+      destroy_file(file);
+      return;
+    }
+
+    parts_len[i] = snprintf(parts[i], part_size,
+        "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+        boundary, mime_type, ranges[i].start, ranges[i].start + ranges[i].len - 1, info->size);
+
+    total += parts_len[i] + ranges[i].len;
+  }
+
+  char closing[KC_SERVER_ETAG_SIZE + 32];
+  size_t closing_len = sprintf(closing, "\r\n--%s--\r\n", boundary);
+  total += closing_len;
+
+  char content_type[KC_SERVER_ETAG_SIZE + 64];
+  sprintf(content_type, "multipart/byteranges; boundary=%s", boundary);
+
+  char content_length[24];
+  sprintf(content_length, "%zu", total);
+
+  res->set_status(res, KC_HTTP_PARTIAL_CONTENT);
+  res->set_header(res, KC_HTTP_HEADER_CONTENT_TYPE, content_type);
+  res->set_header(res, KC_HTTP_HEADER_CONTENT_LENGTH, content_length);
+
+  // the headers of the response, then every part from where it is
+  int ret = send_msg_server(conn->client_fd, res);
+
+  for (int i = 0; i < ranges_len && ret == KC_SERVER_SEND_MSG; ++i)
+  {
+    struct iovec part = { parts[i], parts_len[i] };
+
+    if (_send_iovec(conn->client_fd, &part, 1, MSG_MORE) != KC_SUCCESS ||
+        _send_file(conn->client_fd, file, ranges[i].start, ranges[i].len) != KC_SUCCESS)
+    {
+      ret = KC_NETWORK_ERROR;
+    }
+  }
+
+  if (ret == KC_SERVER_SEND_MSG)
+  {
+    struct iovec end = { closing, closing_len };
+    ret = _send_iovec(conn->client_fd, &end, 1, 0);
+  }
+
+  // the client can't tell where the response stopped
+  if (ret != KC_SUCCESS && ret != KC_SERVER_SEND_MSG)
+  {
+    shutdown(conn->client_fd, SHUT_RDWR);
+  }
+
+  destroy_file(file);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _file_etag(struct kc_file_t* file, struct kc_file_info_t* info, char etag[KC_SERVER_ETAG_SIZE])
+{
+  struct kc_etag_t* cached = NULL;
+
+  // the tag is still good while the file is the same one (the inode), with
+  // the same size and modification time, otherwise it's computed again
+  pthread_mutex_lock(&etags_lock);
+
+  if (etags->get(etags, file->name, (void**)&cached) == KC_SUCCESS &&
+      cached->inode == info->inode && cached->modified == info->modified &&
+      cached->size == info->size)
+  {
+    strcpy(etag, cached->etag);
+    pthread_mutex_unlock(&etags_lock);
+
+    return KC_SUCCESS;
+  }
+
+  pthread_mutex_unlock(&etags_lock);
+
+  struct kc_sha1_t* sha1 = new_sha1();
+  if (sha1 == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // hash the content of the file, chunk by chunk
+  uint8_t buffer[KC_HTTP_BODY_CHUNK_SIZE];
+  int fd = fileno(file->file);
+  size_t offset = 0;
+
+  while (offset < info->size)
+  {
+    ssize_t len = pread(fd, buffer, sizeof(buffer), offset);
+    if (len < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (len <= 0)
+    {
+      destroy_sha1(sha1);
+      return KC_IO_ERROR;
+    }
+
+    sha1->digest(sha1, buffer, len);
+    offset += len;
+  }
+
+  uint8_t digest[KC_SHA1_LENGTH];
+  unsigned char hex[KC_SHA1_LENGTH * 2 + 1];
+
+  sha1->get_hash(sha1, digest);
+  sha1_to_string(digest, hex);
+  destroy_sha1(sha1);
+
+  struct kc_etag_t entry = { info->inode, info->modified, info->size, { 0 } };
+  sprintf(entry.etag, "\"%s\"", hex);
+  strcpy(etag, entry.etag);
+
+  pthread_mutex_lock(&etags_lock);
+  etags->set(etags, file->name, &entry, sizeof(struct kc_etag_t));
+  pthread_mutex_unlock(&etags_lock);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_file_t* _open_static_file(struct kc_static_route_t* route,
+    const char* url, struct kc_file_info_t* info)
+{
+  char relative[PATH_MAX];
+  if (_static_relative_path(route, url, relative) == false)
+  {
+    return NULL;
+  }
+
+  char path[PATH_MAX];
+  int path_len = snprintf(path, sizeof(path), "%s/%s", route->directory, relative);
+
+  if (path_len < 0 || (size_t)path_len >= sizeof(path))
+  {
+    return NULL;
+  }
+
+  char resolved[PATH_MAX];
+  if (realpath(path, resolved) == NULL)
+  {
+    return NULL;
+  }
+
+  // the resolved path must still be inside the directory
+  if (strncmp(resolved, route->directory, route->directory_len) != 0 ||
+      resolved[route->directory_len] != '/')
+  {
+    return NULL;
+  }
+
+  struct kc_file_t* file = new_file();
+  if (file == NULL)
+  {
+    return NULL;
+  }
+
+  if (file->open(file, resolved, KC_FILE_READ) != KC_SUCCESS ||
+      file->stat(file, info) != KC_SUCCESS || info->is_dir)
+  {
+    destroy_file(file);
+    return NULL;
+  }
+
+  return file;
 }
 
 //---------------------------------------------------------------------------//
 
-int start_server(struct kc_server_t* self)
+static bool _static_relative_path(struct kc_static_route_t* route, const char* url,
+    char relative[PATH_MAX])
 {
-  if (self == NULL)
-  {
-    log_error(KC_NULL_REFERENCE_LOG);
-    return KC_NULL_REFERENCE;
-  }
+  // the rest of the URL is the path inside the directory
+  const char* rest = url + route->prefix_len;
+  size_t rest_len = strlen(rest);
 
-  // bind the server socket to the IP address
-  int ret = bind(self->socket->fd, (struct sockaddr*)self->socket->addr, sizeof(*self->socket->addr));
-  if (ret != KC_SUCCESS)
+  // the longest name that can follow is "index.html"
+  if (rest_len + 11 >= PATH_MAX)
   {
-    logger->log(logger, KC_FATAL_LOG,
-      KC_NETWORK_ERROR, __FILE__, __LINE__, __func__);
-    return KC_NETWORK_ERROR;
+    return false;
   }
 
-  // start listening for connections
-  ret = listen(self->socket->fd, KC_SERVER_MAX_CONNECTIONS);
-  if (ret != KC_SUCCESS)
+  // a decoded NUL would end the path early
+  size_t relative_len = http_url_decode(relative, rest, rest_len);
+  if (strlen(relative) != relative_len)
   {
-    logger->log(logger, KC_FATAL_LOG,
-      KC_LOST_CONNECTION, __FILE__, __LINE__, __func__);
-    return KC_LOST_CONNECTION;
+    return false;
   }
 
-  printf("\nApplication listening on %s:%d ... \n\n", self->socket->ip, self->socket->port);
-
-  // separate the connections on different threads
-  while (1)
+  // no segment can climb out of the directory (the symbolic
+  // links that do are caught once the path is resolved)
+  for (char* segment = relative; segment != NULL; )
   {
-    // create a new socket for new connections
-    struct kc_socket_t socket;
-
-    // accept the connection for the new socket
-    int ret = _accept_connection(self->socket->fd, &socket);
-    if (ret != KC_SUCCESS)
+    if (strncmp(segment, "..", 2) == 0 && (segment[2] == '/' || segment[2] == '\0'))
     {
-      logger->log(logger, KC_FATAL_LOG,
-        ret, __FILE__, __LINE__, __func__);
-      return ret;
+      return false;
     }
 
-    struct kc_dispatch_info_t* info = malloc(sizeof(struct kc_dispatch_info_t));
-    info->server = self;
-    info->client_fd = socket.fd;
-
-    pthread_t id;
+    segment = strchr(segment, '/');
+    segment = (segment != NULL) ? segment + 1 : NULL;
+  }
 
-    // create a new thread to process the new connection
-    pthread_create(&id, NULL, &dispatch, (void*)info);
+  // the leading slash is the one after the prefix
+  if (relative[0] == '/')
+  {
+    memmove(relative, relative + 1, relative_len--);
   }
 
-  // first shutdown the connections
-  // then return the error, if any
-  shutdown(self->socket->fd, SHUT_RDWR);
+  // the directories are served by their index page
+  if (relative_len == 0 || relative[relative_len - 1] == '/')
+  {
+    strcpy(relative + relative_len, "index.html");
+  }
 
-  return KC_SUCCESS;
+  return true;
 }
 
 //---------------------------------------------------------------------------//
 
-int send_msg_server(int client_fd, struct kc_http_response_t* res)
+static struct kc_static_route_t* _find_static_route(const char* url)
 {
-  // the file descriptor must be greater then 1
-  if (client_fd <= 0)
-  {
-    return KC_INVALID_ARGUMENT;
-  }
+  struct kc_static_route_t* found = NULL;
 
-  // check if the response was generated
-  if (res == NULL)
+  // the longest prefix wins (ex: /assets/img over /assets)
+  for (int i = 0; i < static_routes_len; ++i)
   {
-    return KC_NULL_REFERENCE;
-  }
+    struct kc_static_route_t* route = &static_routes[i];
 
-  char* response = (char*)malloc(sizeof(char) * KC_HTTP_RESPONSE_MAX_SIZE);
-
-  sprintf(response, "%s %s\r\n", res->http_ver, res->status_code);
-  for (int i = 0; i < res->headers_len; ++i)
-  {
-    char* header = (char*)malloc(sizeof(char) * KC_HTTP_HEADER_MAX_SIZE);
-    sprintf(header, "%s: %s\r\n", res->headers[i]->key, res->headers[i]->val);
-    strcat(response, header);
+    if (strncmp(url, route->prefix, route->prefix_len) == 0 &&
+        (url[route->prefix_len] == '/' || url[route->prefix_len] == '\0') &&
+        (found == NULL || route->prefix_len > found->prefix_len))
+    {
+      found = route;
+    }
   }
 
-  strcat(response, "\r\n");
-  strcat(response, res->body);
-  strcat(response, "\r\n");
-
-  // send a HTTP response
-  send(client_fd, response, strlen(response), 0);
-
-  return KC_SERVER_SEND_MSG;
+  return found;
 }
 
 //---------------------------------------------------------------------------//
 
-void* dispatch(void* dispatch_information)
+static void _add_static_route(char* prefix, char* directory)
 {
-  char recv_buffer[KC_HTTP_REQUEST_MAX_SIZE];
-  struct kc_dispatch_info_t* dispatch_info = (struct kc_dispatch_info_t*)dispatch_information;
-
-  // receive the message from the connection
-  ssize_t recv_ret = recv(dispatch_info->client_fd, recv_buffer, KC_HTTP_REQUEST_MAX_SIZE, 0);
-  if (recv_ret <= KC_SUCCESS)
+  if (prefix == NULL || directory == NULL || prefix[0] != '/')
   {
-    close(dispatch_info->client_fd);
-    pthread_exit((void*)KC_INVALID);
+    log_fatal(KC_INVALID_ARGUMENT_LOG);
+    return;
   }
 
-  // null terminate the request data
-  recv_buffer[recv_ret] = '\0';
-
-  // parse the request buffer and generate the
-  // a new request structure to be used later
-  struct kc_http_request_t* req = new_request();
-  int ret = _parse_request(req, recv_buffer);
-  if (ret != KC_SUCCESS)
+  if (static_routes_len == KC_SERVER_STATIC_ROUTES_SIZE)
   {
-    log_error(kc_error_msg[ret + 1]);
-    close(dispatch_info->client_fd);
-    pthread_exit((void*)KC_INVALID);
+    log_fatal(KC_OVERFLOW_LOG);
+    return;
   }
 
-  // set the file descriptor of the client
-  req->client_fd = dispatch_info->client_fd;
-
-  // create the response structure with all
-  // the general headers to be used later
-  struct kc_http_response_t* res = new_response();
-  res->set_http_ver(res, KC_HTTP_1);
-  res->set_status_code(res, KC_HTTP_STATUS_200);
-
-  // TODO: add general headers
-  res->set_header(res, "Content-Type", "text/plain");
-
-  // search the callback
-  struct kc_endpoint_t* endpoint = NULL;
-  ret = endpoints->get(endpoints, req->url, (void*)&endpoint);
+  struct kc_static_route_t* route = &static_routes[static_routes_len];
 
-  // internal server error, return 500
-  if (ret != KC_SUCCESS && ret != KC_INVALID) // TODO: change KC_INVALID with KC_NOT_FOUND
+  // resolve the directory once, the files are checked against it
+  route->directory = realpath(directory, NULL);
+  if (route->directory == NULL)
   {
-    res->set_status_code(res, KC_HTTP_STATUS_500);
-    res->set_header(res, "Content-Type", "text/html");
-    res->set_body(res, "<h1>500 Internal server error</h1>\r\n");
-    send_msg_server(dispatch_info->client_fd, res);
+    log_fatal(KC_FILE_NOT_FOUND_LOG);
+    return;
   }
-  // page not found, return 404
-  else if (endpoint == NULL)
+
+  route->prefix = malloc(strlen(prefix) + 1);
+  if (route->prefix == NULL)
   {
-    res->set_status_code(res, KC_HTTP_STATUS_404);
-    res->set_header(res, "Content-Type", "text/html");
-    res->set_body(res, "<h1>404 Page Not Found</h1>\r\n");
-    send_msg_server(dispatch_info->client_fd, res);
+    log_fatal(KC_OUT_OF_MEMORY_LOG);
+    free(route->directory);
+    return;
   }
-  // bad request, return 400
-  else if (strcmp(endpoint->method, req->method) != 0)
+
+  strcpy(route->prefix, prefix);
+
+  // "/assets/" and "/assets" are the same prefix, "/" matches everything
+  route->prefix_len = strlen(prefix);
+  while (route->prefix_len > 0 && route->prefix[route->prefix_len - 1] == '/')
   {
-    res->set_status_code(res, KC_HTTP_STATUS_400);
-    res->set_header(res, "Content-Type", "text/html");
-    res->set_body(res, "<h1>400 Bad Request</h1>\r\n");
-    send_msg_server(dispatch_info->client_fd, res);
+    route->prefix[--route->prefix_len] = '\0';
   }
-  else
+
+  // the root directory resolves to "/", the files are joined with a slash
+  route->directory_len = strlen(route->directory);
+  if (route->directory_len == 1)
   {
-    endpoint->callback(dispatch_info->server, req, res);
+    route->directory[0] = '\0';
+    route->directory_len = 0;
   }
 
+  // the files are kept in memory once requested, until they change
+  route->cache = (route->directory_len > 0) ? new_asset_cache(route->directory) : NULL;
 
-  // close the socket
-  close(dispatch_info->client_fd);
+  // all the files of the directory are counted together (ex: "/assets/*")
+  char label[PATH_MAX];
+  snprintf(label, sizeof(label), "%s/*", route->prefix);
 
-  // free the request and response
-  destroy_request(req);
-  destroy_response(res);
+  route->metrics_route = metrics->add_route(metrics, KC_HTTP_METHOD_GET, label);
 
-  pthread_exit((void*)KC_SUCCESS);
+  ++static_routes_len;
 }
 
 //---------------------------------------------------------------------------//
 
-static int _accept_connection(int server_fd, struct kc_socket_t* socket)
+static void _add_metrics_endpoint(char* url)
 {
-  // create a new socket for the client
-  struct sockaddr_in client_addr;
-  int client_addr_size = sizeof(struct sockaddr_in);
+  _add_endpoint(KC_HTTP_METHOD_GET, url, _send_metrics);
+}
 
-  // accept the connection
-  int client_fd = accept(server_fd, (struct sockaddr*)&client_addr,
-    (socklen_t * restrict)&client_addr_size);
+//---------------------------------------------------------------------------//
 
-  // serialize the data
-  socket->addr = &client_addr;
-  socket->fd = client_fd;
+static int _send_metrics(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res)
+{
+  char*  text     = NULL;
+  size_t text_len = 0;
 
-  // make sure the connection was made succesfully
-  if (client_fd <= 0)
+  if (self->metrics->render(self->metrics, &text, &text_len) != KC_SUCCESS)
   {
-    return KC_INVALID;
+    _send_error(req->client_fd, res, KC_HTTP_INTERNAL_SERVER_ERROR,
+        "<h1>500 Internal server error</h1>\r\n");
+    return KC_SERVER_SEND_MSG;
   }
 
-  return KC_SUCCESS;
+  // the body is a copy of the text
+  res->set_header(res, KC_HTTP_HEADER_CONTENT_TYPE, "text/plain; version=0.0.4");
+  res->set_body(res, text);
+
+  free(text);
+
+  return self->send(req->client_fd, res);
 }
 
 //---------------------------------------------------------------------------//
@@ -468,10 +4810,17 @@ static void _add_endpoint(char* method, char* url, int (*callback)(struct kc_ser
   // create a new endpoint
   //endpoints[endpoints_len] = new_endpoint(method, url);
   struct kc_endpoint_t* endpoint = new_endpoint(method, url);
-  endpoint->callback = callback;
+  if (endpoint == NULL)
+  {
+    return;
+  }
+
+  endpoint->callback      = callback;
+  endpoint->metrics_route = metrics->add_route(metrics, method, url);
 
-  // map the endpoint
+  // map the endpoint, the map keeps a copy of it (and owns its strings)
   endpoints->set(endpoints, url, endpoint, sizeof(struct kc_endpoint_t));
+  free(endpoint);
 
   // init the endpoint' callback function
   //endpoints[endpoints_len]->callback = callback;
@@ -482,22 +4831,252 @@ static void _add_endpoint(char* method, char* url, int (*callback)(struct kc_ser
 
 //---------------------------------------------------------------------------//
 
-static int _parse_request(struct kc_http_request_t* req, char recv_buffer[KC_HTTP_REQUEST_MAX_SIZE])
+static void _add_endpoint_cache(char* url, int ttl, size_t max_size, char* headers)
+{
+  struct kc_endpoint_t* endpoint = NULL;
+
+  // only the GET routes can be cached, once they are added
+  if (url == NULL || endpoints->get(endpoints, url, (void**)&endpoint) != KC_SUCCESS ||
+      strcmp(endpoint->method, KC_HTTP_METHOD_GET) != 0)
+  {
+    log_fatal(KC_INVALID_ARGUMENT_LOG);
+    return;
+  }
+
+  if (endpoint->cache != NULL)
+  {
+    destroy_response_cache(endpoint->cache);
+  }
+
+  endpoint->cache = new_response_cache(ttl, max_size, headers);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _add_route_middleware(char* url, int (*middleware)(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res))
+{
+  struct kc_endpoint_t* endpoint = NULL;
+
+  // the route must be added first
+  if (url == NULL || middleware == NULL || endpoints->get(endpoints, url, (void**)&endpoint) != KC_SUCCESS ||
+      endpoint->middleware_len == KC_SERVER_MIDDLEWARE_SIZE)
+  {
+    log_fatal(KC_INVALID_ARGUMENT_LOG);
+    return;
+  }
+
+  endpoint->middleware[endpoint->middleware_len++] = middleware;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _add_blocking_endpoint(char* url)
+{
+  struct kc_endpoint_t* endpoint = NULL;
+
+  // the route must be added first, and it can't take the connection over
+  if (url == NULL || endpoints->get(endpoints, url, (void**)&endpoint) != KC_SUCCESS ||
+      endpoint->sse != NULL || endpoint->websocket.message != NULL)
+  {
+    log_fatal(KC_INVALID_ARGUMENT_LOG);
+    return;
+  }
+
+  endpoint->blocking = true;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _add_sse_endpoint(char* url, struct kc_sse_broadcaster_t* broadcaster)
+{
+  struct kc_endpoint_t* endpoint = NULL;
+
+  if (url == NULL || broadcaster == NULL)
+  {
+    log_fatal(KC_INVALID_ARGUMENT_LOG);
+    return;
+  }
+
+  _add_endpoint(KC_HTTP_METHOD_GET, url, _subscribe_sse);
+
+  // the map keeps a copy of the endpoint, the broadcaster is set on it
+  if (endpoints->get(endpoints, url, (void**)&endpoint) == KC_SUCCESS)
+  {
+    endpoint->sse = broadcaster;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int _subscribe_sse(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res)
+{
+  struct kc_endpoint_t* endpoint = NULL;
+
+  if (endpoints->get(endpoints, req->url, (void**)&endpoint) != KC_SUCCESS || endpoint->sse == NULL)
+  {
+    _send_error(req->client_fd, res, KC_HTTP_INTERNAL_SERVER_ERROR,
+        "<h1>500 Internal server error</h1>\r\n");
+    return KC_SERVER_SEND_MSG;
+  }
+
+  // the broadcaster writes to the socket, not to a stream of HTTP/2 (the
+  // client is told to come back in HTTP/1.1)
+  if (res->_h2 != NULL)
+  {
+    struct kc_connection_t* conn = (struct kc_connection_t*)res->_h2->data;
+    return conn->http2->reset(conn->http2, res->_h2, KC_HTTP2_HTTP_1_1_REQUIRED);
+  }
+
+  res->set_header(res, KC_HTTP_HEADER_CONTENT_TYPE, "text/event-stream");
+  res->set_header(res, "Cache-Control", "no-cache");
+
+  // the events are never chunked, the stream ends with the connection
+  res->_chunked = false;
+
+  int ret = res->begin_stream(res, req->client_fd);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  // the broadcaster keeps the socket open with a descriptor of its own, the
+  // server closes its descriptor once the handler returns (as for any stream
+  // that ends with the connection) and the socket is left to the broadcaster
+  int client_fd = dup(req->client_fd);
+  if (client_fd < 0)
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+    return KC_SYSTEM_ERROR;
+  }
+
+  return endpoint->sse->subscribe(endpoint->sse, client_fd);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _add_websocket_endpoint(char* url, struct kc_websocket_handler_t handler)
+{
+  struct kc_endpoint_t* endpoint = NULL;
+
+  if (url == NULL || handler.message == NULL)
+  {
+    log_fatal(KC_INVALID_ARGUMENT_LOG);
+    return;
+  }
+
+  _add_endpoint(KC_HTTP_METHOD_GET, url, _upgrade_websocket);
+
+  // the map keeps a copy of the endpoint, the handler is set on it
+  if (endpoints->get(endpoints, url, (void**)&endpoint) == KC_SUCCESS)
+  {
+    endpoint->websocket = handler;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int _upgrade_websocket(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res)
 {
-  // mark the end of the header section and the body section
-  int buffer_len = strlen(recv_buffer);
-  for (int i = 0; i < buffer_len - 2; ++i)
+  struct kc_endpoint_t* endpoint = NULL;
+
+  if (endpoints->get(endpoints, req->url, (void**)&endpoint) != KC_SUCCESS ||
+      endpoint->websocket.message == NULL || serving == NULL)
+  {
+    _send_error(req->client_fd, res, KC_HTTP_INTERNAL_SERVER_ERROR,
+        "<h1>500 Internal server error</h1>\r\n");
+    return KC_SERVER_SEND_MSG;
+  }
+
+  char* upgrade    = req->get_header(req, "Upgrade");
+  char* connection = req->get_header(req, KC_HTTP_HEADER_CONNECTION);
+  char* key        = req->get_header(req, "Sec-WebSocket-Key");
+  char* version    = req->get_header(req, "Sec-WebSocket-Version");
+
+  // only the clients that ask for it are upgraded (the key is 16 bytes
+  // in Base64), and not while the server is stopping
+  if (upgrade == NULL || strcasecmp(upgrade, "websocket") != 0 || connection == NULL ||
+      _has_token(connection, "upgrade") == false || key == NULL || strlen(key) != 24 ||
+      strcmp(req->http_ver, KC_HTTP_1) != 0 || __atomic_load_n(&self->_stopping, __ATOMIC_RELAXED))
+  {
+    _send_error(req->client_fd, res, KC_HTTP_BAD_REQUEST,
+        "<h1>400 Bad Request</h1>\r\n");
+    return KC_SERVER_SEND_MSG;
+  }
+
+  // the client is told the version that is spoken
+  if (version == NULL || strcmp(version, "13") != 0)
+  {
+    res->set_header(res, "Sec-WebSocket-Version", "13");
+    _send_error(req->client_fd, res, KC_HTTP_UPGRADE_REQUIRED,
+        "<h1>426 Upgrade Required</h1>\r\n");
+    return KC_SERVER_SEND_MSG;
+  }
+
+  char accept[KC_WEBSOCKET_ACCEPT_SIZE];
+
+  struct kc_websocket_t* websocket = new_websocket(req->client_fd, endpoint->websocket);
+  if (websocket == NULL || kc_websocket_accept(key, accept) != KC_SUCCESS)
   {
-    if (recv_buffer[i] == '\n' && recv_buffer[i + 1] == '\n')
+    if (websocket != NULL)
     {
-      recv_buffer[i + 1] = '|';
+      websocket->state = KC_WEBSOCKET_CLOSED;
+      destroy_websocket(websocket);
     }
+
+    _send_error(req->client_fd, res, KC_HTTP_INTERNAL_SERVER_ERROR,
+        "<h1>500 Internal server error</h1>\r\n");
+    return KC_SERVER_SEND_MSG;
+  }
+
+  res->status = KC_HTTP_SWITCHING_PROTOCOLS;
+  res->set_header(res, "Upgrade", "websocket");
+  res->set_header(res, KC_HTTP_HEADER_CONNECTION, "Upgrade");
+  res->set_header(res, "Sec-WebSocket-Accept", accept);
+
+  int ret = self->send(req->client_fd, res);
+  if (ret != KC_SERVER_SEND_MSG)
+  {
+    websocket->state = KC_WEBSOCKET_CLOSED;
+    destroy_websocket(websocket);
+    return ret;
+  }
+
+  // the connection is handed over (a drain looks for it under the lock),
+  // the frames are received by its loop once the handler returns
+  pthread_mutex_lock(&self->_lock);
+  serving->websocket = websocket;
+  pthread_mutex_unlock(&self->_lock);
+
+  if (websocket->handler.opened != NULL)
+  {
+    websocket->handler.opened(websocket);
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _parse_request(struct kc_http_request_t* req, char recv_buffer[KC_HTTP_REQUEST_MAX_SIZE], size_t recv_len)
+{
+  // the header section ends with an empty line
+  char* headers_end = strstr(recv_buffer, "\r\n\r\n");
+  if (headers_end == NULL)
+  {
+    return KC_FORMAT_ERROR;
   }
 
-  // separate the request data
-  char* request_line     = strtok(recv_buffer, "\r\n");
-  char* request_headers  = strtok(NULL, "|");
-  char* request_body     = strtok(NULL, "|");
+  // the request line is the first line (it can also be the only one)
+  char* line_end = strstr(recv_buffer, "\r\n");
+
+  // separate the request data in place, the headers keep
+  // the last CRLF so that every header line ends the same
+  char* request_line     = recv_buffer;
+  char* request_headers  = line_end + 2;
+  char* request_body     = headers_end + 4;
+
+  headers_end[2] = '\0';
+  line_end[0]    = '\0';
 
   int ret = KC_SUCCESS;
 
@@ -508,21 +5087,52 @@ static int _parse_request(struct kc_http_request_t* req, char recv_buffer[KC_HTT
     return ret;
   }
 
-  // parse the headers
+  // locate the headers, they are parsed only on demand
   ret = http_parse_request_headers(request_headers, req);
   if (ret != KC_SUCCESS)
   {
     return ret;
   }
 
+  // the rest of the body is read from the socket only when the
+  // handler asks for it (see read_body), chunk by chunk
+  char* content_length = req->get_header(req, "Content-Length");
+  if (content_length != NULL)
+  {
+    size_t body_len  = strtoull(content_length, NULL, 10);
+    size_t available = recv_len - (request_body - recv_buffer);
+
+    req->_body_buffered     = request_body;
+    req->_body_buffered_len = (available < body_len) ? available : body_len;
+    req->_body_left         = body_len - req->_body_buffered_len;
+  }
+
   // parse the body only if the method has a body
   if (strcmp(req->method, KC_HTTP_METHOD_GET) == 0)
   {
     return KC_SUCCESS;
   }
 
+  // the forms and the uploads are only streamed, never copied
+  char* content_type = req->get_header(req, "Content-Type");
+  if (content_type != NULL &&
+      (http_parse_content_type(content_type) == KC_BODY_CONTENT_TYPE_FORM ||
+      http_parse_content_type(content_type) == KC_BODY_CONTENT_TYPE_MULTIPART))
+  {
+    return KC_SUCCESS;
+  }
+
+  // the next request may follow the body in the buffer, so the body
+  // is ended for the copy and the byte after it restored right after
+  char* body_end = request_body + req->_body_buffered_len;
+  char  saved    = *body_end;
+  *body_end = '\0';
+
   // TODO: get the Content-Type from the headers and pass it to the parse fun
   ret = http_parse_request_body(request_body, req);
+
+  *body_end = saved;
+
   if (ret != KC_SUCCESS)
   {
     return ret;
@@ -571,6 +5181,17 @@ static struct kc_endpoint_t* new_endpoint(char* method, char* url)
   strcpy(new_endpoint->method, method);
   strcpy(new_endpoint->url, url);
 
+  new_endpoint->cache = NULL;
+  new_endpoint->sse   = NULL;
+
+  memset(&new_endpoint->websocket, 0, sizeof(struct kc_websocket_handler_t));
+
+  new_endpoint->blocking = false;
+
+  new_endpoint->middleware_len = 0;
+  new_endpoint->chain          = NULL;
+  new_endpoint->chain_len      = 0;
+
   return new_endpoint;
 }
 
@@ -593,7 +5214,14 @@ static void destroy_endpoint(struct kc_endpoint_t* endpoint)
     free(endpoint->url);
   }
 
-  free(endpoint);
+  if (endpoint->cache != NULL)
+  {
+    destroy_response_cache(endpoint->cache);
+  }
+
+  free(endpoint->chain);
+
+  // the endpoint itself is a copy kept (and freed) by the map
 }
 
 //---------------------------------------------------------------------------//
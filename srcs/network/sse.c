@@ -0,0 +1,639 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// sse.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/sse.h"
+#include "../../hdrs/system/clock.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// the most events of a client sent with a single call
+#define KC_SSE_IOVEC_SIZE                                                    16
+
+// the most sockets handled by the writer at once
+#define KC_SSE_EVENTS                                                        64
+
+//---------------------------------------------------------------------------//
+
+// an event, serialized once for all the clients
+struct kc_sse_event_t
+{
+  int    refs;  // the publisher holds one, every client that queued it another
+  size_t len;
+  char   data[];
+};
+
+struct kc_sse_client_t
+{
+  int  fd;
+  bool writing;  // waits for the socket to take more
+  bool closed;
+
+  // the events not sent yet, the first one from the offset on
+  struct kc_sse_event_t** queue;
+  size_t                  head;
+  size_t                  len;
+  size_t                  offset;
+
+  struct kc_sse_client_t* prev;
+  struct kc_sse_client_t* next;
+};
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int subscribe_sse_broadcaster  (struct kc_sse_broadcaster_t* self, int client_fd);
+static int publish_sse_broadcaster    (struct kc_sse_broadcaster_t* self, const char* event, const char* data, const char* id);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static struct kc_sse_event_t* _new_event  (const char* event, const char* data, const char* id);
+static void  _release_event   (struct kc_sse_event_t* event);
+static void  _broadcast       (struct kc_sse_broadcaster_t* self, struct kc_sse_event_t* event);
+static void  _flush           (struct kc_sse_broadcaster_t* self, struct kc_sse_client_t* client);
+static void  _watch_writable  (struct kc_sse_broadcaster_t* self, struct kc_sse_client_t* client, bool writable);
+static void  _close_client    (struct kc_sse_broadcaster_t* self, struct kc_sse_client_t* client);
+static void  _free_closed     (struct kc_sse_broadcaster_t* self);
+static void* _write_events    (void* broadcaster);
+
+//---------------------------------------------------------------------------//
+
+struct kc_sse_broadcaster_t* new_sse_broadcaster(int policy, size_t queue_size)
+{
+  if ((policy != KC_SSE_DROP && policy != KC_SSE_DISCONNECT) || queue_size == 0)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
+  // create a broadcaster instance to be returned
+  struct kc_sse_broadcaster_t* new_broadcaster = malloc(sizeof(struct kc_sse_broadcaster_t));
+
+  // confirm that there is memory to allocate
+  if (new_broadcaster == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  memset(new_broadcaster, 0, sizeof(struct kc_sse_broadcaster_t));
+
+  new_broadcaster->policy      = policy;
+  new_broadcaster->queue_size  = queue_size;
+  new_broadcaster->heartbeat   = KC_SSE_HEARTBEAT;
+  new_broadcaster->_stop_fds[0] = -1;
+  new_broadcaster->_stop_fds[1] = -1;
+
+  pthread_mutex_init(&new_broadcaster->_lock, NULL);
+
+  // the writer waits on the sockets of the clients, and on the stop pipe
+  new_broadcaster->_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  struct epoll_event stop;
+  memset(&stop, 0, sizeof(struct epoll_event));
+
+  stop.events   = EPOLLIN;
+  stop.data.ptr = new_broadcaster->_stop_fds;
+
+  if (new_broadcaster->_epoll_fd < 0 || pipe(new_broadcaster->_stop_fds) != 0 ||
+      epoll_ctl(new_broadcaster->_epoll_fd, EPOLL_CTL_ADD, new_broadcaster->_stop_fds[0], &stop) != 0)
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+    destroy_sse_broadcaster(new_broadcaster);
+    return NULL;
+  }
+
+  if (pthread_create(&new_broadcaster->_writer, NULL, _write_events, new_broadcaster) != 0)
+  {
+    log_error(KC_THREAD_ERROR_LOG);
+    destroy_sse_broadcaster(new_broadcaster);
+    return NULL;
+  }
+
+  // assigns the public member methods
+  new_broadcaster->subscribe = subscribe_sse_broadcaster;
+  new_broadcaster->publish   = publish_sse_broadcaster;
+
+  return new_broadcaster;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_sse_broadcaster(struct kc_sse_broadcaster_t* broadcaster)
+{
+  if (broadcaster == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // wake up the writer and wait for it to stop
+  if (broadcaster->_writer != 0)
+  {
+    char stop = 1;
+    while (write(broadcaster->_stop_fds[1], &stop, 1) < 0 && errno == EINTR);
+
+    pthread_join(broadcaster->_writer, NULL);
+  }
+
+  // the subscribers see their connections closed
+  while (broadcaster->_clients != NULL)
+  {
+    _close_client(broadcaster, broadcaster->_clients);
+  }
+
+  _free_closed(broadcaster);
+
+  if (broadcaster->_epoll_fd >= 0)
+  {
+    close(broadcaster->_epoll_fd);
+  }
+
+  for (int i = 0; i < 2; ++i)
+  {
+    if (broadcaster->_stop_fds[i] >= 0)
+    {
+      close(broadcaster->_stop_fds[i]);
+    }
+  }
+
+  pthread_mutex_destroy(&broadcaster->_lock);
+  free(broadcaster);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int subscribe_sse_broadcaster(struct kc_sse_broadcaster_t* self, int client_fd)
+{
+  if (self == NULL || client_fd < 0)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+
+    if (client_fd >= 0)
+    {
+      close(client_fd);
+    }
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct kc_sse_client_t* client = calloc(1, sizeof(struct kc_sse_client_t));
+  if (client != NULL)
+  {
+    client->queue = calloc(self->queue_size, sizeof(struct kc_sse_event_t*));
+  }
+
+  if (client == NULL || client->queue == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+
+    free(client);
+    close(client_fd);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // a slow client must never hold up the others
+  fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+  client->fd = client_fd;
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+
+  // the client is not expected to send anything, only to leave
+  event.events   = EPOLLIN | EPOLLRDHUP;
+  event.data.ptr = client;
+
+  pthread_mutex_lock(&self->_lock);
+
+  if (epoll_ctl(self->_epoll_fd, EPOLL_CTL_ADD, client_fd, &event) != 0)
+  {
+    pthread_mutex_unlock(&self->_lock);
+    log_error(KC_SYSTEM_ERROR_LOG);
+
+    free(client->queue);
+    free(client);
+    close(client_fd);
+
+    return KC_SYSTEM_ERROR;
+  }
+
+  client->next = self->_clients;
+
+  if (self->_clients != NULL)
+  {
+    self->_clients->prev = client;
+  }
+
+  self->_clients = client;
+  __atomic_add_fetch(&self->subscribers, 1, __ATOMIC_RELAXED);
+
+  pthread_mutex_unlock(&self->_lock);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int publish_sse_broadcaster(struct kc_sse_broadcaster_t* self, const char* event, const char* data, const char* id)
+{
+  if (self == NULL || data == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // a line break would end the field early
+  if ((event != NULL && strpbrk(event, "\r\n") != NULL) || (id != NULL && strpbrk(id, "\r\n") != NULL))
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  struct kc_sse_event_t* serialized = _new_event(event, data, id);
+  if (serialized == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  pthread_mutex_lock(&self->_lock);
+
+  _broadcast(self, serialized);
+  _release_event(serialized);
+
+  pthread_mutex_unlock(&self->_lock);
+
+  return KC_SUCCESS;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static struct kc_sse_event_t* _new_event(const char* event, const char* data, const char* id)
+{
+  size_t data_len = strlen(data);
+  size_t lines = 1;
+
+  // a CRLF is a single line break, a lone CR or LF another
+  for (size_t i = 0; i < data_len; ++i)
+  {
+    if (data[i] == '\n' || (data[i] == '\r' && data[i + 1] != '\n'))
+    {
+      lines++;
+    }
+  }
+
+  // "id: ...\n", "event: ...\n", "data: ...\n" for every line, and "\n"
+  size_t size = data_len + (lines * 7) + 2 +
+      ((id != NULL) ? strlen(id) + 5 : 0) + ((event != NULL) ? strlen(event) + 8 : 0);
+
+  struct kc_sse_event_t* serialized = malloc(sizeof(struct kc_sse_event_t) + size);
+  if (serialized == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  char* out = serialized->data;
+
+  if (id != NULL)
+  {
+    out += sprintf(out, "id: %s\n", id);
+  }
+
+  if (event != NULL)
+  {
+    out += sprintf(out, "event: %s\n", event);
+  }
+
+  for (const char* line = data; ; )
+  {
+    size_t line_len = strcspn(line, "\r\n");
+
+    memcpy(out, "data: ", 6);
+    memcpy(out + 6, line, line_len);
+    out += 6 + line_len;
+    *out++ = '\n';
+
+    line += line_len;
+    if (*line == '\0')
+    {
+      break;
+    }
+
+    line += (line[0] == '\r' && line[1] == '\n') ? 2 : 1;
+  }
+
+  // the empty line dispatches the event
+  *out++ = '\n';
+
+  serialized->refs = 1;
+  serialized->len  = out - serialized->data;
+
+  return serialized;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _release_event(struct kc_sse_event_t* event)
+{
+  // the references are taken and released under the lock of the broadcaster
+  if (--event->refs == 0)
+  {
+    free(event);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _broadcast(struct kc_sse_broadcaster_t* self, struct kc_sse_event_t* event)
+{
+  struct kc_sse_client_t* next = NULL;
+
+  for (struct kc_sse_client_t* client = self->_clients; client != NULL; client = next)
+  {
+    // the client can be closed on the way
+    next = client->next;
+
+    if (client->len == self->queue_size)
+    {
+      if (self->policy == KC_SSE_DROP)
+      {
+        __atomic_add_fetch(&self->dropped, 1, __ATOMIC_RELAXED);
+      }
+      else
+      {
+        __atomic_add_fetch(&self->disconnected, 1, __ATOMIC_RELAXED);
+        _close_client(self, client);
+      }
+
+      continue;
+    }
+
+    // the client keeps only a reference to the shared buffer
+    client->queue[(client->head + client->len) % self->queue_size] = event;
+    client->len++;
+    event->refs++;
+
+    // the clients that keep up get the event right away
+    if (client->writing == false)
+    {
+      _flush(self, client);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _flush(struct kc_sse_broadcaster_t* self, struct kc_sse_client_t* client)
+{
+  while (client->len > 0)
+  {
+    struct iovec iov[KC_SSE_IOVEC_SIZE];
+    int iov_len = 0;
+
+    for (size_t i = 0; i < client->len && iov_len < KC_SSE_IOVEC_SIZE; ++i)
+    {
+      struct kc_sse_event_t* event = client->queue[(client->head + i) % self->queue_size];
+      size_t offset = (i == 0) ? client->offset : 0;
+
+      iov[iov_len++] = (struct iovec){ event->data + offset, event->len - offset };
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(struct msghdr));
+
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = iov_len;
+
+    // a closed connection must not kill the process with SIGPIPE
+    ssize_t sent = sendmsg(client->fd, &msg, MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      // the rest is sent by the writer, once the socket takes more
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        if (client->writing == false)
+        {
+          _watch_writable(self, client, true);
+        }
+
+        return;
+      }
+
+      _close_client(self, client);
+      return;
+    }
+
+    // the events sent whole are let go
+    size_t left = (size_t)sent;
+
+    while (left > 0)
+    {
+      struct kc_sse_event_t* event = client->queue[client->head];
+      size_t rest = event->len - client->offset;
+
+      if (left < rest)
+      {
+        client->offset += left;
+        break;
+      }
+
+      left -= rest;
+
+      client->offset = 0;
+      client->head   = (client->head + 1) % self->queue_size;
+      client->len--;
+
+      _release_event(event);
+    }
+  }
+
+  if (client->writing)
+  {
+    _watch_writable(self, client, false);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void _watch_writable(struct kc_sse_broadcaster_t* self, struct kc_sse_client_t* client, bool writable)
+{
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+
+  event.events   = EPOLLIN | EPOLLRDHUP | (writable ? EPOLLOUT : 0);
+  event.data.ptr = client;
+
+  epoll_ctl(self->_epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+  client->writing = writable;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _close_client(struct kc_sse_broadcaster_t* self, struct kc_sse_client_t* client)
+{
+  epoll_ctl(self->_epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+  close(client->fd);
+
+  for (; client->len > 0; client->len--)
+  {
+    _release_event(client->queue[client->head]);
+    client->head = (client->head + 1) % self->queue_size;
+  }
+
+  if (client->prev != NULL)
+  {
+    client->prev->next = client->next;
+  }
+  else
+  {
+    self->_clients = client->next;
+  }
+
+  if (client->next != NULL)
+  {
+    client->next->prev = client->prev;
+  }
+
+  // the writer can still have an event of the client in hand, so it's
+  // freed only between two waits
+  client->closed = true;
+  client->next   = self->_closed;
+  self->_closed  = client;
+
+  __atomic_sub_fetch(&self->subscribers, 1, __ATOMIC_RELAXED);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _free_closed(struct kc_sse_broadcaster_t* self)
+{
+  while (self->_closed != NULL)
+  {
+    struct kc_sse_client_t* client = self->_closed;
+    self->_closed = client->next;
+
+    free(client->queue);
+    free(client);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void* _write_events(void* broadcaster)
+{
+  struct kc_sse_broadcaster_t* self = (struct kc_sse_broadcaster_t*)broadcaster;
+  struct epoll_event events[KC_SSE_EVENTS];
+
+  uint64_t next_beat = kc_clock_monotonic_ms() + self->heartbeat;
+  bool stopped = false;
+
+  while (stopped == false)
+  {
+    // wake up for the next keep-alive comment (if any)
+    int timeout = -1;
+    if (self->heartbeat > 0)
+    {
+      uint64_t now = kc_clock_monotonic_ms();
+      timeout = (next_beat > now) ? (int)(next_beat - now) : 0;
+    }
+
+    int len = epoll_wait(self->_epoll_fd, events, KC_SSE_EVENTS, timeout);
+    if (len < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      log_error(KC_SYSTEM_ERROR_LOG);
+      break;
+    }
+
+    pthread_mutex_lock(&self->_lock);
+
+    for (int i = 0; i < len; ++i)
+    {
+      if (events[i].data.ptr == self->_stop_fds)
+      {
+        stopped = true;
+        continue;
+      }
+
+      struct kc_sse_client_t* client = (struct kc_sse_client_t*)events[i].data.ptr;
+
+      // closed by an earlier event, or by a publisher meanwhile
+      if (client->closed)
+      {
+        continue;
+      }
+
+      if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+      {
+        _close_client(self, client);
+        continue;
+      }
+
+      // whatever the client sends is dropped, until it leaves
+      if (events[i].events & EPOLLIN)
+      {
+        char discard[512];
+        ssize_t ret = recv(client->fd, discard, sizeof(discard), MSG_DONTWAIT);
+
+        if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+          _close_client(self, client);
+          continue;
+        }
+      }
+
+      if (events[i].events & EPOLLOUT)
+      {
+        _flush(self, client);
+      }
+    }
+
+    // a comment is ignored by the clients, but it keeps the connection alive
+    if (self->heartbeat > 0 && kc_clock_monotonic_ms() >= next_beat)
+    {
+      struct kc_sse_event_t* comment = malloc(sizeof(struct kc_sse_event_t) + 3);
+
+      if (comment != NULL)
+      {
+        comment->refs = 1;
+        comment->len  = 3;
+        memcpy(comment->data, ":\n\n", 3);
+
+        _broadcast(self, comment);
+        _release_event(comment);
+      }
+
+      next_beat = kc_clock_monotonic_ms() + self->heartbeat;
+    }
+
+    _free_closed(self);
+
+    pthread_mutex_unlock(&self->_lock);
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,825 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// websocket.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/network/websocket.h"
+#include "../../hdrs/security/base64.h"
+#include "../../hdrs/security/sha1.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int receive_websocket  (struct kc_websocket_t* self, char* data, size_t len);
+static int send_websocket     (struct kc_websocket_t* self, int opcode, const char* data, size_t len);
+static int ping_websocket     (struct kc_websocket_t* self, const char* data, size_t len);
+static int close_websocket    (struct kc_websocket_t* self, int code, const char* reason);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static size_t _header_size      (const uint8_t* header, size_t header_len);
+static int    _begin_frame      (struct kc_websocket_t* self);
+static int    _frame_payload    (struct kc_websocket_t* self, char* data, size_t len);
+static int    _end_frame        (struct kc_websocket_t* self);
+static int    _control_frame    (struct kc_websocket_t* self, int opcode, char* payload, size_t len);
+static int    _fail             (struct kc_websocket_t* self, int code);
+static int    _write_frame      (struct kc_websocket_t* self, int opcode, const char* data, size_t len);
+static bool   _valid_close_code (int code);
+static bool   _valid_utf8       (const char* data, size_t len);
+
+//---------------------------------------------------------------------------//
+
+struct kc_websocket_t* new_websocket(int client_fd, struct kc_websocket_handler_t handler)
+{
+  if (client_fd < 0 || handler.message == NULL)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
+  // create a websocket instance to be returned
+  struct kc_websocket_t* new_websocket = malloc(sizeof(struct kc_websocket_t));
+
+  // confirm that there is memory to allocate
+  if (new_websocket == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  memset(new_websocket, 0, sizeof(struct kc_websocket_t));
+
+  new_websocket->client_fd        = client_fd;
+  new_websocket->state            = KC_WEBSOCKET_OPEN;
+  new_websocket->max_message_size = KC_WEBSOCKET_MAX_MESSAGE_SIZE;
+  new_websocket->handler          = handler;
+
+  pthread_mutex_init(&new_websocket->_send_lock, NULL);
+
+  // assigns the public member methods
+  new_websocket->receive = receive_websocket;
+  new_websocket->send    = send_websocket;
+  new_websocket->ping    = ping_websocket;
+  new_websocket->close   = close_websocket;
+
+  return new_websocket;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_websocket(struct kc_websocket_t* websocket)
+{
+  if (websocket == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // the connection went away without a closing handshake
+  if (websocket->state != KC_WEBSOCKET_CLOSED)
+  {
+    __atomic_store_n(&websocket->state, KC_WEBSOCKET_CLOSED, __ATOMIC_RELEASE);
+
+    if (websocket->handler.closed != NULL)
+    {
+      websocket->handler.closed(websocket, KC_WEBSOCKET_ABNORMAL_CLOSURE);
+    }
+  }
+
+  pthread_mutex_destroy(&websocket->_send_lock);
+
+  free(websocket->_message);
+  free(websocket);
+}
+
+//---------------------------------------------------------------------------//
+
+int kc_websocket_accept(const char* key, char accept[KC_WEBSOCKET_ACCEPT_SIZE])
+{
+  if (key == NULL || accept == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct kc_sha1_t* sha1 = new_sha1();
+  if (sha1 == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // the Base64 SHA-1 of the key followed by the GUID
+  uint8_t digest[KC_SHA1_LENGTH];
+
+  sha1->digest(sha1, (const uint8_t*)key, strlen(key));
+  sha1->digest(sha1, (const uint8_t*)KC_WEBSOCKET_GUID, strlen(KC_WEBSOCKET_GUID));
+
+  int ret = sha1->get_hash(sha1, digest);
+  destroy_sha1(sha1);
+
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  char* encoded = NULL;
+
+  ret = kc_base64_encode((char*)digest, KC_SHA1_LENGTH, &encoded);
+  if (ret != KC_SUCCESS)
+  {
+    return ret;
+  }
+
+  snprintf(accept, KC_WEBSOCKET_ACCEPT_SIZE, "%s", encoded);
+  free(encoded);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+void kc_websocket_unmask(char* data, size_t len, const uint8_t mask[4], uint64_t offset)
+{
+  // the key starts where the payload was left, and repeats every 4 bytes
+  uint8_t key[16];
+  for (int i = 0; i < 16; ++i)
+  {
+    key[i] = mask[(offset + i) % 4];
+  }
+
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  // 16 bytes at a time
+  __m128i key_block = _mm_loadu_si128((const __m128i*)key);
+
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+    _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(block, key_block));
+  }
+#else
+  // 8 bytes at a time
+  uint64_t key_word;
+  memcpy(&key_word, key, sizeof(uint64_t));
+
+  for (; i + 8 <= len; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(uint64_t));
+
+    word ^= key_word;
+    memcpy(data + i, &word, sizeof(uint64_t));
+  }
+#endif
+
+  for (; i < len; ++i)
+  {
+    data[i] ^= key[i % 4];
+  }
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int receive_websocket(struct kc_websocket_t* self, char* data, size_t len)
+{
+  if (self == NULL || (data == NULL && len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  size_t used = 0;
+
+  while (used < len)
+  {
+    if (__atomic_load_n(&self->state, __ATOMIC_ACQUIRE) == KC_WEBSOCKET_CLOSED)
+    {
+      return KC_LOST_CONNECTION;
+    }
+
+    // the header first, its size is known from its first 2 bytes
+    size_t header_size = _header_size(self->_header, self->_header_len);
+    if (self->_header_len < header_size)
+    {
+      size_t take = header_size - self->_header_len;
+      if (take > len - used)
+      {
+        take = len - used;
+      }
+
+      memcpy(self->_header + self->_header_len, data + used, take);
+      self->_header_len += take;
+      used += take;
+
+      if (self->_header_len < _header_size(self->_header, self->_header_len))
+      {
+        continue;
+      }
+
+      int ret = _begin_frame(self);
+      if (ret != KC_SUCCESS)
+      {
+        return ret;
+      }
+    }
+
+    // then the payload (there can be none)
+    uint64_t left = self->_payload_len - self->_payload_read;
+    size_t take = (left < len - used) ? (size_t)left : len - used;
+
+    int ret = _frame_payload(self, data + used, take);
+    if (ret != KC_SUCCESS)
+    {
+      return ret;
+    }
+
+    used += take;
+
+    if (self->_payload_read == self->_payload_len)
+    {
+      self->_header_len = 0;
+
+      ret = _end_frame(self);
+      if (ret != KC_SUCCESS)
+      {
+        return ret;
+      }
+    }
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int send_websocket(struct kc_websocket_t* self, int opcode, const char* data, size_t len)
+{
+  if (self == NULL || (data == NULL && len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (opcode != KC_WEBSOCKET_TEXT && opcode != KC_WEBSOCKET_BINARY)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  pthread_mutex_lock(&self->_send_lock);
+
+  int ret = (self->state == KC_WEBSOCKET_OPEN) ?
+      _write_frame(self, opcode, data, len) : KC_INVALID_OPERATION;
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int ping_websocket(struct kc_websocket_t* self, const char* data, size_t len)
+{
+  if (self == NULL || (data == NULL && len > 0))
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (len > KC_WEBSOCKET_CONTROL_SIZE)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  pthread_mutex_lock(&self->_send_lock);
+
+  int ret = (self->state == KC_WEBSOCKET_OPEN) ?
+      _write_frame(self, KC_WEBSOCKET_PING, data, len) : KC_INVALID_OPERATION;
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int close_websocket(struct kc_websocket_t* self, int code, const char* reason)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // the code takes 2 bytes of the payload, the reason the rest
+  size_t reason_len = (reason != NULL) ? strlen(reason) : 0;
+
+  if (_valid_close_code(code) == false || reason_len > KC_WEBSOCKET_CONTROL_SIZE - 2)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return KC_INVALID_ARGUMENT;
+  }
+
+  char payload[KC_WEBSOCKET_CONTROL_SIZE];
+
+  payload[0] = (char)(code >> 8);
+  payload[1] = (char)(code & 0xFF);
+  memcpy(payload + 2, reason, reason_len);
+
+  pthread_mutex_lock(&self->_send_lock);
+
+  if (self->state != KC_WEBSOCKET_OPEN)
+  {
+    pthread_mutex_unlock(&self->_send_lock);
+    return KC_INVALID_OPERATION;
+  }
+
+  // the connection is closed once the client answers
+  int ret = _write_frame(self, KC_WEBSOCKET_CLOSE, payload, reason_len + 2);
+  __atomic_store_n(&self->state, KC_WEBSOCKET_CLOSING, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  return ret;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static size_t _header_size(const uint8_t* header, size_t header_len)
+{
+  if (header_len < 2)
+  {
+    return 2;
+  }
+
+  // the extended length (if any) and the masking key
+  uint8_t len = header[1] & 0x7F;
+
+  return 2 + ((len == 126) ? 2 : (len == 127) ? 8 : 0) + ((header[1] & 0x80) ? 4 : 0);
+}
+
+//---------------------------------------------------------------------------//
+
+static int _begin_frame(struct kc_websocket_t* self)
+{
+  const uint8_t* header = self->_header;
+
+  bool fin    = (header[0] & 0x80) != 0;
+  int  opcode = header[0] & 0x0F;
+
+  // no extension was agreed on, and the clients always mask their frames
+  if ((header[0] & 0x70) != 0 || (header[1] & 0x80) == 0)
+  {
+    return _fail(self, KC_WEBSOCKET_PROTOCOL_ERROR);
+  }
+
+  uint64_t payload_len = header[1] & 0x7F;
+
+  if (payload_len == 126)
+  {
+    payload_len = ((uint64_t)header[2] << 8) | header[3];
+  }
+  else if (payload_len == 127)
+  {
+    payload_len = 0;
+
+    for (int i = 2; i < 10; ++i)
+    {
+      payload_len = (payload_len << 8) | header[i];
+    }
+
+    // the most significant bit must be 0
+    if (payload_len >> 63)
+    {
+      return _fail(self, KC_WEBSOCKET_PROTOCOL_ERROR);
+    }
+  }
+
+  // the control frames can come between the fragments of a message, but
+  // they are never fragmented themselves
+  if (opcode >= KC_WEBSOCKET_CLOSE)
+  {
+    if (fin == false || opcode > KC_WEBSOCKET_PONG || payload_len > KC_WEBSOCKET_CONTROL_SIZE)
+    {
+      return _fail(self, KC_WEBSOCKET_PROTOCOL_ERROR);
+    }
+  }
+  else if (opcode == KC_WEBSOCKET_CONTINUATION)
+  {
+    if (self->_opcode == 0)
+    {
+      return _fail(self, KC_WEBSOCKET_PROTOCOL_ERROR);
+    }
+  }
+  else if (opcode == KC_WEBSOCKET_TEXT || opcode == KC_WEBSOCKET_BINARY)
+  {
+    if (self->_opcode != 0)
+    {
+      return _fail(self, KC_WEBSOCKET_PROTOCOL_ERROR);
+    }
+
+    self->_opcode = opcode;
+  }
+  else
+  {
+    return _fail(self, KC_WEBSOCKET_PROTOCOL_ERROR);
+  }
+
+  if (opcode < KC_WEBSOCKET_CLOSE && self->_message_len + payload_len > self->max_message_size)
+  {
+    return _fail(self, KC_WEBSOCKET_MESSAGE_TOO_BIG);
+  }
+
+  self->_payload_len  = payload_len;
+  self->_payload_read = 0;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _frame_payload(struct kc_websocket_t* self, char* data, size_t len)
+{
+  // the masking key ends the header
+  const uint8_t* mask = self->_header + _header_size(self->_header, self->_header_len) - 4;
+
+  bool fin    = (self->_header[0] & 0x80) != 0;
+  int  opcode = self->_header[0] & 0x0F;
+
+  kc_websocket_unmask(data, len, mask, self->_payload_read);
+
+  if (opcode >= KC_WEBSOCKET_CLOSE)
+  {
+    memcpy(self->_control + self->_payload_read, data, len);
+  }
+  // a message that came whole is used from where it is, without a copy
+  else if (fin && self->_message_len == 0 && self->_payload_read == 0 && len == self->_payload_len)
+  {
+    self->_direct = data;
+  }
+  else
+  {
+    // the rest of the frame is made room for at once
+    size_t needed = self->_message_len + (size_t)(self->_payload_len - self->_payload_read);
+
+    if (needed > self->_message_cap)
+    {
+      size_t cap = (self->_message_cap * 2 > needed) ? self->_message_cap * 2 : needed;
+
+      char* message = realloc(self->_message, cap);
+      if (message == NULL)
+      {
+        log_error(KC_OUT_OF_MEMORY_LOG);
+        return _fail(self, KC_WEBSOCKET_INTERNAL_ERROR);
+      }
+
+      self->_message     = message;
+      self->_message_cap = cap;
+    }
+
+    memcpy(self->_message + self->_message_len, data, len);
+    self->_message_len += len;
+  }
+
+  self->_payload_read += len;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _end_frame(struct kc_websocket_t* self)
+{
+  bool fin    = (self->_header[0] & 0x80) != 0;
+  int  opcode = self->_header[0] & 0x0F;
+
+  if (opcode >= KC_WEBSOCKET_CLOSE)
+  {
+    return _control_frame(self, opcode, self->_control, (size_t)self->_payload_len);
+  }
+
+  // the next fragment follows
+  if (fin == false)
+  {
+    return KC_SUCCESS;
+  }
+
+  char*  message     = (self->_direct != NULL) ? self->_direct : self->_message;
+  size_t message_len = (self->_direct != NULL) ? (size_t)self->_payload_len : self->_message_len;
+  int    message_opcode = self->_opcode;
+
+  self->_opcode      = 0;
+  self->_message_len = 0;
+  self->_direct      = NULL;
+
+  if (message_opcode == KC_WEBSOCKET_TEXT && _valid_utf8(message, message_len) == false)
+  {
+    return _fail(self, KC_WEBSOCKET_INVALID_DATA);
+  }
+
+  // the messages that come after a close are not for the handler anymore
+  if (__atomic_load_n(&self->state, __ATOMIC_ACQUIRE) == KC_WEBSOCKET_OPEN)
+  {
+    self->handler.message(self, message_opcode, message, message_len);
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _control_frame(struct kc_websocket_t* self, int opcode, char* payload, size_t len)
+{
+  if (opcode == KC_WEBSOCKET_PONG)
+  {
+    return KC_SUCCESS;
+  }
+
+  if (opcode == KC_WEBSOCKET_PING)
+  {
+    pthread_mutex_lock(&self->_send_lock);
+
+    if (self->state == KC_WEBSOCKET_OPEN)
+    {
+      _write_frame(self, KC_WEBSOCKET_PONG, payload, len);
+    }
+
+    pthread_mutex_unlock(&self->_send_lock);
+
+    return KC_SUCCESS;
+  }
+
+  // a close has no payload, or a code and (maybe) a reason
+  int code = KC_WEBSOCKET_NO_STATUS;
+
+  if (len == 1)
+  {
+    return _fail(self, KC_WEBSOCKET_PROTOCOL_ERROR);
+  }
+
+  if (len >= 2)
+  {
+    code = ((uint8_t)payload[0] << 8) | (uint8_t)payload[1];
+
+    if (_valid_close_code(code) == false)
+    {
+      return _fail(self, KC_WEBSOCKET_PROTOCOL_ERROR);
+    }
+
+    if (_valid_utf8(payload + 2, len - 2) == false)
+    {
+      return _fail(self, KC_WEBSOCKET_INVALID_DATA);
+    }
+  }
+
+  pthread_mutex_lock(&self->_send_lock);
+
+  // the close of the client is answered with the same code, unless it's
+  // the answer to the close of the server
+  if (self->state == KC_WEBSOCKET_OPEN)
+  {
+    _write_frame(self, KC_WEBSOCKET_CLOSE, payload, (len >= 2) ? 2 : 0);
+  }
+
+  __atomic_store_n(&self->state, KC_WEBSOCKET_CLOSED, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  if (self->handler.closed != NULL)
+  {
+    self->handler.closed(self, code);
+  }
+
+  return KC_LOST_CONNECTION;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _fail(struct kc_websocket_t* self, int code)
+{
+  char payload[2] = { (char)(code >> 8), (char)(code & 0xFF) };
+
+  pthread_mutex_lock(&self->_send_lock);
+
+  // the client is told why, unless the server already closed
+  if (self->state == KC_WEBSOCKET_OPEN)
+  {
+    _write_frame(self, KC_WEBSOCKET_CLOSE, payload, 2);
+  }
+
+  __atomic_store_n(&self->state, KC_WEBSOCKET_CLOSED, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&self->_send_lock);
+
+  if (self->handler.closed != NULL)
+  {
+    self->handler.closed(self, code);
+  }
+
+  switch (code)
+  {
+    case KC_WEBSOCKET_MESSAGE_TOO_BIG: return KC_OVERFLOW;
+    case KC_WEBSOCKET_INVALID_DATA:    return KC_FORMAT_ERROR;
+    case KC_WEBSOCKET_INTERNAL_ERROR:  return KC_OUT_OF_MEMORY;
+  }
+
+  return KC_PROTOCOL_ERROR;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _write_frame(struct kc_websocket_t* self, int opcode, const char* data, size_t len)
+{
+  // the frames of the server are never masked, nor fragmented
+  uint8_t header[10];
+  size_t header_len = 2;
+
+  header[0] = 0x80 | opcode;
+
+  if (len < 126)
+  {
+    header[1] = (uint8_t)len;
+  }
+  else if (len <= 0xFFFF)
+  {
+    header[1] = 126;
+    header[2] = (uint8_t)(len >> 8);
+    header[3] = (uint8_t)(len & 0xFF);
+    header_len = 4;
+  }
+  else
+  {
+    header[1] = 127;
+
+    for (int i = 0; i < 8; ++i)
+    {
+      header[2 + i] = (uint8_t)((uint64_t)len >> (56 - (8 * i)));
+    }
+
+    header_len = 10;
+  }
+
+  struct iovec iov[2] =
+  {
+    { header, header_len },
+    { (char*)data, len }
+  };
+
+  struct iovec* pos = iov;
+  int iov_len = (len > 0) ? 2 : 1;
+
+  while (iov_len > 0)
+  {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(struct msghdr));
+
+    msg.msg_iov    = pos;
+    msg.msg_iovlen = iov_len;
+
+    // a closed connection must not kill the process with SIGPIPE
+    ssize_t sent = sendmsg(self->client_fd, &msg, MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      // a non-blocking socket waits until it takes more
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        struct pollfd poll_fd = { self->client_fd, POLLOUT, 0 };
+
+        if (poll(&poll_fd, 1, -1) < 0 && errno != EINTR)
+        {
+          return KC_NETWORK_ERROR;
+        }
+
+        continue;
+      }
+
+      return KC_NETWORK_ERROR;
+    }
+
+    // skip what was sent, the rest goes with the next call
+    while (iov_len > 0 && (size_t)sent >= pos->iov_len)
+    {
+      sent -= pos->iov_len;
+      ++pos;
+      --iov_len;
+    }
+
+    if (iov_len > 0)
+    {
+      pos->iov_base = (char*)pos->iov_base + sent;
+      pos->iov_len -= sent;
+    }
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _valid_close_code(int code)
+{
+  // 1004, 1005, 1006 and 1015 are reserved, 3000 and up are for the
+  // libraries and the applications
+  return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) ||
+      (code >= 3000 && code <= 4999);
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _valid_utf8(const char* data, size_t len)
+{
+  const uint8_t* pos = (const uint8_t*)data;
+  const uint8_t* end = pos + len;
+
+  while (pos < end)
+  {
+    // the ASCII text is checked 8 bytes at a time
+    if (end - pos >= 8)
+    {
+      uint64_t word;
+      memcpy(&word, pos, sizeof(uint64_t));
+
+      if ((word & 0x8080808080808080ULL) == 0)
+      {
+        pos += 8;
+        continue;
+      }
+    }
+
+    if (*pos < 0x80)
+    {
+      ++pos;
+      continue;
+    }
+
+    size_t   size = 0;
+    uint32_t code = 0;
+    uint32_t min  = 0;
+
+    if ((*pos & 0xE0) == 0xC0)
+    {
+      size = 2; code = *pos & 0x1F; min = 0x80;
+    }
+    else if ((*pos & 0xF0) == 0xE0)
+    {
+      size = 3; code = *pos & 0x0F; min = 0x800;
+    }
+    else if ((*pos & 0xF8) == 0xF0)
+    {
+      size = 4; code = *pos & 0x07; min = 0x10000;
+    }
+    else
+    {
+      return false;
+    }
+
+    if ((size_t)(end - pos) < size)
+    {
+      return false;
+    }
+
+    for (size_t i = 1; i < size; ++i)
+    {
+      if ((pos[i] & 0xC0) != 0x80)
+      {
+        return false;
+      }
+
+      code = (code << 6) | (pos[i] & 0x3F);
+    }
+
+    // the overlong forms, the surrogates and beyond the last code point
+    if (code < min || (code >= 0xD800 && code <= 0xDFFF) || code > 0x10FFFF)
+    {
+      return false;
+    }
+
+    pos += size;
+  }
+
+  return true;
+}
+
+//---------------------------------------------------------------------------//
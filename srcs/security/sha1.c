@@ -64,6 +64,7 @@ void destroy_sha1(struct kc_sha1_t* sha1)
     return;
   }
 
+  destroy_logger(sha1->_logger);
   free(sha1);
 }
 
@@ -0,0 +1,202 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// arena.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/system/arena.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static void* alloc_arena  (struct kc_arena_t* self, size_t size);
+static void* dup_arena    (struct kc_arena_t* self, const void* src, size_t size);
+static void  reset_arena  (struct kc_arena_t* self);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static struct kc_arena_block_t* _new_block  (size_t size);
+
+//---------------------------------------------------------------------------//
+
+struct kc_arena_t* new_arena(size_t block_size)
+{
+  // create an arena instance to be returned
+  struct kc_arena_t* new_arena = malloc(sizeof(struct kc_arena_t));
+
+  // confirm that there is memory to allocate
+  if (new_arena == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  // use the default size if none was specified
+  if (block_size == 0)
+  {
+    block_size = KC_ARENA_BLOCK_SIZE;
+  }
+
+  // reserve the first block right away
+  new_arena->_first = _new_block(block_size);
+  if (new_arena->_first == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+
+    // free the arena instance
+    free(new_arena);
+
+    return NULL;
+  }
+
+  new_arena->_current    = new_arena->_first;
+  new_arena->_block_size = block_size;
+
+  // assigns the public member methods
+  new_arena->alloc = alloc_arena;
+  new_arena->dup   = dup_arena;
+  new_arena->reset = reset_arena;
+
+  return new_arena;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_arena(struct kc_arena_t* arena)
+{
+  if (arena == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // free every block of the chain
+  struct kc_arena_block_t* block = arena->_first;
+  while (block != NULL)
+  {
+    struct kc_arena_block_t* next = block->next;
+    free(block);
+    block = next;
+  }
+
+  free(arena);
+}
+
+//---------------------------------------------------------------------------//
+
+static void* alloc_arena(struct kc_arena_t* self, size_t size)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return NULL;
+  }
+
+  // keep every allocation aligned for any type
+  size = (size + (KC_ARENA_ALIGNMENT - 1)) & ~((size_t)KC_ARENA_ALIGNMENT - 1);
+
+  struct kc_arena_block_t* block = self->_current;
+
+  // the fast path, there is still room in the current block
+  if (block->size - block->used >= size)
+  {
+    void* ptr = block->data + block->used;
+    block->used += size;
+
+    return ptr;
+  }
+
+  // reuse the next block (reserved by a previous cycle) if it fits
+  if (block->next != NULL && block->next->size >= size)
+  {
+    block = block->next;
+    block->used = 0;
+  }
+  else
+  {
+    // reserve a new block, big enough for large allocations
+    size_t block_size = (size > self->_block_size) ? size : self->_block_size;
+
+    struct kc_arena_block_t* new_block = _new_block(block_size);
+    if (new_block == NULL)
+    {
+      log_error(KC_OUT_OF_MEMORY_LOG);
+      return NULL;
+    }
+
+    // keep the rest of the chain for the next cycles
+    new_block->next = block->next;
+    block->next = new_block;
+    block = new_block;
+  }
+
+  self->_current = block;
+
+  void* ptr = block->data + block->used;
+  block->used += size;
+
+  return ptr;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* dup_arena(struct kc_arena_t* self, const void* src, size_t size)
+{
+  if (src == NULL)
+  {
+    return NULL;
+  }
+
+  void* ptr = alloc_arena(self, size);
+  if (ptr == NULL)
+  {
+    return NULL;
+  }
+
+  memcpy(ptr, src, size);
+
+  return ptr;
+}
+
+//---------------------------------------------------------------------------//
+
+static void reset_arena(struct kc_arena_t* self)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // the blocks are kept, the next blocks in the
+  // chain are emptied only when they are reached
+  self->_current = self->_first;
+  self->_first->used = 0;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_arena_block_t* _new_block(size_t size)
+{
+  struct kc_arena_block_t* block =
+      malloc(sizeof(struct kc_arena_block_t) + size);
+
+  if (block == NULL)
+  {
+    return NULL;
+  }
+
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+
+  return block;
+}
+
+//---------------------------------------------------------------------------//
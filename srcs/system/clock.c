@@ -0,0 +1,174 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// clock.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/system/clock.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------//
+
+// the strings of a second
+struct kc_clock_second_t
+{
+  char date[KC_CLOCK_DATE_SIZE];
+  char local[KC_CLOCK_LOCAL_SIZE];
+};
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static void _refresh  (time_t now);
+static void _read     (time_t now, size_t offset, char* buffer, size_t size);
+
+//--- MARK: PRIVATE MEMBERS -------------------------------------------------//
+
+// the day and month names are always in English, whatever the locale
+static const char* const _week_days[7] =
+{
+  "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+static const char* const _months[12] =
+{
+  "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+// two seconds are kept, so the readers of the last one are not disturbed
+// while the next one is written; the second being written is published as
+// -1, so the readers that copied it in the meantime know to try again
+static struct kc_clock_second_t seconds[2];
+static time_t published = -1;
+
+static pthread_mutex_t refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//---------------------------------------------------------------------------//
+
+time_t kc_clock_monotonic(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+  return now.tv_sec;
+}
+
+//---------------------------------------------------------------------------//
+
+uint64_t kc_clock_monotonic_ms(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+//---------------------------------------------------------------------------//
+
+uint64_t kc_clock_monotonic_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//---------------------------------------------------------------------------//
+
+time_t kc_clock_realtime(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME_COARSE, &now);
+
+  return now.tv_sec;
+}
+
+//---------------------------------------------------------------------------//
+
+size_t kc_clock_http_date(char buffer[KC_CLOCK_DATE_SIZE])
+{
+  _read(kc_clock_realtime(), offsetof(struct kc_clock_second_t, date), buffer, KC_CLOCK_DATE_SIZE);
+
+  return KC_CLOCK_DATE_SIZE - 1;
+}
+
+//---------------------------------------------------------------------------//
+
+size_t kc_clock_local_time(char buffer[KC_CLOCK_LOCAL_SIZE])
+{
+  _read(kc_clock_realtime(), offsetof(struct kc_clock_second_t, local), buffer, KC_CLOCK_LOCAL_SIZE);
+
+  return KC_CLOCK_LOCAL_SIZE - 1;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static void _refresh(time_t now)
+{
+  // only one thread formats, the others use the last second meanwhile
+  if (pthread_mutex_trylock(&refresh_lock) != 0)
+  {
+    return;
+  }
+
+  if (__atomic_load_n(&published, __ATOMIC_ACQUIRE) != now)
+  {
+    __atomic_store_n(&published, -1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    struct kc_clock_second_t* second = &seconds[now & 1];
+    struct tm tm;
+
+    // the fields are clamped to their digits, so the date always fits
+    gmtime_r(&now, &tm);
+    snprintf(second->date, KC_CLOCK_DATE_SIZE, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+        _week_days[tm.tm_wday % 7], tm.tm_mday % 100, _months[tm.tm_mon % 12],
+        (tm.tm_year + 1900) % 10000, tm.tm_hour % 100, tm.tm_min % 100, tm.tm_sec % 100);
+
+    localtime_r(&now, &tm);
+    strftime(second->local, KC_CLOCK_LOCAL_SIZE, "%Y-%m-%d %H:%M:%S", &tm);
+
+    __atomic_store_n(&published, now, __ATOMIC_RELEASE);
+  }
+
+  pthread_mutex_unlock(&refresh_lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _read(time_t now, size_t offset, char* buffer, size_t size)
+{
+  for (;;)
+  {
+    time_t second = __atomic_load_n(&published, __ATOMIC_ACQUIRE);
+
+    // the first reader of a new second formats it
+    if (second != now)
+    {
+      _refresh(now);
+      second = __atomic_load_n(&published, __ATOMIC_ACQUIRE);
+    }
+
+    // being written right now
+    if (second == -1)
+    {
+      continue;
+    }
+
+    memcpy(buffer, (char*)&seconds[second & 1] + offset, size);
+
+    // the copy is good only if the second was not rewritten during it
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&published, __ATOMIC_RELAXED) == second)
+    {
+      return;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,729 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// fiber.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/system/fiber.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// the registers are switched by hand where the calling convention is known
+#if (defined(__x86_64__) || defined(__aarch64__)) && !defined(KC_FIBER_UCONTEXT)
+#define KC_FIBER_SWITCH_ASM
+#else
+#include <ucontext.h>
+#endif
+
+// the room kept on top of every stack for the fiber (and its ucontext)
+#define KC_FIBER_ALIGNED_SIZE  ((sizeof(struct kc_fiber_t) + 63) & ~(size_t)63)
+
+#ifdef KC_FIBER_SWITCH_ASM
+#define KC_FIBER_HEADER_SIZE   KC_FIBER_ALIGNED_SIZE
+#else
+#define KC_FIBER_HEADER_SIZE   (KC_FIBER_ALIGNED_SIZE + sizeof(ucontext_t))
+#endif
+
+//---------------------------------------------------------------------------//
+
+#ifdef KC_FIBER_SWITCH_ASM
+
+// save the registers kept across calls on the current stack, store where
+// it stopped in from, then go on from the stack in to (where the same was
+// saved, or prepared for a new fiber)
+void kc_fiber_switch(void** from, void* to);
+
+#if defined(__x86_64__)
+
+__asm__(
+  ".text\n"
+  ".globl kc_fiber_switch\n"
+  ".hidden kc_fiber_switch\n"
+  ".type kc_fiber_switch, @function\n"
+  "kc_fiber_switch:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $8, %rsp\n"
+  "  stmxcsr (%rsp)\n"
+  "  fnstcw 4(%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  "  ldmxcsr (%rsp)\n"
+  "  fldcw 4(%rsp)\n"
+  "  addq $8, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+  ".size kc_fiber_switch, .-kc_fiber_switch\n"
+);
+
+#else
+
+__asm__(
+  ".text\n"
+  ".globl kc_fiber_switch\n"
+  ".hidden kc_fiber_switch\n"
+  ".type kc_fiber_switch, %function\n"
+  "kc_fiber_switch:\n"
+  "  sub sp, sp, #160\n"
+  "  stp x19, x20, [sp, #0]\n"
+  "  stp x21, x22, [sp, #16]\n"
+  "  stp x23, x24, [sp, #32]\n"
+  "  stp x25, x26, [sp, #48]\n"
+  "  stp x27, x28, [sp, #64]\n"
+  "  stp x29, x30, [sp, #80]\n"
+  "  stp d8, d9, [sp, #96]\n"
+  "  stp d10, d11, [sp, #112]\n"
+  "  stp d12, d13, [sp, #128]\n"
+  "  stp d14, d15, [sp, #144]\n"
+  "  mov x9, sp\n"
+  "  str x9, [x0]\n"
+  "  mov sp, x1\n"
+  "  ldp x19, x20, [sp, #0]\n"
+  "  ldp x21, x22, [sp, #16]\n"
+  "  ldp x23, x24, [sp, #32]\n"
+  "  ldp x25, x26, [sp, #48]\n"
+  "  ldp x27, x28, [sp, #64]\n"
+  "  ldp x29, x30, [sp, #80]\n"
+  "  ldp d8, d9, [sp, #96]\n"
+  "  ldp d10, d11, [sp, #112]\n"
+  "  ldp d12, d13, [sp, #128]\n"
+  "  ldp d14, d15, [sp, #144]\n"
+  "  add sp, sp, #160\n"
+  "  ret\n"
+  ".size kc_fiber_switch, .-kc_fiber_switch\n"
+);
+
+#endif
+
+#endif
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int spawn_fiber_scheduler   (struct kc_fiber_scheduler_t* self, void (*entry)(void* data), void* data, struct kc_fiber_t** fiber);
+static int resume_fiber_scheduler  (struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber, int result);
+static int run_fiber_scheduler     (struct kc_fiber_scheduler_t* self);
+static int poll_fiber_scheduler    (struct kc_fiber_scheduler_t* self, int timeout);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static struct kc_fiber_t* _new_fiber  (struct kc_fiber_scheduler_t* self);
+static void _release      (struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber);
+static void _prepare      (struct kc_fiber_t* fiber);
+static void _start        (void);
+static bool _enter        (struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber);
+static int  _park         (struct kc_fiber_t* fiber, int state);
+static void _switch       (void** from, void* to);
+static void _push_ready   (struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber);
+static struct kc_fiber_t* _pop_ready  (struct kc_fiber_scheduler_t* self);
+
+//---------------------------------------------------------------------------//
+
+// the scheduler whose fiber runs on this thread (if any)
+static __thread struct kc_fiber_scheduler_t* running;
+
+//---------------------------------------------------------------------------//
+
+struct kc_fiber_scheduler_t* new_fiber_scheduler(size_t stack_size)
+{
+  // create a scheduler instance to be returned
+  struct kc_fiber_scheduler_t* new_scheduler = malloc(sizeof(struct kc_fiber_scheduler_t));
+
+  // confirm that there is memory to allocate
+  if (new_scheduler == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_scheduler->fd = epoll_create1(EPOLL_CLOEXEC);
+  if (new_scheduler->fd < 0)
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+    free(new_scheduler);
+
+    return NULL;
+  }
+
+  // the stacks are made of whole pages
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+  if (stack_size == 0)
+  {
+    stack_size = KC_FIBER_STACK_SIZE;
+  }
+  else if (stack_size < KC_FIBER_MIN_STACK_SIZE)
+  {
+    stack_size = KC_FIBER_MIN_STACK_SIZE;
+  }
+
+  new_scheduler->stack_size  = (stack_size + page - 1) & ~(page - 1);
+  new_scheduler->fibers      = 0;
+  new_scheduler->current     = NULL;
+  new_scheduler->switched    = NULL;
+  new_scheduler->_context    = NULL;
+  new_scheduler->_fibers     = NULL;
+  new_scheduler->_ready      = NULL;
+  new_scheduler->_ready_tail = NULL;
+  new_scheduler->_kept       = NULL;
+  new_scheduler->_kept_len   = 0;
+
+#ifndef KC_FIBER_SWITCH_ASM
+  // the thread is saved in its own ucontext
+  new_scheduler->_context = malloc(sizeof(ucontext_t));
+  if (new_scheduler->_context == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+
+    close(new_scheduler->fd);
+    free(new_scheduler);
+
+    return NULL;
+  }
+#endif
+
+  // assigns the public member methods
+  new_scheduler->spawn  = spawn_fiber_scheduler;
+  new_scheduler->resume = resume_fiber_scheduler;
+  new_scheduler->run    = run_fiber_scheduler;
+  new_scheduler->poll   = poll_fiber_scheduler;
+
+  return new_scheduler;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_fiber_scheduler(struct kc_fiber_scheduler_t* scheduler)
+{
+  if (scheduler == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // the fibers that never returned are dropped with their stacks
+  while (scheduler->_fibers != NULL)
+  {
+    struct kc_fiber_t* fiber = scheduler->_fibers;
+    scheduler->_fibers = fiber->_next;
+
+    munmap(fiber->_mapping, fiber->_mapping_size);
+  }
+
+  while (scheduler->_kept != NULL)
+  {
+    struct kc_fiber_t* fiber = scheduler->_kept;
+    scheduler->_kept = fiber->_ready_next;
+
+    munmap(fiber->_mapping, fiber->_mapping_size);
+  }
+
+#ifndef KC_FIBER_SWITCH_ASM
+  free(scheduler->_context);
+#endif
+
+  close(scheduler->fd);
+  free(scheduler);
+}
+
+//---------------------------------------------------------------------------//
+
+struct kc_fiber_t* kc_fiber_current(void)
+{
+  return (running != NULL) ? running->current : NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+int kc_fiber_yield(void)
+{
+  struct kc_fiber_t* fiber = kc_fiber_current();
+
+  // the thread's own stack has nobody to make room for
+  if (fiber == NULL)
+  {
+    return KC_SUCCESS;
+  }
+
+  _push_ready(fiber->scheduler, fiber);
+
+  return _park(fiber, KC_FIBER_READY);
+}
+
+//---------------------------------------------------------------------------//
+
+int kc_fiber_suspend(void)
+{
+  struct kc_fiber_t* fiber = kc_fiber_current();
+
+  // nobody could resume the thread's own stack
+  if (fiber == NULL)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  return _park(fiber, KC_FIBER_WAITING);
+}
+
+//---------------------------------------------------------------------------//
+
+int kc_fiber_wait(int fd, short events)
+{
+  struct kc_fiber_t* fiber = kc_fiber_current();
+
+  // the thread's own stack blocks until the socket is ready
+  if (fiber == NULL)
+  {
+    struct pollfd ready = { .fd = fd, .events = events };
+
+    while (poll(&ready, 1, -1) < 0)
+    {
+      if (errno != EINTR)
+      {
+        return KC_SYSTEM_ERROR;
+      }
+    }
+
+    return KC_SUCCESS;
+  }
+
+  // the socket is watched once, the fiber takes it out when woken up
+  struct epoll_event event;
+  memset(&event, 0, sizeof(struct epoll_event));
+
+  event.events   = EPOLLONESHOT | ((events & POLLIN) ? EPOLLIN : 0) | ((events & POLLOUT) ? EPOLLOUT : 0);
+  event.data.ptr = fiber;
+
+  if (epoll_ctl(fiber->scheduler->fd, EPOLL_CTL_ADD, fd, &event) != 0)
+  {
+    // only a fiber at a time can wait for the same socket
+    int ret = (errno == EEXIST) ? KC_INVALID_OPERATION : KC_SYSTEM_ERROR;
+    log_error(kc_error_msg[ret + 1]);
+
+    return ret;
+  }
+
+  fiber->_fd = fd;
+
+  return _park(fiber, KC_FIBER_WAITING);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int spawn_fiber_scheduler(struct kc_fiber_scheduler_t* self, void (*entry)(void* data),
+    void* data, struct kc_fiber_t** fiber)
+{
+  if (self == NULL || entry == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  struct kc_fiber_t* new_fiber = _new_fiber(self);
+  if (new_fiber == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return KC_OUT_OF_MEMORY;
+  }
+
+  new_fiber->state       = KC_FIBER_READY;
+  new_fiber->entry       = entry;
+  new_fiber->data        = data;
+  new_fiber->scheduler   = self;
+  new_fiber->_fd         = -1;
+  new_fiber->_result     = KC_SUCCESS;
+  new_fiber->_ready_next = NULL;
+
+  _prepare(new_fiber);
+
+  new_fiber->_prev = NULL;
+  new_fiber->_next = self->_fibers;
+
+  if (self->_fibers != NULL)
+  {
+    self->_fibers->_prev = new_fiber;
+  }
+
+  self->_fibers = new_fiber;
+  self->fibers++;
+
+  if (fiber != NULL)
+  {
+    (*fiber) = new_fiber;
+  }
+
+  // a fiber can't run another one, it comes after it
+  if (self->current != NULL)
+  {
+    _push_ready(self, new_fiber);
+    return KC_PENDING;
+  }
+
+  if (_enter(self, new_fiber))
+  {
+    if (fiber != NULL)
+    {
+      (*fiber) = NULL;
+    }
+
+    return KC_SUCCESS;
+  }
+
+  return KC_PENDING;
+}
+
+//---------------------------------------------------------------------------//
+
+static int resume_fiber_scheduler(struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber, int result)
+{
+  if (self == NULL || fiber == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (fiber->scheduler != self || fiber->state != KC_FIBER_WAITING)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  // the socket is not waited for anymore
+  if (fiber->_fd >= 0)
+  {
+    epoll_ctl(self->fd, EPOLL_CTL_DEL, fiber->_fd, NULL);
+    fiber->_fd = -1;
+  }
+
+  fiber->_result = result;
+  _push_ready(self, fiber);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int run_fiber_scheduler(struct kc_fiber_scheduler_t* self)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // only the thread's own stack switches between the fibers
+  if (self->current != NULL)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  struct kc_fiber_t* fiber = NULL;
+
+  while ((fiber = _pop_ready(self)) != NULL)
+  {
+    _enter(self, fiber);
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int poll_fiber_scheduler(struct kc_fiber_scheduler_t* self, int timeout)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (self->current != NULL)
+  {
+    log_error(KC_INVALID_OPERATION_LOG);
+    return KC_INVALID_OPERATION;
+  }
+
+  struct epoll_event events[KC_FIBER_EVENTS];
+
+  int len = epoll_wait(self->fd, events, KC_FIBER_EVENTS, timeout);
+  if (len < 0 && errno != EINTR)
+  {
+    log_error(KC_SYSTEM_ERROR_LOG);
+    return KC_SYSTEM_ERROR;
+  }
+
+  for (int i = 0; i < len; ++i)
+  {
+    struct kc_fiber_t* fiber = events[i].data.ptr;
+
+    // the socket is ready (or failed, the next call on it tells)
+    if (fiber->state == KC_FIBER_WAITING && fiber->_fd >= 0)
+    {
+      resume_fiber_scheduler(self, fiber, KC_SUCCESS);
+    }
+  }
+
+  return run_fiber_scheduler(self);
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static struct kc_fiber_t* _new_fiber(struct kc_fiber_scheduler_t* self)
+{
+  // the mapping of a fiber that returned, already touched
+  if (self->_kept != NULL)
+  {
+    struct kc_fiber_t* fiber = self->_kept;
+
+    self->_kept = fiber->_ready_next;
+    self->_kept_len--;
+
+    return fiber;
+  }
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t header = (KC_FIBER_HEADER_SIZE + page - 1) & ~(page - 1);
+  size_t size = page + self->stack_size + header;
+
+  // the memory is taken only as the stack grows into it
+  char* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+
+  if (mapping == MAP_FAILED)
+  {
+    return NULL;
+  }
+
+  // a stack that overflows hits the guard page, below it
+  if (mprotect(mapping, page, PROT_NONE) != 0)
+  {
+    munmap(mapping, size);
+    return NULL;
+  }
+
+  struct kc_fiber_t* fiber = (struct kc_fiber_t*)(mapping + page + self->stack_size);
+
+  fiber->_mapping      = mapping;
+  fiber->_mapping_size = size;
+
+  return fiber;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _release(struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber)
+{
+  if (fiber->_prev != NULL)
+  {
+    fiber->_prev->_next = fiber->_next;
+  }
+  else
+  {
+    self->_fibers = fiber->_next;
+  }
+
+  if (fiber->_next != NULL)
+  {
+    fiber->_next->_prev = fiber->_prev;
+  }
+
+  self->fibers--;
+
+  // a few are kept for the next ones, the others are given back
+  if (self->_kept_len < KC_FIBER_CACHE_SIZE)
+  {
+    fiber->_ready_next = self->_kept;
+    self->_kept = fiber;
+    self->_kept_len++;
+
+    return;
+  }
+
+  munmap(fiber->_mapping, fiber->_mapping_size);
+}
+
+//---------------------------------------------------------------------------//
+
+static void _prepare(struct kc_fiber_t* fiber)
+{
+  struct kc_fiber_scheduler_t* scheduler = fiber->scheduler;
+
+  // the stack grows down from the fiber, aligned as the calls expect it
+  char* top = (char*)fiber;
+  char* bottom = top - scheduler->stack_size;
+
+#if defined(KC_FIBER_SWITCH_ASM) && defined(__x86_64__)
+  // what kc_fiber_switch pops: the control words of the floating point
+  // (the defaults), the registers, then the return address into _start
+  // (entered as if called, with a return address of its own)
+  uint64_t* sp = (uint64_t*)top;
+
+  *--sp = 0;
+  *--sp = (uint64_t)(uintptr_t)_start;
+
+  for (int i = 0; i < 6; ++i)
+  {
+    *--sp = 0;
+  }
+
+  *--sp = ((uint64_t)0x037F << 32) | 0x1F80;
+
+  fiber->_context = sp;
+  (void)bottom;
+#elif defined(KC_FIBER_SWITCH_ASM)
+  // the registers kc_fiber_switch loads, the link register going to _start
+  uint64_t* sp = (uint64_t*)(top - 160);
+  memset(sp, 0, 160);
+
+  sp[11] = (uint64_t)(uintptr_t)_start;
+
+  fiber->_context = sp;
+  (void)bottom;
+#else
+  // the ucontext is kept above the fiber, in the same mapping
+  ucontext_t* context = (ucontext_t*)(top + KC_FIBER_ALIGNED_SIZE);
+
+  getcontext(context);
+
+  context->uc_stack.ss_sp   = bottom;
+  context->uc_stack.ss_size = scheduler->stack_size;
+  context->uc_link          = NULL;
+
+  makecontext(context, _start, 0);
+
+  fiber->_context = context;
+#endif
+}
+
+//---------------------------------------------------------------------------//
+
+static void _start(void)
+{
+  struct kc_fiber_t* fiber = running->current;
+
+  fiber->entry(fiber->data);
+
+  // back to the scheduler for good, it keeps (or unmaps) the stack
+  fiber->state = KC_FIBER_DONE;
+  _switch(&fiber->_context, fiber->scheduler->_context);
+}
+
+//---------------------------------------------------------------------------//
+
+static bool _enter(struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber)
+{
+  struct kc_fiber_scheduler_t* previous = running;
+
+  running = self;
+  self->current = fiber;
+  fiber->state = KC_FIBER_RUNNING;
+
+  if (self->switched != NULL)
+  {
+    self->switched(fiber);
+  }
+
+  _switch(&self->_context, fiber->_context);
+
+  // the fiber returned, waits, or made room for the others
+  if (self->switched != NULL)
+  {
+    self->switched(NULL);
+  }
+
+  self->current = NULL;
+  running = previous;
+
+  if (fiber->state == KC_FIBER_DONE)
+  {
+    _release(self, fiber);
+    return true;
+  }
+
+  return false;
+}
+
+//---------------------------------------------------------------------------//
+
+static int _park(struct kc_fiber_t* fiber, int state)
+{
+  fiber->state   = state;
+  fiber->_result = KC_SUCCESS;
+
+  _switch(&fiber->_context, fiber->scheduler->_context);
+
+  // resumed, on the stack it stopped on
+  return fiber->_result;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _switch(void** from, void* to)
+{
+#ifdef KC_FIBER_SWITCH_ASM
+  kc_fiber_switch(from, to);
+#else
+  swapcontext((ucontext_t*)(*from), (ucontext_t*)to);
+#endif
+}
+
+//---------------------------------------------------------------------------//
+
+static void _push_ready(struct kc_fiber_scheduler_t* self, struct kc_fiber_t* fiber)
+{
+  fiber->state = KC_FIBER_READY;
+  fiber->_ready_next = NULL;
+
+  if (self->_ready_tail != NULL)
+  {
+    self->_ready_tail->_ready_next = fiber;
+  }
+  else
+  {
+    self->_ready = fiber;
+  }
+
+  self->_ready_tail = fiber;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct kc_fiber_t* _pop_ready(struct kc_fiber_scheduler_t* self)
+{
+  struct kc_fiber_t* fiber = self->_ready;
+
+  if (fiber != NULL)
+  {
+    self->_ready = fiber->_ready_next;
+
+    if (self->_ready == NULL)
+    {
+      self->_ready_tail = NULL;
+    }
+  }
+
+  return fiber;
+}
+
+//---------------------------------------------------------------------------//
@@ -10,10 +10,13 @@
 
 #include "../../hdrs/common.h"
 #include "../../hdrs/system/logger.h"
+#include "../../hdrs/system/fiber.h"
 #include "../../hdrs/system/file.h"
 
 #include <errno.h>
+#include <poll.h>
 #include <stdlib.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <unistd.h>
@@ -31,7 +34,10 @@ static int get_file_path  (struct kc_file_t* self, char** path);
 static int get_opened     (struct kc_file_t* self, bool* is_open);
 static int open_file      (struct kc_file_t* self, char* name, unsigned int mode);
 static int read_file      (struct kc_file_t* self, char** buffer);
+static int send_file      (struct kc_file_t* self, int fd, size_t offset, size_t len);
+static int stat_file      (struct kc_file_t* self, struct kc_file_info_t* info);
 static int write_file     (struct kc_file_t* self, char* buffer);
+static int write_bytes    (struct kc_file_t* self, const char* buffer, size_t len);
 
 //---------------------------------------------------------------------------//
 
@@ -76,7 +82,10 @@ struct kc_file_t* new_file(void)
   new_file->move        = NULL;
   new_file->open        = open_file;
   new_file->read        = read_file;
+  new_file->send        = send_file;
+  new_file->stat        = stat_file;
   new_file->write       = write_file;
+  new_file->write_bytes = write_bytes;
 
   return new_file;
 }
@@ -418,7 +427,12 @@ int open_file(struct kc_file_t* self, char* name, unsigned int mode)
     return KC_INVALID_ARGUMENT;
   }
 
-  // save the file name
+  // save the file name, the previous one is not needed anymore
+  if (self->name != NULL)
+  {
+    free(self->name);
+  }
+
   self->name = (char*)malloc(sizeof(char) * (strlen(name) + 1));
   if (self->name == NULL)
   {
@@ -501,6 +515,93 @@ int read_file(struct kc_file_t* self, char** buffer)
 
 //---------------------------------------------------------------------------//
 
+int send_file(struct kc_file_t* self, int fd, size_t offset, size_t len)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (self->opened == false)
+  {
+    return KC_FILE_NOT_FOUND;
+  }
+
+  int file_fd = fileno(self->file);
+  off_t file_offset = (off_t)offset;
+
+  // the kernel copies the bytes from the page cache straight to the
+  // descriptor (ex: a socket), they never go through user space
+  while (len > 0)
+  {
+    ssize_t sent = sendfile(fd, file_fd, &file_offset, len);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      // a descriptor that doesn't block is waited on until it takes more
+      // (on a fiber, the others run meanwhile)
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && kc_fiber_wait(fd, POLLOUT) == KC_SUCCESS)
+      {
+        continue;
+      }
+
+      self->_logger->log(self->_logger, KC_ERROR_LOG, KC_IO_ERROR,
+          __FILE__, __LINE__, __func__);
+
+      return KC_IO_ERROR;
+    }
+
+    // the file got shorter in the meantime
+    if (sent == 0)
+    {
+      return KC_IO_ERROR;
+    }
+
+    len -= sent;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int stat_file(struct kc_file_t* self, struct kc_file_info_t* info)
+{
+  if (self == NULL || info == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (self->opened == false)
+  {
+    return KC_FILE_NOT_FOUND;
+  }
+
+  struct stat st;
+  if (fstat(fileno(self->file), &st) != 0)
+  {
+    self->_logger->log(self->_logger, KC_ERROR_LOG, KC_IO_ERROR,
+        __FILE__, __LINE__, __func__);
+
+    return KC_IO_ERROR;
+  }
+
+  info->size     = (size_t)st.st_size;
+  info->modified = st.st_mtime;
+  info->inode    = (unsigned long)st.st_ino;
+  info->is_dir   = S_ISDIR(st.st_mode);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
 int write_file(struct kc_file_t* self, char* buffer)
 {
   if (self == NULL || buffer == NULL)
@@ -525,3 +626,29 @@ int write_file(struct kc_file_t* self, char* buffer)
 }
 
 //---------------------------------------------------------------------------//
+
+int write_bytes(struct kc_file_t* self, const char* buffer, size_t len)
+{
+  if (self == NULL || buffer == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // unlike write(), the buffer can hold any byte (ex: an uploaded file)
+  size_t bytes_written = fwrite(buffer, 1, len, self->file);
+
+  // Error writing content to file
+  if (bytes_written != len)
+  {
+    self->_logger->log(self->_logger, KC_ERROR_LOG, KC_IO_ERROR,
+        __FILE__, __LINE__, __func__);
+
+    return KC_IO_ERROR;
+  }
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
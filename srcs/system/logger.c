@@ -8,10 +8,10 @@
 
 #define _CRT_SECURE_NO_WARNINGS
 
+#include "../../hdrs/system/clock.h"
 #include "../../hdrs/system/logger.h"
 #include "../../hdrs/common.h"
 
-#include <time.h>
 #include <string.h>
 
 //--- MARK: PRIVATE MEMBER METHODS PROTOTYPES -------------------------------//
@@ -207,15 +207,9 @@ int log_to_file(const char* filename, const char* level, const char* description
     return KC_CANNOT_OPEN_FILE;
   }
 
-  // get the current timestamp
-  time_t now;
-  struct tm *tm_info;
-  char time_buffer[30];
-  time(&now);
-
-  // convert the timestamp to a human-readable string
-  tm_info = localtime(&now);
-  strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", tm_info);
+  // the timestamp is formatted once per second, for all the lines
+  char time_buffer[KC_CLOCK_LOCAL_SIZE];
+  kc_clock_local_time(time_buffer);
 
   // writing data the log to the file
   fprintf(write_file, "\n[%s] %s: in function ‘%s’\n", time_buffer, level, func);
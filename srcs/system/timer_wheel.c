@@ -0,0 +1,298 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// timer_wheel.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/system/timer_wheel.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// the ticks reached by the whole wheel
+#define KC_TIMER_WHEEL_SPAN  ((uint64_t)1 << (KC_TIMER_WHEEL_LEVELS * KC_TIMER_WHEEL_SLOT_BITS))
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int add_timer_wheel      (struct kc_timer_wheel_t* self, struct kc_timer_t* timer, uint64_t expires);
+static int cancel_timer_wheel   (struct kc_timer_wheel_t* self, struct kc_timer_t* timer);
+static int advance_timer_wheel  (struct kc_timer_wheel_t* self, uint64_t now);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static void _place    (struct kc_timer_wheel_t* self, struct kc_timer_t* timer);
+static void _unlink   (struct kc_timer_wheel_t* self, struct kc_timer_t* timer);
+static void _cascade  (struct kc_timer_wheel_t* self, int level);
+
+//---------------------------------------------------------------------------//
+
+void kc_timer_init(struct kc_timer_t* timer, void (*callback)(struct kc_timer_t* timer), void* data)
+{
+  if (timer == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  timer->expires  = 0;
+  timer->callback = callback;
+  timer->data     = data;
+  timer->_prev    = NULL;
+  timer->_next    = NULL;
+  timer->_slot    = NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+bool kc_timer_pending(struct kc_timer_t* timer)
+{
+  return timer != NULL && timer->_slot != NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+struct kc_timer_wheel_t* new_timer_wheel(unsigned tick, uint64_t start)
+{
+  if (tick == 0)
+  {
+    log_error(KC_INVALID_ARGUMENT_LOG);
+    return NULL;
+  }
+
+  // create a wheel instance to be returned
+  struct kc_timer_wheel_t* new_wheel = malloc(sizeof(struct kc_timer_wheel_t));
+
+  // confirm that there is memory to allocate
+  if (new_wheel == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  new_wheel->tick  = tick;
+  new_wheel->start = start;
+  new_wheel->now   = 0;
+  new_wheel->size  = 0;
+
+  memset(new_wheel->_slots, 0, sizeof(new_wheel->_slots));
+
+  // assigns the public member methods
+  new_wheel->add     = add_timer_wheel;
+  new_wheel->cancel  = cancel_timer_wheel;
+  new_wheel->advance = advance_timer_wheel;
+
+  return new_wheel;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_timer_wheel(struct kc_timer_wheel_t* wheel)
+{
+  if (wheel == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  // the timers still pending belong to their owners, they are only detached
+  for (int level = 0; level < KC_TIMER_WHEEL_LEVELS; ++level)
+  {
+    for (int slot = 0; slot < KC_TIMER_WHEEL_SLOTS; ++slot)
+    {
+      while (wheel->_slots[level][slot] != NULL)
+      {
+        _unlink(wheel, wheel->_slots[level][slot]);
+      }
+    }
+  }
+
+  free(wheel);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int add_timer_wheel(struct kc_timer_wheel_t* self, struct kc_timer_t* timer, uint64_t expires)
+{
+  if (self == NULL || timer == NULL || timer->callback == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  if (timer->_slot != NULL)
+  {
+    _unlink(self, timer);
+  }
+
+  // the first tick that begins after the expiry, so a timer never fires
+  // early, and at the earliest on the next tick (the current one is done)
+  uint64_t ticks = (expires > self->start) ?
+      (expires - self->start + self->tick - 1) / self->tick : 0;
+
+  timer->expires = (ticks > self->now) ? ticks : self->now + 1;
+
+  _place(self, timer);
+  self->size++;
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int cancel_timer_wheel(struct kc_timer_wheel_t* self, struct kc_timer_t* timer)
+{
+  if (self == NULL || timer == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  // it already fired (or was never added)
+  if (timer->_slot == NULL)
+  {
+    return KC_INVALID;
+  }
+
+  _unlink(self, timer);
+
+  return KC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int advance_timer_wheel(struct kc_timer_wheel_t* self, uint64_t now)
+{
+  if (self == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  uint64_t target = (now > self->start) ? (now - self->start) / self->tick : 0;
+  int fired = 0;
+
+  while (self->now < target)
+  {
+    // nothing to fire on the way
+    if (self->size == 0)
+    {
+      self->now = target;
+      break;
+    }
+
+    self->now++;
+
+    // a level wrapped around, bring the next slot of the one above down
+    for (int level = 1; level < KC_TIMER_WHEEL_LEVELS; ++level)
+    {
+      if ((self->now & (((uint64_t)1 << (level * KC_TIMER_WHEEL_SLOT_BITS)) - 1)) != 0)
+      {
+        break;
+      }
+
+      _cascade(self, level);
+    }
+
+    // the callbacks can change the slot, so the timers are taken one by one
+    struct kc_timer_t** slot = &self->_slots[0][self->now & (KC_TIMER_WHEEL_SLOTS - 1)];
+
+    while (*slot != NULL)
+    {
+      struct kc_timer_t* timer = *slot;
+      _unlink(self, timer);
+
+      timer->callback(timer);
+      fired++;
+    }
+  }
+
+  return fired;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static void _place(struct kc_timer_wheel_t* self, struct kc_timer_t* timer)
+{
+  // the timers beyond the wheel wait at its far end, and are placed again
+  // (not fired) when their slot comes down, until they are within reach
+  uint64_t at = timer->expires;
+
+  if (at - self->now >= KC_TIMER_WHEEL_SPAN)
+  {
+    at = self->now + KC_TIMER_WHEEL_SPAN - 1;
+  }
+
+  uint64_t delta = at - self->now;
+  int level = 0;
+
+  while (level < KC_TIMER_WHEEL_LEVELS - 1 &&
+      delta >= ((uint64_t)1 << ((level + 1) * KC_TIMER_WHEEL_SLOT_BITS)))
+  {
+    ++level;
+  }
+
+  int index = (at >> (level * KC_TIMER_WHEEL_SLOT_BITS)) & (KC_TIMER_WHEEL_SLOTS - 1);
+  struct kc_timer_t** slot = &self->_slots[level][index];
+
+  timer->_prev = NULL;
+  timer->_next = *slot;
+  timer->_slot = slot;
+
+  if (*slot != NULL)
+  {
+    (*slot)->_prev = timer;
+  }
+
+  *slot = timer;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _unlink(struct kc_timer_wheel_t* self, struct kc_timer_t* timer)
+{
+  if (timer->_prev != NULL)
+  {
+    timer->_prev->_next = timer->_next;
+  }
+  else
+  {
+    *timer->_slot = timer->_next;
+  }
+
+  if (timer->_next != NULL)
+  {
+    timer->_next->_prev = timer->_prev;
+  }
+
+  timer->_prev = NULL;
+  timer->_next = NULL;
+  timer->_slot = NULL;
+
+  self->size--;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _cascade(struct kc_timer_wheel_t* self, int level)
+{
+  int index = (self->now >> (level * KC_TIMER_WHEEL_SLOT_BITS)) & (KC_TIMER_WHEEL_SLOTS - 1);
+  struct kc_timer_t** slot = &self->_slots[level][index];
+
+  // every timer of the slot expires within the span of the level below,
+  // but the ones beyond the wheel, which go back to its far end
+  while (*slot != NULL)
+  {
+    struct kc_timer_t* timer = *slot;
+
+    _unlink(self, timer);
+    _place(self, timer);
+
+    self->size++;
+  }
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,219 @@
+// This file is part of keepcoding_core
+// ==================================
+//
+// worker_pool.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../../hdrs/system/worker_pool.h"
+#include "../../hdrs/datastructs/histogram.h"
+#include "../../hdrs/system/clock.h"
+#include "../../hdrs/system/logger.h"
+#include "../../hdrs/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// 16 buckets for every power of 2, up to 2^40 ns (as the server metrics)
+#define KC_WORKER_POOL_SUB_BITS                                               4
+#define KC_WORKER_POOL_MAX_BITS                                              40
+
+//---------------------------------------------------------------------------//
+
+struct kc_work_t
+{
+  void (*work)  (void* data);
+  void* data;
+
+  uint64_t queued;  // when it was queued, in nanoseconds
+};
+
+//--- MARK: PUBLIC FUNCTION PROTOTYPES --------------------------------------//
+
+static int submit_worker_pool  (struct kc_worker_pool_t* self, void (*work)(void* data), void* data);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static void* _run_worker  (void* pool);
+static void  _stop        (struct kc_worker_pool_t* pool, size_t started);
+
+//---------------------------------------------------------------------------//
+
+struct kc_worker_pool_t* new_worker_pool(size_t threads, size_t queue_size)
+{
+  // create a pool instance to be returned
+  struct kc_worker_pool_t* new_pool = malloc(sizeof(struct kc_worker_pool_t));
+
+  // confirm that there is memory to allocate
+  if (new_pool == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+    return NULL;
+  }
+
+  memset(new_pool, 0, sizeof(struct kc_worker_pool_t));
+
+  new_pool->threads    = (threads > 0) ? threads : KC_WORKER_POOL_THREADS;
+  new_pool->queue_size = (queue_size > 0) ? queue_size : KC_WORKER_POOL_QUEUE_SIZE;
+
+  new_pool->waits    = new_histogram(KC_WORKER_POOL_SUB_BITS, KC_WORKER_POOL_MAX_BITS);
+  new_pool->_queue   = malloc(sizeof(struct kc_work_t) * new_pool->queue_size);
+  new_pool->_threads = malloc(sizeof(pthread_t) * new_pool->threads);
+
+  if (new_pool->waits == NULL || new_pool->_queue == NULL || new_pool->_threads == NULL)
+  {
+    log_error(KC_OUT_OF_MEMORY_LOG);
+
+    if (new_pool->waits != NULL)
+    {
+      destroy_histogram(new_pool->waits);
+    }
+
+    free(new_pool->_queue);
+    free(new_pool->_threads);
+    free(new_pool);
+
+    return NULL;
+  }
+
+  pthread_mutex_init(&new_pool->_lock, NULL);
+  pthread_cond_init(&new_pool->_available, NULL);
+
+  // assigns the public member methods
+  new_pool->submit = submit_worker_pool;
+
+  for (size_t i = 0; i < new_pool->threads; ++i)
+  {
+    if (pthread_create(&new_pool->_threads[i], NULL, &_run_worker, new_pool) != 0)
+    {
+      log_error(KC_THREAD_ERROR_LOG);
+
+      // the ones already started are stopped
+      _stop(new_pool, i);
+      free(new_pool);
+
+      return NULL;
+    }
+  }
+
+  return new_pool;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_worker_pool(struct kc_worker_pool_t* pool)
+{
+  if (pool == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return;
+  }
+
+  _stop(pool, pool->threads);
+  free(pool);
+}
+
+//--- MARK: PUBLIC FUNCTIONS ------------------------------------------------//
+
+static int submit_worker_pool(struct kc_worker_pool_t* self, void (*work)(void* data), void* data)
+{
+  if (self == NULL || work == NULL)
+  {
+    log_error(KC_NULL_REFERENCE_LOG);
+    return KC_NULL_REFERENCE;
+  }
+
+  pthread_mutex_lock(&self->_lock);
+
+  if (self->queued == self->queue_size || self->_stopping)
+  {
+    __atomic_store_n(&self->refused, self->refused + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&self->_lock);
+
+    return KC_OVERFLOW;
+  }
+
+  struct kc_work_t* next = &self->_queue[(self->_head + self->queued) % self->queue_size];
+
+  next->work   = work;
+  next->data   = data;
+  next->queued = kc_clock_monotonic_ns();
+
+  __atomic_store_n(&self->queued, self->queued + 1, __ATOMIC_RELAXED);
+
+  pthread_cond_signal(&self->_available);
+  pthread_mutex_unlock(&self->_lock);
+
+  return KC_SUCCESS;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static void* _run_worker(void* pool)
+{
+  struct kc_worker_pool_t* self = (struct kc_worker_pool_t*)pool;
+
+  pthread_mutex_lock(&self->_lock);
+
+  for (;;)
+  {
+    // a stopping pool still does the work already queued
+    while (self->queued == 0 && self->_stopping == false)
+    {
+      pthread_cond_wait(&self->_available, &self->_lock);
+    }
+
+    if (self->queued == 0)
+    {
+      break;
+    }
+
+    struct kc_work_t work = self->_queue[self->_head];
+
+    self->_head = (self->_head + 1) % self->queue_size;
+
+    __atomic_store_n(&self->queued, self->queued - 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->busy, self->busy + 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&self->_lock);
+
+    self->waits->record_atomic(self->waits, kc_clock_monotonic_ns() - work.queued);
+    work.work(work.data);
+
+    pthread_mutex_lock(&self->_lock);
+
+    __atomic_store_n(&self->busy, self->busy - 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&self->done, self->done + 1, __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_unlock(&self->_lock);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static void _stop(struct kc_worker_pool_t* pool, size_t started)
+{
+  pthread_mutex_lock(&pool->_lock);
+
+  pool->_stopping = true;
+
+  pthread_cond_broadcast(&pool->_available);
+  pthread_mutex_unlock(&pool->_lock);
+
+  for (size_t i = 0; i < started; ++i)
+  {
+    pthread_join(pool->_threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->_lock);
+  pthread_cond_destroy(&pool->_available);
+
+  destroy_histogram(pool->waits);
+  free(pool->_queue);
+  free(pool->_threads);
+}
+
+//---------------------------------------------------------------------------//
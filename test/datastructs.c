@@ -6,11 +6,17 @@
 // Copyright (c) 2024 Daniel Tanase
 // SPDX-License-Identifier: MIT License
 
+#include "../hdrs/datastructs/histogram.h"
+#include "../hdrs/datastructs/json.h"
+#include "../hdrs/datastructs/json_writer.h"
 #include "../hdrs/datastructs/map.h"
 #include "../hdrs/common.h"
 #include "../hdrs/test.h"
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 int main(void)
@@ -38,7 +44,458 @@ int main(void)
       destroy_map(map);
     }
 
+    subtest("remove()")
+    {
+      struct kc_map_t* map = new_map();
+
+      // enough keys for the slots to collide
+      char key[16];
+      for (int i = 0; i < 300; ++i)
+      {
+        sprintf(key, "key%d", i);
+        map->set(map, key, &i, sizeof(int));
+      }
+
+      ok(map->remove(map, "key42") == KC_SUCCESS);
+      ok(map->remove(map, "key42") == KC_INVALID);
+      ok(map->remove(map, "missing") == KC_INVALID);
+
+      int* found = NULL;
+      ok(map->get(map, "key42", (void**)&found) == KC_INVALID);
+
+      // the other keys are still there
+      bool all_found = true;
+      for (int i = 0; i < 300; ++i)
+      {
+        sprintf(key, "key%d", i);
+        if (i != 42 && (map->get(map, key, (void**)&found) != KC_SUCCESS || *found != i))
+        {
+          all_found = false;
+        }
+      }
+
+      ok(all_found == true);
+
+      // removed and set again
+      int val = 7;
+      ok(map->set(map, "key42", &val, sizeof(int)) == KC_SUCCESS);
+      ok(map->get(map, "key42", (void**)&found) == KC_SUCCESS);
+      ok(*found == 7);
+
+      destroy_map(map);
+    }
+
+    subtest("new_arena_map()")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+      struct kc_map_t* map = new_arena_map(arena);
+      ok(map != NULL);
+      ok(map->_arena == arena);
+
+      // enough keys for the slots to collide
+      char key[16];
+      for (int i = 0; i < 300; ++i)
+      {
+        sprintf(key, "key%d", i);
+        ok(map->set(map, key, &i, sizeof(int)) == KC_SUCCESS);
+      }
+
+      int val = 7;
+      ok(map->set(map, "key42", &val, sizeof(int)) == KC_SUCCESS);
+
+      int* found = NULL;
+      ok(map->get(map, "key42", (void**)&found) == KC_SUCCESS);
+      ok(*found == 7);
+      ok(map->get(map, "key299", (void**)&found) == KC_SUCCESS);
+      ok(*found == 299);
+      ok(map->get(map, "missing", (void**)&found) == KC_INVALID);
+
+      // nothing to free, the memory goes with the arena
+      destroy_map(map);
+      arena->reset(arena);
+
+      map = new_arena_map(arena);
+      ok(map->get(map, "key42", (void**)&found) == KC_INVALID);
+
+      destroy_arena(arena);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_json_t")
+  {
+    subtest("init/desc")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+      struct kc_json_t* json = new_json(arena);
+
+      ok(json != NULL);
+      ok(json->tape == NULL);
+      ok(json->tape_len == 0);
+      ok(json->parse != NULL);
+
+      destroy_arena(arena);
+    }
+
+    subtest("parse()")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+      struct kc_json_t* json = new_json(arena);
+
+      const char* doc =
+          "{ \"id\": 42, \"price\": -1.5e2, \"name\": \"caf\\u00e9 \\\"x\\\"\",\n"
+          "  \"tags\": [\"a\", \"b\", \"c\"], \"active\": true, \"meta\": null }";
+
+      ok(json->parse(json, doc, strlen(doc)) == KC_SUCCESS);
+      ok(json->tape_len > 0);
+
+      const char* invalid[] =
+      {
+        "{\"a\":1,}", "[1 2]", "{\"a\" 1}", "[tru]", "[01]", "\"abc",
+        "[1,]", "{\"a\":1}}", "[[]", "[\"\\ud800\"]", "   "
+      };
+
+      size_t invalid_len = sizeof(invalid) / sizeof(invalid[0]);
+      for (size_t i = 0; i < invalid_len; ++i)
+      {
+        struct kc_json_t* bad = new_json(arena);
+        ok(bad->parse(bad, invalid[i], strlen(invalid[i])) != KC_SUCCESS);
+      }
+
+      destroy_arena(arena);
+    }
+
+    subtest("cursor")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+      struct kc_json_t* json = new_json(arena);
+
+      const char* doc =
+          "{\"id\":42,\"price\":-1.5e2,\"name\":\"caf\\u00e9 \\\"x\\\"\","
+          "\"tags\":[\"a\",\"b\",\"c\"],\"active\":true,\"meta\":null}";
+
+      json->parse(json, doc, strlen(doc));
+
+      struct kc_json_cursor_t root;
+      struct kc_json_cursor_t value;
+
+      ok(json_root(json, &root) == KC_SUCCESS);
+      ok(json_type(root) == KC_JSON_OBJECT);
+
+      size_t size = 0;
+      ok(json_size(root, &size) == KC_SUCCESS);
+      ok(size == 6);
+
+      int64_t id = 0;
+      ok(json_get(root, "id", &value) == KC_SUCCESS);
+      ok(json_get_int(value, &id) == KC_SUCCESS);
+      ok(id == 42);
+
+      double price = 0;
+      ok(json_get(root, "price", &value) == KC_SUCCESS);
+      ok(json_get_double(value, &price) == KC_SUCCESS);
+      ok(price == -150.0);
+
+      const char* name = NULL;
+      size_t name_len = 0;
+      ok(json_get(root, "name", &value) == KC_SUCCESS);
+      ok(json_get_string(value, &name, &name_len) == KC_SUCCESS);
+      ok(strcmp(name, "caf\xc3\xa9 \"x\"") == 0);
+      ok(name_len == 9);
+
+      bool active = false;
+      ok(json_get(root, "active", &value) == KC_SUCCESS);
+      ok(json_get_bool(value, &active) == KC_SUCCESS);
+      ok(active == true);
+
+      ok(json_get(root, "meta", &value) == KC_SUCCESS);
+      ok(json_is_null(value) == true);
+
+      ok(json_get(root, "missing", &value) == KC_INVALID);
+      ok(json_get_int(root, &id) == KC_INVALID);
+
+      destroy_arena(arena);
+    }
+
+    subtest("json_query()")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+      struct kc_json_t* json = new_json(arena);
+
+      const char* doc = "{\"users\":[{\"name\":\"ann\"},{\"name\":\"bob\"}],\"a/b\":1}";
+      json->parse(json, doc, strlen(doc));
+
+      struct kc_json_cursor_t root;
+      struct kc_json_cursor_t value;
+      const char* name = NULL;
+      int64_t number = 0;
+
+      json_root(json, &root);
+
+      ok(json_query(root, "/users/1/name", &value) == KC_SUCCESS);
+      ok(json_get_string(value, &name, NULL) == KC_SUCCESS);
+      ok(strcmp(name, "bob") == 0);
+
+      ok(json_query(root, "/a~1b", &value) == KC_SUCCESS);
+      ok(json_get_int(value, &number) == KC_SUCCESS);
+      ok(number == 1);
+
+      ok(json_query(root, "", &value) == KC_SUCCESS);
+      ok(json_type(value) == KC_JSON_OBJECT);
+
+      ok(json_query(root, "/users/2", &value) == KC_INDEX_OUT_OF_BOUNDS);
+      ok(json_query(root, "/users/x", &value) == KC_INVALID_ARGUMENT);
+      ok(json_query(root, "users", &value) == KC_INVALID_ARGUMENT);
+
+      destroy_arena(arena);
+    }
+
+    subtest("json_first()/json_next()")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+      struct kc_json_t* json = new_json(arena);
+
+      const char* doc = "[1, [2, 3], {\"x\": 4}, 5]";
+      json->parse(json, doc, strlen(doc));
+
+      struct kc_json_cursor_t root;
+      struct kc_json_cursor_t child;
+      int64_t number = 0;
+      size_t count = 0;
+
+      json_root(json, &root);
+
+      // the nested containers are skipped
+      int ret = json_first(root, &child);
+      while (ret == KC_SUCCESS)
+      {
+        ++count;
+        ret = json_next(child, &child);
+      }
+
+      ok(count == 4);
+      ok(json_at(root, 3, &child) == KC_SUCCESS);
+      ok(json_get_int(child, &number) == KC_SUCCESS);
+      ok(number == 5);
+
+      destroy_arena(arena);
+    }
+
     done_testing();
   }
+
+  testgroup("kc_json_writer_t")
+  {
+    subtest("init/desc")
+    {
+      struct kc_json_writer_t* writer = new_json_writer(0);
+
+      ok(writer != NULL);
+      ok(writer->buffer != NULL);
+      ok(writer->len == 0);
+      ok(strcmp(writer->buffer, "") == 0);
+
+      destroy_json_writer(writer);
+    }
+
+    subtest("values")
+    {
+      // start small, so the buffer has to grow
+      struct kc_json_writer_t* writer = new_json_writer(4);
+
+      writer->begin_object(writer);
+      writer->key(writer, "id");
+      writer->integer(writer, -9223372036854775807LL - 1);
+      writer->key(writer, "list");
+      writer->begin_array(writer);
+      writer->integer(writer, 0);
+      writer->boolean(writer, true);
+      writer->boolean(writer, false);
+      writer->null(writer);
+      writer->begin_object(writer);
+      writer->end_object(writer);
+      writer->begin_array(writer);
+      writer->end_array(writer);
+      writer->end_array(writer);
+      writer->end_object(writer);
+
+      const char* expected =
+          "{\"id\":-9223372036854775808,\"list\":[0,true,false,null,{},[]]}";
+
+      ok(strcmp(writer->buffer, expected) == 0);
+      ok(writer->len == strlen(expected));
+
+      destroy_json_writer(writer);
+    }
+
+    subtest("string()")
+    {
+      struct kc_json_writer_t* writer = new_json_writer(0);
+
+      // long enough to go through the 16 bytes scan
+      writer->string(writer, "a \"quoted\" text, a \\ backslash,\n a new line and \x01");
+
+      ok(strcmp(writer->buffer,
+          "\"a \\\"quoted\\\" text, a \\\\ backslash,\\n a new line and \\u0001\"") == 0);
+
+      destroy_json_writer(writer);
+    }
+
+    subtest("number()")
+    {
+      struct kc_json_writer_t* writer = new_json_writer(0);
+
+      double numbers[] = { 0.0, 0.1, -1.5, 1e21, 1e-7, 123.456, 5e-324 };
+
+      writer->begin_array(writer);
+      for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i)
+      {
+        writer->number(writer, numbers[i]);
+      }
+      writer->end_array(writer);
+
+      ok(strcmp(writer->buffer, "[0,0.1,-1.5,1e21,1e-7,123.456,5e-324]") == 0);
+
+      destroy_json_writer(writer);
+    }
+
+    subtest("release()")
+    {
+      struct kc_json_writer_t* writer = new_json_writer(0);
+
+      char* buffer = NULL;
+      size_t len = 0;
+
+      writer->string(writer, "done");
+
+      ok(writer->release(writer, &buffer, &len) == KC_SUCCESS);
+      ok(strcmp(buffer, "\"done\"") == 0);
+      ok(len == 6);
+      ok(writer->buffer == NULL);
+
+      free(buffer);
+      destroy_json_writer(writer);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_histogram_t")
+  {
+    subtest("init/desc")
+    {
+      struct kc_histogram_t* histogram = new_histogram(4, 40);
+      ok(histogram != NULL);
+      ok(histogram->count == 0);
+      ok(histogram->percentile(histogram, 50) == 0);
+      destroy_histogram(histogram);
+
+      // the precision must fit in the range
+      ok(new_histogram(0, 40) == NULL);
+      ok(new_histogram(8, 8) == NULL);
+      ok(new_histogram(4, 65) == NULL);
+    }
+
+    subtest("record()/percentile()")
+    {
+      struct kc_histogram_t* histogram = new_histogram(4, 64);
+
+      for (uint64_t value = 1; value <= 10000; ++value)
+      {
+        histogram->record(histogram, value);
+      }
+
+      ok(histogram->count == 10000);
+      ok(histogram->sum == 50005000);
+      ok(histogram->min == 1);
+      ok(histogram->max == 10000);
+
+      // within 1/16 of the values
+      uint64_t median = histogram->percentile(histogram, 50);
+      ok(median >= 5000 && median <= 5000 + 5000 / 16);
+
+      uint64_t p99 = histogram->percentile(histogram, 99);
+      ok(p99 >= 9900 && p99 <= 9900 + 9900 / 16);
+
+      ok(histogram->percentile(histogram, 0) == 1);
+      ok(histogram->percentile(histogram, 100) == 10000);
+
+      // the small values are exact
+      ok(histogram->count_below(histogram, 31) == 31);
+      ok(histogram->count_below(histogram, UINT64_MAX) == 10000);
+
+      // the values beyond the range are kept in the last bucket
+      histogram->record(histogram, UINT64_MAX);
+      ok(histogram->percentile(histogram, 100) == UINT64_MAX);
+
+      histogram->reset(histogram);
+      ok(histogram->count == 0);
+      ok(histogram->percentile(histogram, 100) == 0);
+
+      destroy_histogram(histogram);
+    }
+
+    subtest("merge()")
+    {
+      struct kc_histogram_t* first  = new_histogram(4, 40);
+      struct kc_histogram_t* second = new_histogram(4, 40);
+      struct kc_histogram_t* other  = new_histogram(5, 40);
+
+      first->record(first, 100);
+      second->record_atomic(second, 1000);
+      second->record_atomic(second, 10);
+
+      ok(first->merge(first, second) == KC_SUCCESS);
+      ok(first->count == 3);
+      ok(first->sum == 1110);
+      ok(first->min == 10);
+      ok(first->max == 1000);
+      ok(first->percentile(first, 50) >= 100 && first->percentile(first, 50) <= 106);
+
+      // only the histograms of the same layout are merged
+      ok(first->merge(first, other) == KC_INVALID_ARGUMENT);
+
+      destroy_histogram(first);
+      destroy_histogram(second);
+      destroy_histogram(other);
+    }
+
+    subtest("serialize()")
+    {
+      struct kc_histogram_t* histogram = new_histogram(4, 40);
+
+      for (uint64_t value = 1; value <= 1000000; value *= 3)
+      {
+        histogram->record(histogram, value);
+      }
+
+      char* data = NULL;
+      size_t len = 0;
+
+      ok(histogram->serialize(histogram, &data, &len) == KC_SUCCESS);
+
+      // only the buckets in use are written
+      ok(len < 100);
+
+      struct kc_histogram_t* copy = deserialize_histogram(data, len);
+      ok(copy != NULL);
+      ok(copy->count == histogram->count);
+      ok(copy->sum == histogram->sum);
+      ok(copy->min == 1 && copy->max == histogram->max);
+      ok(copy->percentile(copy, 90) == histogram->percentile(histogram, 90));
+      ok(memcmp(copy->buckets, histogram->buckets, histogram->buckets_len * sizeof(uint64_t)) == 0);
+
+      // a cut buffer is refused
+      ok(deserialize_histogram(data, len - 1) == NULL);
+
+      free(data);
+      destroy_histogram(copy);
+      destroy_histogram(histogram);
+    }
+
+    done_testing();
+  }
+
   return 0;
 }
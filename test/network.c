@@ -7,15 +7,29 @@
 // SPDX-License-Identifier: MIT License
 
 #include "../hdrs/datastructs/map.h"
+#include "../hdrs/network/asset_cache.h"
 #include "../hdrs/network/server.h"
 #include "../hdrs/network/client.h"
 #include "../hdrs/network/http.h"
+#include "../hdrs/network/http_form.h"
 #include "../hdrs/network/http_parser.h"
+#include "../hdrs/network/io_engine.h"
+#include "../hdrs/network/metrics.h"
+#include "../hdrs/network/response_cache.h"
+#include "../hdrs/network/hpack.h"
+#include "../hdrs/network/http2.h"
+#include "../hdrs/network/sse.h"
+#include "../hdrs/network/websocket.h"
 #include "../hdrs/test.h"
 
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
 
 void test_server(void)
 {
@@ -47,6 +61,9 @@ int get_test(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_
   printf("url: %s \n", req->url);
   printf("HTTP version: %s \n\n", req->http_ver);
 
+  // the headers are parsed on the first lookup
+  char* header_val = req->get_header(req, "Host");
+
   for (int i = 0; i < KC_MAP_MAX_SIZE; ++i)
   {
     struct kc_entry_t* entry = req->headers->entries[i];
@@ -69,15 +86,6 @@ int get_test(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_
     }
   }
 
-  printf("\n\n");
-
-  char* header_val = NULL;
-  int ret = req->headers->get(req->headers, "Host", (void*)&header_val);
-  if (ret != KC_SUCCESS)
-  {
-    printf("%d", ret);
-  }
-
   printf("\n\n%s\n\n", header_val);
 
   res->set_body(res, "GET test");
@@ -92,6 +100,242 @@ int post_test(struct kc_server_t* self, struct kc_http_request_t* req, struct kc
 }
 
 
+struct response_reader_t
+{
+  int fd;
+  char* buffer;
+  size_t len;
+  size_t size;
+};
+
+void* read_response(void* data)
+{
+  struct response_reader_t* reader = (struct response_reader_t*)data;
+
+  ssize_t ret = 0;
+  while ((ret = recv(reader->fd, reader->buffer + reader->len,
+      reader->size - reader->len, 0)) > 0)
+  {
+    reader->len += ret;
+  }
+
+  return NULL;
+}
+
+void* acquire_cached(void* cache)
+{
+  struct kc_response_cache_t* responses = (struct kc_response_cache_t*)cache;
+  struct kc_cached_response_t* response = NULL;
+
+  // waits for the key to be filled by the first caller
+  if (responses->acquire(responses, "/key", &response) != KC_SUCCESS)
+  {
+    return NULL;
+  }
+
+  return response;
+}
+
+struct engine_conn_t
+{
+  int    accepted;
+  int    closed;
+  int    draining;
+  int    woken;
+  int    ready;
+  char   buffer[16];
+  size_t len;
+};
+
+void* engine_accepted(void* data, int fd)
+{
+  struct engine_conn_t* conn = (struct engine_conn_t*)data;
+  conn->accepted++;
+
+  return conn;
+}
+
+char* engine_buffer(void* data, size_t* size)
+{
+  struct engine_conn_t* conn = (struct engine_conn_t*)data;
+  (*size) = sizeof(conn->buffer) - conn->len;
+
+  return conn->buffer + conn->len;
+}
+
+bool engine_received(void* data, size_t len)
+{
+  struct engine_conn_t* conn = (struct engine_conn_t*)data;
+  conn->len += len;
+
+  // the connection is closed once the whole message is here
+  return conn->len < 5;
+}
+
+void engine_closed(void* data)
+{
+  struct engine_conn_t* conn = (struct engine_conn_t*)data;
+  conn->closed++;
+}
+
+void engine_draining(void* data)
+{
+  struct engine_conn_t* conn = (struct engine_conn_t*)data;
+  conn->draining++;
+}
+
+void engine_woken(void* data)
+{
+  struct engine_conn_t* conn = (struct engine_conn_t*)data;
+  conn->woken++;
+}
+
+void engine_ready(void* data, int fd)
+{
+  struct engine_conn_t* conn = (struct engine_conn_t*)data;
+  conn->ready++;
+
+  char byte = 0;
+  ssize_t ret = read(fd, &byte, 1);
+  (void)ret;
+}
+
+void* run_engine(void* data)
+{
+  struct kc_io_engine_t* engine = (struct kc_io_engine_t*)data;
+  engine->run(engine);
+
+  return NULL;
+}
+
+void* record_metrics(void* data)
+{
+  struct kc_metrics_t* metrics = (struct kc_metrics_t*)data;
+  struct kc_metrics_sample_t sample = { 1, 200, 10, 20, { 1000, 2000, 0, 0 } };
+
+  for (int i = 0; i < 1000; ++i)
+  {
+    metrics->record(metrics, &sample);
+  }
+
+  return NULL;
+}
+
+// the last message given to the WebSocket handler
+static char   ws_message[256];
+static size_t ws_message_len;
+static int    ws_opcode;
+static int    ws_closed_code;
+
+void ws_on_message(struct kc_websocket_t* ws, int opcode, char* data, size_t len)
+{
+  ws_opcode = opcode;
+  ws_message_len = len;
+  memcpy(ws_message, data, len);
+}
+
+void ws_on_closed(struct kc_websocket_t* ws, int code)
+{
+  ws_closed_code = code;
+}
+
+// a frame as the clients send it, masked
+size_t ws_frame(char* frame, int first_byte, const char* payload, size_t len)
+{
+  const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+
+  frame[0] = (char)first_byte;
+  frame[1] = (char)(0x80 | len);
+  memcpy(frame + 2, mask, 4);
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    frame[6 + i] = payload[i] ^ mask[i % 4];
+  }
+
+  return 6 + len;
+}
+
+// the headers decoded by HPACK, as "name: value\n"
+static char   hpack_headers[512];
+static size_t hpack_headers_len;
+
+int hpack_on_header(void* data, const char* name, size_t name_len, const char* value, size_t value_len)
+{
+  hpack_headers_len += sprintf(hpack_headers + hpack_headers_len, "%.*s: %.*s\n",
+      (int)name_len, name, (int)value_len, value);
+  return KC_SUCCESS;
+}
+
+// the last request given to the HTTP/2 handler, answered with no content
+static char h2_request[256];
+
+void h2_on_request(struct kc_http2_t* h2, struct kc_http2_stream_t* stream)
+{
+  snprintf(h2_request, sizeof(h2_request), "%s", stream->request);
+
+  struct kc_http2_field_t status = { ":status", 7, "204", 3 };
+  h2->send_headers(h2, stream, &status, 1, true);
+}
+
+// a frame as the clients send it
+size_t h2_frame(uint8_t* frame, uint8_t type, uint8_t flags, uint32_t id, const void* payload, size_t len)
+{
+  frame[0] = (uint8_t)(len >> 16);
+  frame[1] = (uint8_t)(len >> 8);
+  frame[2] = (uint8_t)len;
+  frame[3] = type;
+  frame[4] = flags;
+  frame[5] = (uint8_t)(id >> 24);
+  frame[6] = (uint8_t)(id >> 16);
+  frame[7] = (uint8_t)(id >> 8);
+  frame[8] = (uint8_t)id;
+
+  memcpy(frame + KC_HTTP2_FRAME_HEADER_SIZE, payload, len);
+
+  return KC_HTTP2_FRAME_HEADER_SIZE + len;
+}
+
+// the first frame of a type among the ones the server sent (NULL if none)
+uint8_t* h2_find(uint8_t* frames, size_t len, uint8_t type, uint8_t flags)
+{
+  size_t pos = 0;
+  while (pos + KC_HTTP2_FRAME_HEADER_SIZE <= len)
+  {
+    size_t length = ((size_t)frames[pos] << 16) | ((size_t)frames[pos + 1] << 8) | frames[pos + 2];
+
+    if (frames[pos + 3] == type && (frames[pos + 4] & flags) == flags)
+    {
+      return frames + pos;
+    }
+
+    pos += KC_HTTP2_FRAME_HEADER_SIZE + length;
+  }
+
+  return NULL;
+}
+
+// the layers a request went through, in order
+static char chain_trace[16];
+
+int chain_first(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res)
+{
+  strcat(chain_trace, "1");
+  return self->next(self, req, res);
+}
+
+int chain_stop(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res)
+{
+  strcat(chain_trace, "s");
+  return KC_SUCCESS;
+}
+
+int chain_handler(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res)
+{
+  strcat(chain_trace, "h");
+  return KC_SERVER_SEND_MSG;
+}
+
 int main(int argc, char **argv)
 {
   // this will stop the logger from displaing
@@ -166,12 +410,52 @@ int main(int argc, char **argv)
   {
     subtest("http_parse_request_line()")
     {
+      struct kc_http_request_t* req = new_request();
+      char request_line[] = "GET /users/list?page=2&name=john+doe HTTP/1.1";
+
+      ok(http_parse_request_line(request_line, req) == KC_SUCCESS);
+      ok(strcmp(req->method, "GET") == 0);
+      ok(strcmp(req->url, "/users/list") == 0);
+      ok(strcmp(req->http_ver, "HTTP/1.1") == 0);
+
+      note("the query string is only located, not parsed");
+      ok(req->_raw_query != NULL);
+      ok(req->_raw_query_len == strlen("page=2&name=john+doe"));
+      ok(req->_params_parsed == false);
 
+      ok(http_parse_request_line(NULL, req) == KC_FORMAT_ERROR);
+
+      destroy_request(req);
     }
 
     subtest("http_parse_request_headers()")
     {
+      struct kc_http_request_t* req = new_request();
+      char request_headers[] = "Host: localhost:8000\r\nAccept: */*\r\n";
+
+      ok(http_parse_request_headers(request_headers, req) == KC_SUCCESS);
+      ok(req->_raw_headers == request_headers);
+      ok(req->_raw_headers_len == strlen(request_headers));
+      ok(req->_headers_parsed == false);
+
+      ok(http_parse_request_headers(NULL, req) == KC_FORMAT_ERROR);
+
+      destroy_request(req);
+    }
+
+    subtest("http_url_decode()")
+    {
+      char dest[32];
+
+      ok(http_url_decode(dest, "john+doe", 8) == 8);
+      ok(strcmp(dest, "john doe") == 0);
+
+      ok(http_url_decode(dest, "a%20b%2Fc", 9) == 5);
+      ok(strcmp(dest, "a b/c") == 0);
 
+      note("invalid sequences are kept as they are");
+      ok(http_url_decode(dest, "100%zz", 6) == 6);
+      ok(strcmp(dest, "100%zz") == 0);
     }
 
     subtest("http_parse_request_body()")
@@ -179,6 +463,136 @@ int main(int argc, char **argv)
 
     }
 
+    subtest("http_parse_content_type()")
+    {
+      ok(http_parse_content_type("application/json") == KC_BODY_CONTENT_TYPE_JSON);
+      ok(http_parse_content_type("Application/JSON; charset=utf-8") == KC_BODY_CONTENT_TYPE_JSON);
+      ok(http_parse_content_type("text/html") == KC_BODY_CONTENT_TYPE_HTML);
+      ok(http_parse_content_type("text/plain") == KC_BODY_CONTENT_TYPE_TEXT);
+      ok(http_parse_content_type("application/x-www-form-urlencoded") == KC_BODY_CONTENT_TYPE_FORM);
+      ok(http_parse_content_type("multipart/form-data; boundary=x") == KC_BODY_CONTENT_TYPE_MULTIPART);
+      ok(http_parse_content_type("application/jsonp") == KC_INVALID);
+      ok(http_parse_content_type(NULL) == KC_NULL_REFERENCE);
+    }
+
+    subtest("http_parse_date()")
+    {
+      time_t time = 0;
+      ok(http_parse_date("Sun, 06 Nov 1994 08:49:37 GMT", &time) == KC_SUCCESS);
+      ok(time == 784111777);
+
+      ok(http_parse_date("Thu, 01 Jan 1970 00:00:00 GMT", &time) == KC_SUCCESS);
+      ok(time == 0);
+
+      ok(http_parse_date("Tue, 29 Feb 2028 23:59:59 GMT", &time) == KC_SUCCESS);
+      ok(time == 1835481599);
+
+      // only the fixed format is accepted
+      ok(http_parse_date("Sunday, 06-Nov-94 08:49:37 GMT", &time) == KC_FORMAT_ERROR);
+      ok(http_parse_date("Sun Nov  6 08:49:37 1994", &time) == KC_FORMAT_ERROR);
+      ok(http_parse_date("Sun, 06 Nop 1994 08:49:37 GMT", &time) == KC_FORMAT_ERROR);
+      ok(http_parse_date("Sun, 06 Nov 1994 08:49:37 UTC", &time) == KC_FORMAT_ERROR);
+      ok(http_parse_date(NULL, &time) == KC_NULL_REFERENCE);
+    }
+
+    subtest("http_format_date()")
+    {
+      char date[KC_HTTP_DATE_SIZE];
+
+      ok(http_format_date(784111777, date) == KC_HTTP_DATE_SIZE - 1);
+      ok(strcmp(date, "Sun, 06 Nov 1994 08:49:37 GMT") == 0);
+
+      // every formatted date is parsed back to the same time
+      for (time_t t = 0; t < 4102444800; t += 86399 * 37)
+      {
+        time_t parsed = 0;
+        http_format_date(t, date);
+
+        if (http_parse_date(date, &parsed) != KC_SUCCESS || parsed != t)
+        {
+          ok(false);
+          break;
+        }
+      }
+
+      ok(true);
+    }
+
+    subtest("http_parse_range()")
+    {
+      struct kc_http_range_t ranges[KC_HTTP_MAX_RANGES];
+      int ranges_len = 0;
+
+      ok(http_parse_range("bytes=0-499", 1000, ranges, &ranges_len) == KC_SUCCESS);
+      ok(ranges_len == 1);
+      ok(ranges[0].start == 0 && ranges[0].len == 500);
+
+      // the open and the suffix ranges, and a last byte past the end
+      ok(http_parse_range("bytes=900-, -100, 990-5000", 1000, ranges, &ranges_len) == KC_SUCCESS);
+      ok(ranges_len == 3);
+      ok(ranges[0].start == 900 && ranges[0].len == 100);
+      ok(ranges[1].start == 900 && ranges[1].len == 100);
+      ok(ranges[2].start == 990 && ranges[2].len == 10);
+
+      // a suffix longer than the file is the whole file
+      ok(http_parse_range("bytes=-5000", 1000, ranges, &ranges_len) == KC_SUCCESS);
+      ok(ranges[0].start == 0 && ranges[0].len == 1000);
+
+      // only the satisfiable ranges are kept
+      ok(http_parse_range("bytes=2000-3000,10-19", 1000, ranges, &ranges_len) == KC_SUCCESS);
+      ok(ranges_len == 1);
+      ok(ranges[0].start == 10 && ranges[0].len == 10);
+
+      ok(http_parse_range("bytes=1000-", 1000, ranges, &ranges_len) == KC_INVALID);
+      ok(http_parse_range("bytes=-0", 1000, ranges, &ranges_len) == KC_INVALID);
+      ok(http_parse_range("bytes=0-", 0, ranges, &ranges_len) == KC_INVALID);
+
+      // the malformed headers are ignored
+      ok(http_parse_range("bytes=500-100", 1000, ranges, &ranges_len) == KC_FORMAT_ERROR);
+      ok(http_parse_range("bytes=-", 1000, ranges, &ranges_len) == KC_FORMAT_ERROR);
+      ok(http_parse_range("bytes=", 1000, ranges, &ranges_len) == KC_FORMAT_ERROR);
+      ok(http_parse_range("bytes=1-2;3-4", 1000, ranges, &ranges_len) == KC_FORMAT_ERROR);
+      ok(http_parse_range("items=0-10", 1000, ranges, &ranges_len) == KC_FORMAT_ERROR);
+
+      // and so are too many ranges
+      char many[256] = "bytes=0-0";
+      for (int i = 1; i <= KC_HTTP_MAX_RANGES; ++i)
+      {
+        sprintf(many + strlen(many), ",%d-%d", i, i);
+      }
+
+      ok(http_parse_range(many, 1000, ranges, &ranges_len) == KC_OVERFLOW);
+      ok(http_parse_range(NULL, 1000, ranges, &ranges_len) == KC_NULL_REFERENCE);
+    }
+
+    subtest("http_match_etag()")
+    {
+      ok(http_match_etag("\"abc\"", "\"abc\"") == KC_SUCCESS);
+      ok(http_match_etag("\"x\", W/\"abc\"", "\"abc\"") == KC_SUCCESS);
+      ok(http_match_etag("\"abc\"", "W/\"abc\"") == KC_SUCCESS);
+      ok(http_match_etag("*", "\"abc\"") == KC_SUCCESS);
+
+      ok(http_match_etag("\"abcd\", \"ab\"", "\"abc\"") == KC_INVALID);
+      ok(http_match_etag("abc", "\"abc\"") == KC_INVALID);
+      ok(http_match_etag("\"abc", "\"abc\"") == KC_INVALID);
+      ok(http_match_etag(NULL, "\"abc\"") == KC_NULL_REFERENCE);
+    }
+
+    subtest("http_accept_encoding()")
+    {
+      ok(http_accept_encoding("gzip, deflate, br", "br") == KC_SUCCESS);
+      ok(http_accept_encoding("GZIP;q=0.5", "gzip") == KC_SUCCESS);
+      ok(http_accept_encoding("*", "gzip") == KC_SUCCESS);
+      ok(http_accept_encoding("br;q=1.0, *;q=0", "br") == KC_SUCCESS);
+
+      ok(http_accept_encoding("gzip, br;q=0", "br") == KC_INVALID);
+      ok(http_accept_encoding("br;q=0.000", "br") == KC_INVALID);
+      ok(http_accept_encoding("br;q=1, *;q=0", "gzip") == KC_INVALID);
+      ok(http_accept_encoding("gzip2, xgzip", "gzip") == KC_INVALID);
+      ok(http_accept_encoding("", "gzip") == KC_INVALID);
+      ok(http_accept_encoding(NULL, "gzip") == KC_NULL_REFERENCE);
+    }
+
     subtest("validate_http_method()")
     {
       const char* valid_methods[] =
@@ -207,7 +621,7 @@ int main(int argc, char **argv)
         "/path123/with456/nums789/0", "/0/1/2/3/4/5/6/7/8/9/", "/-_/_-", "/",
         "/ABCDEFGHIJKLMNOPQRSTUVWXYZ", "/abcdefghijklmnopqrstuvwxyz",
         "/ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
-        "/0123456789"
+        "/0123456789", "/style.css", "/~user/file.tar.gz", "/name%20with%20space"
       };
 
       // test valid paths
@@ -285,26 +699,1651 @@ int main(int argc, char **argv)
       destroy_request(req);
     }
 
+    subtest("new_arena_request()")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+
+      // every cycle reuses the same memory
+      for (int i = 0; i < 3; ++i)
+      {
+        struct kc_http_request_t* req = new_arena_request(arena);
+        char request_line[] = "POST /users?id=12 HTTP/1.1";
+        char request_headers[] = "Host: localhost\r\nContent-Type: text/plain\r\n";
+
+        ok(req != NULL);
+        ok(req->_in_arena == true);
+        ok(req->arena == arena);
+
+        ok(http_parse_request_line(request_line, req) == KC_SUCCESS);
+        ok(http_parse_request_headers(request_headers, req) == KC_SUCCESS);
+        ok(http_parse_request_body("hello", req) == KC_SUCCESS);
+
+        ok(strcmp(req->method, "POST") == 0);
+        ok(strcmp(req->url, "/users") == 0);
+        ok(strcmp(req->body, "hello") == 0);
+        ok(strcmp(req->get_header(req, "Host"), "localhost") == 0);
+        ok(strcmp(req->get_param(req, "id"), "12") == 0);
+
+        destroy_request(req);
+        arena->reset(arena);
+      }
+
+      destroy_arena(arena);
+    }
+
     subtest("get_header()")
     {
       struct kc_http_request_t* req = new_request();
+      char request_headers[] =
+          "Host: localhost:8000\r\n"
+          "Content-Type:  application/json \r\n"
+          "Malformed header\r\n";
+
+      http_parse_request_headers(request_headers, req);
+
+      ok(strcmp(req->get_header(req, "Host"), "localhost:8000") == 0);
+      ok(req->_headers_parsed == true);
+      ok(strcmp(req->get_header(req, "Content-Type"), "application/json") == 0);
+      ok(req->get_header(req, "Malformed header") == NULL);
+      ok(req->get_header(req, "Accept") == NULL);
+
       destroy_request(req);
     }
 
     subtest("get_param()")
     {
       struct kc_http_request_t* req = new_request();
+      char request_line[] = "GET /search?q=hello%20world&lang=en&debug HTTP/1.1";
+
+      http_parse_request_line(request_line, req);
+
+      ok(strcmp(req->get_param(req, "q"), "hello world") == 0);
+      ok(req->_params_parsed == true);
+      ok(strcmp(req->get_param(req, "lang"), "en") == 0);
+      ok(strcmp(req->get_param(req, "debug"), "") == 0);
+      ok(req->get_param(req, "page") == NULL);
+
+      destroy_request(req);
+    }
+
+    subtest("get_json()")
+    {
+      struct kc_http_request_t* req = new_request();
+      char request_headers[] = "Content-Type: application/json\r\n";
+
+      http_parse_request_headers(request_headers, req);
+      _set_req_body(req, "{\"id\": 7}");
+
+      struct kc_json_t* json = req->get_json(req);
+      ok(json != NULL);
+      ok(req->arena != NULL);
+
+      note("the body is parsed only once");
+      ok(req->get_json(req) == json);
+
+      struct kc_json_cursor_t root;
+      struct kc_json_cursor_t id;
+      int64_t id_val = 0;
+
+      json_root(json, &root);
+      ok(json_get(root, "id", &id) == KC_SUCCESS);
+      ok(json_get_int(id, &id_val) == KC_SUCCESS);
+      ok(id_val == 7);
+
+      destroy_request(req);
+
+      note("the other content types are not parsed");
+      req = new_request();
+      char text_headers[] = "Content-Type: text/plain\r\n";
+
+      http_parse_request_headers(text_headers, req);
+      _set_req_body(req, "{\"id\": 7}");
+
+      ok(req->get_json(req) == NULL);
+
+      destroy_request(req);
+
+      note("the rest of the body is read before the parse");
+      req = new_request();
+      char json_headers[] = "Content-Type: application/json\r\n";
+      char buffered[] = "{\"id\": ";
+
+      int fds[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+      ok(send(fds[1], "42}", 3, 0) == 3);
+
+      http_parse_request_headers(json_headers, req);
+      _set_req_body(req, buffered);
+
+      req->client_fd          = fds[0];
+      req->_body_buffered     = buffered;
+      req->_body_buffered_len = strlen(buffered);
+      req->_body_left         = 3;
+
+      json = req->get_json(req);
+      ok(json != NULL);
+      ok(req->_body_left == 0);
+
+      json_root(json, &root);
+      ok(json_get(root, "id", &id) == KC_SUCCESS);
+      ok(json_get_int(id, &id_val) == KC_SUCCESS);
+      ok(id_val == 42);
+
+      destroy_request(req);
+
+      note("the bodies over the limit are not read");
+      req = new_request();
+
+      http_parse_request_headers(json_headers, req);
+      _set_req_body(req, buffered);
+
+      req->client_fd          = fds[0];
+      req->_body_buffered     = buffered;
+      req->_body_buffered_len = strlen(buffered);
+      req->_body_left         = KC_HTTP_JSON_MAX_SIZE;
+
+      ok(req->get_json(req) == NULL);
+
+      destroy_request(req);
+
+      close(fds[0]);
+      close(fds[1]);
+    }
+
+    subtest("read_form()")
+    {
+      struct kc_http_request_t* req = new_request();
+      char request_headers[] = "Content-Type: application/x-www-form-urlencoded\r\n";
+      char body[] = "name=john+doe&city=New%20York";
+
+      http_parse_request_headers(request_headers, req);
+      req->_body_buffered     = body;
+      req->_body_buffered_len = strlen(body);
+
+      ok(req->read_form(req) == KC_SUCCESS);
+      ok(strcmp(req->get_param(req, "name"), "john doe") == 0);
+      ok(strcmp(req->get_param(req, "city"), "New York") == 0);
+
+      note("the body can be read only once");
+      size_t len = 1;
+      ok(req->read_body(req, body, sizeof(body), &len) == KC_SUCCESS);
+      ok(len == 0);
+
       destroy_request(req);
     }
 
     done_testing();
   }
 
+  testgroup("http_form")
+  {
+    subtest("kc_urlencoded_t")
+    {
+      struct kc_map_t* params = new_map();
+      struct kc_urlencoded_t* form = new_urlencoded(params);
+
+      // the pairs are split across the chunks
+      ok(form->feed(form, "id=4", 4) == KC_SUCCESS);
+      ok(form->feed(form, "2&na", 4) == KC_SUCCESS);
+      ok(form->feed(form, "me=a%2", 6) == KC_SUCCESS);
+      ok(form->feed(form, "0b", 2) == KC_SUCCESS);
+      ok(form->finish(form) == KC_SUCCESS);
+
+      char* val = NULL;
+      ok(params->get(params, "id", (void*)&val) == KC_SUCCESS);
+      ok(strcmp(val, "42") == 0);
+      ok(params->get(params, "name", (void*)&val) == KC_SUCCESS);
+      ok(strcmp(val, "a b") == 0);
+
+      destroy_urlencoded(form);
+      destroy_map(params);
+    }
+
+    subtest("kc_multipart_t")
+    {
+      ok(new_multipart("multipart/form-data") == NULL);
+
+      struct kc_multipart_t* form =
+          new_multipart("multipart/form-data; boundary=\"--xyz\"");
+      ok(form != NULL);
+
+      struct kc_map_t* fields = new_map();
+      ok(form->save_files(form, "/tmp", fields) == KC_SUCCESS);
+
+      const char body[] =
+          "----xyz\r\n"
+          "Content-Disposition: form-data; name=\"title\"\r\n\r\n"
+          "hello\r\n----xy\r\n"
+          "----xyz\r\n"
+          "Content-Disposition: form-data; name=\"doc\"; filename=\"../kc_upload.txt\"\r\n"
+          "Content-Type: text/plain\r\n\r\n"
+          "line 1\r\nline 2\r\n"
+          "----xyz--\r\n";
+
+      // feed one byte at a time, the worst case for the boundary search
+      int ret = KC_SUCCESS;
+      for (size_t i = 0; i < sizeof(body) - 1 && ret == KC_SUCCESS; ++i)
+      {
+        ret = form->feed(form, body + i, 1);
+      }
+
+      ok(ret == KC_SUCCESS);
+      ok(form->finish(form) == KC_SUCCESS);
+
+      char* val = NULL;
+      ok(fields->get(fields, "title", (void*)&val) == KC_SUCCESS);
+      ok(strcmp(val, "hello\r\n----xy") == 0);
+
+      note("the file is saved without the path sent by the client");
+      ok(fields->get(fields, "doc", (void*)&val) == KC_SUCCESS);
+      ok(strcmp(val, "/tmp/kc_upload.txt") == 0);
+
+      FILE* file = fopen("/tmp/kc_upload.txt", "r");
+      char content[32] = { 0 };
+
+      ok(file != NULL);
+      ok(fread(content, 1, sizeof(content) - 1, file) == 14);
+      ok(strcmp(content, "line 1\r\nline 2") == 0);
+
+      fclose(file);
+      remove("/tmp/kc_upload.txt");
+
+      destroy_map(fields);
+      destroy_multipart(form);
+    }
+
+    done_testing();
+  }
+
   testgroup("kc_http_response_t")
   {
     subtest("init/desc")
     {
+      struct kc_http_response_t* res = new_response();
+
+      ok(res != NULL);
+      ok(strcmp(res->http_ver, KC_HTTP_1) == 0);
+      ok(res->status == KC_HTTP_OK);
+      ok(res->headers_len == 0);
+
+      destroy_response(res);
+    }
+
+    subtest("new_arena_response()")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+      struct kc_http_response_t* res = new_arena_response(arena);
+
+      ok(res != NULL);
+      ok(res->_in_arena == true);
+      ok(res->status == KC_HTTP_OK);
+
+      // the long lists move to the arena as well
+      char key[32];
+      for (int i = 0; i < 40; ++i)
+      {
+        sprintf(key, "X-Header-%d", i);
+        ok(res->set_header(res, key, "value") == KC_SUCCESS);
+      }
+
+      ok(res->headers_len == 40);
+      ok(res->headers != res->_inline_headers);
+
+      // every list the headers moved through kept the ones before
+      bool kept = true;
+      for (int i = 0; i < 40; ++i)
+      {
+        sprintf(key, "X-Header-%d: ", i);
+        kept = kept && strcmp(res->headers[i].key, key) == 0;
+      }
+
+      ok(kept);
+
+      ok(res->set_body(res, "<h1>Hello</h1>") == KC_SUCCESS);
+      ok(res->_heap_body == false);
+      ok(res->body_len == 14);
+
+      // the body of a writer is taken over and freed on destroy
+      struct kc_json_writer_t* writer = new_json_writer(0);
+      writer->begin_object(writer);
+      writer->end_object(writer);
+
+      ok(res->set_json(res, writer) == KC_SUCCESS);
+      ok(res->_heap_body == true);
+      ok(strcmp(res->body, "{}") == 0);
+
+      destroy_json_writer(writer);
+      destroy_response(res);
+      destroy_arena(arena);
+    }
+
+    subtest("http_mime_type()")
+    {
+      ok(strcmp(http_mime_type("/www/index.html"), "text/html; charset=utf-8") == 0);
+      ok(strcmp(http_mime_type("app.JS"), "text/javascript; charset=utf-8") == 0);
+      ok(strcmp(http_mime_type("logo.png"), "image/png") == 0);
+      ok(strcmp(http_mime_type("fonts/a.woff2"), "font/woff2") == 0);
+
+      // no extension, or an unknown one
+      ok(strcmp(http_mime_type("Makefile"), KC_HTTP_DEFAULT_MIME_TYPE) == 0);
+      ok(strcmp(http_mime_type("/www.d/README"), KC_HTTP_DEFAULT_MIME_TYPE) == 0);
+      ok(strcmp(http_mime_type("data.xyz"), KC_HTTP_DEFAULT_MIME_TYPE) == 0);
+      ok(strcmp(http_mime_type(NULL), KC_HTTP_DEFAULT_MIME_TYPE) == 0);
+    }
+
+    subtest("http_status_line()")
+    {
+      size_t len = 0;
+
+      ok(strcmp(http_status_line(KC_HTTP_OK, &len), "HTTP/1.1 200 OK\r\n") == 0);
+      ok(len == 17);
+      ok(strcmp(http_status_line(KC_HTTP_NOT_FOUND, NULL), "HTTP/1.1 404 Not Found\r\n") == 0);
+      ok(http_status_line(299, NULL) == NULL);
+      ok(http_status_line(-1, NULL) == NULL);
+    }
+
+    subtest("set_status()")
+    {
+      struct kc_http_response_t* res = new_response();
+
+      ok(res->set_status(res, KC_HTTP_CREATED) == KC_SUCCESS);
+      ok(res->status == 201);
+      ok(res->set_status(res, 42) == KC_INVALID_ARGUMENT);
+
+      note("the old string codes still work");
+      ok(res->set_status_code(res, KC_HTTP_STATUS_404) == KC_SUCCESS);
+      ok(res->status == KC_HTTP_NOT_FOUND);
+
+      destroy_response(res);
+    }
+
+    subtest("set_header()")
+    {
+      struct kc_http_response_t* res = new_response();
+      char key[32];
+      char val[32];
+
+      // more than the inline headers (and the old limit of 20)
+      for (int i = 0; i < 40; ++i)
+      {
+        sprintf(key, "X-Header-%d", i);
+        sprintf(val, "value %d", i);
+        ok(res->set_header(res, key, val) == KC_SUCCESS);
+      }
+
+      ok(res->headers_len == 40);
+      ok(strcmp(res->headers[39].key, "X-Header-39: ") == 0);
+      ok(strcmp(res->headers[39].val, "value 39") == 0);
+
+      note("the common names are rendered constants");
+      res->set_header(res, "content-type", "text/html");
+      ok(strcmp(res->headers[40].key, "Content-Type: ") == 0);
+
+      note("setting a header again replaces the value");
+      res->set_header(res, KC_HTTP_HEADER_CONTENT_TYPE, "text/plain");
+      ok(res->headers_len == 41);
+      ok(strcmp(res->headers[40].val, "text/plain") == 0);
+      ok(res->headers[40].val_len == 10);
+
+      destroy_response(res);
+    }
+
+    subtest("set_json()")
+    {
+      struct kc_http_response_t* res = new_response();
+      struct kc_json_writer_t* writer = new_json_writer(0);
+
+      writer->begin_object(writer);
+      writer->key(writer, "id");
+      writer->integer(writer, 7);
+      writer->end_object(writer);
+
+      ok(res->set_json(res, writer) == KC_SUCCESS);
+      ok(strcmp(res->body, "{\"id\":7}") == 0);
+      ok(res->body_len == 8);
+      ok(strcmp(res->headers[0].val, "application/json") == 0);
+
+      // the buffer was handed over to the response
+      ok(writer->buffer == NULL);
+      ok(res->set_json(res, writer) == KC_INVALID_ARGUMENT);
+
+      destroy_json_writer(writer);
+      destroy_response(res);
+    }
+
+    subtest("send_msg_server()")
+    {
+      int fds[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+      // bigger than the socket buffer, so it can't be sent at once
+      size_t body_len = 1024 * 1024;
+      char* body = malloc(body_len + 1);
+      memset(body, 'x', body_len);
+      body[body_len] = '\0';
+
+      struct kc_http_response_t* res = new_response();
+      res->set_http_ver(res, KC_HTTP_1);
+      res->set_status_code(res, KC_HTTP_STATUS_200);
+      res->set_header(res, "Content-Type", "text/plain");
+      res->set_header(res, "Date", "Sun, 06 Nov 1994 08:49:37 GMT");
+      res->set_body(res, body);
+
+      struct response_reader_t reader = { fds[1], malloc(body_len + 256), 0, body_len + 256 };
+      pthread_t reader_id;
+      pthread_create(&reader_id, NULL, read_response, &reader);
+
+      ok(send_msg_server(fds[0], res) == KC_SERVER_SEND_MSG);
+      close(fds[0]);
+      pthread_join(reader_id, NULL);
+
+      // the date set by the handler is not replaced
+      const char* head =
+          "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n"
+          "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+          "Content-Length: 1048576\r\n\r\n";
+
+      ok(reader.len == strlen(head) + body_len);
+      ok(memcmp(reader.buffer, head, strlen(head)) == 0);
+      ok(memcmp(reader.buffer + strlen(head), body, body_len) == 0);
+
+      close(fds[1]);
+      free(reader.buffer);
+      free(body);
+      destroy_response(res);
+    }
+
+    subtest("begin_stream()")
+    {
+      int fds[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+      struct kc_http_response_t* res = new_response();
+      res->set_header(res, "Date", "Sun, 06 Nov 1994 08:49:37 GMT");
+      res->set_body(res, "first");
+
+      ok(res->write_chunk(res, "early", 5) == KC_INVALID_OPERATION);
+
+      struct response_reader_t reader = { fds[1], malloc(4096), 0, 4096 };
+      pthread_t reader_id;
+      pthread_create(&reader_id, NULL, read_response, &reader);
+
+      // the body set so far goes as the first chunk
+      ok(res->begin_stream(res, fds[0]) == KC_SUCCESS);
+      ok(res->begin_stream(res, fds[0]) == KC_INVALID_OPERATION);
+      ok(send_msg_server(fds[0], res) == KC_INVALID_OPERATION);
+
+      ok(res->write_chunk(res, "hello", 5) == KC_SUCCESS);
+      ok(res->write_chunk(res, "", 0) == KC_SUCCESS);
+      ok(res->write_chunk(res, " streamed world", 15) == KC_SUCCESS);
+      ok(res->end(res) == KC_SUCCESS);
+      ok(res->end(res) == KC_INVALID_OPERATION);
+
+      close(fds[0]);
+      pthread_join(reader_id, NULL);
+
+      const char* expected =
+          "HTTP/1.1 200 OK\r\nDate: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+          "Transfer-Encoding: chunked\r\n\r\n"
+          "5\r\nfirst\r\n5\r\nhello\r\nf\r\n streamed world\r\n0\r\n\r\n";
+
+      ok(reader.len == strlen(expected));
+      ok(memcmp(reader.buffer, expected, strlen(expected)) == 0);
+
+      close(fds[1]);
+      destroy_response(res);
+
+      // with a known length the pieces are sent as they are
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+      res = new_response();
+      res->set_header(res, "Date", "Sun, 06 Nov 1994 08:49:37 GMT");
+      res->set_header(res, "Content-Length", "10");
+
+      reader.fd  = fds[1];
+      reader.len = 0;
+      pthread_create(&reader_id, NULL, read_response, &reader);
+
+      ok(res->begin_stream(res, fds[0]) == KC_SUCCESS);
+      ok(res->write_chunk(res, "01234", 5) == KC_SUCCESS);
+      ok(res->write_chunk(res, "56789", 5) == KC_SUCCESS);
+      ok(res->end(res) == KC_SUCCESS);
+
+      close(fds[0]);
+      pthread_join(reader_id, NULL);
+
+      expected =
+          "HTTP/1.1 200 OK\r\nDate: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+          "Content-Length: 10\r\n\r\n0123456789";
+
+      ok(reader.len == strlen(expected));
+      ok(memcmp(reader.buffer, expected, strlen(expected)) == 0);
+
+      close(fds[1]);
+      free(reader.buffer);
+      destroy_response(res);
+
+      // the client is gone, the producer is told so
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+      close(fds[1]);
+
+      res = new_response();
+
+      ok(res->begin_stream(res, fds[0]) == KC_NETWORK_ERROR);
+      ok(res->write_chunk(res, "more", 4) == KC_NETWORK_ERROR);
+      ok(res->end(res) == KC_NETWORK_ERROR);
+
+      close(fds[0]);
+      destroy_response(res);
+    }
+
+    subtest("set_file()")
+    {
+      // a file bigger than the socket buffer
+      size_t file_len = 512 * 1024;
+      char* content = malloc(file_len);
+      for (size_t i = 0; i < file_len; ++i)
+      {
+        content[i] = (char)(i * 7);
+      }
+
+      struct kc_file_t* file = new_file();
+      ok(file->open(file, "/tmp/kc_test_set_file.bin", KC_FILE_WRITE) == KC_SUCCESS);
+      ok(file->write_bytes(file, content, file_len) == KC_SUCCESS);
+      ok(file->open(file, "/tmp/kc_test_set_file.bin", KC_FILE_READ) == KC_SUCCESS);
+
+      struct kc_file_info_t info;
+      ok(file->stat(file, &info) == KC_SUCCESS);
+      ok(info.size == file_len);
+      ok(info.is_dir == false);
+
+      int fds[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+      // only a part of the file is sent
+      struct kc_http_response_t* res = new_response();
+      ok(res->set_file(res, file, 1000, file_len - 2000) == KC_SUCCESS);
+
+      struct response_reader_t reader = { fds[1], malloc(file_len + 256), 0, file_len + 256 };
+      pthread_t reader_id;
+      pthread_create(&reader_id, NULL, read_response, &reader);
+
+      ok(send_msg_server(fds[0], res) == KC_SERVER_SEND_MSG);
+      close(fds[0]);
+      pthread_join(reader_id, NULL);
+
+      // the current date is added to every response
+      char head[128];
+      char date[KC_HTTP_DATE_SIZE];
+      time_t date_time = 0;
+
+      memcpy(date, reader.buffer + 23, KC_HTTP_DATE_SIZE - 1);
+      date[KC_HTTP_DATE_SIZE - 1] = '\0';
+
+      sprintf(head, "HTTP/1.1 200 OK\r\nDate: %s\r\nContent-Length: 522288\r\n\r\n", date);
+
+      ok(http_parse_date(date, &date_time) == KC_SUCCESS);
+      ok(date_time > time(NULL) - 5 && date_time <= time(NULL));
+      ok(reader.len == strlen(head) + file_len - 2000);
+      ok(memcmp(reader.buffer, head, strlen(head)) == 0);
+      ok(memcmp(reader.buffer + strlen(head), content + 1000, file_len - 2000) == 0);
+
+      close(fds[1]);
+      free(reader.buffer);
+      free(content);
+
+      // the file is destroyed together with the response
+      destroy_response(res);
+      remove("/tmp/kc_test_set_file.bin");
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_asset_cache_t")
+  {
+    system("rm -rf /tmp/kc_test_assets && mkdir -p /tmp/kc_test_assets/css");
+
+    FILE* file = fopen("/tmp/kc_test_assets/css/app.css", "w");
+    fputs("body { color: red; }", file);
+    fclose(file);
+
+    // a variant does not have to be a real gzip file
+    file = fopen("/tmp/kc_test_assets/css/app.css.gz", "w");
+    fputs("gzipped", file);
+    fclose(file);
+
+    struct kc_asset_cache_t* cache = new_asset_cache("/tmp/kc_test_assets");
+
+    subtest("init/desc")
+    {
+      ok(cache != NULL);
+      ok(cache->size == 0);
+      ok(new_asset_cache("/tmp/kc_test_assets/missing") == NULL);
+    }
+
+    subtest("get()")
+    {
+      struct kc_asset_t* asset = NULL;
+
+      ok(cache->get(cache, "css/app.css", "br", &asset) == KC_SUCCESS);
+      ok(asset->encoding == NULL);
+      ok(asset->body_len == 20);
+      ok(memcmp(asset->body, "body { color: red; }", 20) == 0);
+      ok(strncmp(asset->head, "HTTP/1.1 200 OK\r\n", 17) == 0);
+      ok(strstr(asset->head, "Content-Type: text/css") != NULL);
+      ok(strstr(asset->head, "Content-Length: 20\r\n") != NULL);
+      ok(strstr(asset->head, "Vary: Accept-Encoding\r\n") != NULL);
+      ok(strstr(asset->head, asset->etag) != NULL);
+      ok(strncmp(asset->not_modified, "HTTP/1.1 304 Not Modified\r\n", 27) == 0);
+      cache->release(cache, asset);
+
+      // the precompressed variant, with its own tag
+      struct kc_asset_t* gzipped = NULL;
+
+      ok(cache->get(cache, "css/app.css", "gzip, br;q=0", &gzipped) == KC_SUCCESS);
+      ok(strcmp(gzipped->encoding, "gzip") == 0);
+      ok(gzipped->body_len == 7);
+      ok(strstr(gzipped->head, "Content-Encoding: gzip\r\n") != NULL);
+      ok(strcmp(gzipped->etag, asset->etag) != 0);
+      cache->release(cache, gzipped);
+
+      ok(cache->size > 0);
+      ok(cache->get(cache, "css/missing.css", NULL, &asset) == KC_FILE_NOT_FOUND);
+      ok(cache->get(cache, "css", NULL, &asset) == KC_FILE_NOT_FOUND);
+      ok(cache->get(cache, NULL, NULL, &asset) == KC_NULL_REFERENCE);
+    }
+
+    subtest("invalidate()")
+    {
+      struct kc_asset_t* asset = NULL;
+      ok(cache->get(cache, "css/app.css", NULL, &asset) == KC_SUCCESS);
+
+      // the asset being sent stays valid, the next request gets the new file
+      file = fopen("/tmp/kc_test_assets/css/app.css", "w");
+      fputs("body { color: blue; }", file);
+      fclose(file);
+
+      struct kc_asset_t* changed = asset;
+      for (int i = 0; i < 100 && changed->body_len == 20; ++i)
+      {
+        if (changed != asset)
+        {
+          cache->release(cache, changed);
+        }
+
+        usleep(10000);
+        cache->get(cache, "css/app.css", NULL, &changed);
+      }
+
+      ok(changed->body_len == 21);
+      ok(memcmp(changed->body, "body { color: blue; }", 21) == 0);
+      ok(memcmp(asset->body, "body { color: red; }", 20) == 0);
+
+      cache->release(cache, changed);
+      cache->release(cache, asset);
+
+      cache->invalidate(cache, "css/app.css");
+      ok(cache->size == 0);
+    }
+
+    destroy_asset_cache(cache);
+    system("rm -rf /tmp/kc_test_assets");
+
+    done_testing();
+  }
+
+  testgroup("kc_response_cache_t")
+  {
+    subtest("init/desc")
+    {
+      struct kc_response_cache_t* cache = new_response_cache(5, 1024, "Accept-Language, Accept");
+
+      ok(cache != NULL);
+      ok(cache->ttl == 5);
+      ok(cache->headers_len == 2);
+      ok(strcmp(cache->headers[0], "Accept-Language") == 0);
+      ok(strcmp(cache->headers[1], "Accept") == 0);
+
+      ok(new_response_cache(0, 1024, NULL) == NULL);
+      ok(new_response_cache(5, 0, NULL) == NULL);
+
+      destroy_response_cache(cache);
+    }
+
+    subtest("acquire()/fill()")
+    {
+      struct kc_response_cache_t* cache = new_response_cache(5, 64, NULL);
+      struct kc_cached_response_t* response = NULL;
+
+      // the first caller produces the response
+      ok(cache->acquire(cache, "/key", &response) == KC_PENDING);
+
+      // the next one waits for it
+      pthread_t waiter;
+      pthread_create(&waiter, NULL, acquire_cached, cache);
+      usleep(50000);
+
+      char* data = malloc(32);
+      strcpy(data, "HTTP/1.1 200 OK\r\nbody");
+
+      ok(cache->fill(cache, "/key", data, 17, 21) == KC_SUCCESS);
+      ok(cache->size == 21);
+
+      struct kc_cached_response_t* waited = NULL;
+      pthread_join(waiter, (void**)&waited);
+
+      ok(waited != NULL);
+      ok(waited->head_len == 17);
+      ok(memcmp(waited->data + waited->head_len, "body", 4) == 0);
+      cache->release(cache, waited);
+
+      ok(cache->acquire(cache, "/key", &response) == KC_SUCCESS);
+      ok(response == waited);
+      cache->release(cache, response);
+
+      // the responses that don't fit are not kept
+      ok(cache->acquire(cache, "/big", &response) == KC_PENDING);
+      ok(cache->fill(cache, "/big", calloc(64, 1), 10, 64) == KC_OVERFLOW);
+      ok(cache->size == 21);
+      ok(cache->acquire(cache, "/big", &response) == KC_PENDING);
+
+      // an abandoned key is claimed by the next caller
+      cache->abandon(cache, "/big");
+      ok(cache->acquire(cache, "/big", &response) == KC_PENDING);
+      cache->abandon(cache, "/big");
+
+      ok(cache->acquire(cache, NULL, &response) == KC_NULL_REFERENCE);
+
+      destroy_response_cache(cache);
+    }
+
+    subtest("expires")
+    {
+      struct kc_response_cache_t* cache = new_response_cache(1, 1024, NULL);
+      struct kc_cached_response_t* response = NULL;
+
+      ok(cache->acquire(cache, "/key", &response) == KC_PENDING);
+      ok(cache->fill(cache, "/key", calloc(8, 1), 4, 8) == KC_SUCCESS);
+      ok(cache->acquire(cache, "/key", &response) == KC_SUCCESS);
+
+      // the copy being sent stays valid after the response expires
+      sleep(2);
+      struct kc_cached_response_t* expired = response;
+
+      ok(cache->acquire(cache, "/key", &response) == KC_PENDING);
+      ok(cache->size == 0);
+      ok(expired->len == 8);
+
+      cache->release(cache, expired);
+      cache->abandon(cache, "/key");
+
+      destroy_response_cache(cache);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_io_engine_t")
+  {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+
+    subtest("init/desc")
+    {
+      struct engine_conn_t conn = { 0 };
+      struct kc_io_handler_t handler = { &conn, engine_accepted, engine_buffer, engine_received, engine_closed };
+      int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+      struct kc_io_engine_t* engine = new_io_engine(KC_IO_ENGINE_EPOLL, listen_fd, handler);
+
+      ok(engine != NULL);
+      ok(engine->type == KC_IO_ENGINE_EPOLL);
+      ok(engine->listen_fd == listen_fd);
+
+      destroy_io_engine(engine);
+
+      // the io_uring engine falls back to epoll on the older kernels
+      engine = new_io_engine(KC_IO_ENGINE_IO_URING, listen_fd, handler);
+
+      ok(engine != NULL);
+      ok(engine->type == KC_IO_ENGINE_IO_URING || engine->type == KC_IO_ENGINE_EPOLL);
+
+      destroy_io_engine(engine);
+
+      handler.received = NULL;
+      ok(new_io_engine(KC_IO_ENGINE_EPOLL, listen_fd, handler) == NULL);
+      ok(new_io_engine(0, listen_fd, handler) == NULL);
+
+      close(listen_fd);
+    }
+
+    subtest("run()/stop()")
+    {
+      int types[2] = { KC_IO_ENGINE_EPOLL, KC_IO_ENGINE_IO_URING };
+
+      for (int i = 0; i < 2; ++i)
+      {
+        struct engine_conn_t conn = { 0 };
+        struct kc_io_handler_t handler = { &conn, engine_accepted, engine_buffer, engine_received, engine_closed };
+
+        // a listening socket on a port chosen by the kernel
+        struct sockaddr_in bound = addr;
+        socklen_t bound_len = sizeof(struct sockaddr_in);
+
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        bind(listen_fd, (struct sockaddr*)&bound, sizeof(struct sockaddr_in));
+        listen(listen_fd, 16);
+        getsockname(listen_fd, (struct sockaddr*)&bound, &bound_len);
+
+        struct kc_io_engine_t* engine = new_io_engine(types[i], listen_fd, handler);
+
+        pthread_t runner;
+        pthread_create(&runner, NULL, run_engine, engine);
+
+        int client_fd = socket(AF_INET, SOCK_STREAM, 0);
+        ok(connect(client_fd, (struct sockaddr*)&bound, sizeof(struct sockaddr_in)) == 0);
+
+        // the message comes in two pieces
+        send(client_fd, "hel", 3, 0);
+        usleep(50000);
+        send(client_fd, "lo", 2, 0);
+
+        // the engine closes the connection after it
+        char byte = 0;
+        ok(recv(client_fd, &byte, 1, 0) == 0);
+        close(client_fd);
+
+        ok(conn.accepted == 1);
+        ok(conn.closed == 1);
+        ok(conn.len == 5);
+        ok(memcmp(conn.buffer, "hello", 5) == 0);
+
+        // a connection still open is closed when the engine stops
+        client_fd = socket(AF_INET, SOCK_STREAM, 0);
+        connect(client_fd, (struct sockaddr*)&bound, sizeof(struct sockaddr_in));
+        usleep(50000);
+
+        engine->stop(engine);
+        pthread_join(runner, NULL);
+
+        ok(recv(client_fd, &byte, 1, 0) == 0);
+        ok(conn.accepted == 2);
+        ok(conn.closed == 2);
+
+        close(client_fd);
+        destroy_io_engine(engine);
+        close(listen_fd);
+      }
+    }
+
+    subtest("drain()")
+    {
+      int types[2] = { KC_IO_ENGINE_EPOLL, KC_IO_ENGINE_IO_URING };
+
+      for (int i = 0; i < 2; ++i)
+      {
+        struct engine_conn_t conn = { 0 };
+        struct kc_io_handler_t handler = { &conn, engine_accepted, engine_buffer, engine_received, engine_closed, engine_draining };
+
+        // a listening socket on a port chosen by the kernel
+        struct sockaddr_in bound = addr;
+        socklen_t bound_len = sizeof(struct sockaddr_in);
+
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        bind(listen_fd, (struct sockaddr*)&bound, sizeof(struct sockaddr_in));
+        listen(listen_fd, 16);
+        getsockname(listen_fd, (struct sockaddr*)&bound, &bound_len);
+
+        struct kc_io_engine_t* engine = new_io_engine(types[i], listen_fd, handler);
+
+        pthread_t runner;
+        pthread_create(&runner, NULL, run_engine, engine);
+
+        int client_fd = socket(AF_INET, SOCK_STREAM, 0);
+        ok(connect(client_fd, (struct sockaddr*)&bound, sizeof(struct sockaddr_in)) == 0);
+        usleep(50000);
+
+        engine->drain(engine);
+        usleep(50000);
+
+        ok(conn.draining == 1);
+
+        // the new connections are left waiting in the queue
+        int waiting_fd = socket(AF_INET, SOCK_STREAM, 0);
+        connect(waiting_fd, (struct sockaddr*)&bound, sizeof(struct sockaddr_in));
+        usleep(50000);
+
+        ok(conn.accepted == 1);
+
+        // the open one is still served, the engine stops once it's closed
+        send(client_fd, "hello", 5, 0);
+
+        char byte = 0;
+        ok(recv(client_fd, &byte, 1, 0) == 0);
+
+        pthread_join(runner, NULL);
+
+        ok(conn.accepted == 1);
+        ok(conn.closed == 1);
+        ok(memcmp(conn.buffer, "hello", 5) == 0);
+
+        close(waiting_fd);
+        close(client_fd);
+        destroy_io_engine(engine);
+        close(listen_fd);
+      }
+    }
+
+    subtest("wake()")
+    {
+      int types[2] = { KC_IO_ENGINE_EPOLL, KC_IO_ENGINE_IO_URING };
+
+      for (int i = 0; i < 2; ++i)
+      {
+        struct engine_conn_t conn = { 0 };
+        struct kc_io_handler_t handler = { &conn, engine_accepted, engine_buffer, engine_received, engine_closed, NULL, engine_woken };
+
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        bind(listen_fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in));
+        listen(listen_fd, 16);
+
+        struct kc_io_engine_t* engine = new_io_engine(types[i], listen_fd, handler);
+
+        pthread_t runner;
+        pthread_create(&runner, NULL, run_engine, engine);
+
+        // the loop is woken up on its own thread, and keeps running
+        engine->wake(engine);
+        usleep(50000);
+
+        ok(conn.woken == 1);
+
+        engine->wake(engine);
+        usleep(50000);
+
+        ok(conn.woken == 2);
+
+        engine->stop(engine);
+        pthread_join(runner, NULL);
+
+        ok(conn.woken == 2);
+
+        destroy_io_engine(engine);
+        close(listen_fd);
+      }
+    }
+
+    subtest("watch()")
+    {
+      int types[2] = { KC_IO_ENGINE_EPOLL, KC_IO_ENGINE_IO_URING };
+
+      for (int i = 0; i < 2; ++i)
+      {
+        struct engine_conn_t conn = { 0 };
+        struct kc_io_handler_t handler = { &conn, engine_accepted, engine_buffer, engine_received, engine_closed, NULL, NULL, engine_ready };
+
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        bind(listen_fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_in));
+        listen(listen_fd, 16);
+
+        int fds[2];
+        ok(pipe(fds) == 0);
+
+        struct kc_io_engine_t* engine = new_io_engine(types[i], listen_fd, handler);
+
+        ok(engine->watch(engine, -1) == KC_INVALID_ARGUMENT);
+        ok(engine->watch(engine, fds[0]) == KC_SUCCESS);
+        ok(engine->watch(engine, fds[0]) == KC_INVALID_OPERATION);
+
+        pthread_t runner;
+        pthread_create(&runner, NULL, run_engine, engine);
+
+        // told on the thread of the loop, every time it's readable
+        ok(write(fds[1], "x", 1) == 1);
+        usleep(50000);
+
+        ok(conn.ready == 1);
+
+        ok(write(fds[1], "x", 1) == 1);
+        usleep(50000);
+
+        ok(conn.ready == 2);
+
+        engine->stop(engine);
+        pthread_join(runner, NULL);
+
+        destroy_io_engine(engine);
+        close(fds[0]);
+        close(fds[1]);
+        close(listen_fd);
+      }
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_metrics_t")
+  {
+    subtest("init/desc")
+    {
+      struct kc_metrics_t* metrics = new_metrics();
+
+      ok(metrics != NULL);
+      ok(metrics->routes_len == 1);
+      ok(metrics->requests(metrics, -1) == 0);
+      ok(metrics->active(metrics) == 0);
+
+      destroy_metrics(metrics);
+    }
+
+    subtest("add_route()")
+    {
+      struct kc_metrics_t* metrics = new_metrics();
+
+      ok(metrics->add_route(metrics, "GET", "/home") == 1);
+      ok(metrics->add_route(metrics, "POST", "/home") == 2);
+      ok(metrics->add_route(metrics, "GET", "/home") == 1);
+      ok(metrics->routes_len == 3);
+
+      // the routes beyond the limit are counted with the others
+      for (int i = 3; i < KC_METRICS_ROUTES; ++i)
+      {
+        char url[16];
+        sprintf(url, "/%d", i);
+        metrics->add_route(metrics, "GET", url);
+      }
+
+      ok(metrics->add_route(metrics, "GET", "/more") == KC_METRICS_OTHER_ROUTE);
+
+      destroy_metrics(metrics);
+    }
+
+    subtest("record()")
+    {
+      struct kc_metrics_t* metrics = new_metrics();
+      metrics->add_route(metrics, "GET", "/home");
+
+      metrics->opened(metrics);
+      metrics->opened(metrics);
+      metrics->closed(metrics);
+      ok(metrics->active(metrics) == 1);
+
+      // the threads record at the same time
+      pthread_t threads[4];
+      for (int i = 0; i < 4; ++i)
+      {
+        pthread_create(&threads[i], NULL, record_metrics, metrics);
+      }
+
+      for (int i = 0; i < 4; ++i)
+      {
+        pthread_join(threads[i], NULL);
+      }
+
+      struct kc_metrics_sample_t sample = { 1, 404, 0, 0, { 1000, 1000000, 0, 0 } };
+      metrics->record(metrics, &sample);
+
+      ok(metrics->requests(metrics, 1) == 4001);
+      ok(metrics->requests(metrics, -1) == 4001);
+      ok(metrics->responses(metrics, 200) == 4000);
+      ok(metrics->responses(metrics, 404) == 1);
+
+      // within 1/16 of the values
+      uint64_t median = metrics->latency(metrics, 1, -1, 50);
+      ok(median >= 3000 && median <= 3000 + 3000 / 16);
+
+      uint64_t max = metrics->latency(metrics, 1, -1, 100);
+      ok(max >= 1001000 && max <= 1001000 + 1001000 / 16);
+
+      uint64_t parse = metrics->latency(metrics, -1, KC_METRICS_PARSE, 99);
+      ok(parse >= 1000 && parse <= 1000 + 1000 / 16);
+
+      // the skipped phases are not recorded
+      ok(metrics->latency(metrics, -1, KC_METRICS_SEND, 50) == 0);
+
+      destroy_metrics(metrics);
+    }
+
+    subtest("render()")
+    {
+      struct kc_metrics_t* metrics = new_metrics();
+      metrics->add_route(metrics, "GET", "/say \"hi\"");
+
+      struct kc_metrics_sample_t sample = { 1, 200, 10, 20, { 1000, 2000, 0, 0 } };
+      metrics->record(metrics, &sample);
+
+      char* text = NULL;
+      size_t text_len = 0;
+
+      ok(metrics->render(metrics, &text, &text_len) == KC_SUCCESS);
+      ok(text_len == strlen(text));
+      ok(strstr(text, "kc_http_requests_total{method=\"GET\",route=\"/say \\\"hi\\\"\"} 1\n") != NULL);
+      ok(strstr(text, "kc_http_sent_bytes_total{method=\"GET\",route=\"/say \\\"hi\\\"\"} 20\n") != NULL);
+      ok(strstr(text, "kc_http_responses_total{status=\"200\"} 1\n") != NULL);
+      ok(strstr(text, "kc_http_phase_duration_seconds_bucket{phase=\"parse\",le=\"1e-05\"} 1\n") != NULL);
+      ok(strstr(text, "kc_http_phase_duration_seconds_count{phase=\"handler\"} 1\n") != NULL);
+
+      free(text);
+      destroy_metrics(metrics);
+    }
+
+    subtest("render() with a pool")
+    {
+      struct kc_metrics_t* metrics = new_metrics();
+      struct kc_worker_pool_t* pool = new_worker_pool(3, 8);
+
+      char* text = NULL;
+      size_t text_len = 0;
+
+      // the pool is shown only once there's one
+      ok(metrics->render(metrics, &text, &text_len) == KC_SUCCESS);
+      ok(strstr(text, "kc_blocking") == NULL);
+      free(text);
+
+      metrics->pool = pool;
+
+      ok(metrics->render(metrics, &text, &text_len) == KC_SUCCESS);
+      ok(strstr(text, "kc_blocking_threads 3\n") != NULL);
+      ok(strstr(text, "kc_blocking_queued 0\n") != NULL);
+      ok(strstr(text, "kc_blocking_refused_total 0\n") != NULL);
+      ok(strstr(text, "kc_blocking_wait_seconds_bucket{le=\"+Inf\"} 0\n") != NULL);
+      ok(strstr(text, "kc_blocking_wait_seconds_count 0\n") != NULL);
+
+      free(text);
+      destroy_worker_pool(pool);
+      destroy_metrics(metrics);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_sse_broadcaster_t")
+  {
+    subtest("init/desc")
+    {
+      struct kc_sse_broadcaster_t* broadcaster = new_sse_broadcaster(KC_SSE_DROP, KC_SSE_QUEUE_SIZE);
+
+      ok(broadcaster != NULL);
+      ok(broadcaster->subscribers == 0);
+      ok(broadcaster->heartbeat == KC_SSE_HEARTBEAT);
+      ok(new_sse_broadcaster(0, KC_SSE_QUEUE_SIZE) == NULL);
+      ok(new_sse_broadcaster(KC_SSE_DISCONNECT, 0) == NULL);
+
+      destroy_sse_broadcaster(broadcaster);
+    }
+
+    subtest("publish()")
+    {
+      struct kc_sse_broadcaster_t* broadcaster = new_sse_broadcaster(KC_SSE_DROP, KC_SSE_QUEUE_SIZE);
+
+      int first[2];
+      int second[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, first) == 0);
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, second) == 0);
+
+      ok(broadcaster->subscribe(broadcaster, first[0]) == KC_SUCCESS);
+      ok(broadcaster->subscribe(broadcaster, second[0]) == KC_SUCCESS);
+      ok(broadcaster->subscribers == 2);
+
+      // every line of the data is a field of its own
+      ok(broadcaster->publish(broadcaster, "update", "one\ntwo\r\nthree", "7") == KC_SUCCESS);
+      ok(broadcaster->publish(broadcaster, "bad\nname", "data", NULL) == KC_INVALID_ARGUMENT);
+
+      const char* expected = "id: 7\nevent: update\ndata: one\ndata: two\ndata: three\n\n";
+
+      char buffer[128] = { 0 };
+      ok(recv(first[1], buffer, sizeof(buffer) - 1, 0) == (ssize_t)strlen(expected));
+      ok(strcmp(buffer, expected) == 0);
+
+      memset(buffer, 0, sizeof(buffer));
+      ok(recv(second[1], buffer, sizeof(buffer) - 1, 0) == (ssize_t)strlen(expected));
+      ok(strcmp(buffer, expected) == 0);
+
+      // the client that leaves is let go by the writer
+      close(first[1]);
+
+      for (int i = 0; i < 100 && broadcaster->subscribers == 2; ++i)
+      {
+        usleep(10000);
+      }
+
+      ok(broadcaster->subscribers == 1);
+      ok(broadcaster->publish(broadcaster, NULL, "", NULL) == KC_SUCCESS);
+
+      memset(buffer, 0, sizeof(buffer));
+      ok(recv(second[1], buffer, sizeof(buffer) - 1, 0) == 8);
+      ok(strcmp(buffer, "data: \n\n") == 0);
+
+      destroy_sse_broadcaster(broadcaster);
+      close(second[1]);
+    }
+
+    subtest("slow clients")
+    {
+      char* data = malloc(65536);
+      memset(data, 'x', 65535);
+      data[65535] = '\0';
+
+      int policies[2] = { KC_SSE_DROP, KC_SSE_DISCONNECT };
+      for (int i = 0; i < 2; ++i)
+      {
+        struct kc_sse_broadcaster_t* broadcaster = new_sse_broadcaster(policies[i], 2);
+
+        int fds[2];
+        ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        ok(broadcaster->subscribe(broadcaster, fds[0]) == KC_SUCCESS);
+
+        // the client never reads, its socket and then its queue fill up
+        for (int j = 0; j < 64; ++j)
+        {
+          broadcaster->publish(broadcaster, NULL, data, NULL);
+        }
+
+        if (policies[i] == KC_SSE_DROP)
+        {
+          ok(broadcaster->dropped > 0);
+          ok(broadcaster->subscribers == 1);
+        }
+        else
+        {
+          ok(broadcaster->disconnected == 1);
+          ok(broadcaster->subscribers == 0);
+        }
+
+        destroy_sse_broadcaster(broadcaster);
+        close(fds[1]);
+      }
+
+      free(data);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_websocket_t")
+  {
+    subtest("kc_websocket_accept()")
+    {
+      char accept[KC_WEBSOCKET_ACCEPT_SIZE];
+
+      // the example of RFC 6455
+      ok(kc_websocket_accept("dGhlIHNhbXBsZSBub25jZQ==", accept) == KC_SUCCESS);
+      ok(strcmp(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == 0);
+    }
+
+    subtest("kc_websocket_unmask()")
+    {
+      const uint8_t mask[4] = { 0xA1, 0xB2, 0xC3, 0xD4 };
+      char data[100];
+      char expected[100];
+
+      // from every offset, the blocks and the bytes left agree
+      bool same = true;
+      for (int offset = 0; offset < 4; ++offset)
+      {
+        for (int i = 0; i < 100; ++i)
+        {
+          data[i] = (char)i;
+          expected[i] = (char)(i ^ mask[(offset + i) % 4]);
+        }
+
+        kc_websocket_unmask(data, sizeof(data), mask, offset);
+        same = same && memcmp(data, expected, sizeof(data)) == 0;
+      }
+
+      ok(same);
+    }
+
+    subtest("receive()")
+    {
+      int fds[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+      struct kc_websocket_handler_t handler = { NULL, ws_on_message, ws_on_closed };
+      struct kc_websocket_t* ws = new_websocket(fds[0], handler);
+
+      ok(ws != NULL);
+      ok(ws->state == KC_WEBSOCKET_OPEN);
+
+      // a message in two fragments, with a ping between them, a byte at a time
+      char frames[64];
+      size_t len = 0;
+
+      len += ws_frame(frames + len, KC_WEBSOCKET_TEXT, "hel", 3);
+      len += ws_frame(frames + len, 0x80 | KC_WEBSOCKET_PING, "p", 1);
+      len += ws_frame(frames + len, 0x80 | KC_WEBSOCKET_CONTINUATION, "lo", 2);
+
+      int ret = KC_SUCCESS;
+      for (size_t i = 0; i < len && ret == KC_SUCCESS; ++i)
+      {
+        ret = ws->receive(ws, frames + i, 1);
+      }
+
+      ok(ret == KC_SUCCESS);
+      ok(ws_opcode == KC_WEBSOCKET_TEXT);
+      ok(ws_message_len == 5 && memcmp(ws_message, "hello", 5) == 0);
+
+      // the ping is answered with its payload
+      unsigned char reply[16];
+      ok(recv(fds[1], reply, sizeof(reply), 0) == 3);
+      ok(reply[0] == (0x80 | KC_WEBSOCKET_PONG) && reply[1] == 1 && reply[2] == 'p');
+
+      // a whole message in a single piece
+      len = ws_frame(frames, 0x80 | KC_WEBSOCKET_BINARY, "abc", 3);
+      ok(ws->receive(ws, frames, len) == KC_SUCCESS);
+      ok(ws_opcode == KC_WEBSOCKET_BINARY && ws_message_len == 3);
+
+      ok(ws->send(ws, KC_WEBSOCKET_TEXT, "hi", 2) == KC_SUCCESS);
+      ok(recv(fds[1], reply, sizeof(reply), 0) == 4);
+      ok(reply[0] == (0x80 | KC_WEBSOCKET_TEXT) && reply[1] == 2 && reply[2] == 'h');
+
+      // the close of the client is answered, and the connection is over
+      char code[2] = { 0x03, (char)0xE8 };
+      len = ws_frame(frames, 0x80 | KC_WEBSOCKET_CLOSE, code, 2);
+
+      ok(ws->receive(ws, frames, len) == KC_LOST_CONNECTION);
+      ok(ws->state == KC_WEBSOCKET_CLOSED);
+      ok(ws_closed_code == KC_WEBSOCKET_NORMAL_CLOSURE);
+      ok(recv(fds[1], reply, sizeof(reply), 0) == 4);
+      ok(reply[0] == (0x80 | KC_WEBSOCKET_CLOSE) && reply[2] == 0x03 && reply[3] == 0xE8);
+      ok(ws->send(ws, KC_WEBSOCKET_TEXT, "hi", 2) == KC_INVALID_OPERATION);
+
+      destroy_websocket(ws);
+      close(fds[0]);
+      close(fds[1]);
+    }
+
+    subtest("protocol errors")
+    {
+      int fds[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+      struct kc_websocket_handler_t handler = { NULL, ws_on_message, ws_on_closed };
+      struct kc_websocket_t* ws = new_websocket(fds[0], handler);
+
+      // the frames of the clients must be masked
+      char frame[2] = { (char)(0x80 | KC_WEBSOCKET_TEXT), 0 };
+      ok(ws->receive(ws, frame, 2) == KC_PROTOCOL_ERROR);
+      ok(ws_closed_code == KC_WEBSOCKET_PROTOCOL_ERROR);
+
+      unsigned char reply[16];
+      ok(recv(fds[1], reply, sizeof(reply), 0) == 4);
+      ok(reply[2] == 0x03 && reply[3] == 0xEA);
+
+      destroy_websocket(ws);
+
+      // a text that is not UTF-8
+      ws = new_websocket(fds[0], handler);
+
+      char frames[16];
+      size_t len = ws_frame(frames, 0x80 | KC_WEBSOCKET_TEXT, "\xC0\xAF", 2);
+
+      ok(ws->receive(ws, frames, len) == KC_FORMAT_ERROR);
+      ok(ws_closed_code == KC_WEBSOCKET_INVALID_DATA);
+
+      destroy_websocket(ws);
+
+      // the connection that goes away without a closing handshake
+      ws = new_websocket(fds[0], handler);
+      destroy_websocket(ws);
+      ok(ws_closed_code == KC_WEBSOCKET_ABNORMAL_CLOSURE);
+
+      close(fds[0]);
+      close(fds[1]);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_hpack_t")
+  {
+    subtest("kc_hpack_huffman_encode()")
+    {
+      // the example of RFC 7541 (C.4.1)
+      const uint8_t expected[] = { 0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff };
+      uint8_t out[16];
+
+      ok(kc_hpack_huffman_len((uint8_t*)"www.example.com", 15) == sizeof(expected));
+      ok(kc_hpack_huffman_encode((uint8_t*)"www.example.com", 15, out) == sizeof(expected));
+      ok(memcmp(out, expected, sizeof(expected)) == 0);
+
+      uint8_t decoded[32];
+      size_t decoded_len = 0;
+
+      ok(kc_hpack_huffman_decode(out, sizeof(expected), decoded, sizeof(decoded), &decoded_len) == KC_SUCCESS);
+      ok(decoded_len == 15 && memcmp(decoded, "www.example.com", 15) == 0);
+
+      // the padding is never longer than 7 bits
+      out[sizeof(expected)] = 0xff;
+      ok(kc_hpack_huffman_decode(out, sizeof(expected) + 1, decoded, sizeof(decoded), &decoded_len) == KC_FORMAT_ERROR);
+    }
+
+    subtest("decode()")
+    {
+      struct kc_hpack_t* hpack = new_hpack(KC_HPACK_TABLE_SIZE);
+      ok(hpack != NULL);
+
+      // the requests of RFC 7541 (C.4.1 and C.4.2), the second one uses the
+      // header the first one added to the dynamic table
+      const uint8_t first[] = { 0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5,
+          0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff };
+      const uint8_t second[] = { 0x82, 0x86, 0x84, 0xbe, 0x58, 0x86, 0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xbf };
+
+      hpack_headers_len = 0;
+      ok(hpack->decode(hpack, first, sizeof(first), hpack_on_header, NULL) == KC_SUCCESS);
+      ok(strcmp(hpack_headers, ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n") == 0);
+      ok(hpack->_size == 57);
+
+      hpack_headers_len = 0;
+      ok(hpack->decode(hpack, second, sizeof(second), hpack_on_header, NULL) == KC_SUCCESS);
+      ok(strstr(hpack_headers, ":authority: www.example.com\ncache-control: no-cache\n") != NULL);
+      ok(hpack->_size == 110);
+
+      // an index past the tables
+      const uint8_t wrong[] = { 0xc0 };
+      ok(hpack->decode(hpack, wrong, sizeof(wrong), hpack_on_header, NULL) == KC_FORMAT_ERROR);
+
+      destroy_hpack(hpack);
+    }
+
+    subtest("encode()")
+    {
+      struct kc_hpack_t* encoder = new_hpack(KC_HPACK_TABLE_SIZE);
+      struct kc_hpack_t* decoder = new_hpack(KC_HPACK_TABLE_SIZE);
+
+      uint8_t block[128];
+      size_t len = 0;
+
+      ok(encoder->encode(encoder, ":status", 7, "200", 3, block, sizeof(block), &len) == KC_SUCCESS);
+      ok(len == 1 && block[0] == 0x88);
+
+      // the second time, the header is only an index in the dynamic table
+      ok(encoder->encode(encoder, "x-request-id", 12, "abc", 3, block, sizeof(block), &len) == KC_SUCCESS);
+      size_t first_len = len;
+
+      ok(encoder->encode(encoder, "x-request-id", 12, "abc", 3, block, sizeof(block), &len) == KC_SUCCESS);
+      ok(len == first_len + 1);
+
+      hpack_headers_len = 0;
+      ok(decoder->decode(decoder, block, len, hpack_on_header, NULL) == KC_SUCCESS);
+      ok(strcmp(hpack_headers, ":status: 200\nx-request-id: abc\nx-request-id: abc\n") == 0);
+
+      // the block doesn't fit
+      len = 0;
+      ok(encoder->encode(encoder, "x-other", 7, "abc", 3, block, 4, &len) == KC_OVERFLOW);
+
+      destroy_hpack(encoder);
+      destroy_hpack(decoder);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_http2_t")
+  {
+    subtest("receive()")
+    {
+      int fds[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+      struct kc_http2_t* h2 = new_http2(fds[0], h2_on_request);
+      ok(h2 != NULL);
+
+      // the preface, the settings and a GET (as in RFC 7541, C.4.1)
+      const uint8_t block[] = { 0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5,
+          0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff };
+
+      uint8_t frames[128];
+      size_t len = strlen(KC_HTTP2_PREFACE);
+
+      memcpy(frames, KC_HTTP2_PREFACE, len);
+      len += h2_frame(frames + len, KC_HTTP2_SETTINGS, 0, 0, NULL, 0);
+      len += h2_frame(frames + len, KC_HTTP2_HEADERS,
+          KC_HTTP2_FLAG_END_STREAM | KC_HTTP2_FLAG_END_HEADERS, 1, block, sizeof(block));
+
+      // a byte at a time, the request is handled once it's whole
+      int ret = KC_SUCCESS;
+      for (size_t i = 0; i < len && ret == KC_SUCCESS; ++i)
+      {
+        ret = h2->receive(h2, (char*)frames + i, 1);
+      }
+
+      ok(ret == KC_SUCCESS);
+      ok(strcmp(h2_request, "GET / HTTP/2\r\nHost: www.example.com\r\n\r\n") == 0);
+      ok(h2->streams == 0);
+
+      // the settings of the server, the ack of the client's, the response
+      uint8_t reply[256];
+      ssize_t reply_len = recv(fds[1], reply, sizeof(reply), 0);
+
+      ok(reply_len > 0 && reply[3] == KC_HTTP2_SETTINGS && reply[4] == 0);
+      ok(h2_find(reply, reply_len, KC_HTTP2_SETTINGS, KC_HTTP2_FLAG_ACK) != NULL);
+
+      uint8_t* headers = h2_find(reply, reply_len, KC_HTTP2_HEADERS,
+          KC_HTTP2_FLAG_END_STREAM | KC_HTTP2_FLAG_END_HEADERS);
+      ok(headers != NULL && headers[8] == 1 && headers[2] == 1 && headers[9] == 0x89);
+
+      // a ping is answered with its payload
+      len = h2_frame(frames, KC_HTTP2_PING, 0, 0, "12345678", 8);
+      ok(h2->receive(h2, (char*)frames, len) == KC_SUCCESS);
+
+      reply_len = recv(fds[1], reply, sizeof(reply), 0);
+      ok(reply_len == 17 && reply[3] == KC_HTTP2_PING && reply[4] == KC_HTTP2_FLAG_ACK);
+      ok(memcmp(reply + 9, "12345678", 8) == 0);
+
+      // DATA on the connection itself ends it, the client is told why
+      len = h2_frame(frames, KC_HTTP2_DATA, 0, 0, "x", 1);
+      ok(h2->receive(h2, (char*)frames, len) != KC_SUCCESS);
+
+      reply_len = recv(fds[1], reply, sizeof(reply), 0);
+      ok(reply_len == 17 && reply[3] == KC_HTTP2_GOAWAY && reply[16] == KC_HTTP2_PROTOCOL_ERROR);
+
+      destroy_http2(h2);
+      close(fds[0]);
+      close(fds[1]);
+    }
+
+    subtest("wrong preface")
+    {
+      int fds[2];
+      ok(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+      struct kc_http2_t* h2 = new_http2(fds[0], h2_on_request);
+
+      ok(h2->receive(h2, "GET / HTTP/1.1\r\n\r\n", 18) != KC_SUCCESS);
+
+      destroy_http2(h2);
+      close(fds[0]);
+      close(fds[1]);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_server_t middleware")
+  {
+    subtest("use()")
+    {
+      struct kc_server_t* server = new_server_IPv4("127.0.0.1", 8000);
+
+      ok(server->use(server, chain_first) == KC_SUCCESS);
+      ok(server->use(server, NULL) == KC_NULL_REFERENCE);
+
+      for (int i = 1; i < KC_SERVER_MIDDLEWARE_SIZE; ++i)
+      {
+        server->use(server, chain_first);
+      }
+
+      ok(server->_middleware_len == KC_SERVER_MIDDLEWARE_SIZE);
+      ok(server->use(server, chain_first) == KC_OVERFLOW);
+
+      destroy_server(server);
+    }
+
+    subtest("next()")
+    {
+      struct kc_server_t* server = new_server_IPv4("127.0.0.1", 8000);
+      struct kc_http_request_t* req = new_request();
+      struct kc_http_response_t* res = new_response();
+
+      // the middleware in order, then the handler
+      int (*chain[3])(struct kc_server_t* self, struct kc_http_request_t* req, struct kc_http_response_t* res) =
+          { chain_first, chain_first, chain_handler };
+
+      req->_chain     = chain;
+      req->_chain_len = 3;
+      req->_chain_pos = 0;
+
+      chain_trace[0] = '\0';
+      ok(server->next(server, req, res) == KC_SERVER_SEND_MSG);
+      ok(strcmp(chain_trace, "11h") == 0);
+
+      // there's nothing after the handler
+      ok(server->next(server, req, res) == KC_INVALID_OPERATION);
+
+      // a middleware can answer by itself, the handler is not called
+      chain[1] = chain_stop;
+      req->_chain_pos = 0;
+
+      chain_trace[0] = '\0';
+      ok(server->next(server, req, res) == KC_SUCCESS);
+      ok(strcmp(chain_trace, "1s") == 0);
+
+      destroy_request(req);
+      destroy_response(res);
+      destroy_server(server);
+    }
+
+    subtest("blocking()")
+    {
+      struct kc_server_t* server = new_server_IPv4("127.0.0.1", 8000);
+
+      ok(server->blocking_threads == KC_SERVER_BLOCKING_THREADS);
+      ok(server->blocking_queue_size == KC_SERVER_BLOCKING_QUEUE_SIZE);
+
+      // the threads are made only for a blocking route, by the start
+      server->routes->get("/slow", chain_handler);
+      server->routes->blocking("/slow");
+
+      ok(server->_blocking == NULL);
+
+      destroy_server(server);
+    }
+
+    subtest("defer()")
+    {
+      struct kc_http_response_t* res = new_response();
+
+      // only a handler can defer its response, and only once it's done
+      ok(res->defer(res) == KC_INVALID_OPERATION);
+      ok(res->complete(res) == KC_INVALID_OPERATION);
 
+      destroy_response(res);
     }
 
     done_testing();
@@ -6,15 +6,25 @@
 // Copyright (c) 2024 Daniel Tanase
 // SPDX-License-Identifier: MIT License
 
+#include "../hdrs/datastructs/histogram.h"
+#include "../hdrs/system/arena.h"
+#include "../hdrs/system/clock.h"
+#include "../hdrs/system/fiber.h"
 #include "../hdrs/system/file.h"
 #include "../hdrs/system/logger.h"
 #include "../hdrs/system/thread.h"
+#include "../hdrs/system/timer_wheel.h"
+#include "../hdrs/system/worker_pool.h"
 
 #include "../hdrs/common.h"
 #include "../hdrs/test.h"
 
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #define DEBUG "This is just a test description for debug! XD"
 #define ERROR "This is just a test description for error! XD"
@@ -54,6 +64,81 @@ void* test_race_condition(void* arg)
   return NULL;
 }
 
+int timers_fired = 0;
+
+void count_timer(struct kc_timer_t* timer)
+{
+  timers_fired++;
+
+  // the tick it fired at
+  *(uint64_t*)timer->data = timer->expires;
+}
+
+void rearm_timer(struct kc_timer_t* timer)
+{
+  struct kc_timer_wheel_t* wheel = timer->data;
+  timers_fired++;
+
+  if (timers_fired < 3)
+  {
+    wheel->add(wheel, timer, wheel->start + (wheel->now + 10) * wheel->tick);
+  }
+}
+
+// the order the fibers ran in
+char   fiber_trace[16];
+size_t fiber_trace_len = 0;
+int    fiber_result = 0;
+
+void trace_fiber(void* data)
+{
+  char name = *(char*)data;
+
+  // the lowercase name, then the uppercase one after the others ran
+  fiber_trace[fiber_trace_len++] = name;
+  kc_fiber_yield();
+  fiber_trace[fiber_trace_len++] = name - 'a' + 'A';
+}
+
+void suspend_fiber(void* data)
+{
+  fiber_result = kc_fiber_suspend();
+
+  // a deep stack, on a fiber of its own
+  char stack[32768];
+  memset(stack, 1, sizeof(stack));
+  fiber_result += stack[sizeof(stack) - 1];
+}
+
+void read_fiber(void* data)
+{
+  int fd = *(int*)data;
+  char byte = 0;
+
+  fiber_result = kc_fiber_wait(fd, POLLIN);
+  fiber_result += (read(fd, &byte, 1) == 1 && byte == 'x') ? 0 : 1;
+}
+
+// the work done by the pool, held until the gate opens
+int             work_done = 0;
+bool            work_gate = true;
+pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  work_opened = PTHREAD_COND_INITIALIZER;
+
+void count_work(void* data)
+{
+  pthread_mutex_lock(&work_lock);
+
+  while (work_gate == false)
+  {
+    pthread_cond_wait(&work_opened, &work_lock);
+  }
+
+  work_done += *(int*)data;
+
+  pthread_mutex_unlock(&work_lock);
+}
+
 int main(void)
 {
   testgroup("kc_file_t")
@@ -328,6 +413,50 @@ int main(void)
       destroy_file(file);
     }
 
+    subtest("test stat()")
+    {
+      struct kc_file_t* file = new_file();
+      struct kc_file_info_t info;
+
+      ok(file->stat(file, &info) == KC_FILE_NOT_FOUND);
+
+      ok(file->open(file, "test_stat", KC_FILE_CREATE_NEW) == KC_SUCCESS);
+      ok(file->write(file, "This is just a stat test") == KC_SUCCESS);
+      fflush(file->file);
+
+      ok(file->stat(file, &info) == KC_SUCCESS);
+      ok(info.size == strlen("This is just a stat test"));
+      ok(info.modified > 0);
+      ok(info.is_dir == false);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("test send()")
+    {
+      struct kc_file_t* file = new_file();
+
+      ok(file->open(file, "test_send", KC_FILE_CREATE_NEW) == KC_SUCCESS);
+      ok(file->write(file, "This is just a send test") == KC_SUCCESS);
+      ok(file->open(file, "test_send", KC_FILE_READ) == KC_SUCCESS);
+
+      // the bytes go from the file straight into the pipe
+      int fds[2];
+      ok(pipe(fds) == 0);
+      ok(file->send(file, fds[1], 15, 4) == KC_SUCCESS);
+
+      char buffer[8] = { 0 };
+      ok(read(fds[0], buffer, sizeof(buffer)) == 4);
+      ok(strcmp(buffer, "send") == 0);
+
+      close(fds[0]);
+      close(fds[1]);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
     done_testing();
   }
 
@@ -345,9 +474,9 @@ int main(void)
       const char* filename = "build/bin/test/logger.log";
       struct kc_logger_t* logger = new_logger(filename);
 
-      // write the log to the file
-      logger->log(logger, " [TEST] ", 0,
-        __FILE__, __LINE__, __func__); // DO NOT MOVE THIS LINE!!!
+      // write the log to the file, the line it names is checked below
+      int line = __LINE__;
+      logger->log(logger, " [TEST] ", 0, __FILE__, line, __func__);
 
       // check if the log was printed correctely
       FILE* read_file = fopen(filename, "r");
@@ -364,7 +493,11 @@ int main(void)
       }
 
       fgets(read_line, sizeof(read_line), read_file);
-      test = __FILE__ ":350 -> Successful completion of the process.";
+
+      char expected[100];
+      snprintf(expected, sizeof(expected), "%s:%d -> Successful completion of the process.", __FILE__, line);
+
+      test = expected;
       for (int i = 0; i < strlen(test) - 1; ++i)
       {
         ok(read_line[i] == test[i]);
@@ -490,5 +623,421 @@ int main(void)
     done_testing();
   }
 
+  testgroup("kc_arena_t")
+  {
+    subtest("test init/desc")
+    {
+      struct kc_arena_t* arena = new_arena(0);
+
+      ok(arena != NULL);
+      ok(arena->_first != NULL);
+      ok(arena->_current == arena->_first);
+      ok(arena->_block_size == KC_ARENA_BLOCK_SIZE);
+
+      destroy_arena(arena);
+    }
+
+    subtest("test alloc()")
+    {
+      struct kc_arena_t* arena = new_arena(64);
+
+      char* first  = arena->alloc(arena, 10);
+      char* second = arena->alloc(arena, 10);
+
+      ok(first != NULL);
+      ok(second == first + KC_ARENA_ALIGNMENT);
+      ok(((size_t)second % KC_ARENA_ALIGNMENT) == 0);
+
+      // bigger than a block
+      char* large = arena->alloc(arena, 1000);
+      ok(large != NULL);
+      ok(arena->_current != arena->_first);
+
+      char* copy = arena->dup(arena, "arena", 6);
+      ok(strcmp(copy, "arena") == 0);
+
+      destroy_arena(arena);
+    }
+
+    subtest("test reset()")
+    {
+      struct kc_arena_t* arena = new_arena(64);
+
+      char* first = arena->alloc(arena, 32);
+      arena->alloc(arena, 1000);
+
+      arena->reset(arena);
+
+      // the same memory is handed out again
+      ok(arena->_current == arena->_first);
+      ok(arena->alloc(arena, 32) == first);
+
+      destroy_arena(arena);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_clock")
+  {
+    subtest("test kc_clock_monotonic()")
+    {
+      time_t seconds = kc_clock_monotonic();
+      uint64_t millis = kc_clock_monotonic_ms();
+
+      ok(millis / 1000 >= (uint64_t)seconds);
+
+      usleep(20000);
+      ok(kc_clock_monotonic_ms() > millis);
+      ok(kc_clock_monotonic() >= seconds);
+    }
+
+    subtest("test kc_clock_http_date()")
+    {
+      char date[KC_CLOCK_DATE_SIZE];
+      char expected[KC_CLOCK_DATE_SIZE];
+
+      time_t now = kc_clock_realtime();
+      ok(kc_clock_http_date(date) == 29);
+
+      // formatted from the same second (unless it just changed)
+      struct tm tm;
+      gmtime_r(&now, &tm);
+      strftime(expected, sizeof(expected), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+      ok(strlen(date) == 29);
+      ok(strcmp(date, expected) == 0 || kc_clock_realtime() != now);
+    }
+
+    subtest("test kc_clock_local_time()")
+    {
+      char local[KC_CLOCK_LOCAL_SIZE];
+      char expected[KC_CLOCK_LOCAL_SIZE];
+
+      time_t now = kc_clock_realtime();
+      ok(kc_clock_local_time(local) == 19);
+
+      struct tm tm;
+      localtime_r(&now, &tm);
+      strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S", &tm);
+
+      ok(strcmp(local, expected) == 0 || kc_clock_realtime() != now);
+
+      // the next second is formatted by its first reader
+      sleep(1);
+      kc_clock_local_time(expected);
+      ok(strcmp(local, expected) != 0);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_timer_wheel_t")
+  {
+    subtest("test init/desc")
+    {
+      struct kc_timer_wheel_t* wheel = new_timer_wheel(100, 5000);
+
+      ok(wheel != NULL);
+      ok(wheel->tick == 100);
+      ok(wheel->start == 5000);
+      ok(wheel->now == 0);
+      ok(wheel->size == 0);
+
+      ok(new_timer_wheel(0, 0) == NULL);
+
+      destroy_timer_wheel(wheel);
+    }
+
+    subtest("test add()/advance()")
+    {
+      struct kc_timer_wheel_t* wheel = new_timer_wheel(10, 0);
+      struct kc_timer_t near, far, beyond;
+      uint64_t near_tick = 0, far_tick = 0, beyond_tick = 0;
+
+      kc_timer_init(&near, count_timer, &near_tick);
+      kc_timer_init(&far, count_timer, &far_tick);
+      kc_timer_init(&beyond, count_timer, &beyond_tick);
+
+      timers_fired = 0;
+
+      // 25 ms is in the 3rd tick, 10 minutes two levels up
+      ok(wheel->add(wheel, &near, 25) == KC_SUCCESS);
+      ok(wheel->add(wheel, &far, 600000) == KC_SUCCESS);
+      ok(wheel->add(wheel, &beyond, (((uint64_t)1 << 24) + 100) * 10) == KC_SUCCESS);
+      ok(wheel->size == 3);
+      ok(kc_timer_pending(&near));
+
+      // never early
+      ok(wheel->advance(wheel, 29) == 0);
+      ok(wheel->advance(wheel, 30) == 1);
+      ok(near_tick == 3);
+      ok(kc_timer_pending(&near) == false);
+
+      ok(wheel->advance(wheel, 599990) == 0);
+      ok(wheel->advance(wheel, 600000) == 1);
+      ok(far_tick == 60000);
+
+      // the timers beyond the wheel wait at its far end, still not early
+      ok(wheel->size == 1);
+      ok(wheel->advance(wheel, (((uint64_t)1 << 24) + 99) * 10) == 0);
+      ok(kc_timer_pending(&beyond));
+      ok(wheel->advance(wheel, (((uint64_t)1 << 24) + 100) * 10) == 1);
+      ok(beyond_tick == ((uint64_t)1 << 24) + 100);
+
+      destroy_timer_wheel(wheel);
+    }
+
+    subtest("test cancel()")
+    {
+      struct kc_timer_wheel_t* wheel = new_timer_wheel(10, 0);
+      struct kc_timer_t timer;
+      uint64_t tick = 0;
+
+      kc_timer_init(&timer, count_timer, &tick);
+      timers_fired = 0;
+
+      ok(wheel->cancel(wheel, &timer) == KC_INVALID);
+
+      wheel->add(wheel, &timer, 5000);
+      ok(wheel->cancel(wheel, &timer) == KC_SUCCESS);
+      ok(wheel->size == 0);
+      ok(wheel->advance(wheel, 10000) == 0);
+
+      // adding a pending timer moves it
+      wheel->add(wheel, &timer, 20000);
+      wheel->add(wheel, &timer, 12000);
+      ok(wheel->size == 1);
+      ok(wheel->advance(wheel, 12000) == 1);
+      ok(timers_fired == 1);
+
+      // a callback can add its timer again
+      kc_timer_init(&timer, rearm_timer, wheel);
+      timers_fired = 0;
+
+      wheel->add(wheel, &timer, 12050);
+      ok(wheel->advance(wheel, 13000) == 3);
+      ok(wheel->size == 0);
+
+      destroy_timer_wheel(wheel);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_fiber_t")
+  {
+    subtest("test init/desc")
+    {
+      struct kc_fiber_scheduler_t* scheduler = new_fiber_scheduler(0);
+
+      ok(scheduler != NULL);
+      ok(scheduler->fd >= 0);
+      ok(scheduler->stack_size == KC_FIBER_STACK_SIZE);
+      ok(scheduler->fibers == 0);
+      ok(scheduler->current == NULL);
+
+      destroy_fiber_scheduler(scheduler);
+
+      // the smallest stack
+      scheduler = new_fiber_scheduler(1);
+      ok(scheduler->stack_size == KC_FIBER_MIN_STACK_SIZE);
+
+      destroy_fiber_scheduler(scheduler);
+    }
+
+    subtest("test spawn()/resume()")
+    {
+      struct kc_fiber_scheduler_t* scheduler = new_fiber_scheduler(0);
+      struct kc_fiber_t* fiber = NULL;
+
+      // it runs right away, and waits
+      fiber_result = 0;
+      ok(scheduler->spawn(scheduler, suspend_fiber, NULL, &fiber) == KC_PENDING);
+      ok(fiber != NULL);
+      ok(fiber->state == KC_FIBER_WAITING);
+      ok(scheduler->fibers == 1);
+      ok(kc_fiber_current() == NULL);
+
+      // then goes on with the result it was resumed with
+      ok(scheduler->resume(scheduler, fiber, 7) == KC_SUCCESS);
+      ok(scheduler->resume(scheduler, fiber, 7) == KC_INVALID_OPERATION);
+      ok(scheduler->run(scheduler) == KC_SUCCESS);
+
+      ok(fiber_result == 8);
+      ok(scheduler->fibers == 0);
+
+      ok(kc_fiber_suspend() == KC_INVALID_OPERATION);
+      ok(scheduler->spawn(scheduler, NULL, NULL, NULL) == KC_NULL_REFERENCE);
+
+      destroy_fiber_scheduler(scheduler);
+    }
+
+    subtest("test kc_fiber_yield()")
+    {
+      struct kc_fiber_scheduler_t* scheduler = new_fiber_scheduler(0);
+      char names[2] = { 'a', 'b' };
+
+      fiber_trace_len = 0;
+
+      ok(scheduler->spawn(scheduler, trace_fiber, &names[0], NULL) == KC_PENDING);
+      ok(scheduler->spawn(scheduler, trace_fiber, &names[1], NULL) == KC_PENDING);
+      ok(scheduler->run(scheduler) == KC_SUCCESS);
+
+      ok(fiber_trace_len == 4);
+      ok(memcmp(fiber_trace, "abAB", 4) == 0);
+      ok(scheduler->fibers == 0);
+
+      destroy_fiber_scheduler(scheduler);
+    }
+
+    subtest("test kc_fiber_wait()")
+    {
+      struct kc_fiber_scheduler_t* scheduler = new_fiber_scheduler(0);
+      int fds[2];
+
+      socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+
+      fiber_result = -1;
+      ok(scheduler->spawn(scheduler, read_fiber, &fds[0], NULL) == KC_PENDING);
+
+      // nothing to read yet
+      ok(scheduler->poll(scheduler, 0) == KC_SUCCESS);
+      ok(scheduler->fibers == 1);
+
+      // the scheduler is readable once the socket is
+      write(fds[1], "x", 1);
+
+      struct pollfd ready = { .fd = scheduler->fd, .events = POLLIN };
+      ok(poll(&ready, 1, 1000) == 1);
+
+      ok(scheduler->poll(scheduler, 0) == KC_SUCCESS);
+      ok(fiber_result == KC_SUCCESS);
+      ok(scheduler->fibers == 0);
+
+      // the thread's own stack blocks instead
+      write(fds[1], "y", 1);
+      ok(kc_fiber_wait(fds[0], POLLIN) == KC_SUCCESS);
+
+      close(fds[0]);
+      close(fds[1]);
+      destroy_fiber_scheduler(scheduler);
+    }
+
+    subtest("test many fibers")
+    {
+      struct kc_fiber_scheduler_t* scheduler = new_fiber_scheduler(0);
+      struct kc_fiber_t* fibers[10000];
+
+      for (int i = 0; i < 10000; ++i)
+      {
+        scheduler->spawn(scheduler, suspend_fiber, NULL, &fibers[i]);
+      }
+
+      ok(scheduler->fibers == 10000);
+
+      for (int i = 0; i < 10000; ++i)
+      {
+        scheduler->resume(scheduler, fibers[i], KC_SUCCESS);
+      }
+
+      ok(scheduler->run(scheduler) == KC_SUCCESS);
+      ok(scheduler->fibers == 0);
+
+      // the ones still waiting go with the scheduler
+      scheduler->spawn(scheduler, suspend_fiber, NULL, NULL);
+      destroy_fiber_scheduler(scheduler);
+    }
+
+    done_testing();
+  }
+
+  testgroup("kc_worker_pool_t")
+  {
+    subtest("test init/desc")
+    {
+      struct kc_worker_pool_t* pool = new_worker_pool(0, 0);
+
+      ok(pool != NULL);
+      ok(pool->threads == KC_WORKER_POOL_THREADS);
+      ok(pool->queue_size == KC_WORKER_POOL_QUEUE_SIZE);
+      ok(pool->queued == 0);
+      ok(pool->busy == 0);
+
+      destroy_worker_pool(pool);
+    }
+
+    subtest("test submit()")
+    {
+      struct kc_worker_pool_t* pool = new_worker_pool(2, 8);
+      int one = 1;
+
+      work_done = 0;
+      for (int i = 0; i < 8; ++i)
+      {
+        ok(pool->submit(pool, count_work, &one) == KC_SUCCESS);
+      }
+
+      ok(pool->submit(pool, NULL, NULL) == KC_NULL_REFERENCE);
+
+      // the work queued is done before the threads stop
+      destroy_worker_pool(pool);
+      ok(work_done == 8);
+    }
+
+    subtest("test a full queue")
+    {
+      struct kc_worker_pool_t* pool = new_worker_pool(1, 2);
+      int one = 1;
+
+      work_done = 0;
+      work_gate = false;
+
+      // the thread holds the first one, the queue the next two
+      ok(pool->submit(pool, count_work, &one) == KC_SUCCESS);
+
+      while (__atomic_load_n(&pool->busy, __ATOMIC_RELAXED) == 0)
+      {
+        usleep(1000);
+      }
+
+      ok(pool->submit(pool, count_work, &one) == KC_SUCCESS);
+      ok(pool->submit(pool, count_work, &one) == KC_SUCCESS);
+      ok(pool->submit(pool, count_work, &one) == KC_OVERFLOW);
+
+      ok(pool->queued == 2);
+      ok(pool->refused == 1);
+
+      pthread_mutex_lock(&work_lock);
+      work_gate = true;
+      pthread_cond_broadcast(&work_opened);
+      pthread_mutex_unlock(&work_lock);
+
+      destroy_worker_pool(pool);
+      ok(work_done == 3);
+    }
+
+    subtest("test the counters")
+    {
+      struct kc_worker_pool_t* pool = new_worker_pool(1, 4);
+      int one = 1;
+
+      pool->submit(pool, count_work, &one);
+
+      while (__atomic_load_n(&pool->done, __ATOMIC_RELAXED) == 0)
+      {
+        usleep(1000);
+      }
+
+      // every work waited in the queue, even if not for long
+      ok(pool->busy == 0);
+      ok(pool->waits->count == 1);
+
+      destroy_worker_pool(pool);
+    }
+
+    done_testing();
+  }
+
   return 0;
 }